@@ -3,6 +3,8 @@ package hr.fer.api.bms;
 import lombok.AllArgsConstructor;
 import lombok.Data;
 import lombok.NoArgsConstructor;
+import org.hibernate.annotations.JdbcTypeCode;
+import org.hibernate.type.SqlTypes;
 
 import jakarta.persistence.*;
 import java.time.Instant;
@@ -25,10 +27,8 @@ public class BatteryReading {
 
     private int connectedCells;
 
-    @ElementCollection
-    @CollectionTable(name = "battery_reading_cell_voltages", joinColumns = @JoinColumn(name = "battery_reading_battery_id"))
-    @OrderColumn(name = "cell_voltages_order")
-    @Column(name = "cell_voltage")
+    @JdbcTypeCode(SqlTypes.ARRAY)
+    @Column(columnDefinition = "real[]")
     private List<Float> cellVoltages;
 
     private float cellVoltageMax;
@@ -39,10 +39,8 @@ public class BatteryReading {
 
     private float packCurrent;
 
-    @ElementCollection
-    @CollectionTable(name = "battery_reading_bat_temps", joinColumns = @JoinColumn(name = "battery_reading_battery_id"))
-    @OrderColumn(name = "bat_temps_order")
-    @Column(name = "bat_temps")
+    @JdbcTypeCode(SqlTypes.ARRAY)
+    @Column(columnDefinition = "real[]")
     private List<Float> batTemps;
 
     private float batTempMax;
@@ -64,4 +62,6 @@ public class BatteryReading {
     private long errorFlags;
 
     private Instant timestamp;
+
+    private String deviceId;
 }
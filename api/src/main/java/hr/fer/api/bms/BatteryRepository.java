@@ -1,9 +1,13 @@
 package hr.fer.api.bms;
 
 
+import org.springframework.data.domain.Page;
+import org.springframework.data.domain.Pageable;
 import org.springframework.data.jpa.repository.JpaRepository;
 import org.springframework.data.rest.core.annotation.RepositoryRestResource;
 
 @RepositoryRestResource(collectionResourceRel = "batteries", path = "batteries")
 public interface BatteryRepository extends JpaRepository<BatteryReading, Long> {
+
+    Page<BatteryReading> findByDeviceIdOrderByTimestampDesc(String deviceId, Pageable pageable);
 }
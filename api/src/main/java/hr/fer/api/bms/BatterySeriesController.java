@@ -0,0 +1,56 @@
+package hr.fer.api.bms;
+
+import org.springframework.format.annotation.DateTimeFormat;
+import org.springframework.http.HttpStatus;
+import org.springframework.web.bind.annotation.GetMapping;
+import org.springframework.web.bind.annotation.PathVariable;
+import org.springframework.web.bind.annotation.RequestParam;
+import org.springframework.web.bind.annotation.RestController;
+import org.springframework.web.server.ResponseStatusException;
+
+import java.time.Duration;
+import java.time.Instant;
+import java.util.List;
+
+/**
+ * Battery time series of a device over a range, for dashboards.
+ *
+ * GET /api/devices/{deviceId}/battery-series?from=...&to=...[&resolution=PT1H][&maxPoints=500]
+ *
+ * The step between points is the requested resolution, or coarser when the
+ * range would otherwise need more than maxPoints points. See
+ * BatterySeriesPlan for how the step picks a rollup table.
+ */
+@RestController
+public class BatterySeriesController {
+
+    public static final int MAX_POINTS = 10000;
+
+    public record BatterySeries(String deviceId, Instant from, Instant to, Duration step, String source,
+                                List<BatterySeriesPoint> points) {
+    }
+
+    private final BatterySeriesRepository repository;
+
+    public BatterySeriesController(BatterySeriesRepository repository) {
+        this.repository = repository;
+    }
+
+    @GetMapping("/api/devices/{deviceId}/battery-series")
+    public BatterySeries getSeries(@PathVariable String deviceId,
+                                   @RequestParam @DateTimeFormat(iso = DateTimeFormat.ISO.DATE_TIME) Instant from,
+                                   @RequestParam @DateTimeFormat(iso = DateTimeFormat.ISO.DATE_TIME) Instant to,
+                                   @RequestParam(required = false) Duration resolution,
+                                   @RequestParam(defaultValue = "500") int maxPoints) {
+        if (!from.isBefore(to)) {
+            throw new ResponseStatusException(HttpStatus.BAD_REQUEST, "from must be before to");
+        }
+        if (maxPoints < 1 || maxPoints > MAX_POINTS) {
+            throw new ResponseStatusException(HttpStatus.BAD_REQUEST, "maxPoints must be between 1 and " + MAX_POINTS);
+        }
+
+        BatterySeriesPlan plan = BatterySeriesPlan.of(from, to, resolution, maxPoints);
+        return new BatterySeries(deviceId, from, to, plan.step(), plan.source(),
+                repository.findSeries(deviceId, from, to, plan));
+    }
+}
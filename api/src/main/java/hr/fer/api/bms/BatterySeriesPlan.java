@@ -0,0 +1,35 @@
+package hr.fer.api.bms;
+
+import java.time.Duration;
+import java.time.Instant;
+
+/**
+ * How a battery series request is answered: the step between points and
+ * the rollup table read, or the raw readings when rollup is null.
+ *
+ * The step is at least the requested resolution and long enough to return
+ * at most maxPoints points over the range. It is then rounded up to a
+ * multiple of the coarsest rollup width within it, so every point is made
+ * of whole rollup buckets.
+ */
+public record BatterySeriesPlan(Duration step, RollupWidth rollup) {
+
+    public static BatterySeriesPlan of(Instant from, Instant to, Duration resolution, int maxPoints) {
+        long rangeSeconds = Duration.between(from, to).getSeconds();
+        Duration step = Duration.ofSeconds(Math.max((rangeSeconds + maxPoints - 1) / maxPoints, 1));
+        if (resolution != null && resolution.compareTo(step) > 0) {
+            step = Duration.ofSeconds(Math.max(resolution.getSeconds(), 1));
+        }
+
+        RollupWidth rollup = RollupWidth.coarsestWithin(step);
+        if (rollup != null) {
+            long buckets = (step.getSeconds() + rollup.getWidth().getSeconds() - 1) / rollup.getWidth().getSeconds();
+            step = rollup.getWidth().multipliedBy(buckets);
+        }
+        return new BatterySeriesPlan(step, rollup);
+    }
+
+    public String source() {
+        return rollup == null ? "raw" : rollup.getTable();
+    }
+}
@@ -0,0 +1,37 @@
+package hr.fer.api.bms;
+
+import lombok.AllArgsConstructor;
+import lombok.Data;
+import lombok.NoArgsConstructor;
+
+import java.time.Instant;
+
+/**
+ * Battery readings of one device aggregated over [bucket, bucket + step).
+ */
+@AllArgsConstructor
+@NoArgsConstructor
+@Data
+public class BatterySeriesPoint {
+
+    @AllArgsConstructor
+    @NoArgsConstructor
+    @Data
+    public static class Stats {
+        private float min;
+        private float max;
+        private float avg;
+        private float last; // Of the newest reading in the bucket
+    }
+
+    private Instant bucket;
+
+    private long samples;
+
+    private Stats soc;
+    private Stats packVoltage;
+    private Stats packCurrent;
+    private Stats cellVoltageMin;
+    private Stats cellVoltageMax;
+    private Stats batTempMax;
+}
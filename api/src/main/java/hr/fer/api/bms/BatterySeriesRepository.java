@@ -0,0 +1,83 @@
+package hr.fer.api.bms;
+
+import org.springframework.jdbc.core.JdbcTemplate;
+import org.springframework.jdbc.core.RowMapper;
+import org.springframework.stereotype.Repository;
+
+import java.time.Instant;
+import java.time.LocalDateTime;
+import java.time.ZoneOffset;
+import java.util.EnumMap;
+import java.util.List;
+import java.util.Map;
+
+/**
+ * Battery series straight from SQL: points are aggregated in Postgres with
+ * date_bin, either from a rollup table or from the raw readings, so neither
+ * path loads readings through JPA.
+ */
+@Repository
+public class BatterySeriesRepository {
+
+    // Columns rolled up by the aggregator, in BatterySeriesPoint order
+    private static final List<String> FIELDS = List.of(
+            "soc", "pack_voltage", "pack_current", "cell_voltage_min", "cell_voltage_max", "bat_temp_max");
+
+    private static final String RAW_SQL = seriesSql("batteries", "timestamp", "count(*)",
+            "min(%1$s), max(%1$s), avg(%1$s), (array_agg(%1$s ORDER BY timestamp DESC))[1]");
+
+    private static final Map<RollupWidth, String> ROLLUP_SQL = rollupSql();
+
+    private final JdbcTemplate jdbcTemplate;
+
+    public BatterySeriesRepository(JdbcTemplate jdbcTemplate) {
+        this.jdbcTemplate = jdbcTemplate;
+    }
+
+    private static String seriesSql(String table, String timeColumn, String samples, String fieldAggregates) {
+        StringBuilder sql = new StringBuilder("SELECT date_bin(?::interval, ")
+                .append(timeColumn).append(", TIMESTAMP 'epoch') AS point, ").append(samples);
+        for (String field : FIELDS) {
+            sql.append(", ").append(String.format(fieldAggregates, field));
+        }
+        return sql.append(" FROM ").append(table)
+                .append(" WHERE device_id = ? AND ").append(timeColumn).append(" >= date_bin(?::interval, ?, TIMESTAMP 'epoch')")
+                .append(" AND ").append(timeColumn).append(" < ?")
+                .append(" GROUP BY point ORDER BY point")
+                .toString();
+    }
+
+    private static Map<RollupWidth, String> rollupSql() {
+        Map<RollupWidth, String> sql = new EnumMap<>(RollupWidth.class);
+        for (RollupWidth rollup : RollupWidth.values()) {
+            // Sums and sample counts add up across buckets, avg is their ratio
+            sql.put(rollup, seriesSql(rollup.getTable(), "bucket", "sum(samples)",
+                    "min(%1$s_min), max(%1$s_max), sum(%1$s_sum) / sum(samples), "
+                            + "(array_agg(%1$s_last ORDER BY last_at DESC))[1]"));
+        }
+        return sql;
+    }
+
+    public List<BatterySeriesPoint> findSeries(String deviceId, Instant from, Instant to, BatterySeriesPlan plan) {
+        String sql = plan.rollup() == null ? RAW_SQL : ROLLUP_SQL.get(plan.rollup());
+        String step = plan.step().getSeconds() + " seconds";
+        return jdbcTemplate.query(sql, POINT_MAPPER,
+                step, deviceId, step, toTimestamp(from), toTimestamp(to));
+    }
+
+    // Reading timestamps are stored as UTC without a zone
+    private static LocalDateTime toTimestamp(Instant instant) {
+        return LocalDateTime.ofInstant(instant, ZoneOffset.UTC);
+    }
+
+    private static final RowMapper<BatterySeriesPoint> POINT_MAPPER = (rs, rowNum) -> {
+        BatterySeriesPoint.Stats[] stats = new BatterySeriesPoint.Stats[FIELDS.size()];
+        for (int i = 0; i < stats.length; i++) {
+            int column = 3 + 4 * i;
+            stats[i] = new BatterySeriesPoint.Stats(rs.getFloat(column), rs.getFloat(column + 1),
+                    rs.getFloat(column + 2), rs.getFloat(column + 3));
+        }
+        return new BatterySeriesPoint(rs.getObject(1, LocalDateTime.class).toInstant(ZoneOffset.UTC), rs.getLong(2),
+                stats[0], stats[1], stats[2], stats[3], stats[4], stats[5]);
+    };
+}
@@ -0,0 +1,43 @@
+package hr.fer.api.bms;
+
+import java.time.Duration;
+
+/**
+ * Bucket widths of the battery rollup tables (see the V10 migration), kept
+ * up to date by the aggregator on every ingest batch.
+ */
+public enum RollupWidth {
+    MINUTE("battery_rollups_1m", Duration.ofMinutes(1)),
+    HOUR("battery_rollups_1h", Duration.ofHours(1)),
+    DAY("battery_rollups_1d", Duration.ofDays(1));
+
+    private final String table;
+    private final Duration width;
+
+    RollupWidth(String table, Duration width) {
+        this.table = table;
+        this.width = width;
+    }
+
+    public String getTable() {
+        return table;
+    }
+
+    public Duration getWidth() {
+        return width;
+    }
+
+    /**
+     * The coarsest width that is not wider than step, null when step is
+     * shorter than a minute and only the raw readings can answer.
+     */
+    public static RollupWidth coarsestWithin(Duration step) {
+        RollupWidth coarsest = null;
+        for (RollupWidth width : values()) {
+            if (width.width.compareTo(step) <= 0) {
+                coarsest = width;
+            }
+        }
+        return coarsest;
+    }
+}
@@ -0,0 +1,100 @@
+package hr.fer.api.gps;
+
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * Z-order cells of the location tables, the same as geo_cell() in the V11
+ * migration: latitude and longitude quantized to 26 bits each and
+ * interleaved, longitude bit first.
+ *
+ * A cell at level k is the 2k bit prefix of the cells inside it, so it
+ * covers one contiguous range of them. A bounding box is covered by the
+ * cells of the finest level that needs at most maxCells of them.
+ */
+public final class GeoCell {
+
+    public static final int LEVELS = 26;
+
+    private GeoCell() {
+    }
+
+    /**
+     * A box that does not cross the antimeridian, west <= east.
+     */
+    public record Box(double south, double west, double north, double east) {
+
+        public boolean contains(double latitude, double longitude) {
+            return latitude >= south && latitude <= north && longitude >= west && longitude <= east;
+        }
+
+        /**
+         * Boxes with west > east cross the antimeridian and are split in two.
+         */
+        public static List<Box> of(double south, double west, double north, double east) {
+            if (west <= east) {
+                return List.of(new Box(south, west, north, east));
+            }
+            return List.of(new Box(south, west, north, 180), new Box(south, -180, north, east));
+        }
+    }
+
+    /**
+     * Inclusive range of level 26 cells.
+     */
+    public record Range(long low, long high) {
+    }
+
+    static long quantize(double degrees, double span) {
+        long value = (long) Math.floor((degrees + span / 2) / span * (1L << LEVELS));
+        return Math.min(Math.max(value, 0), (1L << LEVELS) - 1);
+    }
+
+    static long spread(long x) {
+        x = (x | (x << 16)) & 0x0000FFFF0000FFFFL;
+        x = (x | (x << 8)) & 0x00FF00FF00FF00FFL;
+        x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0FL;
+        x = (x | (x << 2)) & 0x3333333333333333L;
+        x = (x | (x << 1)) & 0x5555555555555555L;
+        return x;
+    }
+
+    public static long cell(double latitude, double longitude) {
+        return spread(quantize(longitude, 360)) << 1 | spread(quantize(latitude, 180));
+    }
+
+    /**
+     * Sorted, non-overlapping cell ranges covering the box.
+     */
+    public static List<Range> cover(Box box, int maxCells) {
+        long x0 = quantize(box.west(), 360), x1 = quantize(box.east(), 360);
+        long y0 = quantize(box.south(), 180), y1 = quantize(box.north(), 180);
+
+        int level = LEVELS;
+        while (level > 0 && ((x1 >> (LEVELS - level)) - (x0 >> (LEVELS - level)) + 1)
+                * ((y1 >> (LEVELS - level)) - (y0 >> (LEVELS - level)) + 1) > maxCells) {
+            level--;
+        }
+
+        int shift = LEVELS - level;
+        List<Long> prefixes = new ArrayList<>();
+        for (long x = x0 >> shift; x <= x1 >> shift; x++) {
+            for (long y = y0 >> shift; y <= y1 >> shift; y++) {
+                prefixes.add(spread(x) << 1 | spread(y));
+            }
+        }
+        prefixes.sort(null);
+
+        // Neighbouring cells along the Z curve merge into one range
+        List<Range> ranges = new ArrayList<>();
+        for (long prefix : prefixes) {
+            long low = prefix << (2 * shift);
+            long high = ((prefix + 1) << (2 * shift)) - 1;
+            if (!ranges.isEmpty() && ranges.get(ranges.size() - 1).high() + 1 == low) {
+                low = ranges.remove(ranges.size() - 1).low();
+            }
+            ranges.add(new Range(low, high));
+        }
+        return ranges;
+    }
+}
@@ -0,0 +1,134 @@
+package hr.fer.api.gps;
+
+import com.fasterxml.jackson.core.JsonGenerator;
+import com.fasterxml.jackson.databind.ObjectMapper;
+import org.springframework.format.annotation.DateTimeFormat;
+import org.springframework.http.HttpStatus;
+import org.springframework.http.MediaType;
+import org.springframework.http.ResponseEntity;
+import org.springframework.web.bind.annotation.GetMapping;
+import org.springframework.web.bind.annotation.PathVariable;
+import org.springframework.web.bind.annotation.RequestParam;
+import org.springframework.web.bind.annotation.RestController;
+import org.springframework.web.server.ResponseStatusException;
+import org.springframework.web.servlet.mvc.method.annotation.StreamingResponseBody;
+
+import java.io.BufferedWriter;
+import java.io.IOException;
+import java.io.OutputStreamWriter;
+import java.io.UncheckedIOException;
+import java.io.Writer;
+import java.nio.charset.StandardCharsets;
+import java.time.Duration;
+import java.time.Instant;
+import java.util.List;
+
+/**
+ * Map queries over the location readings.
+ *
+ * GET /api/locations/viewport?south=...&west=...&north=...&east=...[&from=...&to=...][&maxAge=PT15M][&limit=100000]
+ * GET /api/locations/nearest?latitude=...&longitude=...[&limit=10][&maxAge=PT1H]
+ * GET /api/devices/{deviceId}/trips?from=...&to=...
+ * GET /api/trips/{tripId}/polyline
+ *
+ * The viewport returns the readings taken in [from, to) inside the box, or
+ * without a range the newest position of every device reported within
+ * maxAge. West may be greater than east for a box across the antimeridian.
+ * Viewports and polylines are streamed as they are read.
+ */
+@RestController
+public class LocationQueryController {
+
+    public static final int MAX_VIEWPORT_POINTS = 1_000_000;
+    public static final int MAX_NEAREST = 1000;
+
+    private final LocationQueryRepository repository;
+    private final ObjectMapper objectMapper;
+
+    public LocationQueryController(LocationQueryRepository repository, ObjectMapper objectMapper) {
+        this.repository = repository;
+        this.objectMapper = objectMapper;
+    }
+
+    @GetMapping(value = "/api/locations/viewport", produces = MediaType.APPLICATION_JSON_VALUE)
+    public StreamingResponseBody getViewport(@RequestParam double south, @RequestParam double west,
+                                             @RequestParam double north, @RequestParam double east,
+                                             @RequestParam(required = false) @DateTimeFormat(iso = DateTimeFormat.ISO.DATE_TIME) Instant from,
+                                             @RequestParam(required = false) @DateTimeFormat(iso = DateTimeFormat.ISO.DATE_TIME) Instant to,
+                                             @RequestParam(defaultValue = "PT15M") Duration maxAge,
+                                             @RequestParam(defaultValue = "100000") int limit) {
+        if (south < -90 || north > 90 || south > north || west < -180 || west > 180 || east < -180 || east > 180) {
+            throw new ResponseStatusException(HttpStatus.BAD_REQUEST, "invalid bounding box");
+        }
+        if ((from == null) != (to == null) || (from != null && !from.isBefore(to))) {
+            throw new ResponseStatusException(HttpStatus.BAD_REQUEST, "from must be before to");
+        }
+        if (limit < 1 || limit > MAX_VIEWPORT_POINTS) {
+            throw new ResponseStatusException(HttpStatus.BAD_REQUEST, "limit must be between 1 and " + MAX_VIEWPORT_POINTS);
+        }
+
+        List<GeoCell.Box> boxes = GeoCell.Box.of(south, west, north, east);
+        Instant since = Instant.now().minus(maxAge);
+        return out -> {
+            try (JsonGenerator json = objectMapper.getFactory().createGenerator(out)) {
+                json.writeStartArray();
+                if (from != null) {
+                    repository.streamViewport(boxes, from, to, limit, position -> write(json, position));
+                } else {
+                    repository.streamLatest(boxes, since, position -> write(json, position));
+                }
+                json.writeEndArray();
+            }
+        };
+    }
+
+    private static void write(JsonGenerator json, LocationQueryRepository.Position position) {
+        try {
+            json.writeObject(position);
+        } catch (IOException e) {
+            throw new UncheckedIOException(e);
+        }
+    }
+
+    @GetMapping("/api/locations/nearest")
+    public List<LocationQueryRepository.Nearby> getNearest(@RequestParam double latitude, @RequestParam double longitude,
+                                                           @RequestParam(defaultValue = "10") int limit,
+                                                           @RequestParam(defaultValue = "PT1H") Duration maxAge) {
+        if (latitude < -90 || latitude > 90 || longitude < -180 || longitude > 180) {
+            throw new ResponseStatusException(HttpStatus.BAD_REQUEST, "invalid position");
+        }
+        if (limit < 1 || limit > MAX_NEAREST) {
+            throw new ResponseStatusException(HttpStatus.BAD_REQUEST, "limit must be between 1 and " + MAX_NEAREST);
+        }
+        return repository.findNearest(latitude, longitude, limit, Instant.now().minus(maxAge));
+    }
+
+    @GetMapping("/api/devices/{deviceId}/trips")
+    public List<Trip> getTrips(@PathVariable String deviceId,
+                               @RequestParam @DateTimeFormat(iso = DateTimeFormat.ISO.DATE_TIME) Instant from,
+                               @RequestParam @DateTimeFormat(iso = DateTimeFormat.ISO.DATE_TIME) Instant to) {
+        if (!from.isBefore(to)) {
+            throw new ResponseStatusException(HttpStatus.BAD_REQUEST, "from must be before to");
+        }
+        return repository.findTrips(deviceId, from, to);
+    }
+
+    @GetMapping("/api/trips/{tripId}/polyline")
+    public ResponseEntity<StreamingResponseBody> getPolyline(@PathVariable long tripId) {
+        Trip trip = repository.findTrip(tripId)
+                .orElseThrow(() -> new ResponseStatusException(HttpStatus.NOT_FOUND, "no trip " + tripId));
+        StreamingResponseBody body = out -> {
+            try (Writer writer = new BufferedWriter(new OutputStreamWriter(out, StandardCharsets.US_ASCII))) {
+                PolylineEncoder encoder = new PolylineEncoder(writer);
+                repository.streamTrip(trip, position -> {
+                    try {
+                        encoder.add(position.latitude(), position.longitude());
+                    } catch (IOException e) {
+                        throw new UncheckedIOException(e);
+                    }
+                });
+            }
+        };
+        return ResponseEntity.ok().contentType(MediaType.TEXT_PLAIN).body(body);
+    }
+}
@@ -0,0 +1,207 @@
+package hr.fer.api.gps;
+
+import org.springframework.jdbc.core.JdbcTemplate;
+import org.springframework.jdbc.core.RowMapper;
+import org.springframework.stereotype.Repository;
+import org.springframework.transaction.annotation.Transactional;
+
+import javax.sql.DataSource;
+import java.sql.ResultSet;
+import java.sql.SQLException;
+import java.time.Instant;
+import java.time.LocalDateTime;
+import java.time.ZoneOffset;
+import java.util.ArrayList;
+import java.util.Comparator;
+import java.util.List;
+import java.util.Optional;
+import java.util.function.Consumer;
+
+/**
+ * Spatial and trip queries over the location tables, see the V11 migration.
+ *
+ * Bounding boxes are matched through the cell ranges of GeoCell on the
+ * (cell, timestamp) indexes, then filtered exactly. The stream methods hand
+ * rows over as Postgres returns them in fetchSize chunks (which needs a
+ * transaction), so a large result is never materialized.
+ */
+@Repository
+public class LocationQueryRepository {
+
+    public record Position(String deviceId, double latitude, double longitude, Instant timestamp) {
+    }
+
+    public record Nearby(Position position, double distanceM) {
+    }
+
+    // Cells per bounding box: few enough ranges to probe, fine enough to skip most of what is outside
+    static final int MAX_CELLS = 16;
+    static final int FETCH_SIZE = 1000;
+
+    private static final String VIEWPORT_SQL = """
+            SELECT device_id, latitude, longitude, timestamp
+            FROM locations
+            JOIN unnest(?::bigint[], ?::bigint[]) AS r(low, high) ON cell BETWEEN r.low AND r.high
+            WHERE timestamp >= ? AND timestamp < ?
+              AND latitude BETWEEN ? AND ? AND longitude BETWEEN ? AND ?
+            LIMIT ?
+            """;
+
+    private static final String LATEST_SQL = """
+            SELECT device_id, latitude, longitude, timestamp
+            FROM device_positions
+            JOIN unnest(?::bigint[], ?::bigint[]) AS r(low, high) ON cell BETWEEN r.low AND r.high
+            WHERE timestamp >= ?
+              AND latitude BETWEEN ? AND ? AND longitude BETWEEN ? AND ?
+            """;
+
+    private static final String NEAREST_SQL = """
+            SELECT device_id, latitude, longitude, timestamp, geo_distance_m(?, ?, latitude, longitude) AS distance_m
+            FROM device_positions
+            JOIN unnest(?::bigint[], ?::bigint[]) AS r(low, high) ON cell BETWEEN r.low AND r.high
+            WHERE timestamp >= ?
+            ORDER BY distance_m
+            LIMIT ?
+            """;
+
+    private static final String TRIP_COLUMNS = """
+            trip_id, device_id, started_at, ended_at, points, distance_m,
+            min_latitude, max_latitude, min_longitude, max_longitude
+            """;
+
+    private final JdbcTemplate jdbcTemplate;
+
+    public LocationQueryRepository(DataSource dataSource) {
+        this.jdbcTemplate = new JdbcTemplate(dataSource);
+        this.jdbcTemplate.setFetchSize(FETCH_SIZE);
+    }
+
+    // Reading timestamps are stored as UTC without a zone
+    private static LocalDateTime toTimestamp(Instant instant) {
+        return LocalDateTime.ofInstant(instant, ZoneOffset.UTC);
+    }
+
+    private static Instant toInstant(ResultSet rs, String column) throws SQLException {
+        return rs.getObject(column, LocalDateTime.class).toInstant(ZoneOffset.UTC);
+    }
+
+    private static Position position(ResultSet rs) throws SQLException {
+        return new Position(rs.getString("device_id"), rs.getDouble("latitude"), rs.getDouble("longitude"),
+                toInstant(rs, "timestamp"));
+    }
+
+    private static Object[] cellArrays(GeoCell.Box box) {
+        List<GeoCell.Range> ranges = GeoCell.cover(box, MAX_CELLS);
+        long[] lows = new long[ranges.size()];
+        long[] highs = new long[ranges.size()];
+        for (int i = 0; i < ranges.size(); i++) {
+            lows[i] = ranges.get(i).low();
+            highs[i] = ranges.get(i).high();
+        }
+        return new Object[]{lows, highs};
+    }
+
+    /**
+     * Readings inside the boxes taken in [from, to), at most limit of them.
+     */
+    @Transactional(readOnly = true)
+    public void streamViewport(List<GeoCell.Box> boxes, Instant from, Instant to, int limit, Consumer<Position> consumer) {
+        int[] remaining = {limit};
+        for (GeoCell.Box box : boxes) {
+            if (remaining[0] <= 0) {
+                return;
+            }
+            Object[] cells = cellArrays(box);
+            jdbcTemplate.query(VIEWPORT_SQL, rs -> {
+                        remaining[0]--;
+                        consumer.accept(position(rs));
+                    }, cells[0], cells[1], toTimestamp(from), toTimestamp(to),
+                    box.south(), box.north(), box.west(), box.east(), remaining[0]);
+        }
+    }
+
+    /**
+     * Newest position of every device inside the boxes, reported since then.
+     */
+    @Transactional(readOnly = true)
+    public void streamLatest(List<GeoCell.Box> boxes, Instant since, Consumer<Position> consumer) {
+        for (GeoCell.Box box : boxes) {
+            Object[] cells = cellArrays(box);
+            jdbcTemplate.query(LATEST_SQL, (ResultSet rs) -> consumer.accept(position(rs)), cells[0], cells[1], toTimestamp(since),
+                    box.south(), box.north(), box.west(), box.east());
+        }
+    }
+
+    /**
+     * The limit devices closest to the point that reported since then.
+     *
+     * Searches a box around the point that grows until it holds limit
+     * devices within its inscribed circle, so the ones found are the
+     * closest ones.
+     */
+    public List<Nearby> findNearest(double latitude, double longitude, int limit, Instant since) {
+        RowMapper<Nearby> mapper = (rs, rowNum) -> new Nearby(position(rs), rs.getDouble("distance_m"));
+        for (double radiusM = 500; ; radiusM *= 4) {
+            // Degrees of longitude are shortest on the box edge furthest from the equator
+            double dLat = radiusM / 111_195;
+            double dLon = dLat / Math.max(Math.cos(Math.toRadians(Math.min(Math.abs(latitude) + dLat, 90))), 1e-6);
+            boolean world = dLat >= 90 || dLon >= 180;
+            List<GeoCell.Box> boxes = world
+                    ? List.of(new GeoCell.Box(-90, -180, 90, 180))
+                    : GeoCell.Box.of(Math.max(latitude - dLat, -90), wrap(longitude - dLon),
+                    Math.min(latitude + dLat, 90), wrap(longitude + dLon));
+
+            List<Nearby> found = new ArrayList<>();
+            for (GeoCell.Box box : boxes) {
+                Object[] cells = cellArrays(box);
+                found.addAll(jdbcTemplate.query(NEAREST_SQL, mapper, latitude, longitude, cells[0], cells[1],
+                        toTimestamp(since), limit));
+            }
+            found.sort(Comparator.comparingDouble(Nearby::distanceM));
+            if (world || (found.size() >= limit && found.get(limit - 1).distanceM() <= radiusM)) {
+                return found.subList(0, Math.min(limit, found.size()));
+            }
+        }
+    }
+
+    private static double wrap(double longitude) {
+        return longitude > 180 ? longitude - 360 : longitude < -180 ? longitude + 360 : longitude;
+    }
+
+    private static final RowMapper<Trip> TRIP_MAPPER = (rs, rowNum) -> new Trip(
+            rs.getLong("trip_id"), rs.getString("device_id"), toInstant(rs, "started_at"), toInstant(rs, "ended_at"),
+            rs.getLong("points"), rs.getDouble("distance_m"),
+            rs.getDouble("min_latitude"), rs.getDouble("max_latitude"),
+            rs.getDouble("min_longitude"), rs.getDouble("max_longitude"));
+
+    /**
+     * Trips of a device that overlap [from, to), oldest first.
+     */
+    public List<Trip> findTrips(String deviceId, Instant from, Instant to) {
+        return jdbcTemplate.query("SELECT " + TRIP_COLUMNS + """
+                        FROM trips
+                        WHERE device_id = ? AND ended_at >= ? AND started_at < ?
+                        ORDER BY started_at
+                        """, TRIP_MAPPER, deviceId, toTimestamp(from), toTimestamp(to));
+    }
+
+    public Optional<Trip> findTrip(long tripId) {
+        return jdbcTemplate.query("SELECT " + TRIP_COLUMNS + " FROM trips WHERE trip_id = ?", TRIP_MAPPER, tripId)
+                .stream().findFirst();
+    }
+
+    /**
+     * Positions of the trip in time order.
+     */
+    @Transactional(readOnly = true)
+    public void streamTrip(Trip trip, Consumer<Position> consumer) {
+        jdbcTemplate.query("""
+                        SELECT device_id, latitude, longitude, timestamp
+                        FROM locations
+                        WHERE device_id = ? AND timestamp >= ? AND timestamp <= ?
+                        ORDER BY timestamp
+                        """, rs -> {
+                    consumer.accept(position(rs));
+                }, trip.getDeviceId(), toTimestamp(trip.getStartedAt()), toTimestamp(trip.getEndedAt()));
+    }
+}
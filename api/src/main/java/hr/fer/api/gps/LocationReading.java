@@ -5,7 +5,6 @@ import lombok.AllArgsConstructor;
 import lombok.Data;
 import lombok.NoArgsConstructor;
 
-import java.math.BigDecimal;
 import java.time.Instant;
 
 @Entity
@@ -19,9 +18,11 @@ public class LocationReading {
     @GeneratedValue(strategy = GenerationType.IDENTITY)
     private Long locationId;
 
-    private BigDecimal latitude;
+    private double latitude;
 
-    private BigDecimal longitude;
+    private double longitude;
 
     private Instant timestamp;
+
+    private String deviceId;
 }
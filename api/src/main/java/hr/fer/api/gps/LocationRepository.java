@@ -1,8 +1,12 @@
 package hr.fer.api.gps;
 
+import org.springframework.data.domain.Page;
+import org.springframework.data.domain.Pageable;
 import org.springframework.data.jpa.repository.JpaRepository;
 import org.springframework.data.rest.core.annotation.RepositoryRestResource;
 
 @RepositoryRestResource(collectionResourceRel = "locations", path = "locations")
 public interface LocationRepository extends JpaRepository<LocationReading, Long> {
+
+    Page<LocationReading> findByDeviceIdOrderByTimestampDesc(String deviceId, Pageable pageable);
 }
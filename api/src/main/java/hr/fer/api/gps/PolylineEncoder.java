@@ -0,0 +1,37 @@
+package hr.fer.api.gps;
+
+import java.io.IOException;
+import java.io.Writer;
+
+/**
+ * Encoded polyline (the Google Maps format, 5 decimals) written point by
+ * point, so a track is never held in memory.
+ */
+public class PolylineEncoder {
+
+    private final Writer writer;
+    private long latitude;
+    private long longitude;
+
+    public PolylineEncoder(Writer writer) {
+        this.writer = writer;
+    }
+
+    public void add(double latitude, double longitude) throws IOException {
+        long lat = Math.round(latitude * 1e5);
+        long lon = Math.round(longitude * 1e5);
+        encode(lat - this.latitude);
+        encode(lon - this.longitude);
+        this.latitude = lat;
+        this.longitude = lon;
+    }
+
+    private void encode(long delta) throws IOException {
+        long value = delta < 0 ? ~(delta << 1) : delta << 1;
+        while (value >= 0x20) {
+            writer.write((int) ((0x20 | (value & 0x1f)) + 63));
+            value >>= 5;
+        }
+        writer.write((int) (value + 63));
+    }
+}
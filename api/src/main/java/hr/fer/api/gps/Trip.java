@@ -0,0 +1,32 @@
+package hr.fer.api.gps;
+
+import lombok.AllArgsConstructor;
+import lombok.Data;
+import lombok.NoArgsConstructor;
+
+import java.time.Instant;
+
+/**
+ * Positions of a device without a gap longer than the aggregator's
+ * TRIP_GAP, see the V11 migration.
+ */
+@AllArgsConstructor
+@NoArgsConstructor
+@Data
+public class Trip {
+
+    private long tripId;
+
+    private String deviceId;
+
+    private Instant startedAt;
+    private Instant endedAt;
+
+    private long points;
+    private double distanceM;
+
+    private double minLatitude;
+    private double maxLatitude;
+    private double minLongitude;
+    private double maxLongitude;
+}
@@ -0,0 +1,87 @@
+-- db/migration/V10__create_battery_rollups.sql
+
+-- Per device rollups of the battery readings in 1 minute, 1 hour and 1 day
+-- buckets, so range queries over weeks or months read a few hundred rows
+-- instead of every reading. Each field keeps min, max, sum and the value of
+-- the newest reading in the bucket (avg is sum / samples).
+--
+-- The aggregator merges every ingest batch into the three tables in the
+-- same transaction as the readings. rebuild_battery_rollups() recomputes a
+-- range from the readings, for the existing data and after repairs.
+-- Readings from before per-device topics roll up under device ''.
+CREATE TABLE battery_rollups_1m (
+   device_id TEXT NOT NULL,
+   bucket TIMESTAMP NOT NULL,
+   samples BIGINT NOT NULL,
+   last_at TIMESTAMP NOT NULL,
+   soc_min REAL NOT NULL,
+   soc_max REAL NOT NULL,
+   soc_sum DOUBLE PRECISION NOT NULL,
+   soc_last REAL NOT NULL,
+   pack_voltage_min REAL NOT NULL,
+   pack_voltage_max REAL NOT NULL,
+   pack_voltage_sum DOUBLE PRECISION NOT NULL,
+   pack_voltage_last REAL NOT NULL,
+   pack_current_min REAL NOT NULL,
+   pack_current_max REAL NOT NULL,
+   pack_current_sum DOUBLE PRECISION NOT NULL,
+   pack_current_last REAL NOT NULL,
+   cell_voltage_min_min REAL NOT NULL,
+   cell_voltage_min_max REAL NOT NULL,
+   cell_voltage_min_sum DOUBLE PRECISION NOT NULL,
+   cell_voltage_min_last REAL NOT NULL,
+   cell_voltage_max_min REAL NOT NULL,
+   cell_voltage_max_max REAL NOT NULL,
+   cell_voltage_max_sum DOUBLE PRECISION NOT NULL,
+   cell_voltage_max_last REAL NOT NULL,
+   bat_temp_max_min REAL NOT NULL,
+   bat_temp_max_max REAL NOT NULL,
+   bat_temp_max_sum DOUBLE PRECISION NOT NULL,
+   bat_temp_max_last REAL NOT NULL,
+   PRIMARY KEY (device_id, bucket)
+);
+
+CREATE TABLE battery_rollups_1h (LIKE battery_rollups_1m INCLUDING ALL);
+CREATE TABLE battery_rollups_1d (LIKE battery_rollups_1m INCLUDING ALL);
+
+-- Recompute the buckets of all three tables that start in [from_ts, to_ts),
+-- widened to the bucket from_ts falls into
+CREATE FUNCTION rebuild_battery_rollups(from_ts TIMESTAMP, to_ts TIMESTAMP) RETURNS VOID AS $$
+DECLARE
+   rollup_table TEXT;
+   width INTERVAL;
+BEGIN
+   FOR rollup_table, width IN
+      VALUES ('battery_rollups_1m', INTERVAL '1 minute'),
+             ('battery_rollups_1h', INTERVAL '1 hour'),
+             ('battery_rollups_1d', INTERVAL '1 day')
+   LOOP
+      EXECUTE format('DELETE FROM %I WHERE bucket >= date_bin($1, $2, TIMESTAMP ''epoch'') AND bucket < $3',
+                     rollup_table)
+         USING width, from_ts, to_ts;
+      EXECUTE format($sql$
+         INSERT INTO %I
+         SELECT coalesce(device_id, ''), date_bin($1, timestamp, TIMESTAMP 'epoch'), count(*), max(timestamp),
+                min(soc), max(soc), sum(soc), (array_agg(soc ORDER BY timestamp DESC))[1],
+                min(pack_voltage), max(pack_voltage), sum(pack_voltage),
+                (array_agg(pack_voltage ORDER BY timestamp DESC))[1],
+                min(pack_current), max(pack_current), sum(pack_current),
+                (array_agg(pack_current ORDER BY timestamp DESC))[1],
+                min(cell_voltage_min), max(cell_voltage_min), sum(cell_voltage_min),
+                (array_agg(cell_voltage_min ORDER BY timestamp DESC))[1],
+                min(cell_voltage_max), max(cell_voltage_max), sum(cell_voltage_max),
+                (array_agg(cell_voltage_max ORDER BY timestamp DESC))[1],
+                min(bat_temp_max), max(bat_temp_max), sum(bat_temp_max),
+                (array_agg(bat_temp_max ORDER BY timestamp DESC))[1]
+         FROM batteries
+         WHERE timestamp >= date_bin($1, $2, TIMESTAMP 'epoch')
+           AND date_bin($1, timestamp, TIMESTAMP 'epoch') < $3
+         GROUP BY 1, 2
+      $sql$, rollup_table)
+         USING width, from_ts, to_ts;
+   END LOOP;
+END;
+$$ LANGUAGE plpgsql;
+
+SELECT rebuild_battery_rollups(coalesce((SELECT min(timestamp) FROM batteries), now()::TIMESTAMP),
+                               TIMESTAMP 'infinity');
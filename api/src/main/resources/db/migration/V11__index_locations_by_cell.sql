@@ -0,0 +1,99 @@
+-- db/migration/V11__index_locations_by_cell.sql
+
+-- Spatial index without PostGIS: every position gets a cell, its latitude
+-- and longitude quantized to 26 bits each and interleaved into a Z-order
+-- (geohash) integer, longitude bit first. Each cell of 2^(2k) cells at
+-- level k is a contiguous range of these integers, so a bounding box is
+-- covered by a few BETWEEN ranges on a btree. At level 26 a cell is about
+-- 0.6 m north-south.
+--
+-- The API computes the ranges the same way (hr.fer.api.gps.GeoCell).
+CREATE FUNCTION geo_cell(latitude DOUBLE PRECISION, longitude DOUBLE PRECISION) RETURNS BIGINT AS $$
+DECLARE
+   x BIGINT := least(greatest(floor((longitude + 180) / 360 * 67108864), 0), 67108863);
+   y BIGINT := least(greatest(floor((latitude + 90) / 180 * 67108864), 0), 67108863);
+BEGIN
+   -- Spread the bits of both to every other position
+   x := (x | (x << 16)) & 281470681808895;
+   x := (x | (x << 8)) & 71777214294589695;
+   x := (x | (x << 4)) & 1085102592571150095;
+   x := (x | (x << 2)) & 3689348814741910323;
+   x := (x | (x << 1)) & 6148914691236517205;
+   y := (y | (y << 16)) & 281470681808895;
+   y := (y | (y << 8)) & 71777214294589695;
+   y := (y | (y << 4)) & 1085102592571150095;
+   y := (y | (y << 2)) & 3689348814741910323;
+   y := (y | (y << 1)) & 6148914691236517205;
+   RETURN (x << 1) | y;
+END;
+$$ LANGUAGE plpgsql IMMUTABLE STRICT PARALLEL SAFE;
+
+-- Great-circle distance in meters
+CREATE FUNCTION geo_distance_m(lat1 DOUBLE PRECISION, lon1 DOUBLE PRECISION,
+                               lat2 DOUBLE PRECISION, lon2 DOUBLE PRECISION) RETURNS DOUBLE PRECISION AS $$
+   SELECT 2 * 6371008.8 * asin(sqrt(
+      sin(radians(lat2 - lat1) / 2) ^ 2 +
+      cos(radians(lat1)) * cos(radians(lat2)) * sin(radians(lon2 - lon1) / 2) ^ 2))
+$$ LANGUAGE sql IMMUTABLE STRICT PARALLEL SAFE;
+
+ALTER TABLE locations ADD COLUMN cell BIGINT GENERATED ALWAYS AS (geo_cell(latitude, longitude)) STORED;
+CREATE INDEX locations_cell_timestamp_idx ON locations (cell, timestamp);
+
+-- Newest position of every device, kept by the aggregator
+CREATE TABLE device_positions (
+   device_id TEXT PRIMARY KEY,
+   latitude DOUBLE PRECISION NOT NULL,
+   longitude DOUBLE PRECISION NOT NULL,
+   timestamp TIMESTAMP NOT NULL,
+   cell BIGINT GENERATED ALWAYS AS (geo_cell(latitude, longitude)) STORED
+);
+
+CREATE INDEX device_positions_cell_idx ON device_positions (cell);
+
+INSERT INTO device_positions (device_id, latitude, longitude, timestamp)
+SELECT DISTINCT ON (device_id) device_id, latitude, longitude, timestamp
+FROM locations
+WHERE device_id IS NOT NULL
+ORDER BY device_id, timestamp DESC;
+
+-- Positions of a device split where it reported nothing for more than the
+-- trip gap (10 minutes, TRIP_GAP of the aggregator). The aggregator extends
+-- the trip a batch continues or overlaps, and starts a new one otherwise.
+CREATE TABLE trips (
+   trip_id BIGSERIAL PRIMARY KEY,
+   device_id TEXT NOT NULL,
+   started_at TIMESTAMP NOT NULL,
+   ended_at TIMESTAMP NOT NULL,
+   points BIGINT NOT NULL,
+   distance_m DOUBLE PRECISION NOT NULL,
+   end_latitude DOUBLE PRECISION NOT NULL,
+   end_longitude DOUBLE PRECISION NOT NULL,
+   min_latitude DOUBLE PRECISION NOT NULL,
+   max_latitude DOUBLE PRECISION NOT NULL,
+   min_longitude DOUBLE PRECISION NOT NULL,
+   max_longitude DOUBLE PRECISION NOT NULL
+);
+
+CREATE INDEX trips_device_id_ended_at_idx ON trips (device_id, ended_at);
+
+INSERT INTO trips (
+   device_id, started_at, ended_at, points, distance_m, end_latitude, end_longitude,
+   min_latitude, max_latitude, min_longitude, max_longitude
+)
+SELECT device_id, min(timestamp), max(timestamp), count(*), sum(hop_m),
+       (array_agg(latitude ORDER BY timestamp DESC))[1], (array_agg(longitude ORDER BY timestamp DESC))[1],
+       min(latitude), max(latitude), min(longitude), max(longitude)
+FROM (
+   SELECT *, sum(starts) OVER (PARTITION BY device_id ORDER BY timestamp) AS trip
+   FROM (
+      SELECT device_id, latitude, longitude, timestamp,
+             CASE WHEN timestamp - lag(timestamp) OVER w <= INTERVAL '10 minutes' THEN 0 ELSE 1 END AS starts,
+             CASE WHEN timestamp - lag(timestamp) OVER w <= INTERVAL '10 minutes'
+                  THEN geo_distance_m(lag(latitude) OVER w, lag(longitude) OVER w, latitude, longitude)
+                  ELSE 0 END AS hop_m
+      FROM locations
+      WHERE device_id IS NOT NULL
+      WINDOW w AS (PARTITION BY device_id ORDER BY timestamp)
+   ) hops
+) numbered
+GROUP BY device_id, trip;
@@ -0,0 +1,17 @@
+-- db/migration/V12__add_connect_metrics_to_diagnostics.sql
+
+-- MQTT connects, how many found the broker still holding the session and
+-- how many resumed the previous TLS session, with the time and bytes from
+-- the TCP connect to CONNACK. 0 for firmware that does not report them.
+ALTER TABLE diagnostics
+   ADD COLUMN mqtt_connects BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN sessions_present BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN tls_resumed BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN connect_ms_count BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN connect_ms_sum BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN connect_ms_max BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN connect_ms_buckets INTEGER[] NOT NULL DEFAULT '{}',
+   ADD COLUMN connect_bytes_count BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN connect_bytes_sum BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN connect_bytes_max BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN connect_bytes_buckets INTEGER[] NOT NULL DEFAULT '{}';
@@ -0,0 +1,38 @@
+-- db/migration/V13__move_default_rows_into_new_partitions.sql
+
+-- A month cannot be created with PARTITION OF once the default partition
+-- holds one of its rows, so a single early or late reading made every
+-- later create_reading_partitions() call fail. Each missing month is now
+-- created as a plain table, the matching rows are moved out of the default
+-- partition into it, and it is attached then.
+CREATE OR REPLACE FUNCTION create_reading_partitions(from_date DATE, months INTEGER) RETURNS VOID AS $$
+DECLARE
+   partition_month DATE := date_trunc('month', from_date);
+   reading_table TEXT;
+   partition_name TEXT;
+   stored_columns TEXT;
+BEGIN
+   FOR i IN 1..months LOOP
+      FOREACH reading_table IN ARRAY ARRAY['batteries', 'locations'] LOOP
+         partition_name := reading_table || '_' || to_char(partition_month, 'YYYYMM');
+         CONTINUE WHEN to_regclass(partition_name) IS NOT NULL;
+
+         -- Generated columns (locations.cell) are computed again on insert
+         SELECT string_agg(quote_ident(attname), ', ' ORDER BY attnum) INTO stored_columns
+         FROM pg_attribute
+         WHERE attrelid = reading_table::regclass AND attnum > 0 AND NOT attisdropped AND attgenerated = '';
+
+         EXECUTE format('CREATE TABLE %I (LIKE %I INCLUDING DEFAULTS INCLUDING CONSTRAINTS INCLUDING GENERATED)',
+                        partition_name, reading_table);
+         EXECUTE format('WITH moved AS (DELETE FROM %I WHERE timestamp >= %L AND timestamp < %L RETURNING *) '
+                        'INSERT INTO %I (%s) SELECT %s FROM moved',
+                        reading_table || '_default', partition_month, partition_month + INTERVAL '1 month',
+                        partition_name, stored_columns, stored_columns);
+         -- Scans the default partition again, it holds nothing of the month by now
+         EXECUTE format('ALTER TABLE %I ATTACH PARTITION %I FOR VALUES FROM (%L) TO (%L)',
+                        reading_table, partition_name, partition_month, partition_month + INTERVAL '1 month');
+      END LOOP;
+      partition_month := partition_month + INTERVAL '1 month';
+   END LOOP;
+END;
+$$ LANGUAGE plpgsql;
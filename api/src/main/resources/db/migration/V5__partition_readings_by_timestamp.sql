@@ -0,0 +1,157 @@
+-- db/migration/V5__partition_readings_by_timestamp.sql
+
+-- Readings keep cell voltages and thermistor temperatures inline as arrays
+-- instead of one child row per value, and both tables are range partitioned
+-- by month on timestamp. Range scans only touch the matching partitions and
+-- use the BRIN indexes, retention drops whole partitions.
+--
+-- Partitions are created ahead of time by create_reading_partitions() (the
+-- aggregator calls it daily), rows outside every monthly partition land in
+-- the default partition. drop_reading_partitions() removes months older
+-- than a cutoff.
+
+ALTER TABLE batteries RENAME TO batteries_legacy;
+ALTER INDEX batteries_pkey RENAME TO batteries_legacy_pkey;
+ALTER TABLE locations RENAME TO locations_legacy;
+ALTER INDEX locations_pkey RENAME TO locations_legacy_pkey;
+
+-- Keep the id sequences so ids continue where the old tables stopped
+ALTER SEQUENCE batteries_battery_id_seq OWNED BY NONE;
+ALTER SEQUENCE batteries_battery_id_seq AS BIGINT;
+ALTER SEQUENCE locations_location_id_seq OWNED BY NONE;
+ALTER SEQUENCE locations_location_id_seq AS BIGINT;
+
+CREATE TABLE batteries (
+   battery_id BIGINT NOT NULL DEFAULT nextval('batteries_battery_id_seq'),
+   state INTEGER NOT NULL,
+   chg_enable BOOLEAN NOT NULL,
+   dis_enable BOOLEAN NOT NULL,
+   connected_cells INTEGER NOT NULL,
+   cell_voltages REAL[] NOT NULL DEFAULT '{}',
+   cell_voltage_max FLOAT NOT NULL,
+   cell_voltage_min FLOAT NOT NULL,
+   cell_voltage_avg FLOAT NOT NULL,
+   pack_voltage FLOAT NOT NULL,
+   stack_voltage FLOAT NOT NULL,
+   pack_current FLOAT NOT NULL,
+   bat_temps REAL[] NOT NULL DEFAULT '{}',
+   bat_temp_max FLOAT NOT NULL,
+   bat_temp_min FLOAT NOT NULL,
+   bat_temp_avg FLOAT NOT NULL,
+   mosfet_temp FLOAT NOT NULL,
+   ic_temp FLOAT NOT NULL,
+   mcu_temp FLOAT NOT NULL,
+   is_full BOOLEAN NOT NULL,
+   is_empty BOOLEAN NOT NULL,
+   soc FLOAT NOT NULL,
+   balancing_status BIGINT NOT NULL,
+   no_idle_timestamp TIMESTAMP NOT NULL,
+   error_flags BIGINT NOT NULL,
+   timestamp TIMESTAMP NOT NULL,
+   PRIMARY KEY (battery_id, timestamp)
+) PARTITION BY RANGE (timestamp);
+
+CREATE TABLE locations (
+   location_id BIGINT NOT NULL DEFAULT nextval('locations_location_id_seq'),
+   latitude DOUBLE PRECISION NOT NULL,
+   longitude DOUBLE PRECISION NOT NULL,
+   timestamp TIMESTAMP NOT NULL,
+   PRIMARY KEY (location_id, timestamp)
+) PARTITION BY RANGE (timestamp);
+
+ALTER SEQUENCE batteries_battery_id_seq OWNED BY batteries.battery_id;
+ALTER SEQUENCE locations_location_id_seq OWNED BY locations.location_id;
+
+CREATE TABLE batteries_default PARTITION OF batteries DEFAULT;
+CREATE TABLE locations_default PARTITION OF locations DEFAULT;
+
+CREATE INDEX batteries_timestamp_brin ON batteries USING BRIN (timestamp);
+CREATE INDEX locations_timestamp_brin ON locations USING BRIN (timestamp);
+
+-- Create the monthly partitions <table>_YYYYMM of both tables for the given
+-- number of months starting with the month of from_date, existing ones are kept
+CREATE FUNCTION create_reading_partitions(from_date DATE, months INTEGER) RETURNS VOID AS $$
+DECLARE
+   partition_month DATE := date_trunc('month', from_date);
+   reading_table TEXT;
+BEGIN
+   FOR i IN 1..months LOOP
+      FOREACH reading_table IN ARRAY ARRAY['batteries', 'locations'] LOOP
+         EXECUTE format('CREATE TABLE IF NOT EXISTS %I PARTITION OF %I FOR VALUES FROM (%L) TO (%L)',
+                        reading_table || '_' || to_char(partition_month, 'YYYYMM'), reading_table,
+                        partition_month, partition_month + INTERVAL '1 month');
+      END LOOP;
+      partition_month := partition_month + INTERVAL '1 month';
+   END LOOP;
+END;
+$$ LANGUAGE plpgsql;
+
+-- Drop the monthly partitions that end on or before the cutoff, returns how many were dropped
+CREATE FUNCTION drop_reading_partitions(cutoff DATE) RETURNS INTEGER AS $$
+DECLARE
+   partition_name TEXT;
+   dropped INTEGER := 0;
+BEGIN
+   FOR partition_name IN
+      SELECT child.relname
+      FROM pg_inherits
+      JOIN pg_class child ON child.oid = pg_inherits.inhrelid
+      JOIN pg_class parent ON parent.oid = pg_inherits.inhparent
+      WHERE parent.relname IN ('batteries', 'locations')
+        AND child.relname ~ '_[0-9]{6}$'
+        AND to_date(right(child.relname, 6), 'YYYYMM') + INTERVAL '1 month' <= cutoff
+   LOOP
+      EXECUTE format('DROP TABLE %I', partition_name);
+      dropped := dropped + 1;
+   END LOOP;
+   RETURN dropped;
+END;
+$$ LANGUAGE plpgsql;
+
+-- Monthly partitions for the existing data (at most two years back) and the next months
+DO $$
+DECLARE
+   first_month DATE := greatest(
+      least(coalesce((SELECT min(timestamp) FROM batteries_legacy), now()),
+            coalesce((SELECT min(timestamp) FROM locations_legacy), now())),
+      now() - INTERVAL '2 years');
+BEGIN
+   PERFORM create_reading_partitions(first_month,
+      (date_part('year', age(now(), first_month)) * 12 + date_part('month', age(now(), first_month)))::INTEGER + 4);
+END;
+$$;
+
+INSERT INTO batteries (
+   battery_id, state, chg_enable, dis_enable, connected_cells,
+   cell_voltages, cell_voltage_max, cell_voltage_min, cell_voltage_avg,
+   pack_voltage, stack_voltage, pack_current,
+   bat_temps, bat_temp_max, bat_temp_min, bat_temp_avg,
+   mosfet_temp, ic_temp, mcu_temp, is_full, is_empty, soc,
+   balancing_status, no_idle_timestamp, error_flags, timestamp
+)
+SELECT
+   b.battery_id, b.state, b.chg_enable, b.dis_enable, b.connected_cells,
+   coalesce(v.voltages, '{}'), b.cell_voltage_max, b.cell_voltage_min, b.cell_voltage_avg,
+   b.pack_voltage, b.stack_voltage, b.pack_current,
+   coalesce(t.temps, '{}'), b.bat_temp_max, b.bat_temp_min, b.bat_temp_avg,
+   b.mosfet_temp, b.ic_temp, b.mcu_temp, b.is_full, b.is_empty, b.soc,
+   b.balancing_status, b.no_idle_timestamp, b.error_flags, b.timestamp
+FROM batteries_legacy b
+LEFT JOIN (
+   SELECT battery_reading_battery_id, array_agg(cell_voltage ORDER BY cell_voltages_order)::REAL[] AS voltages
+   FROM battery_reading_cell_voltages
+   GROUP BY battery_reading_battery_id
+) v ON v.battery_reading_battery_id = b.battery_id
+LEFT JOIN (
+   SELECT battery_reading_battery_id, array_agg(bat_temps ORDER BY bat_temps_order)::REAL[] AS temps
+   FROM battery_reading_bat_temps
+   GROUP BY battery_reading_battery_id
+) t ON t.battery_reading_battery_id = b.battery_id;
+
+INSERT INTO locations (location_id, latitude, longitude, timestamp)
+SELECT location_id, latitude, longitude, timestamp FROM locations_legacy;
+
+DROP TABLE battery_reading_cell_voltages;
+DROP TABLE battery_reading_bat_temps;
+DROP TABLE batteries_legacy;
+DROP TABLE locations_legacy;
@@ -0,0 +1,10 @@
+-- db/migration/V6__add_device_id.sql
+
+-- Readings carry the device that published them, taken from the
+-- /bicycle/<device-id>/... topic. Rows from before per-device topics have
+-- no device.
+ALTER TABLE batteries ADD COLUMN device_id TEXT;
+ALTER TABLE locations ADD COLUMN device_id TEXT;
+
+CREATE INDEX batteries_device_id_timestamp_idx ON batteries (device_id, timestamp);
+CREATE INDEX locations_device_id_timestamp_idx ON locations (device_id, timestamp);
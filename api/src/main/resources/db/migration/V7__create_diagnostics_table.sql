@@ -0,0 +1,40 @@
+-- db/migration/V7__create_diagnostics_table.sql
+
+-- Periodic runtime snapshots of the trackers (see esp/main/telemetry_metrics.h).
+-- Counters and histograms cover interval_s before timestamp, gauges are the
+-- values at timestamp. Histogram buckets are powers of two: bucket 0 counts
+-- zeros, bucket i counts values in [2^(i-1), 2^i).
+CREATE TABLE diagnostics (
+   diagnostics_id BIGSERIAL PRIMARY KEY,
+   device_id TEXT NOT NULL,
+   timestamp TIMESTAMP NOT NULL,
+   uptime_s BIGINT NOT NULL,
+   interval_s BIGINT NOT NULL,
+   published BIGINT NOT NULL,
+   publish_failed BIGINT NOT NULL,
+   pubacks BIGINT NOT NULL,
+   mqtt_disconnects BIGINT NOT NULL,
+   ppp_reconnects BIGINT NOT NULL,
+   ppp_downtime_ms BIGINT NOT NULL,
+   outbox_bytes INTEGER NOT NULL,
+   free_heap INTEGER NOT NULL,
+   min_free_heap INTEGER NOT NULL,
+   uplink_stack_free INTEGER NOT NULL,
+   sampler_stack_free INTEGER NOT NULL,
+   rssi INTEGER NOT NULL,
+   ber INTEGER NOT NULL,
+   encode_us_count BIGINT NOT NULL,
+   encode_us_sum BIGINT NOT NULL,
+   encode_us_max BIGINT NOT NULL,
+   encode_us_buckets INTEGER[] NOT NULL,
+   publish_us_count BIGINT NOT NULL,
+   publish_us_sum BIGINT NOT NULL,
+   publish_us_max BIGINT NOT NULL,
+   publish_us_buckets INTEGER[] NOT NULL,
+   puback_ms_count BIGINT NOT NULL,
+   puback_ms_sum BIGINT NOT NULL,
+   puback_ms_max BIGINT NOT NULL,
+   puback_ms_buckets INTEGER[] NOT NULL
+);
+
+CREATE INDEX diagnostics_device_id_timestamp_idx ON diagnostics (device_id, timestamp);
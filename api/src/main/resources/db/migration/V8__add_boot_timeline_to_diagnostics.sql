@@ -0,0 +1,8 @@
+-- db/migration/V8__add_boot_timeline_to_diagnostics.sql
+
+-- Time from boot and from network registration to the first publish, as
+-- reported by the tracker since it was last powered up. 0 for firmware that
+-- does not report them, -1 when the modem never registered.
+ALTER TABLE diagnostics
+   ADD COLUMN boot_to_publish_ms INTEGER NOT NULL DEFAULT 0,
+   ADD COLUMN registered_to_publish_ms INTEGER NOT NULL DEFAULT 0;
@@ -0,0 +1,18 @@
+-- db/migration/V9__add_priority_lanes_to_diagnostics.sql
+
+-- Messages the tracker dropped or replaced in its send lanes, the bytes still
+-- waiting there and how long messages waited before MQTT took them. 0 for
+-- firmware without the lanes.
+ALTER TABLE diagnostics
+   ADD COLUMN alarm_dropped BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN routine_dropped BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN routine_coalesced BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN routine_queued_bytes INTEGER NOT NULL DEFAULT 0,
+   ADD COLUMN alarm_queue_ms_count BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN alarm_queue_ms_sum BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN alarm_queue_ms_max BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN alarm_queue_ms_buckets INTEGER[] NOT NULL DEFAULT '{}',
+   ADD COLUMN routine_queue_ms_count BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN routine_queue_ms_sum BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN routine_queue_ms_max BIGINT NOT NULL DEFAULT 0,
+   ADD COLUMN routine_queue_ms_buckets INTEGER[] NOT NULL DEFAULT '{}';
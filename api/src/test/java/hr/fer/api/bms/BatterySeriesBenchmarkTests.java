@@ -0,0 +1,120 @@
+package hr.fer.api.bms;
+
+import org.junit.jupiter.api.AfterAll;
+import org.junit.jupiter.api.BeforeAll;
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.condition.EnabledIfEnvironmentVariable;
+import org.springframework.jdbc.core.JdbcTemplate;
+import org.springframework.jdbc.datasource.DriverManagerDataSource;
+
+import java.time.Duration;
+import java.time.Instant;
+import java.time.LocalDateTime;
+import java.time.ZoneOffset;
+import java.util.Arrays;
+import java.util.List;
+
+import static org.junit.jupiter.api.Assertions.assertEquals;
+
+/**
+ * Compares month-long series read from the rollups with the same series
+ * aggregated from the raw readings, on a real database with the migrations
+ * applied:
+ *
+ *   BENCH_DATABASE_URL=jdbc:postgresql://localhost/postgres BENCH_DATABASE_USERNAME=postgres \
+ *   BENCH_DATABASE_PASSWORD=postgres ./mvnw test -Dtest=BatterySeriesBenchmarkTests
+ *
+ * Seeds a month of readings every 10 s for a throwaway device and removes
+ * them afterwards.
+ */
+@EnabledIfEnvironmentVariable(named = "BENCH_DATABASE_URL", matches = ".+")
+class BatterySeriesBenchmarkTests {
+
+	private static final String DEVICE = "bench-series";
+	private static final Instant FROM = Instant.parse("2024-01-01T00:00:00Z");
+	private static final Instant TO = FROM.plus(Duration.ofDays(30));
+	private static final int RUNS = 20;
+
+	private static JdbcTemplate jdbcTemplate;
+	private static BatterySeriesRepository repository;
+
+	@BeforeAll
+	static void seed() {
+		jdbcTemplate = new JdbcTemplate(new DriverManagerDataSource(System.getenv("BENCH_DATABASE_URL"),
+				System.getenv("BENCH_DATABASE_USERNAME"), System.getenv("BENCH_DATABASE_PASSWORD")));
+		repository = new BatterySeriesRepository(jdbcTemplate);
+		cleanUp();
+
+		LocalDateTime from = LocalDateTime.ofInstant(FROM, ZoneOffset.UTC);
+		LocalDateTime to = LocalDateTime.ofInstant(TO, ZoneOffset.UTC);
+		jdbcTemplate.queryForObject("SELECT create_reading_partitions(?::date, 2)", Object.class, from);
+		jdbcTemplate.update("""
+				INSERT INTO batteries (
+				   state, chg_enable, dis_enable, connected_cells, cell_voltage_max, cell_voltage_min, cell_voltage_avg,
+				   pack_voltage, stack_voltage, pack_current, bat_temp_max, bat_temp_min, bat_temp_avg,
+				   mosfet_temp, ic_temp, mcu_temp, is_full, is_empty, soc,
+				   balancing_status, no_idle_timestamp, error_flags, timestamp, device_id
+				)
+				SELECT 3, true, true, 4, 4.0 - r * 0.1, 3.6 + r * 0.1, 3.8,
+				       14 + r * 2, 14 + r * 2, 10 * sin(n / 360.0), 20 + r * 10, 18, 19,
+				       25, 26, 27, false, false, 100 * r,
+				       0, t, 0, t, ?
+				FROM (SELECT n, t, random() AS r
+				      FROM generate_series(?::timestamp, ?::timestamp - INTERVAL '10 seconds', INTERVAL '10 seconds')
+				      WITH ORDINALITY AS s(t, n)) readings
+				""", DEVICE, from, to);
+		jdbcTemplate.queryForObject("SELECT rebuild_battery_rollups(?, ?)", Object.class, from, to);
+		jdbcTemplate.execute("ANALYZE batteries");
+	}
+
+	@AfterAll
+	static void cleanUp() {
+		jdbcTemplate.update("DELETE FROM batteries WHERE device_id = ?", DEVICE);
+		for (RollupWidth rollup : RollupWidth.values()) {
+			jdbcTemplate.update("DELETE FROM " + rollup.getTable() + " WHERE device_id = ?", DEVICE);
+		}
+	}
+
+	@Test
+	void monthAtDefaultPoints() {
+		compare(BatterySeriesPlan.of(FROM, TO, null, 500));
+	}
+
+	@Test
+	void monthDaily() {
+		compare(BatterySeriesPlan.of(FROM, TO, Duration.ofDays(1), 500));
+	}
+
+	private void compare(BatterySeriesPlan plan) {
+		BatterySeriesPlan raw = new BatterySeriesPlan(plan.step(), null);
+		List<BatterySeriesPoint> fromRaw = repository.findSeries(DEVICE, FROM, TO, raw);
+		List<BatterySeriesPoint> fromRollup = repository.findSeries(DEVICE, FROM, TO, plan);
+
+		assertEquals(fromRaw.size(), fromRollup.size());
+		for (int i = 0; i < fromRaw.size(); i++) {
+			BatterySeriesPoint expected = fromRaw.get(i);
+			BatterySeriesPoint actual = fromRollup.get(i);
+			assertEquals(expected.getBucket(), actual.getBucket());
+			assertEquals(expected.getSamples(), actual.getSamples());
+			assertEquals(expected.getSoc().getMin(), actual.getSoc().getMin(), 1e-3);
+			assertEquals(expected.getSoc().getMax(), actual.getSoc().getMax(), 1e-3);
+			assertEquals(expected.getSoc().getAvg(), actual.getSoc().getAvg(), 1e-2);
+			assertEquals(expected.getPackCurrent().getLast(), actual.getPackCurrent().getLast(), 1e-3);
+		}
+
+		System.out.printf("%d days at %s (%d points): raw %.1f ms, %s %.1f ms (median of %d)%n",
+				Duration.between(FROM, TO).toDays(), plan.step(), fromRollup.size(),
+				medianMillis(raw), plan.source(), medianMillis(plan), RUNS);
+	}
+
+	private double medianMillis(BatterySeriesPlan plan) {
+		long[] nanos = new long[RUNS];
+		for (int i = 0; i < RUNS; i++) {
+			long start = System.nanoTime();
+			repository.findSeries(DEVICE, FROM, TO, plan);
+			nanos[i] = System.nanoTime() - start;
+		}
+		Arrays.sort(nanos);
+		return nanos[RUNS / 2] / 1e6;
+	}
+}
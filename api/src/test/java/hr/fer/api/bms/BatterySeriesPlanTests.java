@@ -0,0 +1,51 @@
+package hr.fer.api.bms;
+
+import org.junit.jupiter.api.Test;
+
+import java.time.Duration;
+import java.time.Instant;
+
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertNull;
+
+class BatterySeriesPlanTests {
+
+	private static final Instant FROM = Instant.parse("2024-03-01T00:00:00Z");
+
+	@Test
+	void monthAtDefaultPointsReadsHourlyRollups() {
+		// 30 days / 500 points = 86.4 min, whole hours of the 1 h rollup
+		BatterySeriesPlan plan = BatterySeriesPlan.of(FROM, FROM.plus(Duration.ofDays(30)), null, 500);
+		assertEquals(RollupWidth.HOUR, plan.rollup());
+		assertEquals(Duration.ofHours(2), plan.step());
+	}
+
+	@Test
+	void resolutionCoarserThanPointsWins() {
+		BatterySeriesPlan plan = BatterySeriesPlan.of(FROM, FROM.plus(Duration.ofDays(30)), Duration.ofDays(1), 500);
+		assertEquals(RollupWidth.DAY, plan.rollup());
+		assertEquals(Duration.ofDays(1), plan.step());
+
+		plan = BatterySeriesPlan.of(FROM, FROM.plus(Duration.ofDays(30)), Duration.ofMinutes(90), 10000);
+		assertEquals(RollupWidth.HOUR, plan.rollup());
+		assertEquals(Duration.ofHours(2), plan.step());
+	}
+
+	@Test
+	void shortRangesReadRawReadings() {
+		BatterySeriesPlan plan = BatterySeriesPlan.of(FROM, FROM.plus(Duration.ofMinutes(10)), Duration.ofSeconds(5), 500);
+		assertNull(plan.rollup());
+		assertEquals("raw", plan.source());
+		assertEquals(Duration.ofSeconds(5), plan.step());
+
+		plan = BatterySeriesPlan.of(FROM, FROM.plus(Duration.ofMinutes(10)), null, 10000);
+		assertEquals(Duration.ofSeconds(1), plan.step());
+	}
+
+	@Test
+	void stepJustAboveAMinuteUsesMinuteRollups() {
+		BatterySeriesPlan plan = BatterySeriesPlan.of(FROM, FROM.plus(Duration.ofHours(10)), null, 500);
+		assertEquals(RollupWidth.MINUTE, plan.rollup());
+		assertEquals(Duration.ofMinutes(2), plan.step());
+	}
+}
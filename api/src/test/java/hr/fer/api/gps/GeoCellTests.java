@@ -0,0 +1,57 @@
+package hr.fer.api.gps;
+
+import org.junit.jupiter.api.Test;
+
+import java.util.List;
+import java.util.Random;
+
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+class GeoCellTests {
+
+	@Test
+	void cellsMatchTheMigration() {
+		// Values of geo_cell() in the V11 migration
+		assertEquals(3377699720527872L, GeoCell.cell(0, 0));
+		assertEquals(3668737142480092L, GeoCell.cell(45.815, 15.9819));
+		assertEquals(3252342838162768L, GeoCell.cell(-33.8688, 151.2093));
+	}
+
+	@Test
+	void coverContainsEveryPointOfTheBox() {
+		Random random = new Random(42);
+		for (int i = 0; i < 100; i++) {
+			double south = random.nextDouble() * 170 - 85;
+			double west = random.nextDouble() * 350 - 175;
+			double size = Math.pow(10, -random.nextInt(5));
+			GeoCell.Box box = new GeoCell.Box(south, west, Math.min(south + size, 90), Math.min(west + size, 180));
+			List<GeoCell.Range> ranges = GeoCell.cover(box, LocationQueryRepository.MAX_CELLS);
+			assertTrue(ranges.size() <= LocationQueryRepository.MAX_CELLS);
+
+			for (int j = 0; j < 100; j++) {
+				double latitude = box.south() + random.nextDouble() * (box.north() - box.south());
+				double longitude = box.west() + random.nextDouble() * (box.east() - box.west());
+				long cell = GeoCell.cell(latitude, longitude);
+				assertTrue(ranges.stream().anyMatch(r -> cell >= r.low() && cell <= r.high()),
+						() -> latitude + "," + longitude + " outside " + ranges);
+			}
+		}
+	}
+
+	@Test
+	void coverRangesAreSortedAndDisjoint() {
+		// About 2 km around Zagreb
+		List<GeoCell.Range> ranges = GeoCell.cover(new GeoCell.Box(45.80, 15.96, 45.82, 15.99), 16);
+		for (int i = 1; i < ranges.size(); i++) {
+			assertTrue(ranges.get(i - 1).high() + 1 < ranges.get(i).low());
+		}
+	}
+
+	@Test
+	void boxesAcrossTheAntimeridianAreSplit() {
+		List<GeoCell.Box> boxes = GeoCell.Box.of(-10, 170, 10, -170);
+		assertEquals(List.of(new GeoCell.Box(-10, 170, 10, 180), new GeoCell.Box(-10, -180, 10, -170)), boxes);
+		assertEquals(1, GeoCell.Box.of(-10, -170, 10, 170).size());
+	}
+}
@@ -0,0 +1,172 @@
+package hr.fer.api.gps;
+
+import org.junit.jupiter.api.AfterAll;
+import org.junit.jupiter.api.BeforeAll;
+import org.junit.jupiter.api.Test;
+import org.junit.jupiter.api.condition.EnabledIfEnvironmentVariable;
+import org.springframework.jdbc.core.JdbcTemplate;
+import org.springframework.jdbc.datasource.DataSourceTransactionManager;
+import org.springframework.jdbc.datasource.DriverManagerDataSource;
+import org.springframework.transaction.support.TransactionTemplate;
+
+import java.io.IOException;
+import java.io.StringWriter;
+import java.io.UncheckedIOException;
+import java.time.Duration;
+import java.time.Instant;
+import java.time.LocalDateTime;
+import java.time.ZoneOffset;
+import java.util.Arrays;
+import java.util.List;
+
+import static org.junit.jupiter.api.Assertions.assertEquals;
+import static org.junit.jupiter.api.Assertions.assertTrue;
+
+/**
+ * Latency of the map queries on a real database with the migrations
+ * applied:
+ *
+ *   BENCH_DATABASE_URL=jdbc:postgresql://localhost/postgres BENCH_DATABASE_USERNAME=postgres \
+ *   BENCH_DATABASE_PASSWORD=postgres ./mvnw test -Dtest=LocationQueryBenchmarkTests
+ *
+ * Seeds BENCH_LOCATION_POINTS readings (20 million by default) of 2000
+ * throwaway devices reporting every 10 s around Zagreb, and removes them
+ * afterwards. The median of each query must stay under its target:
+ *
+ *   2 km viewport over 15 minutes      50 ms
+ *   newest positions in a city box      20 ms
+ *   10 nearest devices                  20 ms
+ *   polyline of a 1 hour trip          100 ms
+ */
+@EnabledIfEnvironmentVariable(named = "BENCH_DATABASE_URL", matches = ".+")
+class LocationQueryBenchmarkTests {
+
+	private static final String PREFIX = "bench-loc-";
+	private static final int DEVICES = 2000;
+	private static final Instant FROM = Instant.parse("2024-02-01T00:00:00Z");
+	private static final int RUNS = 50;
+
+	private static JdbcTemplate jdbcTemplate;
+	private static TransactionTemplate transactionTemplate;
+	private static LocationQueryRepository repository;
+	private static Instant to;
+
+	@BeforeAll
+	static void seed() {
+		DriverManagerDataSource dataSource = new DriverManagerDataSource(System.getenv("BENCH_DATABASE_URL"),
+				System.getenv("BENCH_DATABASE_USERNAME"), System.getenv("BENCH_DATABASE_PASSWORD"));
+		jdbcTemplate = new JdbcTemplate(dataSource);
+		transactionTemplate = new TransactionTemplate(new DataSourceTransactionManager(dataSource));
+		transactionTemplate.setReadOnly(true);
+		repository = new LocationQueryRepository(dataSource);
+		cleanUp();
+
+		long points = Long.parseLong(System.getenv().getOrDefault("BENCH_LOCATION_POINTS", "20000000"));
+		to = FROM.plusSeconds(points / DEVICES * 10);
+		LocalDateTime from = LocalDateTime.ofInstant(FROM, ZoneOffset.UTC);
+		jdbcTemplate.queryForObject("SELECT create_reading_partitions(?::date, ?)", Object.class, from,
+				(int) Duration.between(FROM, to).toDays() / 28 + 2);
+
+		// Every device circles slowly around its own spot of a 14 x 10 km area
+		jdbcTemplate.update("""
+				INSERT INTO locations (latitude, longitude, timestamp, device_id)
+				SELECT 45.75 + 0.09 * (d * 7919 % 1000) / 1000.0 + 0.005 * sin(k / 60.0),
+				       15.90 + 0.18 * (d * 104729 % 1000) / 1000.0 + 0.005 * cos(k / 60.0),
+				       ?::timestamp + k * INTERVAL '10 seconds', ? || d
+				FROM (SELECT n % ? AS d, n / ? AS k FROM generate_series(0, ? - 1) AS n) seeded
+				""", from, PREFIX, DEVICES, DEVICES, points);
+		jdbcTemplate.update("""
+				INSERT INTO device_positions (device_id, latitude, longitude, timestamp)
+				SELECT DISTINCT ON (device_id) device_id, latitude, longitude, timestamp
+				FROM locations
+				WHERE device_id LIKE ? || '%'
+				ORDER BY device_id, timestamp DESC
+				""", PREFIX);
+		jdbcTemplate.update("""
+				INSERT INTO trips (
+				   device_id, started_at, ended_at, points, distance_m, end_latitude, end_longitude,
+				   min_latitude, max_latitude, min_longitude, max_longitude
+				)
+				VALUES (?, ?, ?::timestamp + INTERVAL '1 hour', 360, 0, 0, 0, 0, 0, 0, 0)
+				""", PREFIX + 0, from, from);
+		jdbcTemplate.execute("ANALYZE locations");
+		jdbcTemplate.execute("ANALYZE device_positions");
+	}
+
+	@AfterAll
+	static void cleanUp() {
+		jdbcTemplate.update("DELETE FROM locations WHERE device_id LIKE ? || '%'", PREFIX);
+		jdbcTemplate.update("DELETE FROM device_positions WHERE device_id LIKE ? || '%'", PREFIX);
+		jdbcTemplate.update("DELETE FROM trips WHERE device_id LIKE ? || '%'", PREFIX);
+	}
+
+	@Test
+	void viewport() {
+		// About 2 km across, in the middle of the seeded data
+		List<GeoCell.Box> boxes = GeoCell.Box.of(45.81, 15.97, 45.828, 15.995);
+		Instant from = FROM.plus(Duration.between(FROM, to).dividedBy(2));
+		int[] count = {0};
+		double millis = medianMillis(() -> {
+			count[0] = 0;
+			repository.streamViewport(boxes, from, from.plus(Duration.ofMinutes(15)), 100000, p -> count[0]++);
+		});
+		report("2 km viewport over 15 minutes", count[0], millis, 50);
+	}
+
+	@Test
+	void latest() {
+		List<GeoCell.Box> boxes = GeoCell.Box.of(45.75, 15.90, 45.84, 16.08);
+		int[] count = {0};
+		double millis = medianMillis(() -> {
+			count[0] = 0;
+			repository.streamLatest(boxes, FROM, p -> count[0]++);
+		});
+		assertTrue(count[0] >= DEVICES);
+		report("newest positions in a city box", count[0], millis, 20);
+	}
+
+	@Test
+	void nearest() {
+		int[] count = {0};
+		double millis = medianMillis(() -> count[0] = repository.findNearest(45.815, 15.9819, 10, FROM).size());
+		assertEquals(10, count[0]);
+		report("10 nearest devices", count[0], millis, 20);
+	}
+
+	@Test
+	void tripPolyline() {
+		Trip trip = repository.findTrips(PREFIX + 0, FROM, to).get(0);
+		int[] length = {0};
+		double millis = medianMillis(() -> {
+			StringWriter writer = new StringWriter();
+			PolylineEncoder encoder = new PolylineEncoder(writer);
+			repository.streamTrip(trip, p -> {
+				try {
+					encoder.add(p.latitude(), p.longitude());
+				} catch (IOException e) {
+					throw new UncheckedIOException(e);
+				}
+			});
+			length[0] = writer.getBuffer().length();
+		});
+		report("polyline of a 1 hour trip", length[0], millis, 100);
+	}
+
+	private static void report(String query, int results, double millis, double targetMillis) {
+		System.out.printf("%s: %d results, %.1f ms (median of %d, target %.0f ms)%n",
+				query, results, millis, RUNS, targetMillis);
+		assertTrue(millis < targetMillis, query + " took " + millis + " ms");
+	}
+
+	// Streams run in a read-only transaction like behind the repository's @Transactional
+	private static double medianMillis(Runnable query) {
+		long[] nanos = new long[RUNS];
+		for (int i = 0; i < RUNS; i++) {
+			long start = System.nanoTime();
+			transactionTemplate.executeWithoutResult(status -> query.run());
+			nanos[i] = System.nanoTime() - start;
+		}
+		Arrays.sort(nanos);
+		return nanos[RUNS / 2] / 1e6;
+	}
+}
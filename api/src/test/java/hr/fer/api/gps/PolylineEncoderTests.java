@@ -0,0 +1,31 @@
+package hr.fer.api.gps;
+
+import org.junit.jupiter.api.Test;
+
+import java.io.IOException;
+import java.io.StringWriter;
+
+import static org.junit.jupiter.api.Assertions.assertEquals;
+
+class PolylineEncoderTests {
+
+	@Test
+	void encodesTheReferenceExample() throws IOException {
+		StringWriter writer = new StringWriter();
+		PolylineEncoder encoder = new PolylineEncoder(writer);
+		encoder.add(38.5, -120.2);
+		encoder.add(40.7, -120.95);
+		encoder.add(43.252, -126.453);
+		assertEquals("_p~iF~ps|U_ulLnnqC_mqNvxq`@", writer.toString());
+	}
+
+	@Test
+	void repeatedPointsAreZeroDeltas() throws IOException {
+		StringWriter writer = new StringWriter();
+		PolylineEncoder encoder = new PolylineEncoder(writer);
+		encoder.add(45.815, 15.9819);
+		String first = writer.toString();
+		encoder.add(45.815, 15.9819);
+		assertEquals(first + "??", writer.toString());
+	}
+}
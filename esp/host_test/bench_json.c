@@ -0,0 +1,306 @@
+/**
+ * Checks the fixed-buffer JSON encoders and measures them against the cJSON
+ * tree the firmware used to build for every message.
+ *
+ * Usage: bench_json [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "telemetry.h"
+#include "telemetry_json.h"
+
+#ifdef HAVE_CJSON
+#include "cJSON.h"
+#endif
+
+// Heap accounting, linked with --wrap so every malloc of the process is counted
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+
+static size_t allocations;
+static size_t allocated_bytes;
+
+void *__wrap_malloc(size_t size)
+{
+    allocations++;
+    allocated_bytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    allocations++;
+    allocated_bytes += count * size;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size)
+{
+    allocations++;
+    allocated_bytes += size;
+    return __real_realloc(pointer, size);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#ifdef HAVE_CJSON
+// Original encoder from main.c, kept as the reference for the output format
+static char *cjsonBmsStatusToJSON(const BmsStatus *status)
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "state", status->state);
+    cJSON_AddBoolToObject(root, "chg_enable", status->chg_enable);
+    cJSON_AddBoolToObject(root, "dis_enable", status->dis_enable);
+    cJSON_AddNumberToObject(root, "connected_cells", status->connected_cells);
+
+    cJSON *cellVoltagesArray = cJSON_CreateArray();
+    for (int i = 0; i < BOARD_NUM_CELLS_MAX; i++)
+    {
+        cJSON_AddItemToArray(cellVoltagesArray, cJSON_CreateNumber(status->cell_voltages[i]));
+    }
+    cJSON_AddItemToObject(root, "cell_voltages", cellVoltagesArray);
+
+    cJSON_AddNumberToObject(root, "cell_voltage_max", status->cell_voltage_max);
+    cJSON_AddNumberToObject(root, "cell_voltage_min", status->cell_voltage_min);
+    cJSON_AddNumberToObject(root, "cell_voltage_avg", status->cell_voltage_avg);
+    cJSON_AddNumberToObject(root, "pack_voltage", status->pack_voltage);
+    cJSON_AddNumberToObject(root, "stack_voltage", status->stack_voltage);
+    cJSON_AddNumberToObject(root, "pack_current", status->pack_current);
+
+    cJSON *batTempsArray = cJSON_CreateArray();
+    for (int i = 0; i < BOARD_NUM_THERMISTORS_MAX; i++)
+    {
+        cJSON_AddItemToArray(batTempsArray, cJSON_CreateNumber(status->bat_temps[i]));
+    }
+    cJSON_AddItemToObject(root, "bat_temps", batTempsArray);
+
+    cJSON_AddNumberToObject(root, "bat_temp_max", status->bat_temp_max);
+    cJSON_AddNumberToObject(root, "bat_temp_min", status->bat_temp_min);
+    cJSON_AddNumberToObject(root, "bat_temp_avg", status->bat_temp_avg);
+    cJSON_AddNumberToObject(root, "mosfet_temp", status->mosfet_temp);
+    cJSON_AddNumberToObject(root, "ic_temp", status->ic_temp);
+    cJSON_AddNumberToObject(root, "mcu_temp", status->mcu_temp);
+
+    cJSON_AddBoolToObject(root, "full", status->full);
+    cJSON_AddBoolToObject(root, "empty", status->empty);
+    cJSON_AddNumberToObject(root, "soc", status->soc);
+    cJSON_AddNumberToObject(root, "balancing_status", status->balancing_status);
+
+    char timestampString[21];
+    strftime(timestampString, sizeof(timestampString), "%Y-%m-%dT%H:%M:%SZ", gmtime(&status->no_idle_timestamp));
+    cJSON_AddStringToObject(root, "no_idle_timestamp", timestampString);
+
+    cJSON_AddNumberToObject(root, "error_flags", status->error_flags);
+
+    strftime(timestampString, sizeof(timestampString), "%Y-%m-%dT%H:%M:%SZ", gmtime(&status->timestamp));
+    cJSON_AddStringToObject(root, "timestamp", timestampString);
+
+    cJSON_AddNumberToObject(root, "boot_id", status->boot_id);
+    cJSON_AddNumberToObject(root, "sequence", status->sequence);
+    cJSON_AddNumberToObject(root, "uptime_ms", status->uptime_ms);
+
+    char *jsonString = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return jsonString;
+}
+
+static char *cjsonLocationToJSON(const Location *location)
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "latitude", location->latitude);
+    cJSON_AddNumberToObject(root, "longitude", location->longitude);
+
+    char timestampString[21];
+    strftime(timestampString, sizeof(timestampString), "%Y-%m-%dT%H:%M:%SZ", gmtime(&location->timestamp));
+    cJSON_AddStringToObject(root, "timestamp", timestampString);
+
+    cJSON_AddNumberToObject(root, "boot_id", location->boot_id);
+    cJSON_AddNumberToObject(root, "sequence", location->sequence);
+    cJSON_AddNumberToObject(root, "uptime_ms", location->uptime_ms);
+
+    char *jsonString = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return jsonString;
+}
+#endif
+
+static int check_golden(void)
+{
+    BmsStatus status = {
+        .state = 3,
+        .chg_enable = true,
+        .connected_cells = 4,
+        .cell_voltages = {3.7f, 3.75f, 3.8f, 4.0f, 0.0f, 0.0f},
+        .cell_voltage_max = 4.0f,
+        .cell_voltage_min = 3.7f,
+        .cell_voltage_avg = 3.8125f,
+        .pack_voltage = 15.25f,
+        .stack_voltage = 15.3f,
+        .pack_current = -2.5f,
+        .bat_temps = {21.5f, 22.0f},
+        .bat_temp_max = 22.0f,
+        .bat_temp_min = 21.5f,
+        .bat_temp_avg = 21.75f,
+        .mosfet_temp = 30.0f,
+        .ic_temp = 31.0f,
+        .mcu_temp = 32.0f,
+        .empty = true,
+        .soc = 80.5f,
+        .balancing_status = 3000000000u,
+        .no_idle_timestamp = 1700000000,
+        .error_flags = 5,
+        .timestamp = 1700000010,
+        .boot_id = 3735928559u,
+        .sequence = 42,
+        .uptime_ms = 86400123,
+    };
+    const char *expected =
+        "{\"state\":3,\"chg_enable\":true,\"dis_enable\":false,\"connected_cells\":4,"
+        "\"cell_voltages\":[3.7000000476837158,3.75,3.7999999523162842,4,0,0],"
+        "\"cell_voltage_max\":4,\"cell_voltage_min\":3.7000000476837158,\"cell_voltage_avg\":3.8125,"
+        "\"pack_voltage\":15.25,\"stack_voltage\":15.300000190734863,\"pack_current\":-2.5,"
+        "\"bat_temps\":[21.5,22],\"bat_temp_max\":22,\"bat_temp_min\":21.5,\"bat_temp_avg\":21.75,"
+        "\"mosfet_temp\":30,\"ic_temp\":31,\"mcu_temp\":32,\"full\":false,\"empty\":true,"
+        "\"soc\":80.5,\"balancing_status\":3000000000,\"no_idle_timestamp\":\"2023-11-14T22:13:20Z\","
+        "\"error_flags\":5,\"timestamp\":\"2023-11-14T22:13:30Z\","
+        "\"boot_id\":3735928559,\"sequence\":42,\"uptime_ms\":86400123}";
+
+    char buffer[BMS_STATUS_JSON_MAX_LEN];
+    size_t length = convertBmsStatusToJSON(&status, buffer, sizeof(buffer));
+    if (length != strlen(expected) || strcmp(buffer, expected) != 0)
+    {
+        fprintf(stderr, "golden BmsStatus mismatch:\n  got      %s\n  expected %s\n", buffer, expected);
+        return 1;
+    }
+
+    // A buffer that is one byte short must be rejected instead of truncated
+    if (convertBmsStatusToJSON(&status, buffer, length) != 0)
+    {
+        fprintf(stderr, "short buffer was not rejected\n");
+        return 1;
+    }
+
+    Location location = {
+        .latitude = 45.8150f,
+        .longitude = 15.9819f,
+        .timestamp = 1700000000,
+        .boot_id = 3735928559u,
+        .sequence = 7,
+        .uptime_ms = 86390000,
+    };
+    const char *expectedLocation =
+        "{\"latitude\":45.814998626708984,\"longitude\":15.981900215148926,\"timestamp\":\"2023-11-14T22:13:20Z\","
+        "\"boot_id\":3735928559,\"sequence\":7,\"uptime_ms\":86390000}";
+    char locationBuffer[LOCATION_JSON_MAX_LEN];
+    convertLocationToJSON(&location, locationBuffer, sizeof(locationBuffer));
+    if (strcmp(locationBuffer, expectedLocation) != 0)
+    {
+        fprintf(stderr, "golden Location mismatch:\n  got      %s\n  expected %s\n", locationBuffer, expectedLocation);
+        return 1;
+    }
+
+    char batch[BATCH_JSON_MAX_LEN(2)];
+    BmsStatus statuses[2] = {status, status};
+    size_t batchLength = convertBatchToJSON(statuses, 2, &location, 1, batch, sizeof(batch));
+    char expectedBatch[BATCH_JSON_MAX_LEN(2)];
+    snprintf(expectedBatch, sizeof(expectedBatch), "{\"batteries\":[%s,%s],\"locations\":[%s]}", expected, expected,
+             expectedLocation);
+    if (batchLength != strlen(expectedBatch) || strcmp(batch, expectedBatch) != 0 ||
+        convertBatchToJSON(statuses, 2, &location, 1, batch, batchLength) != 0)
+    {
+        fprintf(stderr, "batch mismatch:\n  got      %s\n  expected %s\n", batch, expectedBatch);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+    int failures = check_golden();
+
+    BmsStatus *statuses = malloc(iterations * sizeof(BmsStatus));
+    Location *locations = malloc(iterations * sizeof(Location));
+    srand(1);
+    for (int i = 0; i < iterations; i++)
+    {
+        statuses[i] = generateRandomBmsStatus();
+        locations[i] = generateRandomLocation();
+    }
+
+    static char bmsBuffer[BMS_STATUS_JSON_MAX_LEN];
+    static char locationBuffer[LOCATION_JSON_MAX_LEN];
+    size_t bytes = 0;
+
+    allocations = 0;
+    double start = now_seconds();
+    for (int i = 0; i < iterations; i++)
+    {
+        bytes += convertBmsStatusToJSON(&statuses[i], bmsBuffer, sizeof(bmsBuffer));
+        bytes += convertLocationToJSON(&locations[i], locationBuffer, sizeof(locationBuffer));
+    }
+    double elapsed = now_seconds() - start;
+    printf("fixed buffer: %8.3f us/sample, %zu allocations, %zu bytes out\n",
+           elapsed * 1e6 / iterations, allocations, bytes);
+    if (allocations != 0)
+    {
+        fprintf(stderr, "the fixed buffer encoders allocated\n");
+        failures++;
+    }
+
+#ifdef HAVE_CJSON
+    allocations = 0;
+    allocated_bytes = 0;
+    bytes = 0;
+    start = now_seconds();
+    for (int i = 0; i < iterations; i++)
+    {
+        char *json = cjsonBmsStatusToJSON(&statuses[i]);
+        bytes += strlen(json);
+        free(json);
+        json = cjsonLocationToJSON(&locations[i]);
+        bytes += strlen(json);
+        free(json);
+    }
+    elapsed = now_seconds() - start;
+    printf("cJSON tree:   %8.3f us/sample, %.1f allocations/sample (%.0f bytes), %zu bytes out\n",
+           elapsed * 1e6 / iterations, (double)allocations / iterations,
+           (double)allocated_bytes / iterations, bytes);
+
+    // Both encoders must produce the exact same documents
+    for (int i = 0; i < iterations; i++)
+    {
+        char *json = cjsonBmsStatusToJSON(&statuses[i]);
+        convertBmsStatusToJSON(&statuses[i], bmsBuffer, sizeof(bmsBuffer));
+        if (strcmp(json, bmsBuffer) != 0)
+        {
+            fprintf(stderr, "BmsStatus %d differs:\n  cJSON %s\n  fixed %s\n", i, json, bmsBuffer);
+            failures++;
+        }
+        free(json);
+
+        json = cjsonLocationToJSON(&locations[i]);
+        convertLocationToJSON(&locations[i], locationBuffer, sizeof(locationBuffer));
+        if (strcmp(json, locationBuffer) != 0)
+        {
+            fprintf(stderr, "Location %d differs:\n  cJSON %s\n  fixed %s\n", i, json, locationBuffer);
+            failures++;
+        }
+        free(json);
+    }
+#endif
+
+    free(statuses);
+    free(locations);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,197 @@
+/**
+ * Compresses synthetic ride traces with the columnar series codec and
+ * reports the compression ratio against the JSON and packed binary batches,
+ * plus the encode cost per sample. Every batch is decoded again and has to
+ * match the input bit for bit.
+ *
+ * Usage: bench_series [rides]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "telemetry.h"
+#include "telemetry_binary.h"
+#include "telemetry_json.h"
+#include "telemetry_series.h"
+
+#define RIDE_SAMPLES 360 // One hour at the default 10 s period
+#define BATCH_SIZE 20
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static float noise(float amplitude)
+{
+    return ((float)rand() / RAND_MAX * 2 - 1) * amplitude;
+}
+
+static float quantize(float value, float step)
+{
+    return roundf(value / step) * step;
+}
+
+/**
+ * A ride with a parked stretch in the middle: the pack discharges under a
+ * noisy load, cells report millivolts, thermistors tenths of a degree, and
+ * the bike moves at about 20 km/h with slow heading changes.
+ */
+static void generate_ride(BmsStatus *statuses, Location *locations, int count)
+{
+    time_t timestamp = 1700000000 + rand() % 100000;
+    time_t noIdle = timestamp;
+    uint32_t bootId = rand();
+    int64_t uptime = rand() % 3600000;
+    float cell = 4.1f;
+    float temperature = 22.0f + noise(3);
+    float soc = 95.0f;
+    double latitude = 45.8 + noise(0.1f);
+    double longitude = 15.95 + noise(0.1f);
+    double heading = noise(3.14f);
+
+    for (int i = 0; i < count; i++)
+    {
+        bool riding = i < count / 3 || i > count / 2;
+        float current = riding ? -6.0f + noise(2.5f) : -0.05f + noise(0.02f);
+
+        timestamp += 10 + (i % 17 == 0); // Occasional one second of jitter
+        uptime += 10000 + rand() % 20;
+        if (riding)
+        {
+            noIdle = timestamp;
+        }
+        cell += current * 0.00008f;
+        temperature += riding ? 0.01f : -0.005f;
+        soc += current * 10 / 3600 / 10 * 100;
+
+        BmsStatus *status = &statuses[i];
+        memset(status, 0, sizeof(*status));
+        status->state = riding ? 2 : 1;
+        status->chg_enable = true;
+        status->dis_enable = true;
+        status->connected_cells = BOARD_NUM_CELLS_MAX;
+
+        float sum = 0, max = 0, min = 10;
+        for (int c = 0; c < BOARD_NUM_CELLS_MAX; c++)
+        {
+            float v = quantize(cell + noise(0.002f), 0.001f);
+            status->cell_voltages[c] = v;
+            sum += v;
+            max = v > max ? v : max;
+            min = v < min ? v : min;
+        }
+        status->cell_voltage_max = max;
+        status->cell_voltage_min = min;
+        status->cell_voltage_avg = sum / BOARD_NUM_CELLS_MAX;
+        status->pack_voltage = quantize(sum, 0.01f);
+        status->stack_voltage = quantize(sum + 0.02f, 0.01f);
+        status->pack_current = quantize(current, 0.01f);
+
+        float tmax = -100, tmin = 100, tsum = 0;
+        for (int t = 0; t < BOARD_NUM_THERMISTORS_MAX; t++)
+        {
+            float v = quantize(temperature + noise(0.15f), 0.1f);
+            status->bat_temps[t] = v;
+            tsum += v;
+            tmax = v > tmax ? v : tmax;
+            tmin = v < tmin ? v : tmin;
+        }
+        status->bat_temp_max = tmax;
+        status->bat_temp_min = tmin;
+        status->bat_temp_avg = tsum / BOARD_NUM_THERMISTORS_MAX;
+        status->mosfet_temp = quantize(temperature + 4 + noise(0.2f), 0.1f);
+        status->ic_temp = quantize(temperature + 6 + noise(0.2f), 0.1f);
+        status->mcu_temp = quantize(temperature + 8 + noise(0.2f), 0.1f);
+        status->soc = soc;
+        status->no_idle_timestamp = noIdle;
+        status->timestamp = timestamp;
+        status->boot_id = bootId;
+        status->sequence = i;
+        status->uptime_ms = uptime;
+
+        if (riding)
+        {
+            heading += noise(0.2f);
+            latitude += cos(heading) * 55 / 111320.0;
+            longitude += sin(heading) * 55 / (111320.0 * cos(latitude * M_PI / 180));
+        }
+        locations[i].latitude = latitude;
+        locations[i].longitude = longitude;
+        locations[i].timestamp = timestamp;
+        locations[i].boot_id = bootId;
+        locations[i].sequence = i;
+        locations[i].uptime_ms = uptime + 5;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int rides = argc > 1 ? atoi(argv[1]) : 50;
+    int failures = 0;
+    size_t jsonBytes = 0, binaryBytes = 0, seriesBytes = 0, samples = 0;
+    double binaryTime = 0, seriesTime = 0;
+
+    static BmsStatus statuses[RIDE_SAMPLES];
+    static Location locations[RIDE_SAMPLES];
+    static char json[BATCH_JSON_MAX_LEN(BATCH_SIZE)];
+    static uint8_t binary[BATCH_BINARY_MAX_LEN(BATCH_SIZE)];
+    static uint8_t series[SERIES_BATCH_MAX_LEN(BATCH_SIZE)];
+
+    srand(3);
+    for (int ride = 0; ride < rides; ride++)
+    {
+        generate_ride(statuses, locations, RIDE_SAMPLES);
+
+        for (int first = 0; first < RIDE_SAMPLES; first += BATCH_SIZE)
+        {
+            int count = RIDE_SAMPLES - first < BATCH_SIZE ? RIDE_SAMPLES - first : BATCH_SIZE;
+            const BmsStatus *batchStatuses = &statuses[first];
+            const Location *batchLocations = &locations[first];
+
+            jsonBytes += convertBatchToJSON(batchStatuses, count, batchLocations, count, json, sizeof(json));
+
+            double start = now_seconds();
+            binaryBytes += convertBatchToBinary(batchStatuses, count, batchLocations, count, binary, sizeof(binary));
+            binaryTime += now_seconds() - start;
+
+            start = now_seconds();
+            size_t length = convertBatchToSeries(batchStatuses, count, batchLocations, count, series, sizeof(series));
+            seriesTime += now_seconds() - start;
+            seriesBytes += length;
+            samples += count;
+
+            BmsStatus decodedStatuses[BATCH_SIZE];
+            Location decodedLocations[BATCH_SIZE];
+            size_t statusCount = BATCH_SIZE, locationCount = BATCH_SIZE;
+            if (length == 0 ||
+                !parseSeriesBatch(series, length, decodedStatuses, &statusCount, decodedLocations, &locationCount) ||
+                statusCount != (size_t)count || locationCount != (size_t)count ||
+                memcmp(decodedStatuses, batchStatuses, count * sizeof(BmsStatus)) != 0 ||
+                memcmp(decodedLocations, batchLocations, count * sizeof(Location)) != 0)
+            {
+                fprintf(stderr, "ride %d, batch at %d does not round-trip\n", ride, first);
+                failures++;
+            }
+            if (parseSeriesBatch(series, length / 2, decodedStatuses, &statusCount, decodedLocations, &locationCount))
+            {
+                fprintf(stderr, "ride %d, truncated batch at %d was accepted\n", ride, first);
+                failures++;
+            }
+        }
+    }
+
+    printf("per sample (BmsStatus + Location), batches of %d:\n", BATCH_SIZE);
+    printf("  json   %7.1f bytes\n", (double)jsonBytes / samples);
+    printf("  binary %7.1f bytes  %6.0f ns to encode\n", (double)binaryBytes / samples, binaryTime * 1e9 / samples);
+    printf("  series %7.1f bytes  %6.0f ns to encode, %.1fx smaller than binary, %.1fx smaller than json\n",
+           (double)seriesBytes / samples, seriesTime * 1e9 / samples, (double)binaryBytes / seriesBytes,
+           (double)jsonBytes / seriesBytes);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
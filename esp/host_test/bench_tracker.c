@@ -0,0 +1,402 @@
+/**
+ * Runs the tracker's telemetry pipeline as a Linux process: a sampler thread
+ * feeding the sample ring and an uplink thread encoding and publishing
+ * through a simulated modem, optionally to a real broker.
+ *
+ * Reports per-stage latency, messages per second and the heap high-water
+ * mark of the telemetry code (malloc is wrapped at link time), and fails if
+ * the publish path allocates or loses messages the link did not drop.
+ *
+ * Usage: bench_tracker [--samples N] [--rate HZ] [--format json|binary]
+ *                      [--broker HOST:PORT] [--latency-us N] [--jitter-us N]
+ *                      [--drop P] [--stall-rate P] [--stall-us N] [--bandwidth BYTES/S]
+ *
+ * Against a local mosquitto: bench_tracker --broker localhost:1883 --rate 50 --latency-us 20000
+ */
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim_link.h"
+#include "telemetry.h"
+#include "telemetry_binary.h"
+#include "telemetry_device.h"
+#include "telemetry_json.h"
+#include "telemetry_pipeline.h"
+
+#define DEVICE_ID "bench-tracker"
+#define TOPIC_BATTERY DEVICE_TOPIC_PREFIX DEVICE_ID "/battery-status"
+#define TOPIC_GPS DEVICE_TOPIC_PREFIX DEVICE_ID "/gps-coordinates"
+#define RING_CAPACITY 64
+#define STAGE_ITERATIONS 20000
+
+// Heap accounting, every allocation made outside libc goes through here
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+void __real_free(void *pointer);
+
+#define HEAP_HEADER 16
+
+static atomic_size_t heapInUse;
+static atomic_size_t heapPeak;
+static atomic_size_t heapAllocations;
+
+static void *heap_track(void *block, size_t size)
+{
+    if (!block)
+    {
+        return NULL;
+    }
+    *(size_t *)block = size;
+    size_t inUse = atomic_fetch_add(&heapInUse, size) + size;
+    size_t peak = atomic_load(&heapPeak);
+    while (inUse > peak && !atomic_compare_exchange_weak(&heapPeak, &peak, inUse))
+    {
+    }
+    atomic_fetch_add(&heapAllocations, 1);
+    return (char *)block + HEAP_HEADER;
+}
+
+void *__wrap_malloc(size_t size)
+{
+    return heap_track(__real_malloc(size + HEAP_HEADER), size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    return heap_track(__real_calloc(1, count * size + HEAP_HEADER), count * size);
+}
+
+void __wrap_free(void *pointer)
+{
+    if (pointer)
+    {
+        char *block = (char *)pointer - HEAP_HEADER;
+        atomic_fetch_sub(&heapInUse, *(size_t *)block);
+        __real_free(block);
+    }
+}
+
+void *__wrap_realloc(void *pointer, size_t size)
+{
+    void *resized = __wrap_malloc(size);
+    if (resized && pointer)
+    {
+        size_t old = *(size_t *)((char *)pointer - HEAP_HEADER);
+        memcpy(resized, pointer, old < size ? old : size);
+        __wrap_free(pointer);
+    }
+    return resized;
+}
+
+// Start a new measurement, returns the bytes in use at that point
+static size_t heap_reset_peak(void)
+{
+    size_t inUse = atomic_load(&heapInUse);
+    atomic_store(&heapPeak, inUse);
+    atomic_store(&heapAllocations, 0);
+    return inUse;
+}
+
+// Timing
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleep_until_ns(int64_t deadline)
+{
+    struct timespec ts = {.tv_sec = deadline / 1000000000, .tv_nsec = deadline % 1000000000};
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+typedef struct
+{
+    const char *name;
+    int64_t *samples;
+    size_t count;
+    size_t capacity;
+} Stage;
+
+static void stage_init(Stage *stage, const char *name, size_t capacity)
+{
+    stage->name = name;
+    stage->samples = calloc(capacity, sizeof(int64_t));
+    stage->count = 0;
+    stage->capacity = capacity;
+}
+
+static void stage_add(Stage *stage, int64_t ns)
+{
+    if (stage->count < stage->capacity)
+    {
+        stage->samples[stage->count++] = ns;
+    }
+}
+
+static int compare_ns(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void stage_report(Stage *stage)
+{
+    if (stage->count == 0)
+    {
+        return;
+    }
+    qsort(stage->samples, stage->count, sizeof(int64_t), compare_ns);
+    double total = 0;
+    for (size_t i = 0; i < stage->count; i++)
+    {
+        total += stage->samples[i];
+    }
+    printf("  %-24s mean %9.0f ns  p50 %9lld  p99 %9lld  max %9lld\n", stage->name, total / stage->count,
+           (long long)stage->samples[stage->count / 2], (long long)stage->samples[stage->count * 99 / 100],
+           (long long)stage->samples[stage->count - 1]);
+    free(stage->samples);
+}
+
+// Pipeline, mirrors sampler_task and uplink_task in main.c
+
+typedef struct
+{
+    uint32_t samples;
+    uint32_t rate;
+    bool binary;
+    SimLink link;
+    SampleRing ring;
+    atomic_bool done;
+
+    SampleJitter jitter;
+    Stage publish;
+    uint32_t published;
+    uint32_t failed;
+} Pipeline;
+
+static SampleRecord ringRecords[RING_CAPACITY];
+
+static void *sampler_thread(void *arg)
+{
+    Pipeline *pipeline = arg;
+    int64_t period = pipeline->rate ? 1000000000LL / pipeline->rate : 0;
+    int64_t start = now_ns();
+    uint32_t sequence = 0;
+
+    for (uint32_t i = 0; i < pipeline->samples; i++)
+    {
+        if (period)
+        {
+            int64_t scheduled = start + (int64_t)i * period;
+            sleep_until_ns(scheduled);
+            sampleJitterAdd(&pipeline->jitter, scheduled / 1000, now_ns() / 1000);
+        }
+        else if (sampleRingCount(&pipeline->ring) > RING_CAPACITY - 2)
+        {
+            // Flat out: wait for the uplink instead of measuring the drop policy
+            sched_yield();
+            i--;
+            continue;
+        }
+
+        SampleRecord record = {.type = SAMPLE_BMS_STATUS, .sequence = sequence++, .status = generateRandomBmsStatus()};
+        sampleRingPush(&pipeline->ring, &record);
+        record.type = SAMPLE_LOCATION;
+        record.sequence = sequence++;
+        record.location = generateRandomLocation();
+        sampleRingPush(&pipeline->ring, &record);
+    }
+    atomic_store(&pipeline->done, true);
+    return NULL;
+}
+
+static int publish_record(Pipeline *pipeline, const SampleRecord *record)
+{
+    static char json[BMS_STATUS_JSON_MAX_LEN];
+    static uint8_t binary[BMS_STATUS_BINARY_MAX_LEN];
+
+    if (record->type == SAMPLE_BMS_STATUS)
+    {
+        if (pipeline->binary)
+        {
+            size_t length = convertBmsStatusToBinary(&record->status, binary, sizeof(binary));
+            return simLinkPublish(&pipeline->link, TOPIC_BATTERY "/bin", binary, length);
+        }
+        size_t length = convertBmsStatusToJSON(&record->status, json, sizeof(json));
+        return simLinkPublish(&pipeline->link, TOPIC_BATTERY, json, length);
+    }
+    if (pipeline->binary)
+    {
+        size_t length = convertLocationToBinary(&record->location, binary, sizeof(binary));
+        return simLinkPublish(&pipeline->link, TOPIC_GPS "/bin", binary, length);
+    }
+    size_t length = convertLocationToJSON(&record->location, json, sizeof(json));
+    return simLinkPublish(&pipeline->link, TOPIC_GPS, json, length);
+}
+
+static void *uplink_thread(void *arg)
+{
+    Pipeline *pipeline = arg;
+    SampleRecord record;
+    while (1)
+    {
+        bool done = atomic_load(&pipeline->done);
+        if (!sampleRingPop(&pipeline->ring, &record))
+        {
+            if (done)
+            {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+
+        int64_t start = now_ns();
+        int msgId = publish_record(pipeline, &record);
+        stage_add(&pipeline->publish, now_ns() - start);
+        if (msgId < 0)
+        {
+            pipeline->failed++;
+        }
+        else
+        {
+            pipeline->published++;
+        }
+    }
+    return NULL;
+}
+
+// Stages in isolation
+
+static void bench_stages(void)
+{
+    static BmsStatus statuses[256];
+    static Location locations[256];
+    static char bmsJson[BMS_STATUS_JSON_MAX_LEN];
+    static char locationJson[LOCATION_JSON_MAX_LEN];
+    Stage sample, bms, location;
+
+    stage_init(&sample, "generateRandomBmsStatus", STAGE_ITERATIONS);
+    stage_init(&bms, "convertBmsStatusToJSON", STAGE_ITERATIONS);
+    stage_init(&location, "convertLocationToJSON", STAGE_ITERATIONS);
+
+    for (int i = 0; i < STAGE_ITERATIONS; i++)
+    {
+        int64_t start = now_ns();
+        statuses[i % 256] = generateRandomBmsStatus();
+        stage_add(&sample, now_ns() - start);
+        locations[i % 256] = generateRandomLocation();
+    }
+    for (int i = 0; i < STAGE_ITERATIONS; i++)
+    {
+        int64_t start = now_ns();
+        convertBmsStatusToJSON(&statuses[i % 256], bmsJson, sizeof(bmsJson));
+        stage_add(&bms, now_ns() - start);
+
+        start = now_ns();
+        convertLocationToJSON(&locations[i % 256], locationJson, sizeof(locationJson));
+        stage_add(&location, now_ns() - start);
+    }
+
+    printf("stages, %d iterations:\n", STAGE_ITERATIONS);
+    stage_report(&sample);
+    stage_report(&bms);
+    stage_report(&location);
+}
+
+int main(int argc, char **argv)
+{
+    static Pipeline pipeline;
+    SimModemConfig modem = {0};
+    const char *broker = NULL;
+    pipeline.samples = 5000;
+
+    static const struct option options[] = {
+        {"samples", required_argument, NULL, 'n'},    {"rate", required_argument, NULL, 'r'},
+        {"format", required_argument, NULL, 'f'},     {"broker", required_argument, NULL, 'b'},
+        {"latency-us", required_argument, NULL, 'l'}, {"jitter-us", required_argument, NULL, 'j'},
+        {"drop", required_argument, NULL, 'd'},       {"stall-rate", required_argument, NULL, 's'},
+        {"stall-us", required_argument, NULL, 'S'},   {"bandwidth", required_argument, NULL, 'w'},
+        {NULL, 0, NULL, 0},
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1)
+    {
+        switch (option)
+        {
+        case 'n': pipeline.samples = strtoul(optarg, NULL, 0); break;
+        case 'r': pipeline.rate = strtoul(optarg, NULL, 0); break;
+        case 'f': pipeline.binary = strcmp(optarg, "binary") == 0; break;
+        case 'b': broker = optarg; break;
+        case 'l': modem.latency_us = strtoul(optarg, NULL, 0); break;
+        case 'j': modem.jitter_us = strtoul(optarg, NULL, 0); break;
+        case 'd': modem.drop_rate = strtof(optarg, NULL); break;
+        case 's': modem.stall_rate = strtof(optarg, NULL); break;
+        case 'S': modem.stall_us = strtoul(optarg, NULL, 0); break;
+        case 'w': modem.bytes_per_second = strtoul(optarg, NULL, 0); break;
+        default: return 2;
+        }
+    }
+
+    srand(1);
+    bench_stages();
+
+    if (!simLinkOpen(&pipeline.link, &modem, broker, DEVICE_ID))
+    {
+        return 1;
+    }
+    sampleRingInit(&pipeline.ring, ringRecords, RING_CAPACITY, SAMPLE_RING_DROP_OLDEST);
+    stage_init(&pipeline.publish, "encode + publish", pipeline.samples * 2);
+    atomic_init(&pipeline.done, false);
+
+    size_t heapBaseline = heap_reset_peak();
+    int64_t start = now_ns();
+    pthread_t sampler, uplink;
+    pthread_create(&uplink, NULL, uplink_thread, &pipeline);
+    pthread_create(&sampler, NULL, sampler_thread, &pipeline);
+    pthread_join(sampler, NULL);
+    pthread_join(uplink, NULL);
+    double seconds = (now_ns() - start) / 1e9;
+    size_t pipelineAllocations = atomic_load(&heapAllocations);
+    size_t pipelinePeak = atomic_load(&heapPeak) - heapBaseline;
+    simLinkClose(&pipeline.link);
+
+    uint32_t ringDropped = atomic_load(&pipeline.ring.dropped);
+    printf("publish loop, %u samples, %s, %s:\n", pipeline.samples, pipeline.binary ? "binary" : "json",
+           broker ? broker : "no broker");
+    stage_report(&pipeline.publish);
+    printf("  %.0f messages/s, %u published, %u lost on the link, %u dropped by the ring, %u stalls, %.1f KiB sent\n",
+           pipeline.published / seconds, pipeline.published, pipeline.link.dropped, ringDropped,
+           pipeline.link.stalls, pipeline.link.bytes / 1024.0);
+    if (pipeline.rate)
+    {
+        printf("  sampler jitter max %lld us, mean %.1f us\n", (long long)pipeline.jitter.max_us,
+               (double)pipeline.jitter.total_us / pipeline.jitter.samples);
+    }
+    printf("  heap high-water mark %zu bytes, %zu allocations\n", pipelinePeak, pipelineAllocations);
+
+    int failures = 0;
+    if (pipelineAllocations != 0)
+    {
+        fprintf(stderr, "the publish path allocated %zu times\n", pipelineAllocations);
+        failures++;
+    }
+    if (pipeline.published + pipeline.failed + ringDropped != pipeline.samples * 2 ||
+        pipeline.failed != pipeline.link.dropped)
+    {
+        fprintf(stderr, "messages went missing outside of the simulated link\n");
+        failures++;
+    }
+    return failures ? 1 : 0;
+}
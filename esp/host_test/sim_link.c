@@ -0,0 +1,227 @@
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim_link.h"
+
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH_QOS1 0x32
+#define MQTT_DISCONNECT 0xe0
+#define MQTT_KEEPALIVE 120
+#define MQTT_FRAME_MAX (16 * 1024)
+
+static void sleep_us(uint64_t us)
+{
+    struct timespec ts = {.tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000};
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+    {
+    }
+}
+
+static float chance(void)
+{
+    return (float)rand() / ((float)RAND_MAX + 1);
+}
+
+static size_t put_length(uint8_t *frame, size_t length)
+{
+    size_t i = 0;
+    do
+    {
+        uint8_t byte = length % 128;
+        length /= 128;
+        frame[i++] = byte | (length > 0 ? 0x80 : 0);
+    } while (length > 0);
+    return i;
+}
+
+static size_t put_string(uint8_t *frame, const char *text)
+{
+    size_t length = strlen(text);
+    frame[0] = length >> 8;
+    frame[1] = length & 0xff;
+    memcpy(frame + 2, text, length);
+    return length + 2;
+}
+
+static bool write_all(int fd, const uint8_t *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = send(fd, data, length, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+// PUBACKs are not tracked, just keep the receive buffer from filling up
+static void discard_input(int fd)
+{
+    uint8_t scratch[256];
+    while (recv(fd, scratch, sizeof(scratch), MSG_DONTWAIT) > 0)
+    {
+    }
+}
+
+// Delay, drop or stall a frame like the cellular link would, then hand it to the broker
+static bool modem_write(SimLink *link, const uint8_t *frame, size_t length)
+{
+    const SimModemConfig *config = &link->config;
+    uint64_t delay = config->latency_us;
+    if (config->jitter_us)
+    {
+        delay += rand() % config->jitter_us;
+    }
+    if (config->bytes_per_second)
+    {
+        delay += (uint64_t)length * 1000000 / config->bytes_per_second;
+    }
+    if (config->stall_rate > 0 && chance() < config->stall_rate)
+    {
+        link->stalls++;
+        delay += config->stall_us;
+    }
+    if (delay)
+    {
+        sleep_us(delay);
+    }
+
+    link->writes++;
+    if (config->drop_rate > 0 && chance() < config->drop_rate)
+    {
+        link->dropped++;
+        return false;
+    }
+    link->bytes += length;
+    if (link->fd < 0)
+    {
+        return true;
+    }
+    discard_input(link->fd);
+    return write_all(link->fd, frame, length);
+}
+
+static int connect_broker(const char *broker)
+{
+    char host[256];
+    const char *port = strrchr(broker, ':');
+    if (!port || (size_t)(port - broker) >= sizeof(host))
+    {
+        fprintf(stderr, "broker must be host:port, got %s\n", broker);
+        return -1;
+    }
+    memcpy(host, broker, port - broker);
+    host[port - broker] = '\0';
+
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *addresses;
+    if (getaddrinfo(host, port + 1, &hints, &addresses) != 0)
+    {
+        fprintf(stderr, "cannot resolve %s\n", host);
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *address = addresses; address && fd < 0; address = address->ai_next)
+    {
+        fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd >= 0 && connect(fd, address->ai_addr, address->ai_addrlen) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0)
+    {
+        fprintf(stderr, "cannot connect to %s\n", broker);
+    }
+    return fd;
+}
+
+bool simLinkOpen(SimLink *link, const SimModemConfig *config, const char *broker, const char *clientId)
+{
+    memset(link, 0, sizeof(*link));
+    link->config = *config;
+    link->fd = -1;
+    if (!broker)
+    {
+        return true;
+    }
+
+    link->fd = connect_broker(broker);
+    if (link->fd < 0)
+    {
+        return false;
+    }
+
+    uint8_t body[300];
+    size_t length = put_string(body, "MQTT");
+    body[length++] = 4;    // Protocol level 3.1.1
+    body[length++] = 0x02; // Clean session
+    body[length++] = MQTT_KEEPALIVE >> 8;
+    body[length++] = MQTT_KEEPALIVE & 0xff;
+    length += put_string(body + length, clientId);
+
+    uint8_t frame[sizeof(body) + 5] = {MQTT_CONNECT};
+    size_t header = 1 + put_length(frame + 1, length);
+    memcpy(frame + header, body, length);
+
+    uint8_t connack[4];
+    if (!write_all(link->fd, frame, header + length) || recv(link->fd, connack, sizeof(connack), MSG_WAITALL) != 4 ||
+        connack[0] != MQTT_CONNACK || connack[3] != 0)
+    {
+        fprintf(stderr, "broker %s refused the connection\n", broker);
+        simLinkClose(link);
+        return false;
+    }
+    return true;
+}
+
+void simLinkClose(SimLink *link)
+{
+    if (link->fd >= 0)
+    {
+        uint8_t disconnect[2] = {MQTT_DISCONNECT, 0};
+        write_all(link->fd, disconnect, sizeof(disconnect));
+        close(link->fd);
+        link->fd = -1;
+    }
+}
+
+int simLinkPublish(SimLink *link, const char *topic, const void *payload, size_t length)
+{
+    static _Thread_local uint8_t frame[MQTT_FRAME_MAX]; // One link per thread at a time
+    size_t topicLength = strlen(topic);
+    size_t remaining = 2 + topicLength + 2 + length;
+    if (remaining + 5 > sizeof(frame))
+    {
+        return -1;
+    }
+
+    link->packet_id = link->packet_id == UINT16_MAX ? 1 : link->packet_id + 1;
+    size_t offset = 0;
+    frame[offset++] = MQTT_PUBLISH_QOS1;
+    offset += put_length(frame + offset, remaining);
+    offset += put_string(frame + offset, topic);
+    frame[offset++] = link->packet_id >> 8;
+    frame[offset++] = link->packet_id & 0xff;
+    memcpy(frame + offset, payload, length);
+    offset += length;
+
+    return modem_write(link, frame, offset) ? link->packet_id : -1;
+}
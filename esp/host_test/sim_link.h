@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Stand-in for the modem, PPP and esp-mqtt layers of the firmware, so the
+ * telemetry pipeline can run as a Linux process.
+ *
+ * Writes are delayed and dropped the way a cellular uplink would, then
+ * either go to a real MQTT broker over TCP (e.g. a local mosquitto) or are
+ * discarded. MQTT is limited to what the tracker uses: CONNECT and QoS 1
+ * PUBLISH, acknowledgements are read and ignored like esp-mqtt's outbox
+ * would handle them asynchronously.
+ */
+
+typedef struct
+{
+    uint32_t latency_us;      ///< Base delay of every write
+    uint32_t jitter_us;       ///< Uniform extra delay on top of latency_us
+    float drop_rate;          ///< Probability a write is lost on the air
+    float stall_rate;         ///< Probability a write hits a stall (cell reselection, ...)
+    uint32_t stall_us;        ///< Length of a stall
+    uint32_t bytes_per_second; ///< Uplink throughput, 0 for unlimited
+} SimModemConfig;
+
+typedef struct
+{
+    SimModemConfig config;
+    int fd;             ///< Broker socket, -1 to discard everything
+    uint16_t packet_id; ///< Last MQTT packet identifier
+
+    uint32_t writes;
+    uint32_t dropped;
+    uint32_t stalls;
+    uint64_t bytes;
+} SimLink;
+
+/**
+ * Set up the link. With a NULL broker, messages are only counted.
+ *
+ * @param broker "host:port" of an MQTT broker, or NULL
+ * @return false if the broker could not be reached or refused the connection
+ */
+bool simLinkOpen(SimLink *link, const SimModemConfig *config, const char *broker, const char *clientId);
+
+void simLinkClose(SimLink *link);
+
+/**
+ * Publish like esp_mqtt_client_publish() with QoS 1.
+ *
+ * @return The packet identifier, or -1 if the message was lost
+ */
+int simLinkPublish(SimLink *link, const char *topic, const void *payload, size_t length);
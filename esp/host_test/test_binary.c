@@ -0,0 +1,144 @@
+/**
+ * Round-trips BmsStatus and Location through the binary wire format, checks
+ * version 1 messages still parse, and reports how many bytes it saves
+ * compared to the JSON documents.
+ *
+ * Usage: test_binary [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry.h"
+#include "telemetry_binary.h"
+#include "telemetry_json.h"
+
+static int compare_status(const BmsStatus *a, const BmsStatus *b)
+{
+    int cells = a->connected_cells;
+    if (a->state != b->state || a->chg_enable != b->chg_enable || a->dis_enable != b->dis_enable ||
+        a->connected_cells != b->connected_cells ||
+        memcmp(a->cell_voltages, b->cell_voltages, cells * sizeof(float)) != 0 ||
+        a->cell_voltage_max != b->cell_voltage_max || a->cell_voltage_min != b->cell_voltage_min ||
+        a->cell_voltage_avg != b->cell_voltage_avg || a->pack_voltage != b->pack_voltage ||
+        a->stack_voltage != b->stack_voltage || a->pack_current != b->pack_current ||
+        memcmp(a->bat_temps, b->bat_temps, sizeof(a->bat_temps)) != 0 ||
+        a->bat_temp_max != b->bat_temp_max || a->bat_temp_min != b->bat_temp_min ||
+        a->bat_temp_avg != b->bat_temp_avg || a->mosfet_temp != b->mosfet_temp ||
+        a->ic_temp != b->ic_temp || a->mcu_temp != b->mcu_temp || a->full != b->full ||
+        a->empty != b->empty || a->soc != b->soc || a->balancing_status != b->balancing_status ||
+        a->no_idle_timestamp != b->no_idle_timestamp || a->error_flags != b->error_flags ||
+        a->timestamp != b->timestamp || a->boot_id != b->boot_id || a->sequence != b->sequence ||
+        a->uptime_ms != b->uptime_ms)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+    int failures = 0;
+    size_t jsonBytes = 0;
+    size_t binaryBytes = 0;
+
+    srand(2);
+    for (int i = 0; i < iterations; i++)
+    {
+        BmsStatus status = generateRandomBmsStatus();
+        Location location = generateRandomLocation();
+        status.boot_id = location.boot_id = rand();
+        status.sequence = location.sequence = i;
+        status.uptime_ms = location.uptime_ms = (int64_t)rand() * 1000 + i;
+
+        uint8_t payload[BMS_STATUS_BINARY_MAX_LEN];
+        size_t length = convertBmsStatusToBinary(&status, payload, sizeof(payload));
+        BmsStatus decoded;
+        if (length == 0 || !parseBmsStatusBinary(payload, length, &decoded) || compare_status(&status, &decoded))
+        {
+            fprintf(stderr, "BmsStatus %d does not round-trip\n", i);
+            failures++;
+        }
+        // Every truncation has to be detected
+        if (parseBmsStatusBinary(payload, length - 1, &decoded))
+        {
+            fprintf(stderr, "truncated BmsStatus %d was accepted\n", i);
+            failures++;
+        }
+        binaryBytes += length;
+
+        uint8_t locationPayload[LOCATION_BINARY_LEN];
+        length = convertLocationToBinary(&location, locationPayload, sizeof(locationPayload));
+        Location decodedLocation;
+        if (length != LOCATION_BINARY_LEN || !parseLocationBinary(locationPayload, length, &decodedLocation) ||
+            decodedLocation.latitude != location.latitude || decodedLocation.longitude != location.longitude ||
+            decodedLocation.timestamp != location.timestamp || decodedLocation.boot_id != location.boot_id ||
+            decodedLocation.sequence != location.sequence || decodedLocation.uptime_ms != location.uptime_ms)
+        {
+            fprintf(stderr, "Location %d does not round-trip\n", i);
+            failures++;
+        }
+        binaryBytes += length;
+
+        // Version 1 ends before boot_id
+        length = convertBmsStatusToBinary(&status, payload, sizeof(payload));
+        payload[0] = 1;
+        BmsStatus untraced = status;
+        untraced.boot_id = untraced.sequence = untraced.uptime_ms = 0;
+        if (!parseBmsStatusBinary(payload, length - 16, &decoded) || compare_status(&untraced, &decoded))
+        {
+            fprintf(stderr, "version 1 BmsStatus %d was not parsed\n", i);
+            failures++;
+        }
+        locationPayload[0] = 1;
+        if (!parseLocationBinary(locationPayload, LOCATION_BINARY_LEN - 16, &decodedLocation) ||
+            decodedLocation.timestamp != location.timestamp || decodedLocation.boot_id != 0 ||
+            decodedLocation.uptime_ms != 0)
+        {
+            fprintf(stderr, "version 1 Location %d was not parsed\n", i);
+            failures++;
+        }
+
+        char json[BMS_STATUS_JSON_MAX_LEN];
+        jsonBytes += convertBmsStatusToJSON(&status, json, sizeof(json));
+        jsonBytes += convertLocationToJSON(&location, json, sizeof(json));
+    }
+
+    // A batch is the concatenation of the individual messages behind a small header
+    BmsStatus statuses[3];
+    Location locations[2];
+    uint8_t expected[BATCH_BINARY_MAX_LEN(3)] = {TELEMETRY_BINARY_VERSION, 3, 2};
+    size_t expectedLength = 3;
+    for (int i = 0; i < 3; i++)
+    {
+        statuses[i] = generateRandomBmsStatus();
+        expectedLength += convertBmsStatusToBinary(&statuses[i], expected + expectedLength, sizeof(expected) - expectedLength);
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        locations[i] = generateRandomLocation();
+        expectedLength += convertLocationToBinary(&locations[i], expected + expectedLength, sizeof(expected) - expectedLength);
+    }
+    uint8_t batch[BATCH_BINARY_MAX_LEN(3)];
+    size_t batchLength = convertBatchToBinary(statuses, 3, locations, 2, batch, sizeof(batch));
+    if (batchLength != expectedLength || memcmp(batch, expected, batchLength) != 0 ||
+        convertBatchToBinary(statuses, 3, locations, 2, batch, batchLength - 1) != 0)
+    {
+        fprintf(stderr, "binary batch does not match its messages\n");
+        failures++;
+    }
+
+    uint8_t wrongVersion[LOCATION_BINARY_LEN] = {TELEMETRY_BINARY_VERSION + 1};
+    Location location;
+    if (parseLocationBinary(wrongVersion, sizeof(wrongVersion), &location))
+    {
+        fprintf(stderr, "unknown version was accepted\n");
+        failures++;
+    }
+
+    printf("json %.1f bytes/sample, binary %.1f bytes/sample, %.1fx smaller\n",
+           (double)jsonBytes / iterations, (double)binaryBytes / iterations, (double)jsonBytes / binaryBytes);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,118 @@
+/**
+ * Checks the boot path helpers: registration and network time answers as
+ * modems send them, re-stamping of samples taken before the clock was set
+ * and the boot timeline.
+ *
+ * Usage: test_boot
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "telemetry_boot.h"
+
+static int failures;
+
+static void expect(int condition, const char *what)
+{
+    if (!condition)
+    {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static void check_registration(void)
+{
+    expect(bootParseRegistration("+CREG: 0,1"), "registered at home");
+    expect(bootParseRegistration("\r\n+CEREG: 2,5,\"1A2B\",\"01A2B3C4\",7\r\n"), "roaming with location");
+    expect(bootParseRegistration("+CGREG: 1"), "unsolicited registration");
+    expect(!bootParseRegistration("+CREG: 0,2"), "still searching");
+    expect(!bootParseRegistration("+CREG: 0,3"), "denied");
+    expect(!bootParseRegistration("+CREG: 1,0"), "not registered");
+    expect(!bootParseRegistration("ERROR"), "error");
+    expect(!bootParseRegistration("+CREG: ,"), "garbage");
+}
+
+static int64_t utc(int year, int month, int day, int hour, int minute, int second)
+{
+    struct tm tm = {.tm_year = year - 1900, .tm_mon = month - 1, .tm_mday = day,
+                    .tm_hour = hour, .tm_min = minute, .tm_sec = second};
+    return timegm(&tm);
+}
+
+static void check_network_time(void)
+{
+    int64_t time;
+    expect(bootParseNetworkTime("+CCLK: \"24/03/10,23:50:00+08\"", &time) && time == utc(2024, 3, 10, 21, 50, 0),
+           "CCLK two hours east");
+    expect(bootParseNetworkTime("\"25/01/01,00:30:15-20\"", &time) && time == utc(2025, 1, 1, 5, 30, 15),
+           "CCLK five hours west across midnight");
+    expect(bootParseNetworkTime("24/02/29,12:00:00+0", &time) && time == utc(2024, 2, 29, 12, 0, 0),
+           "CCLK leap day, one digit zone");
+    expect(!bootParseNetworkTime("+CCLK: \"80/01/06,00:01:12+00\"", &time), "modem default before registration");
+    expect(!bootParseNetworkTime("+CCLK: \"04/01/01,00:00:00+00\"", &time), "before CLOCK_VALID_AFTER");
+    expect(!bootParseNetworkTime("+CCLK: \"24/13/10,23:50:00+08\"", &time), "month out of range");
+    expect(!bootParseNetworkTime("+CCLK: \"24/03/10,23:50\"", &time), "truncated");
+    expect(!bootParseNetworkTime("ERROR", &time), "error");
+
+    // Every day of the years a tracker may see against the C library
+    for (int64_t day = utc(2020, 1, 1, 0, 0, 0); day < utc(2070, 1, 1, 0, 0, 0); day += 86400)
+    {
+        time_t t = (time_t)(day + 12 * 3600 + 34 * 60 + 56);
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        char cclk[32];
+        snprintf(cclk, sizeof(cclk), "%02d/%02d/%02d,%02d:%02d:%02d+00", tm.tm_year % 100, tm.tm_mon + 1,
+                 tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+        if (!bootParseNetworkTime(cclk, &time) || time != t)
+        {
+            printf("FAIL: %s parsed as %lld, expected %lld\n", cclk, (long long)time, (long long)t);
+            failures++;
+            break;
+        }
+    }
+}
+
+static void check_restamp(void)
+{
+    ClockSync clock;
+    clockSyncInit(&clock);
+    expect(!clockSyncIsSet(&clock), "clock not set at boot");
+    expect(clockSyncRestamp(&clock, 12) == 12, "nothing to re-stamp with before the clock is set");
+
+    // Network time 20 s after boot, SNTP moves it 3 s ahead a minute later
+    const int64_t bootUtc = utc(2024, 3, 10, 21, 49, 40);
+    expect(clockSyncStep(&clock, 20, bootUtc + 20, CLOCK_SOURCE_NETWORK) == bootUtc, "network step");
+    expect(clockSyncIsSet(&clock) && atomic_load(&clock.source) == CLOCK_SOURCE_NETWORK, "clock set");
+    expect(clockSyncRestamp(&clock, 12) == bootUtc + 12, "sample at 12 s re-stamped");
+    expect(clockSyncRestamp(&clock, bootUtc + 30) == bootUtc + 30, "valid sample unchanged");
+
+    expect(clockSyncStep(&clock, bootUtc + 80, bootUtc + 83, CLOCK_SOURCE_SNTP) == 3, "SNTP step");
+    expect(clockSyncRestamp(&clock, 12) == bootUtc + 15, "re-stamped with the refined clock");
+}
+
+static void check_timeline(void)
+{
+    BootTimeline timeline;
+    bootTimelineInit(&timeline);
+    expect(bootTimelineMs(&timeline, BOOT_REGISTERED, BOOT_FIRST_PUBLISH) == -1, "nothing reached");
+    expect(bootTimelineMark(&timeline, BOOT_MODEM_READY, 3200000), "modem ready");
+    expect(bootTimelineMark(&timeline, BOOT_REGISTERED, 9100000), "registered");
+    expect(bootTimelineMark(&timeline, BOOT_FIRST_PUBLISH, 12650000), "first publish");
+    expect(!bootTimelineMark(&timeline, BOOT_FIRST_PUBLISH, 22650000), "only the first publish counts");
+    expect(bootTimelineMs(&timeline, BOOT_REGISTERED, BOOT_FIRST_PUBLISH) == 3550, "registered to first publish");
+    expect(bootTimelineMs(&timeline, BOOT_MODEM_READY, BOOT_PPP_UP) == -1, "PPP not up");
+    expect(strcmp(bootMilestoneName(BOOT_MQTT_UP), "MQTT up") == 0, "milestone name");
+}
+
+int main(void)
+{
+    check_registration();
+    check_network_time();
+    check_restamp();
+    check_timeline();
+
+    printf("%s\n", failures ? "boot FAILED" : "boot OK");
+    return failures ? 1 : 0;
+}
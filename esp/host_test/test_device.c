@@ -0,0 +1,55 @@
+/**
+ * Checks the device ID and per-device topics against what the aggregator
+ * parses out of /bicycle/<device-id>/...
+ *
+ * Usage: test_device
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "telemetry_device.h"
+
+static int failures;
+
+static void expect(int condition, const char *what)
+{
+    if (!condition)
+    {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+int main(void)
+{
+    const uint8_t mac[6] = {0xa4, 0xcf, 0x12, 0xf3, 0xc0, 0xde};
+    char id[DEVICE_ID_MAX_LEN];
+    expect(deviceIdFromMac(mac, id, sizeof(id)) == 12 && strcmp(id, "a4cf12f3c0de") == 0, "ID from MAC");
+    expect(deviceIdFromMac(mac, id, 12) == 0, "ID from MAC into a short buffer");
+    expect(deviceIdIsValid("a4cf12f3c0de"), "MAC ID is valid");
+    expect(deviceIdIsValid("bike-17"), "provisioned ID is valid");
+
+    const char *invalid[] = {"", "bike/17", "bike+", "#", "bike 17", "bike\n", "0123456789abcdef0123456789abcdef"};
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        char what[64];
+        snprintf(what, sizeof(what), "\"%s\" is rejected", invalid[i]);
+        expect(!deviceIdIsValid(invalid[i]), what);
+    }
+
+    char topic[DEVICE_TOPIC_MAX_LEN];
+    expect(deviceTopic(topic, sizeof(topic), "a4cf12f3c0de", "battery-status/bin") > 0 &&
+               strcmp(topic, "/bicycle/a4cf12f3c0de/battery-status/bin") == 0,
+           "battery topic");
+    expect(deviceTopic(topic, 16, "a4cf12f3c0de", "battery-status") == 0, "topic into a short buffer");
+
+    // The longest ID has to fit with the longest suffix
+    char longest[DEVICE_ID_MAX_LEN];
+    memset(longest, 'x', sizeof(longest) - 1);
+    longest[sizeof(longest) - 1] = '\0';
+    expect(deviceIdIsValid(longest), "longest ID is valid");
+    expect(deviceTopic(topic, sizeof(topic), longest, "gps-coordinates/bin") > 0, "longest topic fits");
+
+    printf("%s\n", failures ? "device topics FAILED" : "device topics OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,382 @@
+/**
+ * Checks the compact sample history: every measurement comes back within
+ * half a quantization step, unpacking and packing again gives the same
+ * record for every code, out of range values are clamped, and the ring
+ * keeps the newest samples with exact timestamps, boot ID and uptimes.
+ * Then replays a simulated ride through the ring, which must give back
+ * every record exactly, and reports how many samples fit in the RAM of
+ * BmsStatus copies, with and without the boot_id, sequence and uptime_ms
+ * fields.
+ *
+ * Usage: test_history [iterations]
+ */
+#include <inttypes.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry_history.h"
+
+#define BASE 1700000000
+#define BOOT_ID 0xdeadbeef
+#define UPTIME 0x1fffff000LL // Low 32 bits wrap between the ring samples
+#define DEPTH 8 // Random samples do not fit a slot, each one is kept in full
+#define RIDE_SAMPLES 2000
+#define SMALL_SLOTS 7 // Records kept in full wrap around the end
+#define RAM_BYTES (64 * 1024)
+
+static int failures;
+
+static void expect(int condition, const char *what)
+{
+    if (!condition)
+    {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Half a step, and the float rounding of the value itself
+static void expect_within(float actual, float expected, float step, const char *what)
+{
+    if (fabsf(actual - expected) > step / 2 + fabsf(expected) * 2e-7f)
+    {
+        printf("FAIL: %s %.6f instead of %.6f\n", what, actual, expected);
+        failures++;
+    }
+}
+
+static BmsStatus random_status(int64_t timestamp)
+{
+    BmsStatus status = generateRandomBmsStatus();
+    status.pack_current = ((float)rand() / RAND_MAX) * 200.0f - 100.0f;
+    status.bat_temps[0] = ((float)rand() / RAND_MAX) * 120.0f - 40.0f;
+    status.balancing_status &= (1u << BOARD_NUM_CELLS_MAX) - 1;
+    status.timestamp = timestamp;
+    status.no_idle_timestamp = timestamp - rand() % 100000;
+    status.boot_id = BOOT_ID;
+    status.sequence = rand();
+    status.uptime_ms = UPTIME + (timestamp - BASE) * 1000;
+    return status;
+}
+
+static void check_bounds(long iterations)
+{
+    for (long n = 0; n < iterations; n++)
+    {
+        BmsStatus status = random_status(BASE + n);
+        HistoryRecord record;
+        BmsStatus unpacked;
+        expect(historyPack(&status, BASE, &record), "pack");
+        historyUnpack(&record, BASE, &unpacked);
+
+        expect(unpacked.timestamp == status.timestamp, "timestamp");
+        expect(unpacked.no_idle_timestamp == status.no_idle_timestamp, "no_idle_timestamp");
+        expect(unpacked.state == status.state && unpacked.chg_enable == status.chg_enable &&
+                   unpacked.dis_enable == status.dis_enable && unpacked.full == status.full &&
+                   unpacked.empty == status.empty,
+               "state and flags");
+        expect(unpacked.connected_cells == status.connected_cells, "connected_cells");
+        expect(unpacked.balancing_status == status.balancing_status, "balancing_status");
+        expect(unpacked.error_flags == status.error_flags, "error_flags");
+        expect(unpacked.sequence == status.sequence, "sequence");
+        expect(unpacked.uptime_ms == (uint32_t)status.uptime_ms, "low bits of uptime_ms");
+
+        for (int i = 0; i < status.connected_cells; i++)
+        {
+            expect_within(unpacked.cell_voltages[i], status.cell_voltages[i], 0.001f, "cell voltage");
+        }
+        expect_within(unpacked.cell_voltage_max, status.cell_voltage_max, 0.001f, "cell_voltage_max");
+        expect_within(unpacked.cell_voltage_min, status.cell_voltage_min, 0.001f, "cell_voltage_min");
+        expect_within(unpacked.cell_voltage_avg, status.cell_voltage_avg, 0.001f, "cell_voltage_avg");
+        expect_within(unpacked.pack_voltage, status.pack_voltage, 0.001f, "pack_voltage");
+        expect_within(unpacked.stack_voltage, status.stack_voltage, 0.001f, "stack_voltage");
+        expect_within(unpacked.pack_current, status.pack_current, 0.01f, "pack_current");
+        expect_within(unpacked.soc, status.soc, 0.01f, "soc");
+        for (int i = 0; i < BOARD_NUM_THERMISTORS_MAX; i++)
+        {
+            expect_within(unpacked.bat_temps[i], status.bat_temps[i], 0.1f, "bat_temps");
+        }
+        expect_within(unpacked.bat_temp_max, status.bat_temp_max, 0.1f, "bat_temp_max");
+        expect_within(unpacked.bat_temp_min, status.bat_temp_min, 0.1f, "bat_temp_min");
+        expect_within(unpacked.bat_temp_avg, status.bat_temp_avg, 0.1f, "bat_temp_avg");
+        expect_within(unpacked.mosfet_temp, status.mosfet_temp, 0.1f, "mosfet_temp");
+        expect_within(unpacked.ic_temp, status.ic_temp, 0.1f, "ic_temp");
+        expect_within(unpacked.mcu_temp, status.mcu_temp, 0.1f, "mcu_temp");
+
+        // A kept sample encodes the same every time
+        HistoryRecord again;
+        memset(&again, 0, sizeof(again));
+        historyPack(&unpacked, BASE, &again);
+        expect(memcmp(&record, &again, sizeof(record)) == 0, "pack after unpack");
+    }
+}
+
+// Every code of every field survives unpack and pack
+static void check_codes(void)
+{
+    HistoryRecord record;
+    memset(&record, 0, sizeof(record));
+    record.flags = BOARD_NUM_CELLS_MAX << 4;
+    for (int32_t code = 0; code <= UINT16_MAX; code++)
+    {
+        for (int i = 0; i < BOARD_NUM_CELLS_MAX; i++)
+        {
+            record.cell_mv[i] = code;
+        }
+        record.cell_max_mv = record.cell_min_mv = record.cell_avg_mv = code;
+        record.pack_mv = record.stack_mv = record.soc_centi = code;
+        record.current_10ma = code + INT16_MIN;
+        for (int i = 0; i < BOARD_NUM_THERMISTORS_MAX; i++)
+        {
+            record.bat_temp_dd[i] = code + INT16_MIN;
+        }
+        record.bat_temp_max_dd = record.bat_temp_min_dd = record.bat_temp_avg_dd = code + INT16_MIN;
+        record.mosfet_temp_dd = record.ic_temp_dd = record.mcu_temp_dd = code + INT16_MIN;
+
+        BmsStatus status;
+        HistoryRecord again;
+        memset(&again, 0, sizeof(again));
+        historyUnpack(&record, BASE, &status);
+        historyPack(&status, BASE, &again);
+        if (memcmp(&record, &again, sizeof(record)) != 0)
+        {
+            printf("FAIL: code %ld changed\n", (long)code);
+            failures++;
+            return;
+        }
+    }
+}
+
+static void check_clamping(void)
+{
+    BmsStatus status = random_status(BASE);
+    status.connected_cells = BOARD_NUM_CELLS_MAX + 3;
+    status.cell_voltages[0] = -1.0f;
+    status.cell_voltages[1] = NAN;
+    status.pack_voltage = 70.0f;
+    status.pack_current = -400.0f;
+    status.bat_temp_max = 5000.0f;
+
+    HistoryRecord record;
+    expect(historyPack(&status, BASE, &record), "pack out of range values");
+    expect(record.flags >> 4 == BOARD_NUM_CELLS_MAX, "connected_cells clamped");
+    expect(record.cell_mv[0] == 0 && record.cell_mv[1] == 0, "negative and NaN voltage clamped to 0");
+    expect(record.pack_mv == UINT16_MAX, "pack_voltage clamped");
+    expect(record.current_10ma == INT16_MIN, "pack_current clamped");
+    expect(record.bat_temp_max_dd == INT16_MAX, "temperature clamped");
+
+    expect(!historyPack(&status, BASE + 1, &record), "timestamp before the base");
+    status.timestamp = BASE + 0x100000000LL;
+    expect(!historyPack(&status, BASE, &record), "timestamp past the offset");
+}
+
+static void check_ring(void)
+{
+    static HistorySlot slots[DEPTH * HISTORY_RECORD_SLOTS];
+    HistoryRing ring;
+    BmsStatus status;
+
+    historyRingInit(&ring, slots, DEPTH * HISTORY_RECORD_SLOTS);
+    expect(!historyRingPop(&ring, &status), "empty ring");
+
+    for (int i = 0; i < 20; i++)
+    {
+        BmsStatus sample = random_status(BASE + 10 * i);
+        sample.state = i;
+        expect(historyRingPush(&ring, &sample), "push");
+    }
+    expect(ring.count == DEPTH && ring.overwritten == 20 - DEPTH, "newest samples kept");
+    expect(historyRingGet(&ring, DEPTH - 1, &status) && status.state == 19, "newest sample");
+    expect(!historyRingGet(&ring, DEPTH, &status), "past the newest sample");
+    for (int i = 0; i < DEPTH; i++)
+    {
+        historyRingGet(&ring, i, &status);
+        expect(status.boot_id == BOOT_ID && status.uptime_ms == UPTIME + 10000LL * (20 - DEPTH + i),
+               "boot ID and uptime across the 32 bit wrap");
+    }
+    BmsStatus rebooted = random_status(BASE + 1000);
+    rebooted.boot_id = BOOT_ID + 1;
+    expect(!historyRingPush(&ring, &rebooted), "sample of another boot");
+
+    // A sample from before the base moves it back, the others keep their timestamps
+    BmsStatus early = random_status(BASE - 3600);
+    early.state = 100;
+    expect(historyRingPush(&ring, &early), "push an earlier sample");
+    expect(ring.base == BASE - 3600, "base moved back");
+    for (int i = 13; i < 20; i++)
+    {
+        expect(historyRingPop(&ring, &status) && status.state == i && status.timestamp == BASE + 10 * i,
+               "oldest first with exact timestamps");
+    }
+    expect(historyRingPop(&ring, &status) && status.state == 100 && status.timestamp == BASE - 3600,
+           "earlier sample last");
+    expect(ring.count == 0, "drained");
+
+    BmsStatus far = random_status(BASE);
+    expect(historyRingPush(&ring, &far), "push after draining");
+    expect(ring.base == BASE, "empty ring takes the next timestamp as base");
+    far.timestamp = BASE - 0x100000000LL;
+    expect(!historyRingPush(&ring, &far), "sample too far back");
+}
+
+// A sample n of a ride sampled every 10 s, measurements drift slowly around their last values
+static BmsStatus ride_status(int n)
+{
+    static int64_t noIdle = BASE;
+    static uint32_t sequence;
+
+    BmsStatus status;
+    memset(&status, 0, sizeof(status));
+    status.state = n < RIDE_SAMPLES / 2 ? 3 : 4; // Changes once, then the record is kept in full
+    status.chg_enable = true;
+    status.dis_enable = rand() % 50 > 0;
+    status.connected_cells = BOARD_NUM_CELLS_MAX;
+    status.balancing_status = rand() & ((1u << BOARD_NUM_CELLS_MAX) - 1);
+    status.pack_current = 15.0f * sinf(n * 0.05f) + ((float)rand() / RAND_MAX) - 0.5f;
+
+    float average = 4.1f - 0.0003f * n + 0.002f * status.pack_current;
+    float sum = 0;
+    status.cell_voltage_max = 0;
+    status.cell_voltage_min = 5;
+    for (int i = 0; i < BOARD_NUM_CELLS_MAX; i++)
+    {
+        status.cell_voltages[i] = average + 0.004f * i + ((float)rand() / RAND_MAX) * 0.01f;
+        sum += status.cell_voltages[i];
+        status.cell_voltage_max = fmaxf(status.cell_voltage_max, status.cell_voltages[i]);
+        status.cell_voltage_min = fminf(status.cell_voltage_min, status.cell_voltages[i]);
+    }
+    status.cell_voltage_avg = sum / BOARD_NUM_CELLS_MAX;
+    status.stack_voltage = sum + ((float)rand() / RAND_MAX) * 0.01f;
+    status.pack_voltage = status.stack_voltage + 0.003f * status.pack_current;
+    status.soc = 95.0f - 0.02f * n;
+
+    for (int i = 0; i < BOARD_NUM_THERMISTORS_MAX; i++)
+    {
+        status.bat_temps[i] = 25.0f + 5.0f * sinf(n * 0.01f) + i + ((float)rand() / RAND_MAX) * 0.3f;
+    }
+    status.bat_temp_max = fmaxf(status.bat_temps[0], status.bat_temps[BOARD_NUM_THERMISTORS_MAX - 1]);
+    status.bat_temp_min = fminf(status.bat_temps[0], status.bat_temps[BOARD_NUM_THERMISTORS_MAX - 1]);
+    status.bat_temp_avg = (status.bat_temp_max + status.bat_temp_min) / 2;
+    status.mosfet_temp = status.bat_temp_max + fabsf(status.pack_current) * 0.5f;
+    status.ic_temp = 30.0f + ((float)rand() / RAND_MAX) * 0.5f;
+    status.mcu_temp = 35.0f + ((float)rand() / RAND_MAX) * 0.5f;
+
+    status.timestamp = BASE + 10 * n;
+    noIdle = fabsf(status.pack_current) > 2.0f ? status.timestamp : noIdle;
+    status.no_idle_timestamp = noIdle;
+    status.boot_id = BOOT_ID;
+    sequence += rand() % 20 > 0 ? 1 : 2; // Alarms skip a number
+    status.sequence = sequence;
+    status.uptime_ms = UPTIME + 10000LL * n + rand() % 1000;
+    return status;
+}
+
+// The sample as the ring gives it back
+static BmsStatus kept(const BmsStatus *status, int64_t base)
+{
+    HistoryRecord record;
+    BmsStatus expected;
+    historyPack(status, base, &record);
+    historyUnpack(&record, base, &expected);
+    expected.boot_id = status->boot_id;
+    expected.uptime_ms = status->uptime_ms;
+    return expected;
+}
+
+static void expect_kept(const BmsStatus *actual, const BmsStatus *status, int64_t base, const char *what)
+{
+    BmsStatus expected = kept(status, base);
+    expect(memcmp(actual, &expected, sizeof(expected)) == 0, what);
+}
+
+static void check_ride(void)
+{
+    static HistorySlot slots[RAM_BYTES / sizeof(HistorySlot)];
+    static BmsStatus samples[RIDE_SAMPLES];
+    HistoryRing ring;
+    BmsStatus status;
+
+    historyRingInit(&ring, slots, RAM_BYTES / sizeof(HistorySlot));
+    for (int n = 0; n < RIDE_SAMPLES; n++)
+    {
+        samples[n] = ride_status(n);
+        expect(historyRingPush(&ring, &samples[n]), "push ride sample");
+    }
+    uint32_t full = (ring.used - ring.count) / (HISTORY_RECORD_SLOTS - 1);
+    expect(ring.overwritten == 0, "ride fits");
+    expect(full == 2, "only the first sample and the state change kept in full");
+
+    size_t withMeta = (size_t)ring.used * sizeof(HistorySlot);
+    size_t metaBytes = sizeof(((HistorySlot *)0)->sequence) + sizeof(((HistorySlot *)0)->uptime_ms);
+    size_t withoutMeta = withMeta - (ring.count - full) * metaBytes - full * 2 * sizeof(uint32_t);
+    double ratio = (double)sizeof(BmsStatus) * ring.count / withMeta;
+    double ratioWithoutMeta = (double)offsetof(BmsStatus, boot_id) * ring.count / withoutMeta;
+    printf("Ride: %" PRIu32 " samples in %" PRIu32 " slots of %zu bytes, %.1f bytes per sample (%.1fx), "
+           "%.1f without sequence and uptime_ms against %zu bytes of BmsStatus without them (%.1fx)\n",
+           ring.count, ring.used, sizeof(HistorySlot), (double)withMeta / ring.count, ratio,
+           (double)withoutMeta / ring.count, offsetof(BmsStatus, boot_id), ratioWithoutMeta);
+    expect(ratio >= 4.0 && ratioWithoutMeta >= 4.0, "four times the samples");
+
+    for (int n = 0; n < RIDE_SAMPLES; n++)
+    {
+        expect(historyRingPop(&ring, &status), "pop ride sample");
+        expect_kept(&status, &samples[n], BASE, "ride sample decoded exactly");
+    }
+    expect(ring.count == 0 && ring.used == 0, "ride drained");
+
+    // A small ring overwrites differences and records kept in full alike
+    static HistorySlot small[SMALL_SLOTS];
+    historyRingInit(&ring, small, SMALL_SLOTS);
+    for (int n = 0; n < 60; n++)
+    {
+        samples[n] = ride_status(n);
+        samples[n].state = n / 9; // Kept in full now and then
+        expect(historyRingPush(&ring, &samples[n]), "push to the small ring");
+        for (uint32_t i = 0; i < ring.count; i++)
+        {
+            expect(historyRingGet(&ring, i, &status), "get from the small ring");
+            expect_kept(&status, &samples[n + 1 - ring.count + i], ring.base, "newest samples after overwriting");
+        }
+        expect(ring.used <= SMALL_SLOTS && ring.count + ring.overwritten == (uint32_t)n + 1, "slots accounted");
+    }
+
+    // A sample from before the base shifts the records kept in full, the differences stay
+    BmsStatus early = ride_status(0);
+    early.state = 59 / 9;
+    early.timestamp = BASE - 600;
+    expect(historyRingPush(&ring, &early), "push an earlier sample");
+    expect(ring.base == BASE - 600, "base moved back");
+    uint32_t count = ring.count;
+    for (uint32_t i = 0; i + 1 < count; i++)
+    {
+        expect(historyRingPop(&ring, &status), "pop after moving the base");
+        expect_kept(&status, &samples[60 - count + 1 + i], BASE - 600, "samples after moving the base");
+    }
+    expect(historyRingPop(&ring, &status) && status.timestamp == BASE - 600, "earlier sample last");
+
+    HistorySlot tiny[HISTORY_RECORD_SLOTS - 1];
+    historyRingInit(&ring, tiny, HISTORY_RECORD_SLOTS - 1);
+    expect(!historyRingPush(&ring, &early), "ring smaller than a record");
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 100000;
+
+    srand(1);
+    check_bounds(iterations);
+    check_codes();
+    check_clamping();
+    check_ring();
+    check_ride();
+
+    printf("BmsStatus %zu bytes, HistoryRecord %zu bytes, HistorySlot %zu bytes: %zu vs %zu to %zu samples in %d KiB\n",
+           sizeof(BmsStatus), sizeof(HistoryRecord), sizeof(HistorySlot), RAM_BYTES / sizeof(BmsStatus),
+           RAM_BYTES / (HISTORY_RECORD_SLOTS * sizeof(HistorySlot)), RAM_BYTES / sizeof(HistorySlot), RAM_BYTES / 1024);
+
+    printf("%s\n", failures ? "history FAILED" : "history OK");
+    return failures ? 1 : 0;
+}
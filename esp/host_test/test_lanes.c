@@ -0,0 +1,258 @@
+/**
+ * Checks the priority lanes: payloads survive the byte ring wrapping, every
+ * queued message is sent, dropped or coalesced exactly once, and the budget
+ * holds. Then replays an outage with an alarm in the middle, once through a
+ * single FIFO like the plain MQTT outbox and once through the lanes, and
+ * reports how long the alarm waited after the reconnect.
+ *
+ * Usage: test_lanes [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry_lanes.h"
+
+#define BUDGET 1024
+#define CAPACITY 16
+
+#define ROUTINE_BUDGET 4096
+#define ROUTINE_CAPACITY 64
+#define STATUS_BYTES 130
+#define LOCATION_BYTES 24
+#define OUTAGE_S 600
+#define ALARM_AT_S 300
+#define SENDS_PER_S 5
+
+enum
+{
+    KEY_STATUS = 1,
+    KEY_LOCATION = 2,
+};
+
+static int failures;
+
+static void expect(int condition, const char *what)
+{
+    if (!condition)
+    {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static void fill(uint8_t *payload, uint32_t length, uint32_t id)
+{
+    for (uint32_t i = 0; i < length; i++)
+    {
+        payload[i] = (uint8_t)(id * 31 + i);
+    }
+}
+
+static int intact(const uint8_t *payload, uint32_t length, uint32_t id)
+{
+    for (uint32_t i = 0; i < length; i++)
+    {
+        if (payload[i] != (uint8_t)(id * 31 + i))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void check_basics(void)
+{
+    static uint8_t buffer[BUDGET];
+    static LaneMessage messages[CAPACITY];
+    SendLane lane;
+    uint8_t payload[BUDGET + 1];
+
+    expect(!sendLaneInit(&lane, LANE_DROP_OLDEST, buffer, BUDGET, messages, 12), "capacity must be a power of two");
+    expect(sendLaneInit(&lane, LANE_DROP_OLDEST, buffer, BUDGET, messages, CAPACITY), "init");
+    expect(sendLanePeek(&lane) == NULL, "empty lane");
+    expect(!sendLanePush(&lane, 0, 0, payload, BUDGET + 1, 0), "larger than the budget");
+    expect(lane.counters.dropped == 1, "oversized payload counted as dropped");
+
+    // Drop oldest: 300 bytes neither fit behind two 400 byte payloads nor in front of the first
+    fill(payload, 400, 1);
+    sendLanePush(&lane, 0, 0, payload, 400, 1);
+    fill(payload, 400, 2);
+    sendLanePush(&lane, 0, 0, payload, 400, 2);
+    fill(payload, 300, 3);
+    sendLanePush(&lane, 0, 0, payload, 300, 3);
+    const LaneMessage *message = sendLanePeek(&lane);
+    expect(message != NULL && message->enqueued_us == 2 && intact(sendLanePayload(&lane, message), 400, 2),
+           "oldest evicted");
+    expect(lane.counters.dropped == 2 && lane.bytes == 700, "drop counted");
+    sendLanePop(&lane);
+    message = sendLanePeek(&lane);
+    expect(message != NULL && message->offset == 0 && intact(sendLanePayload(&lane, message), 300, 3),
+           "wrapped to the start of the buffer");
+    sendLanePop(&lane);
+
+    // Coalesce latest: only the newest message per key stays
+    SendLane latest;
+    sendLaneInit(&latest, LANE_COALESCE_LATEST, buffer, BUDGET, messages, CAPACITY);
+    for (uint32_t id = 1; id <= 5; id++)
+    {
+        fill(payload, 50, id);
+        sendLanePush(&latest, 0, id % 2 ? KEY_STATUS : KEY_LOCATION, payload, 50, id);
+    }
+    message = sendLanePeek(&latest);
+    expect(message != NULL && message->enqueued_us == 4 && message->key == KEY_LOCATION, "latest location first");
+    sendLanePop(&latest);
+    message = sendLanePeek(&latest);
+    expect(message != NULL && message->enqueued_us == 5 && intact(sendLanePayload(&latest, message), 50, 5),
+           "latest status");
+    sendLanePop(&latest);
+    expect(sendLanePeek(&latest) == NULL, "coalesced lane drained");
+    expect(latest.counters.coalesced == 3 && latest.counters.sent == 2 && latest.bytes == 0, "coalesce counted");
+}
+
+// Random pushes and pops against the bookkeeping every message has to satisfy
+static void check_random(SendLane *lane, LanePolicy policy, long iterations)
+{
+    static uint8_t buffer[BUDGET];
+    static LaneMessage messages[CAPACITY];
+    uint8_t payload[BUDGET];
+    sendLaneInit(lane, policy, buffer, BUDGET, messages, CAPACITY);
+
+    uint32_t nextId = 1;
+    int64_t lastPopped = 0;
+    for (long i = 0; i < iterations; i++)
+    {
+        if (rand() % 3)
+        {
+            uint32_t length = 1 + rand() % (rand() % 8 ? 120 : BUDGET);
+            fill(payload, length, nextId);
+            expect(sendLanePush(lane, 0, rand() % 4, payload, length, nextId), "push");
+            nextId++;
+        }
+        else
+        {
+            const LaneMessage *message = sendLanePeek(lane);
+            if (message != NULL)
+            {
+                uint32_t id = (uint32_t)message->enqueued_us;
+                if (!intact(sendLanePayload(lane, message), message->length, id) || message->enqueued_us <= lastPopped)
+                {
+                    printf("FAIL: message %u corrupted or out of order\n", id);
+                    failures++;
+                    return;
+                }
+                lastPopped = message->enqueued_us;
+                sendLanePop(lane);
+            }
+        }
+
+        uint32_t live = 0;
+        uint32_t bytes = 0;
+        for (uint32_t j = 0; j < lane->count; j++)
+        {
+            const LaneMessage *message = &lane->messages[(lane->head + j) & (lane->capacity - 1)];
+            if (message->live)
+            {
+                live++;
+                bytes += message->length;
+            }
+        }
+        const LaneCounters *counters = &lane->counters;
+        if (bytes != lane->bytes || bytes > BUDGET ||
+            counters->enqueued != counters->sent + counters->dropped + counters->coalesced + live)
+        {
+            printf("FAIL: %s bookkeeping after %ld operations\n",
+                   policy == LANE_DROP_OLDEST ? "drop-oldest" : "coalesce-latest", i);
+            failures++;
+            return;
+        }
+    }
+}
+
+typedef struct
+{
+    const char *name;
+    int lanes; ///< 1: everything in one FIFO like the MQTT outbox
+    LanePolicy policy;
+    uint32_t budget;
+} Scenario;
+
+static void replay(const Scenario *scenario)
+{
+    static uint8_t buffers[LANE_COUNT][1 << 20];
+    static LaneMessage messages[LANE_COUNT][4096];
+    SendLane lanes[LANE_COUNT];
+    uint8_t payload[STATUS_BYTES];
+    memset(payload, 0, sizeof(payload));
+
+    sendLaneInit(&lanes[LANE_ALARM], LANE_DROP_OLDEST, buffers[LANE_ALARM], 1024, messages[LANE_ALARM], 8);
+    sendLaneInit(&lanes[LANE_ROUTINE], scenario->policy, buffers[LANE_ROUTINE], scenario->budget,
+                 messages[LANE_ROUTINE], scenario->lanes == 1 ? 4096 : ROUTINE_CAPACITY);
+    SendLane *alarmLane = scenario->lanes == 1 ? &lanes[LANE_ROUTINE] : &lanes[LANE_ALARM];
+
+    int64_t alarmSentAt = -1;
+    uint32_t peakBytes = 0;
+    for (int64_t now = 0; now < OUTAGE_S * 3 && alarmSentAt < 0; now++)
+    {
+        sendLanePush(&lanes[LANE_ROUTINE], 0, KEY_STATUS, payload, STATUS_BYTES, now);
+        sendLanePush(&lanes[LANE_ROUTINE], 1, KEY_LOCATION, payload, LOCATION_BYTES, now);
+        if (now == ALARM_AT_S)
+        {
+            sendLanePush(alarmLane, 2, 0, payload, STATUS_BYTES, now);
+        }
+        uint32_t bytes = lanes[LANE_ALARM].bytes + lanes[LANE_ROUTINE].bytes;
+        peakBytes = bytes > peakBytes ? bytes : peakBytes;
+
+        for (int sent = 0; now >= OUTAGE_S && sent < SENDS_PER_S; sent++)
+        {
+            SendLane *lane = sendLanePeek(&lanes[LANE_ALARM]) ? &lanes[LANE_ALARM] : &lanes[LANE_ROUTINE];
+            const LaneMessage *message = sendLanePeek(lane);
+            if (message == NULL)
+            {
+                break;
+            }
+            if (message->topic == 2)
+            {
+                alarmSentAt = now;
+            }
+            sendLanePop(lane);
+        }
+    }
+
+    const LaneCounters *routine = &lanes[LANE_ROUTINE].counters;
+    printf("%-16s alarm out %4lld s after the reconnect, peak %7u bytes queued, routine %5u dropped, %5u coalesced\n",
+           scenario->name, (long long)(alarmSentAt - OUTAGE_S), peakBytes, routine->dropped, routine->coalesced);
+
+    if (scenario->lanes > 1)
+    {
+        char what[96];
+        snprintf(what, sizeof(what), "%s sends the alarm right after the reconnect", scenario->name);
+        expect(alarmSentAt == OUTAGE_S, what);
+        snprintf(what, sizeof(what), "%s stays within its budget", scenario->name);
+        expect(peakBytes <= 1024 + scenario->budget, what);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 200000;
+
+    srand(1);
+    check_basics();
+    SendLane lane;
+    check_random(&lane, LANE_DROP_OLDEST, iterations);
+    check_random(&lane, LANE_COALESCE_LATEST, iterations);
+
+    const Scenario scenarios[] = {
+        {.name = "single FIFO", .lanes = 1, .policy = LANE_DROP_OLDEST, .budget = 1 << 20},
+        {.name = "drop-oldest", .lanes = 2, .policy = LANE_DROP_OLDEST, .budget = ROUTINE_BUDGET},
+        {.name = "coalesce-latest", .lanes = 2, .policy = LANE_COALESCE_LATEST, .budget = ROUTINE_BUDGET},
+    };
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+    {
+        replay(&scenarios[i]);
+    }
+
+    printf("%s\n", failures ? "lanes FAILED" : "lanes OK");
+    return failures ? 1 : 0;
+}
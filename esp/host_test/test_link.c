@@ -0,0 +1,272 @@
+/**
+ * Runs the duty-cycling link manager against a simulated modem for a day
+ * of samples and reports the radio-on time per hour against keeping PPP
+ * up permanently.
+ *
+ * The simulated DCE takes a few seconds to answer AT after power-on and to
+ * attach, sometimes never does, and sometimes drops the link mid-flush.
+ * No sample may be lost, none may wait longer than the maximum interval
+ * plus one failed window, alarms must go out within one wake-up, and the
+ * adaptive interval must keep the radio off most of the time.
+ *
+ * Usage: test_link [hours]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry_link.h"
+
+#define STEP_US 100000LL // Simulation resolution
+#define US_PER_S 1000000LL
+#define SAMPLE_PERIOD_S 10
+#define BUFFER_CAPACITY 4096
+#define SAMPLE_BYTES 130
+#define ALARM_EVERY_S 7200
+
+typedef struct
+{
+    const char *name;
+    LinkConfig config;
+    float max_radio_on_per_hour; ///< s, the test fails above it
+} Scenario;
+
+typedef struct
+{
+    double wake_s[2];   ///< Power-on to AT answer, uniform range
+    double attach_s[2]; ///< Data mode to PPP address
+    double mqtt_s[2];   ///< MQTT CONNECT to CONNACK
+    double fail_rate;   ///< Chance a step never completes
+    double lost_rate;   ///< Chance the link drops during a flush
+    double bytes_per_second;
+} SimDce;
+
+typedef struct
+{
+    // Buffered sample timestamps, oldest first
+    int64_t samples[BUFFER_CAPACITY];
+    size_t head;
+    size_t count;
+    int64_t pending_alarm_us; ///< Oldest alarm not sent yet, -1 for none
+
+    LinkEvent next_event;
+    int64_t next_event_us; ///< -1 when the DCE is not going to answer
+    size_t flushing;       ///< Samples sent by the current flush
+
+    uint64_t sent;
+    uint64_t lost;
+    int64_t max_latency_us;
+    int64_t max_alarm_latency_us;
+} Sim;
+
+static const SimDce dce = {
+    .wake_s = {3, 6},
+    .attach_s = {2, 8},
+    .mqtt_s = {0.3, 1.5},
+    .fail_rate = 0.03,
+    .lost_rate = 0.02,
+    .bytes_per_second = 2000,
+};
+
+static double uniform(const double range[2])
+{
+    return range[0] + (range[1] - range[0]) * rand() / RAND_MAX;
+}
+
+static void schedule(Sim *sim, LinkEvent event, int64_t now_us, double seconds)
+{
+    sim->next_event = event;
+    sim->next_event_us = (double)rand() / RAND_MAX < dce.fail_rate ? -1 : now_us + (int64_t)(seconds * US_PER_S);
+}
+
+static void carry_out(Sim *sim, LinkAction action, int64_t now_us)
+{
+    switch (action)
+    {
+    case LINK_ACTION_NONE:
+        break;
+    case LINK_ACTION_POWER_ON:
+        schedule(sim, LINK_EVENT_MODEM_READY, now_us, uniform(dce.wake_s));
+        break;
+    case LINK_ACTION_START_PPP:
+        schedule(sim, LINK_EVENT_PPP_UP, now_us, uniform(dce.attach_s));
+        break;
+    case LINK_ACTION_START_MQTT:
+        schedule(sim, LINK_EVENT_MQTT_UP, now_us, uniform(dce.mqtt_s));
+        break;
+    case LINK_ACTION_FLUSH:
+        sim->flushing = sim->count;
+        if ((double)rand() / RAND_MAX < dce.lost_rate)
+        {
+            sim->flushing = 0;
+            sim->next_event = LINK_EVENT_LOST;
+            sim->next_event_us = now_us + US_PER_S;
+        }
+        else
+        {
+            sim->next_event = LINK_EVENT_FLUSHED;
+            sim->next_event_us = now_us + (int64_t)(0.3 * US_PER_S + sim->count * SAMPLE_BYTES * US_PER_S /
+                                                                          dce.bytes_per_second);
+        }
+        break;
+    case LINK_ACTION_RELEASE:
+        sim->next_event = LINK_EVENT_RELEASED;
+        sim->next_event_us = now_us + US_PER_S / 2;
+        break;
+    case LINK_ACTION_POWER_OFF:
+        sim->next_event_us = -1;
+        break;
+    }
+}
+
+static void flushed(Sim *sim, int64_t now_us)
+{
+    for (size_t i = 0; i < sim->flushing; i++)
+    {
+        int64_t latency = now_us - sim->samples[sim->head];
+        if (latency > sim->max_latency_us)
+        {
+            sim->max_latency_us = latency;
+        }
+        sim->head = (sim->head + 1) % BUFFER_CAPACITY;
+    }
+    sim->count -= sim->flushing;
+    sim->sent += sim->flushing;
+    sim->flushing = 0;
+
+    if (sim->pending_alarm_us >= 0)
+    {
+        int64_t latency = now_us - sim->pending_alarm_us;
+        if (latency > sim->max_alarm_latency_us)
+        {
+            sim->max_alarm_latency_us = latency;
+        }
+        sim->pending_alarm_us = -1;
+    }
+}
+
+static int run(const Scenario *scenario, double hours)
+{
+    srand(1);
+    static Sim sim;
+    memset(&sim, 0, sizeof(sim));
+    sim.next_event_us = -1;
+    sim.pending_alarm_us = -1;
+
+    LinkManager link;
+    linkInit(&link, &scenario->config, 0);
+
+    const int64_t end_us = (int64_t)(hours * 3600 * US_PER_S);
+    int64_t next_sample_us = 0;
+    int64_t next_alarm_us = ALARM_EVERY_S / 2 * US_PER_S;
+    uint32_t minInterval = UINT32_MAX, maxInterval = 0;
+
+    for (int64_t now = 0; now < end_us; now += STEP_US)
+    {
+        if (now >= next_sample_us)
+        {
+            if (sim.count == BUFFER_CAPACITY)
+            {
+                sim.lost++;
+            }
+            else
+            {
+                sim.samples[(sim.head + sim.count++) % BUFFER_CAPACITY] = now;
+            }
+            linkSetBuffered(&link, sim.count);
+            next_sample_us += SAMPLE_PERIOD_S * US_PER_S;
+        }
+        if (now >= next_alarm_us)
+        {
+            if (sim.pending_alarm_us < 0)
+            {
+                sim.pending_alarm_us = now;
+            }
+            linkRequestUpload(&link);
+            next_alarm_us += ALARM_EVERY_S * US_PER_S;
+        }
+
+        LinkEvent event = LINK_EVENT_TICK;
+        if (sim.next_event_us >= 0 && now >= sim.next_event_us)
+        {
+            event = sim.next_event;
+            sim.next_event_us = -1;
+            if (event == LINK_EVENT_FLUSHED)
+            {
+                flushed(&sim, now);
+            }
+        }
+        carry_out(&sim, linkHandle(&link, event, now), now);
+
+        if (link.wake_cost_us > 0)
+        {
+            minInterval = link.interval_s < minInterval ? link.interval_s : minInterval;
+            maxInterval = link.interval_s > maxInterval ? link.interval_s : maxInterval;
+        }
+    }
+
+    const LinkConfig *config = &scenario->config;
+    float radioOn = linkRadioOnPerHour(&link, end_us);
+    int64_t latencyBound = ((int64_t)config->max_interval_s * 2 + 4 * config->wake_timeout_s + 2 * config->flush_timeout_s) *
+                           US_PER_S;
+    int64_t alarmBound = (int64_t)(6 * config->wake_timeout_s + 2 * config->flush_timeout_s) * US_PER_S;
+
+    printf("%-10s %8.1f s/h radio on (%4.1f%%), %5u windows, %3u failed, wake cost %4.1f s, interval %u-%u s, "
+           "max latency %5.0f s, max alarm latency %4.0f s, %llu sent, %llu lost\n",
+           scenario->name, radioOn, radioOn / 36, link.windows, link.failures, link.wake_cost_us / 1e6, minInterval,
+           maxInterval, sim.max_latency_us / 1e6, sim.max_alarm_latency_us / 1e6, (unsigned long long)sim.sent,
+           (unsigned long long)sim.lost);
+
+    int failures = 0;
+    if (sim.lost > 0)
+    {
+        printf("FAIL: %s lost samples\n", scenario->name);
+        failures++;
+    }
+    if (sim.max_latency_us > latencyBound)
+    {
+        printf("FAIL: %s held a sample for %.0f s\n", scenario->name, sim.max_latency_us / 1e6);
+        failures++;
+    }
+    if (sim.max_alarm_latency_us > alarmBound)
+    {
+        printf("FAIL: %s took %.0f s to send an alarm\n", scenario->name, sim.max_alarm_latency_us / 1e6);
+        failures++;
+    }
+    if (radioOn > scenario->max_radio_on_per_hour)
+    {
+        printf("FAIL: %s radio on for %.1f s/h, expected at most %.1f\n", scenario->name, radioOn,
+               scenario->max_radio_on_per_hour);
+        failures++;
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    double hours = argc > 1 ? atof(argv[1]) : 24;
+
+    const Scenario scenarios[] = {
+        {
+            .name = "fixed-60s",
+            .config = {.min_interval_s = 60, .max_interval_s = 60, .overhead_percent = 0, .wake_timeout_s = 30,
+                       .flush_timeout_s = 60, .buffer_high_water = 0},
+            .max_radio_on_per_hour = 1800,
+        },
+        {
+            .name = "adaptive",
+            .config = {.min_interval_s = 60, .max_interval_s = 900, .overhead_percent = 5, .wake_timeout_s = 30,
+                       .flush_timeout_s = 60, .buffer_high_water = 2048},
+            .max_radio_on_per_hour = 3600 * 0.15f,
+        },
+    };
+
+    printf("always-on    3600.0 s/h radio on (100.0%%)\n");
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+    {
+        failures += run(&scenarios[i], hours);
+    }
+    printf("%s\n", failures ? "link manager FAILED" : "link manager OK");
+    return failures ? 1 : 0;
+}
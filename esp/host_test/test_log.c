@@ -0,0 +1,426 @@
+/**
+ * Exercises the flash telemetry log on a simulated NOR flash: writes can only
+ * clear bits, erases set whole sectors to 0xff, and power can be cut after
+ * any number of programmed bytes. After every cut the log is remounted and
+ * checked for lost, reordered, corrupted or resurrected records. Records
+ * read ahead and handed to MQTT are only consumed once acknowledged, in
+ * order, and read again after a reboot or a rewind.
+ *
+ * Usage: test_log [trials]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry_log.h"
+
+#define SECTORS 8
+#define FLASH_SIZE (SECTORS * TELEMETRY_LOG_SECTOR_SIZE)
+
+typedef struct
+{
+    uint8_t data[FLASH_SIZE];
+    long budget; ///< Bytes that can still be programmed or erased before power is lost, -1 for unlimited
+    uint32_t erases[SECTORS];
+} SimFlash;
+
+static bool power_lost(SimFlash *flash, size_t *length)
+{
+    if (flash->budget < 0)
+    {
+        return false;
+    }
+    if ((long)*length <= flash->budget)
+    {
+        flash->budget -= *length;
+        return false;
+    }
+    *length = flash->budget;
+    flash->budget = 0;
+    return true;
+}
+
+static int sim_read(void *ctx, uint32_t offset, void *dst, size_t length)
+{
+    SimFlash *flash = ctx;
+    memcpy(dst, flash->data + offset, length);
+    return 0;
+}
+
+static int sim_write(void *ctx, uint32_t offset, const void *src, size_t length)
+{
+    SimFlash *flash = ctx;
+    bool lost = power_lost(flash, &length);
+    const uint8_t *bytes = src;
+    for (size_t i = 0; i < length; i++)
+    {
+        flash->data[offset + i] &= bytes[i];
+    }
+    return lost ? -1 : 0;
+}
+
+static int sim_erase(void *ctx, uint32_t offset)
+{
+    SimFlash *flash = ctx;
+    size_t length = TELEMETRY_LOG_SECTOR_SIZE;
+    bool lost = power_lost(flash, &length);
+    memset(flash->data + offset, 0xff, length);
+    flash->erases[offset / TELEMETRY_LOG_SECTOR_SIZE]++;
+    return lost ? -1 : 0;
+}
+
+static SimFlash flash;
+
+static TelemetryLogFlash sim_flash(void)
+{
+    TelemetryLogFlash ops = {
+        .read = sim_read,
+        .write = sim_write,
+        .erase_sector = sim_erase,
+        .ctx = &flash,
+        .size = FLASH_SIZE,
+    };
+    return ops;
+}
+
+// Records carry their sequence number and a length and filler derived from it
+static size_t make_record(uint32_t sequence, uint8_t *buffer)
+{
+    size_t length = 8 + sequence * 7 % 120;
+    memcpy(buffer, &sequence, sizeof(sequence));
+    for (size_t i = sizeof(sequence); i < length; i++)
+    {
+        buffer[i] = (uint8_t)(sequence + i);
+    }
+    return length;
+}
+
+static bool check_record(const uint8_t *buffer, size_t length, uint32_t *sequence)
+{
+    uint8_t expected[TELEMETRY_LOG_MAX_RECORD_LEN];
+    memcpy(sequence, buffer, sizeof(*sequence));
+    return length == make_record(*sequence, expected) && memcmp(buffer, expected, length) == 0;
+}
+
+/**
+ * Append and consume records until power is cut, then verify that after a
+ * remount the log holds exactly the records that were acknowledged and not
+ * yet consumed, allowing only the record in flight at the cut to differ.
+ */
+static int power_loss_trial(unsigned seed)
+{
+    srand(seed);
+    memset(flash.data, 0xff, sizeof(flash.data));
+    flash.budget = -1;
+
+    TelemetryLog log;
+    TelemetryLogFlash ops = sim_flash();
+    telemetryLogMount(&log, &ops);
+
+    // Run a few cycles first so the cut can land anywhere in the ring
+    uint32_t appended = 0;  // Next sequence to append
+    uint32_t consumed = 0;  // Records confirmed consumed
+    for (int i = rand() % 400; i > 0; i--)
+    {
+        uint8_t buffer[TELEMETRY_LOG_MAX_RECORD_LEN];
+        telemetryLogAppend(&log, 1, buffer, make_record(appended++, buffer));
+        if (rand() % 3 == 0)
+        {
+            uint8_t type;
+            while (telemetryLogPeek(&log, &type, buffer, sizeof(buffer)) && rand() % 4 != 0)
+            {
+                telemetryLogPop(&log);
+                consumed++;
+            }
+        }
+    }
+
+    flash.budget = rand() % 3000;
+    uint32_t in_flight_append = UINT32_MAX;
+    uint32_t in_flight_pop = UINT32_MAX;
+    while (flash.budget > 0)
+    {
+        uint8_t buffer[TELEMETRY_LOG_MAX_RECORD_LEN];
+        if (rand() % 2)
+        {
+            in_flight_append = appended;
+            if (telemetryLogAppend(&log, 1, buffer, make_record(appended, buffer)))
+            {
+                in_flight_append = UINT32_MAX;
+            }
+            appended++;
+        }
+        else
+        {
+            uint8_t type;
+            if (telemetryLogPeek(&log, &type, buffer, sizeof(buffer)))
+            {
+                in_flight_pop = consumed;
+                if (telemetryLogPop(&log))
+                {
+                    in_flight_pop = UINT32_MAX;
+                    consumed++;
+                }
+            }
+        }
+    }
+    uint32_t dropped = log.dropped;
+
+    flash.budget = -1;
+    if (!telemetryLogMount(&log, &ops))
+    {
+        fprintf(stderr, "seed %u: remount failed\n", seed);
+        return 1;
+    }
+
+    // Without drops the log must hold exactly the records from the last
+    // consumed one onwards, give or take the records in flight at the cut
+    uint32_t expected = in_flight_pop != UINT32_MAX ? in_flight_pop : consumed;
+    uint32_t previous = UINT32_MAX;
+    uint8_t buffer[TELEMETRY_LOG_MAX_RECORD_LEN];
+    uint8_t type;
+    size_t length;
+    while ((length = telemetryLogPeek(&log, &type, buffer, sizeof(buffer))) > 0)
+    {
+        uint32_t sequence;
+        if (type != 1 || !check_record(buffer, length, &sequence) || sequence >= appended)
+        {
+            fprintf(stderr, "seed %u: corrupted record returned\n", seed);
+            return 1;
+        }
+        if (previous != UINT32_MAX && sequence <= previous)
+        {
+            fprintf(stderr, "seed %u: record %u after %u\n", seed, sequence, previous);
+            return 1;
+        }
+        if (dropped == 0)
+        {
+            // A torn append may still be complete if its tail bytes were 0xff
+            if (expected == in_flight_append && sequence != expected)
+            {
+                expected++;
+            }
+            if (sequence != expected)
+            {
+                fprintf(stderr, "seed %u: got record %u, expected %u\n", seed, sequence, expected);
+                return 1;
+            }
+            expected++;
+        }
+        previous = sequence;
+        telemetryLogPop(&log);
+    }
+
+    // Every acknowledged append must have survived
+    uint32_t newest = in_flight_append == appended - 1 ? appended - 2 : appended - 1;
+    if (newest != UINT32_MAX && newest >= consumed && previous != newest && previous != in_flight_append)
+    {
+        fprintf(stderr, "seed %u: log ended at %u, newest acknowledged record is %u\n", seed, previous, newest);
+        return 1;
+    }
+    return 0;
+}
+
+// Keep the log busy long enough to wrap many times and compare sector wear
+static int wear_trial(void)
+{
+    memset(flash.data, 0xff, sizeof(flash.data));
+    memset(flash.erases, 0, sizeof(flash.erases));
+    flash.budget = -1;
+
+    TelemetryLog log;
+    TelemetryLogFlash ops = sim_flash();
+    telemetryLogMount(&log, &ops);
+
+    uint8_t buffer[TELEMETRY_LOG_MAX_RECORD_LEN];
+    uint8_t type;
+    for (uint32_t sequence = 0; sequence < 20000; sequence++)
+    {
+        telemetryLogAppend(&log, 1, buffer, make_record(sequence, buffer));
+        if (sequence % 5000 == 0)
+        {
+            // Remount now and then, rotation has to carry on where it stopped
+            telemetryLogMount(&log, &ops);
+        }
+        if (sequence % 3 == 0)
+        {
+            while (telemetryLogPeek(&log, &type, buffer, sizeof(buffer)))
+            {
+                telemetryLogPop(&log);
+            }
+        }
+    }
+
+    uint32_t min = UINT32_MAX, max = 0;
+    for (int i = 0; i < SECTORS; i++)
+    {
+        min = flash.erases[i] < min ? flash.erases[i] : min;
+        max = flash.erases[i] > max ? flash.erases[i] : max;
+    }
+    printf("wear: %u..%u erases per sector, max erase count %u\n", min, max, telemetryLogMaxEraseCount(&log));
+    if (max - min > 1)
+    {
+        fprintf(stderr, "uneven wear\n");
+        return 1;
+    }
+
+    // Overfill without consuming: only the newest records survive, in order
+    uint32_t first = 100000;
+    for (uint32_t sequence = first; sequence < first + 2000; sequence++)
+    {
+        telemetryLogAppend(&log, 1, buffer, make_record(sequence, buffer));
+    }
+    if (log.dropped == 0)
+    {
+        fprintf(stderr, "overfilled log did not drop anything\n");
+        return 1;
+    }
+    uint32_t previous = 0;
+    size_t length;
+    while ((length = telemetryLogPeek(&log, &type, buffer, sizeof(buffer))) > 0)
+    {
+        uint32_t sequence;
+        if (!check_record(buffer, length, &sequence) || sequence <= previous)
+        {
+            fprintf(stderr, "overfilled log returned records out of order\n");
+            return 1;
+        }
+        previous = sequence;
+        telemetryLogPop(&log);
+    }
+    if (previous != first + 1999)
+    {
+        fprintf(stderr, "overfilled log lost the newest record\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int expect_read(TelemetryLog *log, uint32_t expected, const char *what)
+{
+    uint8_t buffer[TELEMETRY_LOG_MAX_RECORD_LEN];
+    uint8_t type;
+    uint32_t sequence;
+    size_t length = telemetryLogRead(log, &type, buffer, sizeof(buffer));
+    if (length == 0 || !check_record(buffer, length, &sequence) || sequence != expected)
+    {
+        fprintf(stderr, "%s: did not read record %u\n", what, expected);
+        return 1;
+    }
+    return 0;
+}
+
+static int read_ahead_trial(void)
+{
+    TelemetryLog log;
+    LogInFlight flight;
+    TelemetryLogFlash ops = sim_flash();
+    uint8_t buffer[TELEMETRY_LOG_MAX_RECORD_LEN];
+    int failures = 0;
+
+    memset(flash.data, 0xff, sizeof(flash.data));
+    flash.budget = -1;
+    telemetryLogMount(&log, &ops);
+    logInFlightInit(&flight);
+    for (uint32_t sequence = 0; sequence < 100; sequence++)
+    {
+        telemetryLogAppend(&log, 1, buffer, make_record(sequence, buffer));
+    }
+
+    // Ten records out, PUBACKs for 0 to 2 and 4: only 0 to 2 are consumed
+    for (uint32_t sequence = 0; sequence < 10; sequence++)
+    {
+        failures += expect_read(&log, sequence, "read ahead");
+        logInFlightSent(&flight, 100 + sequence, sequence);
+    }
+    logInFlightAcked(&flight, 101);
+    logInFlightAcked(&flight, 100);
+    logInFlightAcked(&flight, 104);
+    logInFlightAcked(&flight, 102);
+    logInFlightAcked(&flight, 999);
+    for (uint32_t completed = logInFlightCompleted(&flight); completed > 0; completed--)
+    {
+        telemetryLogPop(&log);
+    }
+    if (log.pending != 97 || log.unread != 90 || flight.count != 7)
+    {
+        fprintf(stderr, "acknowledged: %u pending, %u unread, %u in flight\n", log.pending, log.unread, flight.count);
+        failures++;
+    }
+    if (!logInFlightExpired(&flight, 3 + 30001, 30000) || logInFlightExpired(&flight, 3 + 30000, 30000))
+    {
+        fprintf(stderr, "expiry of the oldest record\n");
+        failures++;
+    }
+    failures += expect_read(&log, 10, "read on");
+
+    // A reboot reads everything that was not acknowledged again
+    telemetryLogMount(&log, &ops);
+    if (log.pending != 97 || log.unread != 97)
+    {
+        fprintf(stderr, "remounted: %u pending, %u unread\n", log.pending, log.unread);
+        failures++;
+    }
+    failures += expect_read(&log, 3, "after the reboot");
+    failures += expect_read(&log, 4, "after the reboot");
+    telemetryLogRewind(&log);
+    failures += expect_read(&log, 3, "after a rewind");
+
+    // Consuming without reading ahead moves the read cursor along
+    telemetryLogRewind(&log);
+    telemetryLogPop(&log);
+    failures += expect_read(&log, 4, "after a pop");
+
+    // Dropping a sector while records are out reads the survivors again
+    for (uint32_t sequence = 1000; log.dropped == 0; sequence++)
+    {
+        telemetryLogAppend(&log, 1, buffer, make_record(sequence, buffer));
+    }
+    uint8_t type;
+    uint32_t oldest;
+    size_t length = telemetryLogPeek(&log, &type, buffer, sizeof(buffer));
+    if (log.unread != log.pending || !check_record(buffer, length, &oldest))
+    {
+        fprintf(stderr, "no rewind after a dropped sector\n");
+        failures++;
+    }
+    else
+    {
+        failures += expect_read(&log, oldest, "after a dropped sector");
+    }
+
+    logInFlightClear(&flight);
+    if (flight.count != 0 || logInFlightCompleted(&flight) != 0 || logInFlightExpired(&flight, 1000000, 0))
+    {
+        fprintf(stderr, "cleared records still in flight\n");
+        failures++;
+    }
+    for (uint32_t i = 0; i < LOG_IN_FLIGHT_SLOTS; i++)
+    {
+        logInFlightSent(&flight, 0, 0);
+    }
+    if (logInFlightSent(&flight, 1, 0) || logInFlightCompleted(&flight) != LOG_IN_FLIGHT_SLOTS)
+    {
+        fprintf(stderr, "records without a PUBACK\n");
+        failures++;
+    }
+
+    printf("read ahead: %s\n", failures ? "FAILED" : "OK");
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    int trials = argc > 1 ? atoi(argv[1]) : 10000;
+    int failures = 0;
+
+    for (int seed = 1; seed <= trials; seed++)
+    {
+        failures += power_loss_trial(seed);
+    }
+    printf("power loss: %d of %d trials failed\n", failures, trials);
+
+    failures += wear_trial();
+    failures += read_ahead_trial();
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,200 @@
+/**
+ * Checks the metrics registry: histogram buckets, counts recorded from
+ * several threads at once, the snapshot layout and reset, and PUBACK
+ * matching. Prints a fixed snapshot as hex, which is the golden payload of
+ * the aggregator's decoder test.
+ *
+ * Usage: test_metrics [records per thread]
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry_metrics.h"
+
+#define THREADS 4
+
+static int failures;
+static MetricsRegistry metrics;
+static long recordsPerThread = 100000;
+
+static void expect(int condition, const char *what)
+{
+    if (!condition)
+    {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static uint32_t get_u32(const uint8_t *at)
+{
+    return at[0] | at[1] << 8 | at[2] << 16 | (uint32_t)at[3] << 24;
+}
+
+static void *recorder(void *arg)
+{
+    uint32_t seed = (uint32_t)(uintptr_t)arg;
+    for (long i = 0; i < recordsPerThread; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        metricsRecord(&metrics, METRIC_PUBLISH_US, seed >> 20);
+        metricsCount(&metrics, METRIC_PUBLISHED, 1);
+    }
+    return NULL;
+}
+
+static void check_buckets(void)
+{
+    expect(metricsBucket(0) == 0, "0 in bucket 0");
+    expect(metricsBucket(1) == 1, "1 in bucket 1");
+    expect(metricsBucket(2) == 2 && metricsBucket(3) == 2, "2-3 in bucket 2");
+    expect(metricsBucket(1000) == 10, "1000 in bucket 10");
+    expect(metricsBucket(UINT32_MAX) == METRIC_HISTOGRAM_BUCKETS - 1, "overflow in the last bucket");
+}
+
+static void check_concurrent_records(void)
+{
+    metricsInit(&metrics);
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; i++)
+    {
+        pthread_create(&threads[i], NULL, recorder, (void *)(uintptr_t)(i + 1));
+    }
+    for (int i = 0; i < THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    uint32_t bucketTotal = 0;
+    for (int i = 0; i < METRIC_HISTOGRAM_BUCKETS; i++)
+    {
+        bucketTotal += atomic_load(&metrics.histograms[METRIC_PUBLISH_US].buckets[i]);
+    }
+    uint32_t expected = THREADS * recordsPerThread;
+    expect(atomic_load(&metrics.histograms[METRIC_PUBLISH_US].count) == expected, "histogram count");
+    expect(bucketTotal == expected, "bucket total");
+    expect(atomic_load(&metrics.counters[METRIC_PUBLISHED]) == expected, "counter");
+    expect(atomic_load(&metrics.histograms[METRIC_PUBLISH_US].max) < 4096, "max below 2^12");
+}
+
+static void check_snapshot(void)
+{
+    metricsInit(&metrics);
+    metricsCount(&metrics, METRIC_PUBLISHED, 118);
+    metricsCount(&metrics, METRIC_PUBLISH_FAILED, 2);
+    metricsCount(&metrics, METRIC_PUBACKS, 117);
+    metricsCount(&metrics, METRIC_MQTT_DISCONNECTS, 1);
+    metricsCount(&metrics, METRIC_PPP_RECONNECTS, 1);
+    metricsCount(&metrics, METRIC_PPP_DOWNTIME_MS, 4250);
+    metricsCount(&metrics, METRIC_ROUTINE_DROPPED, 12);
+    metricsCount(&metrics, METRIC_MQTT_CONNECTS, 2);
+    metricsCount(&metrics, METRIC_SESSIONS_PRESENT, 1);
+    metricsCount(&metrics, METRIC_TLS_RESUMED, 1);
+    metricsSet(&metrics, METRIC_OUTBOX_BYTES, 310);
+    metricsSet(&metrics, METRIC_FREE_HEAP, 182344);
+    metricsSet(&metrics, METRIC_MIN_FREE_HEAP, 171020);
+    metricsSet(&metrics, METRIC_UPLINK_STACK_FREE, 1260);
+    metricsSet(&metrics, METRIC_SAMPLER_STACK_FREE, 980);
+    metricsSet(&metrics, METRIC_RSSI, 17);
+    metricsSet(&metrics, METRIC_BOOT_TO_PUBLISH_MS, 14250);
+    metricsSet(&metrics, METRIC_REGISTERED_TO_PUBLISH_MS, 3550);
+    metricsSet(&metrics, METRIC_ROUTINE_QUEUED_BYTES, 1240);
+    const uint32_t encode[] = {180, 210, 195};
+    const uint32_t publish[] = {900, 15000};
+    const uint32_t puback[] = {420, 380, 2900};
+    const uint32_t alarmQueue[] = {3};
+    const uint32_t connectMs[] = {2350, 980};
+    const uint32_t connectBytes[] = {2456, 797};
+    for (size_t i = 0; i < sizeof(encode) / sizeof(encode[0]); i++)
+    {
+        metricsRecord(&metrics, METRIC_ENCODE_US, encode[i]);
+    }
+    for (size_t i = 0; i < sizeof(publish) / sizeof(publish[0]); i++)
+    {
+        metricsRecord(&metrics, METRIC_PUBLISH_US, publish[i]);
+    }
+    for (size_t i = 0; i < sizeof(puback) / sizeof(puback[0]); i++)
+    {
+        metricsRecord(&metrics, METRIC_PUBACK_MS, puback[i]);
+    }
+    for (size_t i = 0; i < sizeof(alarmQueue) / sizeof(alarmQueue[0]); i++)
+    {
+        metricsRecord(&metrics, METRIC_ALARM_QUEUE_MS, alarmQueue[i]);
+    }
+    for (size_t i = 0; i < sizeof(connectMs) / sizeof(connectMs[0]); i++)
+    {
+        metricsRecord(&metrics, METRIC_CONNECT_MS, connectMs[i]);
+        metricsRecord(&metrics, METRIC_CONNECT_BYTES, connectBytes[i]);
+    }
+
+    uint8_t small[METRICS_SNAPSHOT_LEN - 1];
+    expect(metricsSnapshot(&metrics, 600, 1700000000, small, sizeof(small)) == 0, "snapshot into a short buffer");
+
+    uint8_t snapshot[METRICS_SNAPSHOT_LEN];
+    size_t length = metricsSnapshot(&metrics, 600, 1700000000, snapshot, sizeof(snapshot));
+    expect(length == METRICS_SNAPSHOT_LEN, "snapshot length");
+    expect(snapshot[0] == METRICS_SNAPSHOT_VERSION && snapshot[1] == METRIC_COUNTER_COUNT &&
+               snapshot[2] == METRIC_GAUGE_COUNT && snapshot[3] == METRIC_HISTOGRAM_COUNT &&
+               snapshot[4] == METRIC_HISTOGRAM_BUCKETS,
+           "snapshot header");
+    expect(get_u32(snapshot + 5) == 600 && get_u32(snapshot + 9) == 600, "uptime and interval");
+    expect(get_u32(snapshot + 21) == 118, "first counter");
+
+    printf("snapshot (%zu bytes): ", length);
+    for (size_t i = 0; i < length; i++)
+    {
+        printf("%02x", snapshot[i]);
+    }
+    printf("\n");
+
+    // Counters and histograms restart, gauges and the interval carry on
+    metricsCount(&metrics, METRIC_PUBLISHED, 3);
+    length = metricsSnapshot(&metrics, 900, 1700000300, snapshot, sizeof(snapshot));
+    size_t gauges = 21 + 4 * METRIC_COUNTER_COUNT;
+    size_t histograms = gauges + 4 * METRIC_GAUGE_COUNT;
+    expect(get_u32(snapshot + 9) == 300, "second interval");
+    expect(get_u32(snapshot + 21) == 3, "counter reset");
+    expect(get_u32(snapshot + gauges + 4 * METRIC_FREE_HEAP) == 182344, "gauge kept");
+    expect(get_u32(snapshot + histograms) == 0, "histogram reset");
+}
+
+static void check_puback_tracker(void)
+{
+    PubackTracker tracker;
+    pubackTrackerInit(&tracker);
+    int64_t rtt;
+
+    pubackTrackerSent(&tracker, 7, 1000);
+    pubackTrackerSent(&tracker, 8, 2000);
+    pubackTrackerSent(&tracker, 0, 2500); // QoS 0
+    expect(pubackTrackerAcked(&tracker, 8, 2600, &rtt) && rtt == 600, "PUBACK 8");
+    expect(pubackTrackerAcked(&tracker, 7, 5000, &rtt) && rtt == 4000, "PUBACK 7");
+    expect(!pubackTrackerAcked(&tracker, 7, 5000, &rtt), "duplicate PUBACK");
+    expect(!pubackTrackerAcked(&tracker, 9, 5000, &rtt), "untracked PUBACK");
+
+    // More publishes in flight than slots: the oldest ones are forgotten
+    for (int id = 100; id < 100 + PUBACK_TRACKER_SLOTS + 4; id++)
+    {
+        pubackTrackerSent(&tracker, id, id);
+    }
+    expect(!pubackTrackerAcked(&tracker, 100, 200, &rtt), "forgotten PUBACK");
+    expect(pubackTrackerAcked(&tracker, 119, 200, &rtt) && rtt == 81, "recent PUBACK");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        recordsPerThread = atol(argv[1]);
+    }
+
+    check_buckets();
+    check_concurrent_records();
+    check_snapshot();
+    check_puback_tracker();
+
+    printf("%s\n", failures ? "metrics FAILED" : "metrics OK");
+    return failures ? 1 : 0;
+}
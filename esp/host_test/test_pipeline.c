@@ -0,0 +1,187 @@
+/**
+ * Drives the sample ring from two threads, like the sampler and uplink
+ * tasks on the device.
+ *
+ * The stress run pushes and pops as fast as possible with both drop
+ * policies and checks that records arrive in order, untorn, and that every
+ * record is either delivered or counted as dropped.
+ *
+ * The stall run samples at a fixed period while the consumer simulates
+ * modem stalls far longer than the period, and reports how far the sample
+ * times drift from the schedule.
+ *
+ * Usage: test_pipeline [records]
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "telemetry_pipeline.h"
+
+#define RING_CAPACITY 64
+#define SAMPLE_PERIOD_US 2000
+#define STALL_SAMPLES 1500
+#define MAX_JITTER_US 50000 // Generous for a loaded host, still well below the 200 ms stalls
+
+typedef struct
+{
+    SampleRing ring;
+    uint32_t records;
+    bool paced;          ///< Sample on SAMPLE_PERIOD_US instead of as fast as possible
+    atomic_bool done;    ///< Set by the producer after its last push
+    SampleJitter jitter; ///< Producer side
+    uint32_t accepted;   ///< Producer side
+    uint32_t popped;     ///< Consumer side
+    uint32_t errors;     ///< Consumer side
+} Run;
+
+static SampleRecord storage[RING_CAPACITY];
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleep_until_us(int64_t deadline)
+{
+    struct timespec ts = {.tv_sec = deadline / 1000000, .tv_nsec = (deadline % 1000000) * 1000};
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static void *producer(void *arg)
+{
+    Run *run = arg;
+    int64_t start = now_us();
+    for (uint32_t i = 0; i < run->records; i++)
+    {
+        if (run->paced)
+        {
+            int64_t scheduled = start + (int64_t)i * SAMPLE_PERIOD_US;
+            sleep_until_us(scheduled);
+            sampleJitterAdd(&run->jitter, scheduled, now_us());
+        }
+
+        SampleRecord record;
+        memset(&record, 0, sizeof(record));
+        record.type = SAMPLE_BMS_STATUS;
+        record.sequence = i;
+        record.status.timestamp = i;
+        record.status.balancing_status = ~i;
+        run->accepted += sampleRingPush(&run->ring, &record);
+    }
+    atomic_store(&run->done, true);
+    return NULL;
+}
+
+static void *consumer(void *arg)
+{
+    Run *run = arg;
+    int64_t lastSequence = -1;
+    SampleRecord record;
+    while (1)
+    {
+        bool done = atomic_load(&run->done);
+        if (!sampleRingPop(&run->ring, &record))
+        {
+            if (done)
+            {
+                break;
+            }
+            // The uplink task blocks on a notification instead of spinning
+            if (run->paced)
+            {
+                sleep_until_us(now_us() + 200);
+            }
+            else
+            {
+                sched_yield();
+            }
+            continue;
+        }
+
+        run->popped++;
+        if ((int64_t)record.sequence <= lastSequence || record.status.timestamp != (time_t)record.sequence ||
+            record.status.balancing_status != ~record.sequence)
+        {
+            run->errors++;
+        }
+        lastSequence = record.sequence;
+
+        if (run->paced && rand() % 200 == 0)
+        {
+            // Modem stall
+            sleep_until_us(now_us() + 50000 + rand() % 150000);
+        }
+    }
+    return NULL;
+}
+
+static int run_ring(const char *name, uint32_t records, bool paced, SampleRingDropPolicy policy)
+{
+    static Run run;
+    memset(&run, 0, sizeof(run));
+    srand(1); // Same stalls for both policies
+    sampleRingInit(&run.ring, storage, RING_CAPACITY, policy);
+    run.records = records;
+    run.paced = paced;
+    atomic_init(&run.done, false);
+
+    pthread_t threads[2];
+    pthread_create(&threads[1], NULL, consumer, &run);
+    pthread_create(&threads[0], NULL, producer, &run);
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+
+    uint32_t overflows = atomic_load(&run.ring.overflows);
+    uint32_t dropped = atomic_load(&run.ring.dropped);
+    printf("  %-26s %8u pushed %8u delivered %8u dropped %8u overflows", name, records, run.popped, dropped,
+           overflows);
+    if (paced)
+    {
+        printf("  jitter max %5.2f ms mean %5.3f ms", run.jitter.max_us / 1000.0,
+               run.jitter.total_us / 1000.0 / run.jitter.samples);
+    }
+    printf("\n");
+
+    int failures = 0;
+    if (run.errors)
+    {
+        fprintf(stderr, "%s: %u records out of order or torn\n", name, run.errors);
+        failures++;
+    }
+    if (run.popped + dropped != records)
+    {
+        fprintf(stderr, "%s: %u delivered + %u dropped != %u pushed\n", name, run.popped, dropped, records);
+        failures++;
+    }
+    if (policy == SAMPLE_RING_DROP_NEWEST && run.accepted != run.popped)
+    {
+        fprintf(stderr, "%s: %u accepted but %u delivered\n", name, run.accepted, run.popped);
+        failures++;
+    }
+    if (paced && run.jitter.max_us > MAX_JITTER_US)
+    {
+        fprintf(stderr, "%s: sample jitter %.2f ms\n", name, run.jitter.max_us / 1000.0);
+        failures++;
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t records = argc > 1 ? (uint32_t)atoi(argv[1]) : 1000000;
+    int failures = 0;
+
+    printf("ring of %d records\n", RING_CAPACITY);
+    failures += run_ring("stress, drop newest", records, false, SAMPLE_RING_DROP_NEWEST);
+    failures += run_ring("stress, drop oldest", records, false, SAMPLE_RING_DROP_OLDEST);
+    failures += run_ring("modem stalls, drop newest", STALL_SAMPLES, true, SAMPLE_RING_DROP_NEWEST);
+    failures += run_ring("modem stalls, drop oldest", STALL_SAMPLES, true, SAMPLE_RING_DROP_OLDEST);
+
+    return failures ? 1 : 0;
+}
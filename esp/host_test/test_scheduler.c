@@ -0,0 +1,159 @@
+/**
+ * Runs the change-driven publish scheduler over a simulated fleet day and
+ * reports the messages sent against the fixed period. Idle bikes must send
+ * at least ten times fewer BmsStatus messages, and every alarm has to be
+ * published on the sample it appears in.
+ *
+ * Usage: test_scheduler [bikes]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry_scheduler.h"
+
+#define PERIOD 10 // s, default CONFIG_MESSAGE_PERIOD
+#define DAY_SAMPLES (24 * 3600 / PERIOD)
+
+static const PublishThresholds thresholds = {
+    .soc = 1.0f,
+    .current = 0.5f,
+    .cell_voltage = 0.02f,
+    .temperature = 2.0f,
+    .distance = 25.0f,
+    .heartbeat = 600,
+};
+
+typedef enum
+{
+    BIKE_IDLE,     ///< Parked all day
+    BIKE_COMMUTER, ///< Two rides and a charge
+    BIKE_FAULTY,   ///< Parked, with a flapping error flag
+} BikeProfile;
+
+static float noise(float amplitude)
+{
+    return ((float)rand() / RAND_MAX * 2 - 1) * amplitude;
+}
+
+typedef struct
+{
+    uint32_t samples;
+    uint32_t alarms;
+    uint32_t late_alarms;
+} Stats;
+
+static void simulate(BikeProfile profile, PublishScheduler *scheduler, Stats *stats)
+{
+    BmsStatus status;
+    memset(&status, 0, sizeof(status));
+    status.state = 1;
+    status.chg_enable = true;
+    status.dis_enable = true;
+    status.connected_cells = 4;
+    status.soc = 60.0f + noise(20);
+    status.timestamp = 1700000000;
+
+    Location location = {.latitude = 45.815f + noise(0.05f), .longitude = 15.98f + noise(0.05f)};
+
+    for (int i = 0; i < DAY_SAMPLES; i++)
+    {
+        int minute = i * PERIOD / 60;
+        bool riding = profile == BIKE_COMMUTER && ((minute >= 480 && minute < 520) || (minute >= 1050 && minute < 1090));
+        bool charging = profile == BIKE_COMMUTER && minute >= 1200 && status.soc < 100.0f;
+
+        float current = riding ? -6.0f + noise(3.0f) : charging ? 2.0f + noise(0.05f) : noise(0.02f);
+        status.soc += current * PERIOD / 3600.0f / 10.0f * 100.0f;
+        status.soc = status.soc > 100.0f ? 100.0f : status.soc;
+        status.pack_current = current;
+        status.full = status.soc >= 100.0f;
+        status.empty = status.soc <= 5.0f;
+        status.state = riding ? 2 : charging ? 3 : 1;
+
+        float cell = 3.3f + status.soc / 100.0f * 0.9f + current * 0.01f;
+        status.cell_voltage_max = roundf((cell + 0.01f + noise(0.002f)) * 1000) / 1000;
+        status.cell_voltage_min = roundf((cell - 0.01f + noise(0.002f)) * 1000) / 1000;
+
+        // Ambient swing over the day plus self-heating under load
+        float ambient = 15.0f + 6.0f * sinf((float)i / DAY_SAMPLES * 2 * (float)M_PI);
+        status.bat_temp_max = roundf((ambient + (riding || charging ? 4.0f : 0) + noise(0.2f)) * 10) / 10;
+
+        bool alarm = false;
+        if (profile == BIKE_FAULTY && rand() % 500 == 0)
+        {
+            status.error_flags ^= 1u << (rand() % 8);
+            alarm = true;
+        }
+
+        if (riding)
+        {
+            location.latitude += 7.0f * PERIOD / 111195.0f;
+        }
+        status.timestamp += PERIOD;
+        location.timestamp = status.timestamp;
+
+        stats->samples++;
+        PublishReason reason = schedulerCheckBmsStatus(scheduler, &status);
+        if (alarm)
+        {
+            stats->alarms++;
+            stats->late_alarms += reason != PUBLISH_ALARM;
+        }
+        schedulerCheckLocation(scheduler, &location);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int bikes = argc > 1 ? atoi(argv[1]) : 100;
+    static const char *names[] = {"idle", "commuter", "faulty"};
+    int failures = 0;
+
+    srand(1);
+    printf("%d bikes per profile, one sample every %d s for a day\n", bikes, PERIOD);
+
+    for (BikeProfile profile = BIKE_IDLE; profile <= BIKE_FAULTY; profile++)
+    {
+        Stats stats = {0};
+        PublishCounters battery = {0}, gps = {0};
+        for (int bike = 0; bike < bikes; bike++)
+        {
+            PublishScheduler scheduler;
+            schedulerInit(&scheduler, &thresholds);
+            simulate(profile, &scheduler, &stats);
+            battery.published += scheduler.battery.published;
+            battery.suppressed += scheduler.battery.suppressed;
+            gps.published += scheduler.gps.published;
+            gps.suppressed += scheduler.gps.suppressed;
+        }
+
+        double batteryRatio = (double)stats.samples / battery.published;
+        printf("  %-8s battery %6u sent, %7u suppressed (%5.1fx fewer)  gps %6u sent (%5.1fx fewer)", names[profile],
+               battery.published, battery.suppressed, batteryRatio, gps.published,
+               (double)stats.samples / gps.published);
+        if (stats.alarms)
+        {
+            printf("  %u alarms, %u late", stats.alarms, stats.late_alarms);
+        }
+        printf("\n");
+
+        if (battery.published + battery.suppressed != stats.samples)
+        {
+            fprintf(stderr, "%s: counters do not add up to the samples\n", names[profile]);
+            failures++;
+        }
+        if (profile == BIKE_IDLE && batteryRatio < 10)
+        {
+            fprintf(stderr, "idle bikes only send %.1fx fewer messages\n", batteryRatio);
+            failures++;
+        }
+        if (stats.late_alarms)
+        {
+            fprintf(stderr, "%s: %u alarms were not published right away\n", names[profile], stats.late_alarms);
+            failures++;
+        }
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+/**
+ * Checks the TLS session cache: a session is only offered to its broker
+ * and within its lifetime, storing the session a resumed connection ended
+ * with again does not ask for an NVS write, and the NVS blob round-trips
+ * while every torn or corrupted blob is rejected.
+ *
+ * Usage: test_session
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "telemetry_session.h"
+
+#define NOW 1700000000
+#define MAX_AGE 7200
+
+static int failures;
+static SessionCache cache;
+static SessionCache restored;
+
+static void expect(int condition, const char *what)
+{
+    if (!condition)
+    {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static void fill(uint8_t *data, size_t length, uint8_t seed)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        data[i] = seed + i * 7;
+    }
+}
+
+static void check_lookup(void)
+{
+    uint8_t session[300];
+    fill(session, sizeof(session), 1);
+    size_t length = 0;
+
+    sessionCacheInit(&cache);
+    expect(sessionCacheLookup(&cache, "broker.example", NOW, MAX_AGE, &length) == NULL, "empty cache");
+
+    expect(sessionCacheStore(&cache, "broker.example", session, sizeof(session), NOW), "first session stored");
+    const uint8_t *offered = sessionCacheLookup(&cache, "broker.example", NOW + 60, MAX_AGE, &length);
+    expect(offered && length == sizeof(session) && memcmp(offered, session, length) == 0, "session offered");
+    expect(sessionCacheLookup(&cache, "other.example", NOW + 60, MAX_AGE, &length) == NULL, "other broker");
+    expect(sessionCacheLookup(&cache, "broker.example", NOW + MAX_AGE, MAX_AGE, &length) == NULL, "expired");
+    expect(sessionCacheLookup(&cache, "broker.example", NOW - 60, MAX_AGE, &length) == NULL, "clock went back");
+    // Rebooted and the clock not set yet: the age is unknown
+    expect(sessionCacheLookup(&cache, "broker.example", 42, MAX_AGE, &length) != NULL, "boot-relative clock");
+
+    // A resumed connection ends with the same session, nothing to write
+    expect(!sessionCacheStore(&cache, "broker.example", session, sizeof(session), NOW + 600), "same session");
+    expect(cache.saved_at == NOW, "age of the unchanged session");
+    session[0]++;
+    expect(sessionCacheStore(&cache, "broker.example", session, sizeof(session), NOW + 600), "new ticket");
+    expect(cache.saved_at == NOW + 600, "new ticket saved at");
+
+    uint8_t large[SESSION_DATA_MAX_LEN + 1] = {0};
+    expect(!sessionCacheStore(&cache, "broker.example", large, sizeof(large), NOW) &&
+               sessionCacheLookup(&cache, "broker.example", NOW, MAX_AGE, &length) == NULL,
+           "oversized session dropped");
+
+    expect(sessionCacheStore(&cache, "broker.example", session, sizeof(session), NOW), "stored again");
+    sessionCacheClear(&cache);
+    expect(sessionCacheLookup(&cache, "broker.example", NOW, MAX_AGE, &length) == NULL, "cleared");
+}
+
+static void check_blob(void)
+{
+    static uint8_t blob[SESSION_BLOB_MAX_LEN];
+    uint8_t session[SESSION_DATA_MAX_LEN];
+    fill(session, sizeof(session), 3);
+
+    sessionCacheInit(&cache);
+    expect(sessionCacheEncode(&cache, blob, sizeof(blob)) == 0, "empty cache encoded");
+
+    char host[SESSION_HOST_MAX_LEN + 1];
+    memset(host, 'h', SESSION_HOST_MAX_LEN);
+    host[SESSION_HOST_MAX_LEN] = '\0';
+    sessionCacheStore(&cache, host, session, sizeof(session), NOW);
+    size_t length = sessionCacheEncode(&cache, blob, sizeof(blob));
+    expect(length == SESSION_BLOB_MAX_LEN, "largest blob");
+    expect(sessionCacheEncode(&cache, blob, length - 1) == 0, "short buffer");
+    expect(sessionCacheDecode(&restored, blob, length), "largest blob decoded");
+    expect(strcmp(restored.host, host) == 0 && restored.saved_at == NOW && restored.length == sizeof(session) &&
+               memcmp(restored.data, session, sizeof(session)) == 0,
+           "largest blob round trip");
+
+    sessionCacheStore(&cache, "10.0.0.2", session, 180, -5);
+    length = sessionCacheEncode(&cache, blob, sizeof(blob));
+    expect(length == SESSION_BLOB_HEADER_LEN + 8 + 180 + 4, "blob length");
+    expect(sessionCacheDecode(&restored, blob, length) && restored.saved_at == -5 &&
+               strcmp(restored.host, "10.0.0.2") == 0,
+           "round trip");
+
+    int rejected = 0;
+    for (size_t cut = 0; cut < length; cut++)
+    {
+        rejected += !sessionCacheDecode(&restored, blob, cut);
+    }
+    expect(rejected == (int)length, "every torn blob rejected");
+    expect(!sessionCacheDecode(&restored, blob, length + 1), "trailing byte rejected");
+
+    rejected = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        for (int bit = 0; bit < 8; bit++)
+        {
+            blob[i] ^= 1 << bit;
+            rejected += !sessionCacheDecode(&restored, blob, length);
+            blob[i] ^= 1 << bit;
+        }
+    }
+    expect(rejected == (int)length * 8, "every flipped bit rejected");
+    expect(restored.length == 0, "rejected blob leaves the cache empty");
+    expect(sessionCacheDecode(&restored, blob, length), "blob intact");
+}
+
+int main(void)
+{
+    check_lookup();
+    check_blob();
+
+    printf("%s\n", failures ? "session FAILED" : "session OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,222 @@
+/**
+ * Replays GPS tracks through the trajectory simplifier and reports how many
+ * positions are published against the error of the track rebuilt from them
+ * by linear interpolation over time. Every sample has to be rebuilt within
+ * the configured tolerance.
+ *
+ * Tracks are read from CSV files (timestamp,latitude,longitude per line), or
+ * synthesized when none are given: a commute at one fix per second with a
+ * parked stretch, stops at junctions, corners, a roundabout and GPS noise.
+ *
+ * Usage: test_track [track.csv ...]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry_track.h"
+
+#define TRACK_SAMPLES_MAX 20000
+#define FIXED_PERIOD 10 // s, what publishGPS sends without simplification
+
+static Location samples[TRACK_SAMPLES_MAX];
+static Location published[TRACK_SAMPLES_MAX];
+
+static float noise(float amplitude)
+{
+    return ((float)rand() / RAND_MAX * 2 - 1) * amplitude;
+}
+
+static size_t synthesize_track(Location *track)
+{
+    const double metersPerDegree = 111195.0;
+    double latitude = 45.8150;
+    double longitude = 15.9819;
+    double heading = 0.3;
+    time_t timestamp = 1700000000;
+    size_t count = 0;
+
+    // Legs of (seconds, speed m/s, turn rate rad/s)
+    static const float legs[][3] = {
+        {900, 0.0f, 0.0f},  // Parked at home
+        {120, 7.0f, 0.0f},  // Straight street
+        {8, 3.0f, 0.19f},   // Right-angle corner
+        {45, 0.0f, 0.0f},   // Traffic light
+        {200, 8.5f, 0.002f}, // Long gentle curve
+        {25, 4.0f, -0.25f}, // Roundabout
+        {160, 8.0f, 0.0f},
+        {8, 3.0f, -0.19f},
+        {300, 6.0f, 0.01f},
+        {1800, 0.0f, 0.0f}, // Parked at work
+    };
+
+    for (size_t leg = 0; leg < sizeof(legs) / sizeof(legs[0]); leg++)
+    {
+        for (int second = 0; second < legs[leg][0] && count < TRACK_SAMPLES_MAX; second++)
+        {
+            heading += legs[leg][2];
+            latitude += legs[leg][1] * cos(heading) / metersPerDegree;
+            longitude += legs[leg][1] * sin(heading) / (metersPerDegree * cos(latitude * M_PI / 180));
+
+            float jitter = legs[leg][1] > 0 ? 1.5f : 2.5f; // Parked fixes wander more
+            track[count].latitude = latitude + noise(jitter) / metersPerDegree;
+            track[count].longitude = longitude + noise(jitter) / (metersPerDegree * cos(latitude * M_PI / 180));
+            track[count].timestamp = timestamp++;
+            count++;
+        }
+    }
+    return count;
+}
+
+static size_t read_track(const char *path, Location *track)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    size_t count = 0;
+    long long timestamp;
+    float latitude, longitude;
+    char line[128];
+    while (count < TRACK_SAMPLES_MAX && fgets(line, sizeof(line), file))
+    {
+        if (sscanf(line, "%lld,%f,%f", &timestamp, &latitude, &longitude) == 3)
+        {
+            track[count].timestamp = timestamp;
+            track[count].latitude = latitude;
+            track[count].longitude = longitude;
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+/**
+ * Rebuild every sample from the published positions and return the maximum
+ * error, the mean goes to meanError.
+ */
+static float reconstruction_error(const Location *track, size_t count, const Location *kept, size_t keptCount,
+                                  float *meanError)
+{
+    float max = 0;
+    double sum = 0;
+    size_t segment = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        while (segment + 2 < keptCount && kept[segment + 1].timestamp <= track[i].timestamp)
+        {
+            segment++;
+        }
+        const Location *end = keptCount > 1 ? &kept[segment + 1] : &kept[segment];
+        float error = trackSegmentError(&kept[segment], end, &track[i]);
+        sum += error;
+        if (error > max)
+        {
+            max = error;
+        }
+    }
+    *meanError = sum / count;
+    return max;
+}
+
+static size_t simplify(const Location *track, size_t count, const TrackConfig *config, Track *state)
+{
+    size_t keptCount = 0;
+    trackInit(state, config);
+    for (size_t i = 0; i < count; i++)
+    {
+        keptCount += trackAddLocation(state, &track[i], &published[keptCount]);
+    }
+    keptCount += trackFlush(state, &published[keptCount]);
+    return keptCount;
+}
+
+static int replay(const char *name, const Location *track, size_t count)
+{
+    static const float tolerances[] = {2, 5, 10, 25};
+    int failures = 0;
+
+    printf("%s: %zu positions over %ld s\n", name, count, (long)(track[count - 1].timestamp - track[0].timestamp));
+
+    // Baseline, one position every FIXED_PERIOD seconds as publishGPS does today
+    size_t fixedCount = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i % FIXED_PERIOD == 0 || i == count - 1)
+        {
+            published[fixedCount++] = track[i];
+        }
+    }
+    float mean;
+    float max = reconstruction_error(track, count, published, fixedCount, &mean);
+    printf("  fixed %2d s        %5zu published (%5.1f%%)  max error %6.1f m  mean %5.1f m\n", FIXED_PERIOD,
+           fixedCount, 100.0 * fixedCount / count, max, mean);
+
+    for (size_t t = 0; t < sizeof(tolerances) / sizeof(tolerances[0]); t++)
+    {
+        TrackConfig config = {.tolerance_m = tolerances[t], .window = 32, .max_interval = 300};
+        Track state;
+        size_t keptCount = simplify(track, count, &config, &state);
+
+        max = reconstruction_error(track, count, published, keptCount, &mean);
+        printf("  tolerance %4.0f m  %5zu published (%5.1f%%)  max error %6.1f m  mean %5.1f m\n", tolerances[t],
+               keptCount, 100.0 * keptCount / count, max, mean);
+
+        if (max > tolerances[t] + 0.01f)
+        {
+            fprintf(stderr, "%s: error %.2f m exceeds the %.0f m tolerance\n", name, max, tolerances[t]);
+            failures++;
+        }
+        if (state.published != keptCount || state.sampled != count)
+        {
+            fprintf(stderr, "%s: counters disagree with the replay\n", name);
+            failures++;
+        }
+        for (size_t i = 1; i < keptCount; i++)
+        {
+            if (published[i].timestamp - published[i - 1].timestamp > (time_t)config.max_interval)
+            {
+                fprintf(stderr, "%s: %ld s without a position\n", name,
+                        (long)(published[i].timestamp - published[i - 1].timestamp));
+                failures++;
+                break;
+            }
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    int failures = 0;
+
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            size_t count = read_track(argv[i], samples);
+            if (count > 0)
+            {
+                failures += replay(argv[i], samples, count);
+            }
+        }
+    }
+    else
+    {
+        srand(1);
+        size_t count = synthesize_track(samples);
+        failures += replay("synthetic commute", samples, count);
+    }
+
+    if (failures)
+    {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    return 0;
+}
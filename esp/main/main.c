@@ -1,14 +1,21 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <stddef.h>
 #include <string.h>
+#include <sys/time.h>
 // #include "esp_wifi.h"
 #include "esp_system.h"
+#include "esp_random.h"
+#include "esp_mac.h"
 #include "nvs_flash.h"
+#include "nvs.h"
 #include "esp_event.h"
 #include "esp_netif.h"
 #include "esp_netif_ppp.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
 #include "mqtt_client.h"
 #include "esp_modem_api.h"
 #include "protocol_examples_common.h"
@@ -29,9 +36,24 @@
 
 #include "sdkconfig.h"
 
-#include "cJSON.h"
 #include "driver/gpio.h"
 
+#include "telemetry.h"
+#include "telemetry_json.h"
+#include "telemetry_binary.h"
+#include "telemetry_log.h"
+#include "telemetry_series.h"
+#include "telemetry_track.h"
+#include "telemetry_scheduler.h"
+#include "telemetry_pipeline.h"
+#include "telemetry_device.h"
+#include "telemetry_metrics.h"
+#include "telemetry_link.h"
+#include "telemetry_boot.h"
+#include "telemetry_lanes.h"
+#include "telemetry_history.h"
+#include "telemetry_transport.h"
+
 #if defined(CONFIG_EXAMPLE_FLOW_CONTROL_NONE)
 #define EXAMPLE_FLOW_CONTROL ESP_MODEM_FLOW_CONTROL_NONE
 #elif defined(CONFIG_EXAMPLE_FLOW_CONTROL_SW)
@@ -42,76 +64,77 @@
 
 static EventGroupHandle_t event_group = NULL;
 static const int CONNECT_BIT = BIT0;
+static const int MQTT_CONNECTED_BIT = BIT1;
 static const int GOT_DATA_BIT = BIT2;
 
 #ifdef CONFIG_EXAMPLE_MODEM_DEVICE_CUSTOM
 esp_err_t esp_modem_get_time(esp_modem_dce_t *dce_wrap, char *p_time);
 #endif
 
-#define TOPIC_BATTERY "/bicycle/battery-status"
-#define TOPIC_GPS "/bicycle/gps-coordinates"
-
-// TODO Select appropriate numbers
-#define BOARD_NUM_CELLS_MAX 6
-#define BOARD_NUM_THERMISTORS_MAX 2
-
-/**
- * Current BMS status including measurements and error flags
- */
-typedef struct
+// Topics live under /bicycle/<device-id>/, they are built once the ID is known
+typedef enum
 {
-    uint16_t state;  ///< Current state of the battery
-    bool chg_enable; ///< Manual enable/disable setting for charging
-    bool dis_enable; ///< Manual enable/disable setting for discharging
-
-    uint16_t connected_cells; ///< \brief Actual number of cells connected (might
-                              ///< be less than BOARD_NUM_CELLS_MAX)
-
-    float cell_voltages[BOARD_NUM_CELLS_MAX]; ///< Single cell voltages (V)
-    float cell_voltage_max;                   ///< Maximum cell voltage (V)
-    float cell_voltage_min;                   ///< Minimum cell voltage (V)
-    float cell_voltage_avg;                   ///< Average cell voltage (V)
-    float pack_voltage;                       ///< Battery external pack voltage (V)
-    float stack_voltage;                      ///< Battery internal stack voltage (V)
-
-    float pack_current; ///< \brief Battery pack current, charging direction
-                        ///< has positive sign (A)
+    TOPIC_BATTERY,
+    TOPIC_GPS,
+    TOPIC_BATTERY_BINARY,
+    TOPIC_GPS_BINARY,
+    TOPIC_BATCH,
+    TOPIC_BATCH_BINARY,
+    TOPIC_BATCH_SERIES,
+    TOPIC_DIAGNOSTICS,
+    TOPIC_ALARM,
+    TOPIC_ALARM_BINARY,
+    TOPIC_COUNT,
+} Topic;
+
+static const char *const topicSuffixes[TOPIC_COUNT] = {
+    [TOPIC_BATTERY] = "battery-status",
+    [TOPIC_GPS] = "gps-coordinates",
+    [TOPIC_BATTERY_BINARY] = "battery-status/bin",
+    [TOPIC_GPS_BINARY] = "gps-coordinates/bin",
+    [TOPIC_BATCH] = "batch",
+    [TOPIC_BATCH_BINARY] = "batch/bin",
+    [TOPIC_BATCH_SERIES] = "batch/series",
+    [TOPIC_DIAGNOSTICS] = "diagnostics",
+    [TOPIC_ALARM] = "alarm",
+    [TOPIC_ALARM_BINARY] = "alarm/bin",
+};
+
+static char deviceId[DEVICE_ID_MAX_LEN];
+static char topics[TOPIC_COUNT][DEVICE_TOPIC_MAX_LEN];
 
-    float bat_temps[BOARD_NUM_THERMISTORS_MAX]; ///< Battery temperatures (°C)
-    float bat_temp_max;                         ///< Maximum battery temperature (°C)
-    float bat_temp_min;                         ///< Minimum battery temperature (°C)
-    float bat_temp_avg;                         ///< Average battery temperature (°C)
-    float mosfet_temp;                          ///< MOSFET temperature (°C)
-    float ic_temp;                              ///< Internal BMS IC temperature (°C)
-    float mcu_temp;                             ///< MCU temperature (°C)
+static const char *TAG = "mqtt_tracker";
 
-    bool full;  ///< CV charging to cell_chg_voltage finished
-    bool empty; ///< Battery is discharged below cell_dis_voltage
+static esp_mqtt_client_handle_t client;
+static esp_transport_handle_t transport;
 
-    float soc; ///< Calculated State of Charge (%)
+static TaskHandle_t uplinkTask;
+static TaskHandle_t samplerTask;
 
-    uint32_t balancing_status; ///< holds on/off status of balancing switches
-    time_t no_idle_timestamp;  ///< Stores last time of current > idle threshold
+_Static_assert((CONFIG_TELEMETRY_RING_SIZE & (CONFIG_TELEMETRY_RING_SIZE - 1)) == 0,
+               "CONFIG_TELEMETRY_RING_SIZE must be a power of two");
 
-    uint32_t error_flags; ///< Bit array for different BmsErrorFlag errors
+// Samples on their way from sampler_task to uplink_task
+static SampleRing sampleRing;
+static SampleRecord sampleRecords[CONFIG_TELEMETRY_RING_SIZE];
+static SampleJitter samplerJitter;
 
-    time_t timestamp;
-} BmsStatus;
+static ClockSync clockSync;
+static BootTimeline bootTimeline;
+// Random per boot, so the aggregator tells a reboot from lost messages
+static uint32_t bootId;
 
-/**
- * Current GPS location
- */
-typedef struct
-{
-    float latitude;
-    float longitude;
-    time_t timestamp;
-} Location;
-
-static const char *TAG = "mqtt_tracker";
+#if CONFIG_LINK_DUTY_CYCLE
+static LinkManager linkManager;
+#endif
 
-static esp_mqtt_client_handle_t client;
+#if CONFIG_DIAGNOSTICS
+static MetricsRegistry metrics;
+static PubackTracker pubackTracker;
+static int64_t pppLostAt = 0;
+#endif
 
+// Started once PPP is up, SNTP only refines the clock the network time set at boot
 void initialize_sntp(void)
 {
     ESP_LOGI(TAG, "Initializing SNTP");
@@ -126,225 +149,937 @@ void set_timezone(void)
     tzset();                 // Apply the timezone setting
 }
 
-void obtain_time(void)
+// Step the system clock, samples taken before are re-stamped from the steps
+static void setClock(const struct timeval *utc, ClockSource source)
+{
+    int64_t step = clockSyncStep(&clockSync, time(NULL), utc->tv_sec, source);
+    settimeofday(utc, NULL);
+    ESP_LOGI(TAG, "Clock set from %s, stepped %lld s", source == CLOCK_SOURCE_SNTP ? "SNTP" : "the network",
+             (long long)step);
+    if (bootTimelineMark(&bootTimeline, BOOT_CLOCK_SET, esp_timer_get_time()) && uplinkTask != NULL)
+    {
+        xTaskNotifyGive(uplinkTask); // Samples held back for the clock can go
+    }
+}
+
+// Replaces the weak esp_sntp hook so SNTP steps go through setClock
+void sntp_sync_time(struct timeval *tv)
 {
-    initialize_sntp();
-    set_timezone(); // Set the timezone before synchronizing time
+    setClock(tv, CLOCK_SOURCE_SNTP);
+    sntp_set_sync_status(SNTP_SYNC_STATUS_COMPLETED);
+}
 
-    time_t now = 0;
-    struct tm timeinfo = {0};
-    int retry = 0;
-    const int retry_count = 10;
+static void logBootTimeline(void)
+{
+    char line[160];
+    size_t used = 0;
+    for (int i = 0; i < BOOT_MILESTONE_COUNT && used < sizeof(line); i++)
+    {
+        int64_t at = atomic_load(&bootTimeline.at_us[i]);
+        if (at != 0)
+        {
+            used += snprintf(line + used, sizeof(line) - used, "%s%s %lld ms", used ? ", " : "",
+                             bootMilestoneName(i), (long long)(at / 1000));
+        }
+    }
+    ESP_LOGI(TAG, "Boot: %s", line);
 
-    while (timeinfo.tm_year < (2016 - 1900) && ++retry < retry_count)
+    int32_t registeredToPublish = bootTimelineMs(&bootTimeline, BOOT_REGISTERED, BOOT_FIRST_PUBLISH);
+    if (registeredToPublish > CONFIG_BOOT_PUBLISH_TARGET_MS)
     {
-        ESP_LOGI(TAG, "Waiting for system time to be set... (%d/%d)", retry, retry_count);
-        vTaskDelay(2000 / portTICK_PERIOD_MS);
-        time(&now);
-        localtime_r(&now, &timeinfo);
+        ESP_LOGW(TAG, "First publish %" PRId32 " ms after registration, target %d ms", registeredToPublish,
+                 CONFIG_BOOT_PUBLISH_TARGET_MS);
     }
+#if CONFIG_DIAGNOSTICS
+    metricsSet(&metrics, METRIC_BOOT_TO_PUBLISH_MS, atomic_load(&bootTimeline.at_us[BOOT_FIRST_PUBLISH]) / 1000);
+    metricsSet(&metrics, METRIC_REGISTERED_TO_PUBLISH_MS, registeredToPublish);
+#endif
 }
 
-// Function to generate random float within a given range
-float generateRandomFloat(float min, float max)
+// Encode buffers are static so the publish path never touches the heap
+#if CONFIG_TELEMETRY_FORMAT_BINARY
+static uint8_t bmsStatusPayload[BMS_STATUS_BINARY_MAX_LEN];
+static uint8_t locationPayload[LOCATION_BINARY_LEN];
+#else
+static char bmsStatusJson[BMS_STATUS_JSON_MAX_LEN];
+static char locationJson[LOCATION_JSON_MAX_LEN];
+#endif
+
+_Static_assert((CONFIG_ROUTINE_LANE_MESSAGES & (CONFIG_ROUTINE_LANE_MESSAGES - 1)) == 0,
+               "CONFIG_ROUTINE_LANE_MESSAGES must be a power of two");
+
+// Encoded messages wait here until MQTT takes them, alarms first
+static SendLane lanes[LANE_COUNT];
+static uint8_t alarmLaneBuffer[CONFIG_ALARM_LANE_BUDGET];
+static LaneMessage alarmLaneMessages[8];
+static uint8_t routineLaneBuffer[CONFIG_ROUTINE_LANE_BUDGET];
+static LaneMessage routineLaneMessages[CONFIG_ROUTINE_LANE_MESSAGES];
+static AlarmDetector alarmDetector;
+
+static void initLanes(void)
 {
-    return ((float)rand() / RAND_MAX) * (max - min) + min;
+    sendLaneInit(&lanes[LANE_ALARM], LANE_DROP_OLDEST, alarmLaneBuffer, sizeof(alarmLaneBuffer), alarmLaneMessages,
+                 sizeof(alarmLaneMessages) / sizeof(alarmLaneMessages[0]));
+#if CONFIG_ROUTINE_LANE_COALESCE_LATEST
+    LanePolicy policy = LANE_COALESCE_LATEST;
+#else
+    LanePolicy policy = LANE_DROP_OLDEST;
+#endif
+    sendLaneInit(&lanes[LANE_ROUTINE], policy, routineLaneBuffer, sizeof(routineLaneBuffer), routineLaneMessages,
+                 CONFIG_ROUTINE_LANE_MESSAGES);
+    alarmDetectorInit(&alarmDetector, CONFIG_ALARM_MAX_TEMPERATURE);
 }
 
-// Function to generate random BmsStatus data
-BmsStatus generateRandomBmsStatus()
+// Queue an encoded payload, encoding started at encodeStart (esp_timer_get_time). Returns -1 when it is empty
+// or can never fit.
+static int queuePayload(Lane lane, Topic topic, const void *payload, size_t length, int64_t encodeStart)
 {
-    BmsStatus status;
+    // esp_mqtt_client_publish takes a length of 0 for strlen(), which a binary payload must never get
+    if (length == 0)
+    {
+        return -1;
+    }
+    int64_t now = esp_timer_get_time();
+#if CONFIG_DIAGNOSTICS
+    metricsRecord(&metrics, METRIC_ENCODE_US, now - encodeStart);
+#endif
+    // Keyed by topic, so coalescing keeps the newest status, position or batch
+    return sendLanePush(&lanes[lane], topic, topic, payload, length, now) ? 0 : -1;
+}
 
-    // Populate BmsStatus with random data
-    status.state = rand() % 100;    // Adjust as needed
-    status.chg_enable = rand() % 2; // 0 or 1
-    status.dis_enable = rand() % 2; // 0 or 1
+// Hand an encoded payload to MQTT with QoS 1
+static int publishPayload(Topic topic, const void *payload, size_t length)
+{
+    int64_t start = esp_timer_get_time();
+    int msg_id = esp_mqtt_client_publish(client, topics[topic], (const char *)payload, length, 1, 0);
+#if CONFIG_DIAGNOSTICS
+    int64_t published = esp_timer_get_time();
+    metricsRecord(&metrics, METRIC_PUBLISH_US, published - start);
+    metricsCount(&metrics, msg_id < 0 ? METRIC_PUBLISH_FAILED : METRIC_PUBLISHED, 1);
+    pubackTrackerSent(&pubackTracker, msg_id, published);
+#endif
+    if (msg_id >= 0 && bootTimelineMark(&bootTimeline, BOOT_FIRST_PUBLISH, esp_timer_get_time()))
+    {
+        logBootTimeline();
+    }
+    return msg_id;
+}
 
-    status.connected_cells = rand() % (BOARD_NUM_CELLS_MAX + 1);
+/**
+ * Move queued messages to MQTT while it is connected. Alarms always go,
+ * routine messages only while the MQTT outbox is below its budget, so the
+ * outbox cannot eat the heap on a slow link. Returns true when the lanes
+ * are empty.
+ */
+static bool pumpLanes(void)
+{
+    if (!(xEventGroupGetBits(event_group) & MQTT_CONNECTED_BIT))
+    {
+        return sendLanePeek(&lanes[LANE_ALARM]) == NULL && sendLanePeek(&lanes[LANE_ROUTINE]) == NULL;
+    }
 
-    for (int i = 0; i < BOARD_NUM_CELLS_MAX; ++i)
+    for (int lane = 0; lane < LANE_COUNT; lane++)
     {
-        status.cell_voltages[i] = ((float)rand() / RAND_MAX) * 4.2;
+        const LaneMessage *message;
+        while ((message = sendLanePeek(&lanes[lane])) != NULL)
+        {
+            if (lane == LANE_ROUTINE && esp_mqtt_client_get_outbox_size(client) >= CONFIG_OUTBOX_BUDGET)
+            {
+                return false;
+            }
+            if (publishPayload(message->topic, sendLanePayload(&lanes[lane], message), message->length) < 0)
+            {
+                return false; // Disconnected meanwhile, try again after the reconnect
+            }
+#if CONFIG_DIAGNOSTICS
+            metricsRecord(&metrics, lane == LANE_ALARM ? METRIC_ALARM_QUEUE_MS : METRIC_ROUTINE_QUEUE_MS,
+                          (esp_timer_get_time() - message->enqueued_us) / 1000);
+#endif
+            sendLanePop(&lanes[lane]);
+        }
     }
+    return true;
+}
 
-    status.cell_voltage_max = ((float)rand() / RAND_MAX) * 4.2;
-    status.cell_voltage_min = ((float)rand() / RAND_MAX) * 4.2;
-    status.cell_voltage_avg = ((float)rand() / RAND_MAX) * 4.2;
-    status.pack_voltage = ((float)rand() / RAND_MAX) * 50.0;
-    status.stack_voltage = ((float)rand() / RAND_MAX) * 50.0;
-    status.pack_current = ((float)rand() / RAND_MAX) * 10.0;
+// Encode a BmsStatus into its buffer, alarms go to their own topic. Returns 0 on failure.
+static size_t encodeBmsStatus(const BmsStatus *status, Lane lane, Topic *topic, const void **payload)
+{
+#if CONFIG_TELEMETRY_FORMAT_BINARY
+    size_t length = convertBmsStatusToBinary(status, bmsStatusPayload, sizeof(bmsStatusPayload));
+    *topic = lane == LANE_ALARM ? TOPIC_ALARM_BINARY : TOPIC_BATTERY_BINARY;
+    *payload = bmsStatusPayload;
+    if (length == 0)
+    {
+        ESP_LOGE(TAG, "BmsStatus does not fit into the binary buffer");
+    }
+#else
+    size_t length = convertBmsStatusToJSON(status, bmsStatusJson, sizeof(bmsStatusJson));
+    *topic = lane == LANE_ALARM ? TOPIC_ALARM : TOPIC_BATTERY;
+    *payload = bmsStatusJson;
+    if (length == 0)
+    {
+        ESP_LOGE(TAG, "BmsStatus does not fit into the JSON buffer");
+    }
+#endif
+    return length;
+}
 
-    for (int i = 0; i < BOARD_NUM_THERMISTORS_MAX; ++i)
+// Encode a Location into its buffer, returns 0 on failure
+static size_t encodeLocation(const Location *location, Topic *topic, const void **payload)
+{
+#if CONFIG_TELEMETRY_FORMAT_BINARY
+    size_t length = convertLocationToBinary(location, locationPayload, sizeof(locationPayload));
+    *topic = TOPIC_GPS_BINARY;
+    *payload = locationPayload;
+    if (length == 0)
     {
-        status.bat_temps[i] = ((float)rand() / RAND_MAX) * 100.0;
+        ESP_LOGE(TAG, "Location does not fit into the binary buffer");
     }
+#else
+    size_t length = convertLocationToJSON(location, locationJson, sizeof(locationJson));
+    *topic = TOPIC_GPS;
+    *payload = locationJson;
+    if (length == 0)
+    {
+        ESP_LOGE(TAG, "Location does not fit into the JSON buffer");
+    }
+#endif
+    return length;
+}
 
-    status.bat_temp_max = ((float)rand() / RAND_MAX) * 100.0;
-    status.bat_temp_min = ((float)rand() / RAND_MAX) * 100.0;
-    status.bat_temp_avg = ((float)rand() / RAND_MAX) * 100.0;
-    status.mosfet_temp = ((float)rand() / RAND_MAX) * 100.0;
-    status.ic_temp = ((float)rand() / RAND_MAX) * 100.0;
-    status.mcu_temp = ((float)rand() / RAND_MAX) * 100.0;
+// Encode and queue a BmsStatus, returns -1 on failure
+static int sendBmsStatus(const BmsStatus *status, Lane lane)
+{
+    int64_t start = esp_timer_get_time();
+    Topic topic;
+    const void *payload;
+    size_t length = encodeBmsStatus(status, lane, &topic, &payload);
+    return length == 0 ? -1 : queuePayload(lane, topic, payload, length, start);
+}
 
-    status.full = rand() % 2;
-    status.empty = rand() % 2;
+// Encode and queue a Location, returns -1 on failure
+static int sendLocation(const Location *location)
+{
+    int64_t start = esp_timer_get_time();
+    Topic topic;
+    const void *payload;
+    size_t length = encodeLocation(location, &topic, &payload);
+    return length == 0 ? -1 : queuePayload(LANE_ROUTINE, topic, payload, length, start);
+}
 
-    status.soc = ((float)rand() / RAND_MAX) * 100.0;
+#if CONFIG_TELEMETRY_LOG || CONFIG_HISTORY_DEPTH > 0
+static bool isLinkUp(void)
+{
+    return (xEventGroupGetBits(event_group) & (CONNECT_BIT | MQTT_CONNECTED_BIT)) == (CONNECT_BIT | MQTT_CONNECTED_BIT);
+}
+#endif
 
-    status.balancing_status = rand();
+#if CONFIG_TELEMETRY_LOG
+// Records in the flash log hold the binary encoding, whatever the wire format
+#define TELEMETRY_RECORD_BMS_STATUS 1
+#define TELEMETRY_RECORD_LOCATION 2
 
-    status.no_idle_timestamp = time(NULL); // Use current time
+static TelemetryLog telemetryLog;
+// Records handed to MQTT, popped from the log once the broker acknowledged them
+static LogInFlight logInFlight;
+static uint32_t logDroppedSeen;
+static bool telemetryLogReady = false;
+static uint8_t telemetryRecord[TELEMETRY_LOG_MAX_RECORD_LEN];
 
-    status.error_flags = rand();
+static int logFlashRead(void *ctx, uint32_t offset, void *dst, size_t length)
+{
+    return esp_partition_read(ctx, offset, dst, length);
+}
 
-    status.timestamp = time(NULL); // Use current time
+static int logFlashWrite(void *ctx, uint32_t offset, const void *src, size_t length)
+{
+    return esp_partition_write(ctx, offset, src, length);
+}
 
-    return status;
+static int logFlashErase(void *ctx, uint32_t offset)
+{
+    return esp_partition_erase_range(ctx, offset, TELEMETRY_LOG_SECTOR_SIZE);
 }
 
-// Function to generate random Location data
-Location generateRandomLocation()
+static void initTelemetryLog(void)
 {
-    Location location;
+    const esp_partition_t *partition =
+        esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "telemetry");
+    if (partition == NULL)
+    {
+        ESP_LOGE(TAG, "No telemetry partition, samples will not be kept while offline");
+        return;
+    }
 
-    // Populate Location with random data
-    location.latitude = generateRandomFloat(-90.0, 90.0);
-    location.longitude = generateRandomFloat(-180.0, 180.0);
-    location.timestamp = time(NULL); // Use current time
+    TelemetryLogFlash flash = {
+        .read = logFlashRead,
+        .write = logFlashWrite,
+        .erase_sector = logFlashErase,
+        .ctx = (void *)partition,
+        .size = partition->size - partition->size % TELEMETRY_LOG_SECTOR_SIZE,
+    };
+    logInFlightInit(&logInFlight);
+    telemetryLogReady = telemetryLogMount(&telemetryLog, &flash);
+    logDroppedSeen = telemetryLog.dropped;
+    ESP_LOGI(TAG, "Telemetry log mounted: %" PRIu32 " pending records, max erase count %" PRIu32,
+             telemetryLog.pending, telemetryLogMaxEraseCount(&telemetryLog));
+}
+
+/**
+ * While offline, until the clock is set, and until the backlog is drained,
+ * samples go to flash so they are delivered in timestamp order.
+ */
+static bool shouldStoreTelemetry(void)
+{
+    return telemetryLogReady && (!isLinkUp() || !clockSyncIsSet(&clockSync) || telemetryLog.pending > 0);
+}
+
+static void storeTelemetry(uint8_t type, const uint8_t *payload, size_t length)
+{
+    if (!telemetryLogAppend(&telemetryLog, type, payload, length))
+    {
+        ESP_LOGE(TAG, "Failed to append to the telemetry log");
+    }
+}
 
-    return location;
+// esp-mqtt drops a message from its outbox after this, its PUBACK will not come any more
+#ifndef CONFIG_MQTT_OUTBOX_EXPIRED_TIMEOUT_MS
+#define CONFIG_MQTT_OUTBOX_EXPIRED_TIMEOUT_MS 30000
+#endif
+
+// Pop the acknowledged records, read the rest again once they can no longer be acknowledged
+static void settleTelemetryLog(void)
+{
+    for (uint32_t completed = logInFlightCompleted(&logInFlight); completed > 0; completed--)
+    {
+        telemetryLogPop(&telemetryLog);
+    }
+    // The log rewinds itself when the ring drops a sector
+    bool rewound = telemetryLog.dropped != logDroppedSeen;
+    if (rewound ||
+        logInFlightExpired(&logInFlight, esp_timer_get_time(), CONFIG_MQTT_OUTBOX_EXPIRED_TIMEOUT_MS * 1000LL))
+    {
+        logDroppedSeen = telemetryLog.dropped;
+        logInFlightClear(&logInFlight);
+        telemetryLogRewind(&telemetryLog);
+    }
 }
 
-char *convertBmsStatusToJSON(const BmsStatus *status)
+// Publish the next record, false when it has to wait for the next attempt
+static bool sendTelemetryRecord(void)
 {
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "state", status->state);
-    cJSON_AddBoolToObject(root, "chg_enable", status->chg_enable);
-    cJSON_AddBoolToObject(root, "dis_enable", status->dis_enable);
-    cJSON_AddNumberToObject(root, "connected_cells", status->connected_cells);
+    uint8_t type;
+    size_t length = telemetryLogRead(&telemetryLog, &type, telemetryRecord, sizeof(telemetryRecord));
+    if (length == 0)
+    {
+        return false;
+    }
+
+    // Records that fail to parse or encode are consumed in their turn without a PUBACK
+    Topic topic;
+    const void *payload;
+    size_t payloadLength = 0;
+    if (type == TELEMETRY_RECORD_BMS_STATUS)
+    {
+        BmsStatus status;
+        if (parseBmsStatusBinary(telemetryRecord, length, &status))
+        {
+            // Stored with a boot-relative clock, only this boot's steps apply
+            if (status.boot_id == bootId)
+            {
+                status.timestamp = clockSyncRestamp(&clockSync, status.timestamp);
+                status.no_idle_timestamp = clockSyncRestamp(&clockSync, status.no_idle_timestamp);
+            }
+            payloadLength = encodeBmsStatus(&status, LANE_ROUTINE, &topic, &payload);
+        }
+    }
+    else if (type == TELEMETRY_RECORD_LOCATION)
+    {
+        Location location;
+        if (parseLocationBinary(telemetryRecord, length, &location))
+        {
+            if (location.boot_id == bootId)
+            {
+                location.timestamp = clockSyncRestamp(&clockSync, location.timestamp);
+            }
+            payloadLength = encodeLocation(&location, &topic, &payload);
+        }
+    }
 
-    // Add cell voltage array
-    cJSON *cellVoltagesArray = cJSON_CreateArray();
-    for (int i = 0; i < BOARD_NUM_CELLS_MAX; i++)
+    int msg_id = payloadLength > 0 ? publishPayload(topic, payload, payloadLength) : 0;
+    if (msg_id < 0)
     {
-        cJSON_AddItemToArray(cellVoltagesArray, cJSON_CreateNumber(status->cell_voltages[i]));
+        // Disconnected meanwhile: the records in flight may still be acknowledged, this one is read again
+        logInFlightClear(&logInFlight);
+        telemetryLogRewind(&telemetryLog);
+        return false;
     }
-    cJSON_AddItemToObject(root, "cell_voltages", cellVoltagesArray);
+    logInFlightSent(&logInFlight, msg_id, esp_timer_get_time());
+    return true;
+}
 
-    cJSON_AddNumberToObject(root, "cell_voltage_max", status->cell_voltage_max);
-    cJSON_AddNumberToObject(root, "cell_voltage_min", status->cell_voltage_min);
-    cJSON_AddNumberToObject(root, "cell_voltage_avg", status->cell_voltage_avg);
-    cJSON_AddNumberToObject(root, "pack_voltage", status->pack_voltage);
-    cJSON_AddNumberToObject(root, "stack_voltage", status->stack_voltage);
-    cJSON_AddNumberToObject(root, "pack_current", status->pack_current);
+/**
+ * Send stored records in rate-limited batches until the log is empty or the
+ * next sample is due. Records go straight to MQTT rather than through the
+ * routine lane, and stay in the log until their PUBACK, so a reboot, an
+ * expired outbox or a stopped client cannot lose them.
+ */
+static void drainTelemetryLog(TickType_t deadline)
+{
+    const TickType_t interval = pdMS_TO_TICKS(CONFIG_TELEMETRY_LOG_DRAIN_INTERVAL_MS);
 
-    // Add battery temperature array
-    cJSON *batTempsArray = cJSON_CreateArray();
-    for (int i = 0; i < BOARD_NUM_THERMISTORS_MAX; i++)
+    while (telemetryLogReady && telemetryLog.pending > 0 && isLinkUp() && clockSyncIsSet(&clockSync))
     {
-        cJSON_AddItemToArray(batTempsArray, cJSON_CreateNumber(status->bat_temps[i]));
+        settleTelemetryLog();
+        for (int i = 0; i < CONFIG_TELEMETRY_LOG_DRAIN_BATCH && logInFlight.count < LOG_IN_FLIGHT_SLOTS; i++)
+        {
+            // Live messages go first, and the backlog keeps the outbox within its budget too
+            if (!pumpLanes() || esp_mqtt_client_get_outbox_size(client) >= CONFIG_OUTBOX_BUDGET)
+            {
+                return; // Keep the rest for the next attempt
+            }
+            if (!sendTelemetryRecord())
+            {
+                break; // Everything is out, wait for the PUBACKs
+            }
+        }
+
+        // New samples may hold an alarm, they go before the rest of the backlog
+        if (sampleRingCount(&sampleRing) > 0 || (int32_t)(deadline - xTaskGetTickCount()) <= (int32_t)interval)
+        {
+            return;
+        }
+        vTaskDelay(interval);
     }
-    cJSON_AddItemToObject(root, "bat_temps", batTempsArray);
+    settleTelemetryLog();
+}
+#endif
 
-    cJSON_AddNumberToObject(root, "bat_temp_max", status->bat_temp_max);
-    cJSON_AddNumberToObject(root, "bat_temp_min", status->bat_temp_min);
-    cJSON_AddNumberToObject(root, "bat_temp_avg", status->bat_temp_avg);
-    cJSON_AddNumberToObject(root, "mosfet_temp", status->mosfet_temp);
-    cJSON_AddNumberToObject(root, "ic_temp", status->ic_temp);
-    cJSON_AddNumberToObject(root, "mcu_temp", status->mcu_temp);
+#if CONFIG_HISTORY_DEPTH > 0
+// Battery samples taken while offline when there is no flash log, packed to fit more of them
+static HistoryRing history;
+static HistorySlot historySlots[CONFIG_HISTORY_DEPTH];
 
-    cJSON_AddBoolToObject(root, "full", status->full);
-    cJSON_AddBoolToObject(root, "empty", status->empty);
-    cJSON_AddNumberToObject(root, "soc", status->soc);
-    cJSON_AddNumberToObject(root, "balancing_status", status->balancing_status);
+static bool shouldHoldInHistory(void)
+{
+#if CONFIG_TELEMETRY_LOG
+    if (telemetryLogReady)
+    {
+        return false;
+    }
+#endif
+    return !isLinkUp() || history.count > 0;
+}
 
-    // Format timestamp as RFC3339 string
-    char timestampString[21]; // Adjust the size as needed
-    strftime(timestampString, sizeof(timestampString), "%Y-%m-%dT%H:%M:%SZ", gmtime(&status->no_idle_timestamp));
+// Send held samples oldest first while the lanes keep up
+static void drainHistory(void)
+{
+    BmsStatus status;
+    while (isLinkUp() && pumpLanes() && historyRingPop(&history, &status))
+    {
+        if (sendBmsStatus(&status, LANE_ROUTINE) < 0)
+        {
+            ESP_LOGW(TAG, "Dropped held BmsStatus %" PRIu32, status.sequence);
+        }
+    }
+}
+#endif
 
-    cJSON_AddStringToObject(root, "no_idle_timestamp", timestampString);
+#if CONFIG_TELEMETRY_BATCH_SIZE > 1
+static BmsStatus batchStatuses[CONFIG_TELEMETRY_BATCH_SIZE];
+static Location batchLocations[CONFIG_TELEMETRY_BATCH_SIZE];
+static size_t batchStatusCount = 0;
+static size_t batchLocationCount = 0;
+static TickType_t batchStartTick;
+
+#if CONFIG_TELEMETRY_BATCH_SERIES
+static uint8_t batchPayload[SERIES_BATCH_MAX_LEN(CONFIG_TELEMETRY_BATCH_SIZE)];
+#elif CONFIG_TELEMETRY_FORMAT_BINARY
+static uint8_t batchPayload[BATCH_BINARY_MAX_LEN(CONFIG_TELEMETRY_BATCH_SIZE)];
+#else
+static char batchPayload[BATCH_JSON_MAX_LEN(CONFIG_TELEMETRY_BATCH_SIZE)];
+#endif
 
-    cJSON_AddNumberToObject(root, "error_flags", status->error_flags);
+// Send every collected sample in one envelope on the batch topic
+static void flushBatch(void)
+{
+    if (batchStatusCount == 0 && batchLocationCount == 0)
+    {
+        return;
+    }
 
-    strftime(timestampString, sizeof(timestampString), "%Y-%m-%dT%H:%M:%SZ", gmtime(&status->timestamp));
+    int msg_id = -1;
+#if CONFIG_TELEMETRY_LOG
+    if (!shouldStoreTelemetry())
+#endif
+    {
+        int64_t start = esp_timer_get_time();
+#if CONFIG_TELEMETRY_BATCH_SERIES
+        size_t length = convertBatchToSeries(batchStatuses, batchStatusCount, batchLocations, batchLocationCount,
+                                             batchPayload, sizeof(batchPayload));
+        msg_id = queuePayload(LANE_ROUTINE, TOPIC_BATCH_SERIES, batchPayload, length, start);
+#elif CONFIG_TELEMETRY_FORMAT_BINARY
+        size_t length = convertBatchToBinary(batchStatuses, batchStatusCount, batchLocations, batchLocationCount,
+                                             batchPayload, sizeof(batchPayload));
+        msg_id = queuePayload(LANE_ROUTINE, TOPIC_BATCH_BINARY, batchPayload, length, start);
+#else
+        size_t length = convertBatchToJSON(batchStatuses, batchStatusCount, batchLocations, batchLocationCount,
+                                           batchPayload, sizeof(batchPayload));
+        msg_id = queuePayload(LANE_ROUTINE, TOPIC_BATCH, batchPayload, length, start);
+#endif
+    }
 
-    cJSON_AddStringToObject(root, "timestamp", timestampString);
+#if CONFIG_TELEMETRY_LOG
+    // The batch is larger than the routine lane, keep its samples in the log
+    if (msg_id < 0 && telemetryLogReady)
+    {
+        uint8_t payload[BMS_STATUS_BINARY_MAX_LEN];
+        for (size_t i = 0; i < batchStatusCount; i++)
+        {
+            storeTelemetry(TELEMETRY_RECORD_BMS_STATUS, payload,
+                           convertBmsStatusToBinary(&batchStatuses[i], payload, sizeof(payload)));
+        }
+        for (size_t i = 0; i < batchLocationCount; i++)
+        {
+            storeTelemetry(TELEMETRY_RECORD_LOCATION, payload,
+                           convertLocationToBinary(&batchLocations[i], payload, sizeof(payload)));
+        }
+    }
+#endif
+    if (msg_id < 0)
+    {
+        ESP_LOGW(TAG, "Failed to publish a batch of %u samples", (unsigned)(batchStatusCount + batchLocationCount));
+    }
 
-    char *jsonString = cJSON_PrintUnformatted(root);
-    cJSON_Delete(root);
-    return jsonString;
+    batchStatusCount = 0;
+    batchLocationCount = 0;
 }
 
-// Function to convert Location to JSON string
-char *convertLocationToJSON(const Location *location)
+static bool isBatchDue(void)
 {
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "latitude", location->latitude);
-    cJSON_AddNumberToObject(root, "longitude", location->longitude);
+    if (batchStatusCount == 0 && batchLocationCount == 0)
+    {
+        return false;
+    }
+    return batchStatusCount >= CONFIG_TELEMETRY_BATCH_SIZE || batchLocationCount >= CONFIG_TELEMETRY_BATCH_SIZE ||
+           xTaskGetTickCount() - batchStartTick >= pdMS_TO_TICKS(CONFIG_TELEMETRY_BATCH_MAX_AGE * 1000);
+}
 
-    // Format timestamp as RFC3339 string
-    char timestampString[21]; // Adjust the size as needed
-    strftime(timestampString, sizeof(timestampString), "%Y-%m-%dT%H:%M:%SZ", gmtime(&location->timestamp));
+static void startBatchIfEmpty(void)
+{
+    if (batchStatusCount == 0 && batchLocationCount == 0)
+    {
+        batchStartTick = xTaskGetTickCount();
+    }
+}
+#endif
 
-    cJSON_AddStringToObject(root, "timestamp", timestampString);
+#if CONFIG_PUBLISH_ON_CHANGE
+static PublishScheduler scheduler;
 
-    char *jsonString = cJSON_PrintUnformatted(root);
-    cJSON_Delete(root);
-    return jsonString;
+static void initScheduler(void)
+{
+    PublishThresholds thresholds = {
+        .soc = CONFIG_PUBLISH_DEADBAND_SOC,
+        .current = CONFIG_PUBLISH_DEADBAND_CURRENT_MA / 1000.0f,
+        .cell_voltage = CONFIG_PUBLISH_DEADBAND_CELL_MV / 1000.0f,
+        .temperature = CONFIG_PUBLISH_DEADBAND_TEMP,
+        .distance = CONFIG_PUBLISH_DEADBAND_DISTANCE_M,
+        .heartbeat = CONFIG_PUBLISH_HEARTBEAT,
+    };
+    schedulerInit(&scheduler, &thresholds);
 }
+#endif
+
+static uint32_t batterySequence = 0;
+static uint32_t locationSequence = 0;
 
 // Function to publish BmsStatus to the specified topic
-void publishBatteryStatus()
+void publishBatteryStatus(BmsStatus *status)
 {
-    BmsStatus status = generateRandomBmsStatus();
-    char *jsonString = convertBmsStatusToJSON(&status);
-    esp_mqtt_client_publish(client, TOPIC_BATTERY, jsonString, strlen(jsonString), 1, 0);
-    free(jsonString); // Free the allocated memory for the JSON string
+    bool alarm = alarmCheck(&alarmDetector, status);
+#if CONFIG_PUBLISH_ON_CHANGE
+    // Runs for alarms too so it keeps comparing against the last status sent
+    PublishReason reason = schedulerCheckBmsStatus(&scheduler, status);
+    if (reason == PUBLISH_SUPPRESS && !alarm)
+    {
+        return;
+    }
+    if (reason == PUBLISH_HEARTBEAT)
+    {
+        ESP_LOGI(TAG, "Heartbeat, battery %" PRIu32 " sent / %" PRIu32 " suppressed, gps %" PRIu32 " sent / %" PRIu32
+                      " suppressed",
+                 scheduler.battery.published, scheduler.battery.suppressed, scheduler.gps.published,
+                 scheduler.gps.suppressed);
+    }
+#endif
+    // Numbered once it is sent, so suppressed samples do not look lost
+    status->boot_id = bootId;
+    status->sequence = batterySequence++;
+    status->timestamp = clockSyncRestamp(&clockSync, status->timestamp);
+    status->no_idle_timestamp = clockSyncRestamp(&clockSync, status->no_idle_timestamp);
+    // Until the clock is set even alarms wait in the log, published they would read 1970
+    if (alarm && clockSyncIsSet(&clockSync))
+    {
+        // Faults skip the log and the batch, the alarm lane goes out first
+        if (sendBmsStatus(status, LANE_ALARM) < 0)
+        {
+            ESP_LOGE(TAG, "Dropped alarm BmsStatus %" PRIu32, status->sequence);
+        }
+#if CONFIG_LINK_DUTY_CYCLE
+        linkRequestUpload(&linkManager);
+#endif
+        return;
+    }
+#if CONFIG_TELEMETRY_LOG
+    if (shouldStoreTelemetry())
+    {
+#if CONFIG_TELEMETRY_BATCH_SIZE > 1
+        flushBatch(); // Older samples go to the log first
+#endif
+        uint8_t payload[BMS_STATUS_BINARY_MAX_LEN];
+        size_t length = convertBmsStatusToBinary(status, payload, sizeof(payload));
+        storeTelemetry(TELEMETRY_RECORD_BMS_STATUS, payload, length);
+        return;
+    }
+#endif
+#if CONFIG_HISTORY_DEPTH > 0
+    if (shouldHoldInHistory())
+    {
+#if CONFIG_TELEMETRY_BATCH_SIZE > 1
+        flushBatch(); // Older samples go to the routine lane first
+#endif
+        historyRingPush(&history, status);
+        return;
+    }
+#endif
+#if CONFIG_TELEMETRY_BATCH_SIZE > 1
+    startBatchIfEmpty();
+    batchStatuses[batchStatusCount++] = *status;
+#if CONFIG_PUBLISH_ON_CHANGE
+    if (reason == PUBLISH_ALARM)
+    {
+        flushBatch(); // State changes do not wait for the batch to fill up
+    }
+#endif
+#else
+    if (sendBmsStatus(status, LANE_ROUTINE) < 0)
+    {
+        ESP_LOGW(TAG, "Dropped BmsStatus %" PRIu32, status->sequence);
+    }
+#endif
 }
 
+static void publishLocation(Location *location)
+{
+    location->boot_id = bootId;
+    location->sequence = locationSequence++;
+    location->timestamp = clockSyncRestamp(&clockSync, location->timestamp);
+
+#if CONFIG_TELEMETRY_LOG
+    if (shouldStoreTelemetry())
+    {
+#if CONFIG_TELEMETRY_BATCH_SIZE > 1
+        flushBatch(); // Older samples go to the log first
+#endif
+        uint8_t payload[LOCATION_BINARY_LEN];
+        size_t length = convertLocationToBinary(location, payload, sizeof(payload));
+        storeTelemetry(TELEMETRY_RECORD_LOCATION, payload, length);
+        return;
+    }
+#endif
+#if CONFIG_TELEMETRY_BATCH_SIZE > 1
+    startBatchIfEmpty();
+    batchLocations[batchLocationCount++] = *location;
+#else
+    if (sendLocation(location) < 0)
+    {
+        ESP_LOGW(TAG, "Dropped Location %" PRIu32, location->sequence);
+    }
+#endif
+}
+
+#if CONFIG_TRACK_SIMPLIFY
+// Positions picked by the track simplifier, published from uplink_task
+static QueueHandle_t trackQueue;
+
+// Task sampling GPS faster than MESSAGE_PERIOD and keeping only the positions needed to rebuild the track
+void gps_track_task(void *pvParameters)
+{
+    static Track track;
+    TrackConfig config = {
+        .tolerance_m = CONFIG_TRACK_TOLERANCE_M,
+        .window = CONFIG_TRACK_WINDOW,
+        .max_interval = CONFIG_TRACK_MAX_INTERVAL,
+    };
+    trackInit(&track, &config);
+
+    TickType_t xLastWakeTime = xTaskGetTickCount();
+
+    while (1)
+    {
+        Location location = generateRandomLocation();
+        location.uptime_ms = esp_timer_get_time() / 1000;
+        Location keep[TRACK_MAX_EMIT];
+        size_t count = trackAddLocation(&track, &location, keep);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (xQueueSend(trackQueue, &keep[i], 0) != pdTRUE)
+            {
+                ESP_LOGW(TAG, "Track queue full, position dropped");
+            }
+        }
+
+        vTaskDelayUntil(&xLastWakeTime, CONFIG_TRACK_SAMPLE_PERIOD_MS / portTICK_PERIOD_MS);
+    }
+}
+
+// Function to publish the positions kept by the track simplifier
+void publishTrack()
+{
+    Location location;
+    while (xQueueReceive(trackQueue, &location, 0) == pdTRUE)
+    {
+        publishLocation(&location);
+    }
+}
+#else
 // Function to publish Location to the specified topic
-void publishGPS()
+void publishGPS(Location *location)
 {
-    Location location = generateRandomLocation();
-    char *jsonString = convertLocationToJSON(&location);
-    esp_mqtt_client_publish(client, TOPIC_GPS, jsonString, strlen(jsonString), 1, 0);
-    free(jsonString); // Free the allocated memory for the JSON string
+#if CONFIG_PUBLISH_ON_CHANGE
+    if (schedulerCheckLocation(&scheduler, location) == PUBLISH_SUPPRESS)
+    {
+        return;
+    }
+#endif
+    publishLocation(location);
+}
+#endif
+
+static void initSampleRing(void)
+{
+#if CONFIG_TELEMETRY_RING_DROP_OLDEST
+    sampleRingInit(&sampleRing, sampleRecords, CONFIG_TELEMETRY_RING_SIZE, SAMPLE_RING_DROP_OLDEST);
+#else
+    sampleRingInit(&sampleRing, sampleRecords, CONFIG_TELEMETRY_RING_SIZE, SAMPLE_RING_DROP_NEWEST);
+#endif
 }
 
-// Task to periodically publish messages to the MQTT broker
-void mqtt_publish_task(void *pvParameters)
+static void pushSample(SampleRecord *record)
 {
+    static uint32_t sequence = 0;
+    record->sequence = sequence++;
+    sampleRingPush(&sampleRing, record);
+}
+
+// High priority task taking a sample every MESSAGE_PERIOD, never waits on the network
+void sampler_task(void *pvParameters)
+{
+    const int64_t period_us = CONFIG_MESSAGE_PERIOD * 1000000LL;
+    int64_t start_us = esp_timer_get_time();
     TickType_t xLastWakeTime = xTaskGetTickCount();
 
     while (1)
     {
-        // Publish BmsStatus to the battery topic
-        publishBatteryStatus();
+        sampleJitterAdd(&samplerJitter, start_us + samplerJitter.samples * period_us, esp_timer_get_time());
 
-        // Publish Location to the GPS topic
-        publishGPS();
+        SampleRecord record = {.type = SAMPLE_BMS_STATUS, .status = generateRandomBmsStatus()};
+        record.status.uptime_ms = esp_timer_get_time() / 1000;
+        pushSample(&record);
 
+#if !CONFIG_TRACK_SIMPLIFY
+        record.type = SAMPLE_LOCATION;
+        record.location = generateRandomLocation();
+        record.location.uptime_ms = esp_timer_get_time() / 1000;
+        pushSample(&record);
+#endif
+
+        xTaskNotifyGive(uplinkTask);
         vTaskDelayUntil(&xLastWakeTime, CONFIG_MESSAGE_PERIOD * 1000 / portTICK_PERIOD_MS); // MESSAGE_PERIOD in seconds
     }
 }
 
+static void reportSampleDrops(void)
+{
+    static uint32_t reported = 0;
+    uint32_t dropped = atomic_load(&sampleRing.dropped);
+    if (dropped != reported)
+    {
+        ESP_LOGW(TAG, "Sample ring dropped %" PRIu32 " records (%" PRIu32 " overflows), sampler jitter max %lld us",
+                 dropped, (uint32_t)atomic_load(&sampleRing.overflows), (long long)samplerJitter.max_us);
+        reported = dropped;
+    }
+}
+
+#if CONFIG_DIAGNOSTICS
+static uint8_t diagnosticsPayload[METRICS_SNAPSHOT_LEN];
+
+static void initDiagnostics(void)
+{
+    metricsInit(&metrics);
+    pubackTrackerInit(&pubackTracker);
+}
+
+// Called from uplink_task, so its own stack is the one measured with NULL
+static void sampleGauges(void)
+{
+    metricsSet(&metrics, METRIC_OUTBOX_BYTES, esp_mqtt_client_get_outbox_size(client));
+    metricsSet(&metrics, METRIC_FREE_HEAP, esp_get_free_heap_size());
+    metricsSet(&metrics, METRIC_MIN_FREE_HEAP, esp_get_minimum_free_heap_size());
+    metricsSet(&metrics, METRIC_UPLINK_STACK_FREE, uxTaskGetStackHighWaterMark(NULL));
+    metricsSet(&metrics, METRIC_SAMPLER_STACK_FREE, uxTaskGetStackHighWaterMark(samplerTask));
+    metricsSet(&metrics, METRIC_ROUTINE_QUEUED_BYTES, lanes[LANE_ROUTINE].bytes);
+
+    // The lanes count since boot, the snapshot wants the interval
+    static LaneCounters alarm, routine;
+    metricsCount(&metrics, METRIC_ALARM_DROPPED, lanes[LANE_ALARM].counters.dropped - alarm.dropped);
+    metricsCount(&metrics, METRIC_ROUTINE_DROPPED, lanes[LANE_ROUTINE].counters.dropped - routine.dropped);
+    metricsCount(&metrics, METRIC_ROUTINE_COALESCED, lanes[LANE_ROUTINE].counters.coalesced - routine.coalesced);
+    alarm = lanes[LANE_ALARM].counters;
+    routine = lanes[LANE_ROUTINE].counters;
+}
+
+// Snapshot the metrics every DIAGNOSTICS_PERIOD while MQTT is up, they keep adding up otherwise
+static void publishDiagnostics(void)
+{
+    static TickType_t lastTick = 0;
+    TickType_t now = xTaskGetTickCount();
+    if (now - lastTick < pdMS_TO_TICKS(CONFIG_DIAGNOSTICS_PERIOD * 1000) ||
+        !(xEventGroupGetBits(event_group) & MQTT_CONNECTED_BIT))
+    {
+        return;
+    }
+    lastTick = now;
+
+    sampleGauges();
+    size_t length = metricsSnapshot(&metrics, esp_timer_get_time() / 1000000, time(NULL), diagnosticsPayload,
+                                    sizeof(diagnosticsPayload));
+    // QoS 0, a lost snapshot is not worth an outbox slot
+    esp_mqtt_client_publish(client, topics[TOPIC_DIAGNOSTICS], (const char *)diagnosticsPayload, length, 0, 0);
+}
+#endif
+
+/**
+ * Timestamps count from boot until the clock is set. The flash log keeps
+ * such samples and they are re-stamped when it is drained, without it they
+ * wait in the ring (and the track queue) for the clock.
+ */
+static bool canTakeSamples(void)
+{
+#if CONFIG_TELEMETRY_LOG
+    if (telemetryLogReady)
+    {
+        return true;
+    }
+#endif
+    return clockSyncIsSet(&clockSync);
+}
+
+// Task encoding and publishing samples at the pace the link allows
+void uplink_task(void *pvParameters)
+{
+    static SampleRecord record;
+
+    while (1)
+    {
+        while (canTakeSamples() && sampleRingPop(&sampleRing, &record))
+        {
+            if (record.type == SAMPLE_BMS_STATUS)
+            {
+                // Publish BmsStatus to the battery topic
+                publishBatteryStatus(&record.status);
+            }
+#if !CONFIG_TRACK_SIMPLIFY
+            else if (record.type == SAMPLE_LOCATION)
+            {
+                // Publish Location to the GPS topic
+                publishGPS(&record.location);
+            }
+#endif
+        }
+        reportSampleDrops();
+        pumpLanes(); // Alarms go out before anything else
+
+#if CONFIG_TRACK_SIMPLIFY
+        if (canTakeSamples())
+        {
+            publishTrack();
+        }
+#endif
+
+#if CONFIG_TELEMETRY_BATCH_SIZE > 1
+        if (isBatchDue())
+        {
+            flushBatch();
+        }
+#endif
+
+#if CONFIG_TELEMETRY_LOG
+        // Catch up on samples stored while offline, new samples wait in the ring meanwhile
+        drainTelemetryLog(xTaskGetTickCount() + CONFIG_MESSAGE_PERIOD * 1000 / portTICK_PERIOD_MS);
+#endif
+#if CONFIG_HISTORY_DEPTH > 0
+        drainHistory();
+#endif
+
+#if CONFIG_DIAGNOSTICS
+        publishDiagnostics();
+#endif
+
+        // Come back soon while routine messages wait for room in the outbox
+        TickType_t period = CONFIG_MESSAGE_PERIOD * 1000 / portTICK_PERIOD_MS;
+        ulTaskNotifyTake(pdTRUE, pumpLanes() ? period : pdMS_TO_TICKS(CONFIG_LANE_RETRY_MS));
+    }
+}
+
 // MQTT event handler
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
 {
     esp_mqtt_event_handle_t event = event_data;
     client = event->client;
+#if CONFIG_DIAGNOSTICS
+    int64_t rtt_us;
+#endif
     switch ((esp_mqtt_event_id_t)event_id)
     {
     case MQTT_EVENT_CONNECTED:
 
-        ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
+        ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED (session %s)", event->session_present ? "resumed" : "new");
+        xEventGroupSetBits(event_group, MQTT_CONNECTED_BIT);
+        bootTimelineMark(&bootTimeline, BOOT_MQTT_UP, esp_timer_get_time());
+#if CONFIG_DIAGNOSTICS
+        if (transport)
+        {
+            const TransportStats *stats = telemetryTransportStats(transport);
+            metricsCount(&metrics, METRIC_MQTT_CONNECTS, 1);
+            metricsCount(&metrics, METRIC_SESSIONS_PRESENT, event->session_present ? 1 : 0);
+            metricsCount(&metrics, METRIC_TLS_RESUMED, stats->resumed ? 1 : 0);
+            metricsRecord(&metrics, METRIC_CONNECT_MS, (esp_timer_get_time() - stats->connect_started_us) / 1000);
+            metricsRecord(&metrics, METRIC_CONNECT_BYTES, stats->bytes);
+        }
+#endif
+        xTaskNotifyGive(uplinkTask); // Send what queued up while disconnected right away
         break;
     case MQTT_EVENT_DISCONNECTED:
         ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+        xEventGroupClearBits(event_group, MQTT_CONNECTED_BIT);
+#if CONFIG_DIAGNOSTICS
+        metricsCount(&metrics, METRIC_MQTT_DISCONNECTS, 1);
+#endif
         break;
     case MQTT_EVENT_PUBLISHED:
         ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED");
+#if CONFIG_DIAGNOSTICS
+        if (pubackTrackerAcked(&pubackTracker, event->msg_id, esp_timer_get_time(), &rtt_us))
+        {
+            metricsCount(&metrics, METRIC_PUBACKS, 1);
+            metricsRecord(&metrics, METRIC_PUBACK_MS, rtt_us / 1000);
+        }
+#endif
+#if CONFIG_TELEMETRY_LOG
+        logInFlightAcked(&logInFlight, event->msg_id);
+#endif
         break;
     default:
         break;
@@ -383,12 +1118,35 @@ static void on_ip_event(void *arg, esp_event_base_t event_base, int32_t event_id
         ESP_LOGI(TAG, "Name Server2: " IPSTR, IP2STR(&dns_info.ip.u_addr.ip4));
         ESP_LOGI(TAG, "~~~~~~~~~~~~~~");
         xEventGroupSetBits(event_group, CONNECT_BIT);
+        bootTimelineMark(&bootTimeline, BOOT_PPP_UP, esp_timer_get_time());
+        if (!esp_sntp_enabled())
+        {
+            initialize_sntp();
+        }
+#if CONFIG_DIAGNOSTICS
+        if (pppLostAt != 0)
+        {
+            metricsCount(&metrics, METRIC_PPP_RECONNECTS, 1);
+            metricsCount(&metrics, METRIC_PPP_DOWNTIME_MS, (esp_timer_get_time() - pppLostAt) / 1000);
+            pppLostAt = 0;
+        }
+#endif
 
         ESP_LOGI(TAG, "GOT ip event!!!");
     }
     else if (event_id == IP_EVENT_PPP_LOST_IP)
     {
         ESP_LOGI(TAG, "Modem Disconnect from PPP Server");
+        xEventGroupClearBits(event_group, CONNECT_BIT);
+#if CONFIG_DIAGNOSTICS && CONFIG_LINK_DUTY_CYCLE
+        // Releasing the link between upload windows is not an outage
+        if (linkManager.state == LINK_CONNECTING || linkManager.state == LINK_FLUSHING)
+        {
+            pppLostAt = esp_timer_get_time();
+        }
+#elif CONFIG_DIAGNOSTICS
+        pppLostAt = esp_timer_get_time();
+#endif
     }
     else if (event_id == IP_EVENT_GOT_IP6)
     {
@@ -399,25 +1157,262 @@ static void on_ip_event(void *arg, esp_event_base_t event_base, int32_t event_id
     }
 }
 
-static void mqtt_app_start(void)
+// The device ID is provisioned in NVS (namespace "tracker", key "device_id")
+// or falls back to the factory MAC
+static void initDeviceId(void)
+{
+    nvs_handle_t nvs;
+    size_t length = sizeof(deviceId);
+    bool provisioned = nvs_open("tracker", NVS_READONLY, &nvs) == ESP_OK;
+    if (provisioned)
+    {
+        provisioned = nvs_get_str(nvs, "device_id", deviceId, &length) == ESP_OK;
+        nvs_close(nvs);
+    }
+    if (provisioned && !deviceIdIsValid(deviceId))
+    {
+        ESP_LOGE(TAG, "Provisioned device ID \"%s\" is not a valid topic level, using the MAC", deviceId);
+        provisioned = false;
+    }
+    if (!provisioned)
+    {
+        uint8_t mac[6];
+        ESP_ERROR_CHECK(esp_efuse_mac_get_default(mac));
+        deviceIdFromMac(mac, deviceId, sizeof(deviceId));
+    }
+
+    for (int topic = 0; topic < TOPIC_COUNT; topic++)
+    {
+        deviceTopic(topics[topic], sizeof(topics[topic]), deviceId, topicSuffixes[topic]);
+    }
+    ESP_LOGI(TAG, "Device ID %s, publishing to " DEVICE_TOPIC_PREFIX "%s/", deviceId, deviceId);
+}
+
+// Created before the link is up so samples can be queued from boot on. The
+// client ID stays the device ID across reconnects and reboots, so with a
+// persistent session the broker picks up where the last connection stopped.
+static void mqtt_app_init(void)
 {
+    transport = telemetryTransportInit(strncmp(CONFIG_BROKER_URL, "mqtts://", 8) == 0);
     esp_mqtt_client_config_t mqtt_cfg = {
         .broker.address.uri = CONFIG_BROKER_URL,
+        .credentials.client_id = deviceId,
+        .network.transport = transport,
+        .session.keepalive = CONFIG_MQTT_KEEPALIVE,
+#if CONFIG_MQTT_PERSISTENT_SESSION
+        .session.disable_clean_session = true,
+#endif
     };
 
-    esp_mqtt_client_handle_t client = esp_mqtt_client_init(&mqtt_cfg);
+    client = esp_mqtt_client_init(&mqtt_cfg);
     /* The last argument may be used to pass data to the event handler, in this example mqtt_event_handler */
     esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
-    esp_mqtt_client_start(client);
-    ESP_LOGI(TAG, "Waiting for MQTT data");
 }
 
 #define MODEM_RST 5
 #define MODEM_PWKEY 4
 #define MODEM_POWER_ON 23
 
+#if CONFIG_LINK_DUTY_CYCLE
+static esp_modem_dce_t *modemDce;
+
+static void initLinkManager(void)
+{
+    const LinkConfig config = {
+        .min_interval_s = CONFIG_LINK_MIN_INTERVAL,
+        .max_interval_s = CONFIG_LINK_MAX_INTERVAL,
+        .overhead_percent = CONFIG_LINK_OVERHEAD_PERCENT,
+        .wake_timeout_s = CONFIG_LINK_WAKE_TIMEOUT,
+        .flush_timeout_s = CONFIG_LINK_FLUSH_TIMEOUT,
+        .buffer_high_water = CONFIG_LINK_BUFFER_HIGH_WATER,
+    };
+    linkInit(&linkManager, &config, esp_timer_get_time());
+}
+
+static void linkAct(LinkAction action)
+{
+    switch (action)
+    {
+    case LINK_ACTION_NONE:
+        break;
+    case LINK_ACTION_POWER_ON:
+        gpio_set_level(MODEM_PWKEY, 0);
+        gpio_set_level(MODEM_POWER_ON, 1);
+        break;
+    case LINK_ACTION_START_PPP:
+        if (esp_modem_set_mode(modemDce, ESP_MODEM_MODE_DATA) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "esp_modem_set_mode(ESP_MODEM_MODE_DATA) failed");
+        }
+        break;
+    case LINK_ACTION_START_MQTT:
+        esp_mqtt_client_start(client);
+        break;
+    case LINK_ACTION_FLUSH:
+        xTaskNotifyGive(uplinkTask);
+        break;
+    case LINK_ACTION_RELEASE:
+        esp_mqtt_client_stop(client);
+        esp_modem_set_mode(modemDce, ESP_MODEM_MODE_COMMAND);
+        break;
+    case LINK_ACTION_POWER_OFF:
+        esp_modem_power_down(modemDce);
+        gpio_set_level(MODEM_POWER_ON, 0);
+        ESP_LOGI(TAG, "Radio off, on for %.1f s/h, wake-up %lld ms, next upload in %" PRIu32 " s (%" PRIu32
+                      " windows, %" PRIu32 " failed)",
+                 linkRadioOnPerHour(&linkManager, esp_timer_get_time()), (long long)(linkManager.wake_cost_us / 1000),
+                 linkManager.interval_s, linkManager.windows, linkManager.failures);
+        break;
+    }
+}
+
+// Turns what happened to the modem, PPP and MQTT into link manager events
+static LinkEvent linkPoll(void)
+{
+    EventBits_t bits = xEventGroupGetBits(event_group);
+    switch (linkManager.state)
+    {
+    case LINK_WAKING:
+        return esp_modem_sync(modemDce) == ESP_OK ? LINK_EVENT_MODEM_READY : LINK_EVENT_TICK;
+    case LINK_ATTACHING:
+        return (bits & CONNECT_BIT) ? LINK_EVENT_PPP_UP : LINK_EVENT_TICK;
+    case LINK_CONNECTING:
+        if (!(bits & CONNECT_BIT))
+        {
+            return LINK_EVENT_LOST;
+        }
+        return (bits & MQTT_CONNECTED_BIT) ? LINK_EVENT_MQTT_UP : LINK_EVENT_TICK;
+    case LINK_FLUSHING:
+        if ((bits & (CONNECT_BIT | MQTT_CONNECTED_BIT)) != (CONNECT_BIT | MQTT_CONNECTED_BIT))
+        {
+            return LINK_EVENT_LOST;
+        }
+        // Every stored sample sent and acknowledged
+        // Lane bytes are only read here, the lanes belong to uplink_task
+        return telemetryLog.pending == 0 && sampleRingCount(&sampleRing) == 0 && lanes[LANE_ALARM].bytes == 0 &&
+                       lanes[LANE_ROUTINE].bytes == 0 && esp_mqtt_client_get_outbox_size(client) == 0
+                   ? LINK_EVENT_FLUSHED
+                   : LINK_EVENT_TICK;
+    case LINK_RELEASING:
+        return LINK_EVENT_RELEASED; // esp_modem_set_mode(COMMAND) returned
+    default:
+        return LINK_EVENT_TICK;
+    }
+}
+
+// Wakes the modem for upload windows and powers it down in between, samples wait in the telemetry log
+void link_task(void *pvParameters)
+{
+    while (1)
+    {
+        linkSetBuffered(&linkManager, telemetryLog.pending);
+        LinkEvent event = linkPoll();
+        linkAct(linkHandle(&linkManager, event, esp_timer_get_time()));
+        vTaskDelay(pdMS_TO_TICKS(linkManager.state == LINK_ASLEEP ? 1000 : 200));
+    }
+}
+#endif
+
+#ifdef CONFIG_ESP_MODEM_C_API_STR_MAX
+#define MODEM_RESPONSE_LEN CONFIG_ESP_MODEM_C_API_STR_MAX
+#else
+#define MODEM_RESPONSE_LEN 128
+#endif
+
+static void powerOnModem(void)
+{
+    gpio_config_t io_conf;
+    io_conf.intr_type = GPIO_INTR_DISABLE;
+    io_conf.mode = GPIO_MODE_OUTPUT;
+    io_conf.pin_bit_mask = (1 << MODEM_RST) | (1 << MODEM_PWKEY) | (1 << MODEM_POWER_ON);
+    io_conf.pull_down_en = 0;
+    io_conf.pull_up_en = 0;
+    gpio_config(&io_conf);
+
+    gpio_set_level(MODEM_PWKEY, 0);
+    gpio_set_level(MODEM_RST, 1);
+    gpio_set_level(MODEM_POWER_ON, 1);
+}
+
+// Poll AT until the modem answers instead of waiting out its worst-case boot time
+static bool waitForModem(esp_modem_dce_t *dce)
+{
+    const int64_t deadline = esp_timer_get_time() + CONFIG_MODEM_READY_TIMEOUT * 1000000LL;
+    while (esp_modem_sync(dce) != ESP_OK)
+    {
+        if (esp_timer_get_time() > deadline)
+        {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_MODEM_POLL_INTERVAL_MS));
+    }
+    bootTimelineMark(&bootTimeline, BOOT_MODEM_READY, esp_timer_get_time());
+    return true;
+}
+
+// Registered on LTE (CEREG) or on 2G/3G (CREG)
+static bool isRegistered(esp_modem_dce_t *dce)
+{
+    static const char *const queries[] = {"AT+CEREG?", "AT+CREG?"};
+    char response[MODEM_RESPONSE_LEN];
+    for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); i++)
+    {
+        if (esp_modem_at(dce, queries[i], response, 1000) == ESP_OK && bootParseRegistration(response))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool waitForRegistration(esp_modem_dce_t *dce)
+{
+    const int64_t deadline = esp_timer_get_time() + CONFIG_MODEM_REGISTRATION_TIMEOUT * 1000000LL;
+    while (!isRegistered(dce))
+    {
+        if (esp_timer_get_time() > deadline)
+        {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_MODEM_POLL_INTERVAL_MS));
+    }
+    bootTimelineMark(&bootTimeline, BOOT_REGISTERED, esp_timer_get_time());
+    return true;
+}
+
+static esp_err_t readNetworkTime(esp_modem_dce_t *dce, char *response)
+{
+#ifdef CONFIG_EXAMPLE_MODEM_DEVICE_CUSTOM
+    return esp_modem_get_time(dce, response);
+#else
+    return esp_modem_at(dce, "AT+CCLK?", response, 1000);
+#endif
+}
+
+// The network sends its time shortly after registration, SNTP takes over if it does not
+static void syncNetworkTime(esp_modem_dce_t *dce)
+{
+    const int64_t deadline = esp_timer_get_time() + CONFIG_NETWORK_TIME_TIMEOUT * 1000000LL;
+    char response[MODEM_RESPONSE_LEN];
+    int64_t utc;
+    while (readNetworkTime(dce, response) != ESP_OK || !bootParseNetworkTime(response, &utc))
+    {
+        if (esp_timer_get_time() > deadline)
+        {
+            ESP_LOGW(TAG, "No network time, waiting for SNTP");
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_MODEM_POLL_INTERVAL_MS));
+    }
+    const struct timeval tv = {.tv_sec = utc};
+    setClock(&tv, CLOCK_SOURCE_NETWORK);
+}
+
 void app_main(void)
 {
+    // The modem boots while the rest is initialised
+    powerOnModem();
+
     ESP_LOGI(TAG, "[APP] Startup..");
     ESP_LOGI(TAG, "[APP] Free memory: %" PRIu32 " bytes", esp_get_free_heap_size());
     ESP_LOGI(TAG, "[APP] IDF version: %s", esp_get_idf_version());
@@ -430,29 +1425,53 @@ void app_main(void)
     esp_log_level_set("TRANSPORT", ESP_LOG_VERBOSE);
     esp_log_level_set("outbox", ESP_LOG_VERBOSE);
 
+    clockSyncInit(&clockSync);
+    bootTimelineInit(&bootTimeline);
+    set_timezone();
+
     /* Init and register system/core components */
     ESP_ERROR_CHECK(nvs_flash_init());
+    initDeviceId();
+    do
+    {
+        bootId = esp_random();
+    } while (bootId == 0); // 0 marks samples without a boot ID
+    ESP_LOGI(TAG, "Boot ID %08" PRIx32, bootId);
+#if CONFIG_DIAGNOSTICS
+    initDiagnostics();
+#endif
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, ESP_EVENT_ANY_ID, &on_ip_event, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(NETIF_PPP_STATUS, ESP_EVENT_ANY_ID, &on_ppp_changed, NULL));
 
-    gpio_config_t io_conf;
-    io_conf.intr_type = GPIO_INTR_DISABLE;
-    io_conf.mode = GPIO_MODE_OUTPUT;
-    io_conf.pin_bit_mask = (1 << MODEM_RST) | (1 << MODEM_PWKEY) | (1 << MODEM_POWER_ON);
-    io_conf.pull_down_en = 0;
-    io_conf.pull_up_en = 0;
-    gpio_config(&io_conf);
+    event_group = xEventGroupCreate();
+    xEventGroupClearBits(event_group, CONNECT_BIT | MQTT_CONNECTED_BIT | GOT_DATA_BIT);
 
-    gpio_set_level(MODEM_PWKEY, 0);
-    gpio_set_level(MODEM_RST, 1);
-    gpio_set_level(MODEM_POWER_ON, 1);
+    // Sampling starts now, samples wait in the ring until the clock is set
+    mqtt_app_init();
+
+#if CONFIG_TELEMETRY_LOG
+    initTelemetryLog();
+#endif
+
+#if CONFIG_PUBLISH_ON_CHANGE
+    initScheduler();
+#endif
 
-    vTaskDelay(15000 / portTICK_PERIOD_MS);
+#if CONFIG_TRACK_SIMPLIFY
+    trackQueue = xQueueCreate(CONFIG_TRACK_QUEUE_LEN, sizeof(Location));
+    xTaskCreate(&gps_track_task, "gps_track_task", 3072, NULL, 5, NULL);
+#endif
 
-    // Synchronize time with NTP server
-    // obtain_time();
+    // Create the uplink task first, the sampler notifies it
+    initSampleRing();
+    initLanes();
+#if CONFIG_HISTORY_DEPTH > 0
+    historyRingInit(&history, historySlots, CONFIG_HISTORY_DEPTH);
+#endif
+    xTaskCreate(&uplink_task, "uplink_task", 4096, NULL, 5, &uplinkTask);
+    xTaskCreate(&sampler_task, "sampler_task", 3072, NULL, CONFIG_SAMPLER_TASK_PRIORITY, &samplerTask);
 
     /* This helper function configures Wi-Fi or Ethernet, as selected in menuconfig.
      * Read "Establishing Wi-Fi or Ethernet Connection" section in
@@ -466,8 +1485,6 @@ void app_main(void)
     esp_netif_t *esp_netif = esp_netif_new(&netif_ppp_config);
     assert(esp_netif);
 
-    event_group = xEventGroupCreate();
-
     /* Configure the DTE */
 #if defined(CONFIG_EXAMPLE_SERIAL_CONFIG_UART)
     esp_modem_dte_config_t dte_config = ESP_MODEM_DTE_DEFAULT_CONFIG();
@@ -522,7 +1539,11 @@ void app_main(void)
 #error Invalid serial connection to modem.
 #endif
 
-    xEventGroupClearBits(event_group, CONNECT_BIT | GOT_DATA_BIT);
+    if (!waitForModem(dce))
+    {
+        ESP_LOGE(TAG, "Modem did not answer within %d s", CONFIG_MODEM_READY_TIMEOUT);
+        return;
+    }
 
     /* Run the modem demo app */
 #if CONFIG_EXAMPLE_NEED_SIM_PIN == 1
@@ -549,20 +1570,30 @@ void app_main(void)
         return;
     }
     ESP_LOGI(TAG, "Signal quality: rssi=%d, ber=%d", rssi, ber);
+#if CONFIG_DIAGNOSTICS
+    // Read once: in PPP data mode the modem does not take AT commands
+    metricsSet(&metrics, METRIC_RSSI, rssi);
+    metricsSet(&metrics, METRIC_BER, ber);
+#endif
 
-#ifdef CONFIG_EXAMPLE_MODEM_DEVICE_CUSTOM
+    // Let the modem keep its clock from the network time (NITZ)
+    char response[MODEM_RESPONSE_LEN];
+    esp_modem_at(dce, "AT+CTZU=1", response, 1000);
+    if (waitForRegistration(dce))
     {
-        char time[64];
-        err = esp_modem_get_time(dce, time);
-        if (err != ESP_OK)
-        {
-            ESP_LOGE(TAG, "esp_modem_get_time failed with %d %s", err, esp_err_to_name(err));
-            return;
-        }
-        ESP_LOGI(TAG, "esp_modem_get_time: %s", time);
+        syncNetworkTime(dce);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Not registered within %d s", CONFIG_MODEM_REGISTRATION_TIMEOUT);
     }
-#endif
 
+#if CONFIG_LINK_DUTY_CYCLE
+    // PPP and MQTT are brought up by link_task for each upload window
+    modemDce = dce;
+    initLinkManager();
+    xTaskCreate(&link_task, "link_task", 4096, NULL, 5, NULL);
+#else
     err = esp_modem_set_mode(dce, ESP_MODEM_MODE_DATA);
     if (err != ESP_OK)
     {
@@ -576,10 +1607,8 @@ void app_main(void)
 
     /* Start MQTT client */
     ESP_LOGI(TAG, "Starting MQTT client");
-    mqtt_app_start();
-
-    // Create the MQTT publish task
-    xTaskCreate(&mqtt_publish_task, "mqtt_publish_task", 4096, NULL, 5, NULL);
+    esp_mqtt_client_start(client);
+#endif
 
     /* Wait for establishing connection */
     ESP_LOGI(TAG, "Waiting for establishing connection");
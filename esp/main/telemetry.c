@@ -0,0 +1,71 @@
+#include <stdlib.h>
+
+#include "telemetry.h"
+
+float generateRandomFloat(float min, float max)
+{
+    return ((float)rand() / RAND_MAX) * (max - min) + min;
+}
+
+BmsStatus generateRandomBmsStatus(void)
+{
+    BmsStatus status;
+
+    // Populate BmsStatus with random data
+    status.state = rand() % 100;    // Adjust as needed
+    status.chg_enable = rand() % 2; // 0 or 1
+    status.dis_enable = rand() % 2; // 0 or 1
+
+    status.connected_cells = rand() % (BOARD_NUM_CELLS_MAX + 1);
+
+    for (int i = 0; i < BOARD_NUM_CELLS_MAX; ++i)
+    {
+        status.cell_voltages[i] = ((float)rand() / RAND_MAX) * 4.2;
+    }
+
+    status.cell_voltage_max = ((float)rand() / RAND_MAX) * 4.2;
+    status.cell_voltage_min = ((float)rand() / RAND_MAX) * 4.2;
+    status.cell_voltage_avg = ((float)rand() / RAND_MAX) * 4.2;
+    status.pack_voltage = ((float)rand() / RAND_MAX) * 50.0;
+    status.stack_voltage = ((float)rand() / RAND_MAX) * 50.0;
+    status.pack_current = ((float)rand() / RAND_MAX) * 10.0;
+
+    for (int i = 0; i < BOARD_NUM_THERMISTORS_MAX; ++i)
+    {
+        status.bat_temps[i] = ((float)rand() / RAND_MAX) * 100.0;
+    }
+
+    status.bat_temp_max = ((float)rand() / RAND_MAX) * 100.0;
+    status.bat_temp_min = ((float)rand() / RAND_MAX) * 100.0;
+    status.bat_temp_avg = ((float)rand() / RAND_MAX) * 100.0;
+    status.mosfet_temp = ((float)rand() / RAND_MAX) * 100.0;
+    status.ic_temp = ((float)rand() / RAND_MAX) * 100.0;
+    status.mcu_temp = ((float)rand() / RAND_MAX) * 100.0;
+
+    status.full = rand() % 2;
+    status.empty = rand() % 2;
+
+    status.soc = ((float)rand() / RAND_MAX) * 100.0;
+
+    status.balancing_status = rand();
+
+    status.no_idle_timestamp = time(NULL); // Use current time
+
+    status.error_flags = rand();
+
+    status.timestamp = time(NULL); // Use current time
+
+    return status;
+}
+
+Location generateRandomLocation(void)
+{
+    Location location;
+
+    // Populate Location with random data
+    location.latitude = generateRandomFloat(-90.0, 90.0);
+    location.longitude = generateRandomFloat(-180.0, 180.0);
+    location.timestamp = time(NULL); // Use current time
+
+    return location;
+}
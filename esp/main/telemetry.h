@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// TODO Select appropriate numbers
+#define BOARD_NUM_CELLS_MAX 6
+#define BOARD_NUM_THERMISTORS_MAX 2
+
+/**
+ * Current BMS status including measurements and error flags
+ */
+typedef struct
+{
+    uint16_t state;  ///< Current state of the battery
+    bool chg_enable; ///< Manual enable/disable setting for charging
+    bool dis_enable; ///< Manual enable/disable setting for discharging
+
+    uint16_t connected_cells; ///< \brief Actual number of cells connected (might
+                              ///< be less than BOARD_NUM_CELLS_MAX)
+
+    float cell_voltages[BOARD_NUM_CELLS_MAX]; ///< Single cell voltages (V)
+    float cell_voltage_max;                   ///< Maximum cell voltage (V)
+    float cell_voltage_min;                   ///< Minimum cell voltage (V)
+    float cell_voltage_avg;                   ///< Average cell voltage (V)
+    float pack_voltage;                       ///< Battery external pack voltage (V)
+    float stack_voltage;                      ///< Battery internal stack voltage (V)
+
+    float pack_current; ///< \brief Battery pack current, charging direction
+                        ///< has positive sign (A)
+
+    float bat_temps[BOARD_NUM_THERMISTORS_MAX]; ///< Battery temperatures (°C)
+    float bat_temp_max;                         ///< Maximum battery temperature (°C)
+    float bat_temp_min;                         ///< Minimum battery temperature (°C)
+    float bat_temp_avg;                         ///< Average battery temperature (°C)
+    float mosfet_temp;                          ///< MOSFET temperature (°C)
+    float ic_temp;                              ///< Internal BMS IC temperature (°C)
+    float mcu_temp;                             ///< MCU temperature (°C)
+
+    bool full;  ///< CV charging to cell_chg_voltage finished
+    bool empty; ///< Battery is discharged below cell_dis_voltage
+
+    float soc; ///< Calculated State of Charge (%)
+
+    uint32_t balancing_status; ///< holds on/off status of balancing switches
+    time_t no_idle_timestamp;  ///< Stores last time of current > idle threshold
+
+    uint32_t error_flags; ///< Bit array for different BmsErrorFlag errors
+
+    time_t timestamp;
+
+    uint32_t boot_id;  ///< Random per boot, 0 when not stamped
+    uint32_t sequence; ///< Per boot, counts the published BmsStatus messages
+    int64_t uptime_ms; ///< Time since boot when the sample was taken
+} BmsStatus;
+
+/**
+ * Current GPS location
+ */
+typedef struct
+{
+    float latitude;
+    float longitude;
+    time_t timestamp;
+
+    uint32_t boot_id;  ///< Random per boot, 0 when not stamped
+    uint32_t sequence; ///< Per boot, counts the published Location messages
+    int64_t uptime_ms; ///< Time since boot when the position was taken
+} Location;
+
+// Function to generate random float within a given range
+float generateRandomFloat(float min, float max);
+
+// Function to generate random BmsStatus data
+BmsStatus generateRandomBmsStatus(void);
+
+// Function to generate random Location data
+Location generateRandomLocation(void);
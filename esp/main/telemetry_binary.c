@@ -0,0 +1,302 @@
+#include <string.h>
+
+#include "telemetry_binary.h"
+
+/**
+ * Bounds-checked little-endian cursor over a byte buffer. Once an access
+ * runs past the end, `overflow` is latched and every following access is a
+ * no-op, so callers only need to check once at the end.
+ */
+typedef struct
+{
+    uint8_t *data;
+    size_t size;
+    size_t offset;
+    bool overflow;
+} BinaryCursor;
+
+static uint8_t *cursor_take(BinaryCursor *cursor, size_t length)
+{
+    if (cursor->overflow || cursor->offset + length > cursor->size)
+    {
+        cursor->overflow = true;
+        return NULL;
+    }
+    uint8_t *at = cursor->data + cursor->offset;
+    cursor->offset += length;
+    return at;
+}
+
+static void put_u8(BinaryCursor *cursor, uint8_t value)
+{
+    uint8_t *at = cursor_take(cursor, 1);
+    if (at)
+    {
+        at[0] = value;
+    }
+}
+
+static void put_u16(BinaryCursor *cursor, uint16_t value)
+{
+    uint8_t *at = cursor_take(cursor, 2);
+    if (at)
+    {
+        at[0] = value;
+        at[1] = value >> 8;
+    }
+}
+
+static void put_u32(BinaryCursor *cursor, uint32_t value)
+{
+    uint8_t *at = cursor_take(cursor, 4);
+    if (at)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            at[i] = value >> (8 * i);
+        }
+    }
+}
+
+static void put_i64(BinaryCursor *cursor, int64_t value)
+{
+    uint8_t *at = cursor_take(cursor, 8);
+    if (at)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            at[i] = (uint64_t)value >> (8 * i);
+        }
+    }
+}
+
+static void put_f32(BinaryCursor *cursor, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_u32(cursor, bits);
+}
+
+static uint8_t get_u8(BinaryCursor *cursor)
+{
+    uint8_t *at = cursor_take(cursor, 1);
+    return at ? at[0] : 0;
+}
+
+static uint16_t get_u16(BinaryCursor *cursor)
+{
+    uint8_t *at = cursor_take(cursor, 2);
+    return at ? (uint16_t)(at[0] | at[1] << 8) : 0;
+}
+
+static uint32_t get_u32(BinaryCursor *cursor)
+{
+    uint8_t *at = cursor_take(cursor, 4);
+    uint32_t value = 0;
+    for (int i = 0; at && i < 4; i++)
+    {
+        value |= (uint32_t)at[i] << (8 * i);
+    }
+    return value;
+}
+
+static int64_t get_i64(BinaryCursor *cursor)
+{
+    uint8_t *at = cursor_take(cursor, 8);
+    uint64_t value = 0;
+    for (int i = 0; at && i < 8; i++)
+    {
+        value |= (uint64_t)at[i] << (8 * i);
+    }
+    return (int64_t)value;
+}
+
+static float get_f32(BinaryCursor *cursor)
+{
+    uint32_t bits = get_u32(cursor);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+size_t convertBmsStatusToBinary(const BmsStatus *status, uint8_t *buffer, size_t size)
+{
+    BinaryCursor cursor = {.data = buffer, .size = size};
+    uint16_t cells = status->connected_cells;
+    if (cells > BOARD_NUM_CELLS_MAX)
+    {
+        cells = BOARD_NUM_CELLS_MAX;
+    }
+
+    uint8_t flags = 0;
+    flags |= status->chg_enable ? BMS_STATUS_FLAG_CHG_ENABLE : 0;
+    flags |= status->dis_enable ? BMS_STATUS_FLAG_DIS_ENABLE : 0;
+    flags |= status->full ? BMS_STATUS_FLAG_FULL : 0;
+    flags |= status->empty ? BMS_STATUS_FLAG_EMPTY : 0;
+
+    put_u8(&cursor, TELEMETRY_BINARY_VERSION);
+    put_u16(&cursor, status->state);
+    put_u8(&cursor, flags);
+    put_u8(&cursor, cells);
+    put_u8(&cursor, BOARD_NUM_THERMISTORS_MAX);
+
+    for (int i = 0; i < cells; i++)
+    {
+        put_f32(&cursor, status->cell_voltages[i]);
+    }
+    put_f32(&cursor, status->cell_voltage_max);
+    put_f32(&cursor, status->cell_voltage_min);
+    put_f32(&cursor, status->cell_voltage_avg);
+    put_f32(&cursor, status->pack_voltage);
+    put_f32(&cursor, status->stack_voltage);
+    put_f32(&cursor, status->pack_current);
+
+    for (int i = 0; i < BOARD_NUM_THERMISTORS_MAX; i++)
+    {
+        put_f32(&cursor, status->bat_temps[i]);
+    }
+    put_f32(&cursor, status->bat_temp_max);
+    put_f32(&cursor, status->bat_temp_min);
+    put_f32(&cursor, status->bat_temp_avg);
+    put_f32(&cursor, status->mosfet_temp);
+    put_f32(&cursor, status->ic_temp);
+    put_f32(&cursor, status->mcu_temp);
+    put_f32(&cursor, status->soc);
+
+    put_u32(&cursor, status->balancing_status);
+    put_u32(&cursor, status->error_flags);
+    put_i64(&cursor, status->no_idle_timestamp);
+    put_i64(&cursor, status->timestamp);
+    put_u32(&cursor, status->boot_id);
+    put_u32(&cursor, status->sequence);
+    put_i64(&cursor, status->uptime_ms);
+
+    return cursor.overflow ? 0 : cursor.offset;
+}
+
+size_t convertLocationToBinary(const Location *location, uint8_t *buffer, size_t size)
+{
+    BinaryCursor cursor = {.data = buffer, .size = size};
+
+    put_u8(&cursor, TELEMETRY_BINARY_VERSION);
+    put_f32(&cursor, location->latitude);
+    put_f32(&cursor, location->longitude);
+    put_i64(&cursor, location->timestamp);
+    put_u32(&cursor, location->boot_id);
+    put_u32(&cursor, location->sequence);
+    put_i64(&cursor, location->uptime_ms);
+
+    return cursor.overflow ? 0 : cursor.offset;
+}
+
+size_t convertBatchToBinary(const BmsStatus *statuses, size_t statusCount, const Location *locations,
+                            size_t locationCount, uint8_t *buffer, size_t size)
+{
+    BinaryCursor cursor = {.data = buffer, .size = size};
+    if (statusCount > UINT8_MAX || locationCount > UINT8_MAX)
+    {
+        return 0;
+    }
+
+    put_u8(&cursor, TELEMETRY_BINARY_VERSION);
+    put_u8(&cursor, statusCount);
+    put_u8(&cursor, locationCount);
+
+    for (size_t i = 0; i < statusCount && !cursor.overflow; i++)
+    {
+        size_t length = convertBmsStatusToBinary(&statuses[i], buffer + cursor.offset, size - cursor.offset);
+        cursor.overflow |= length == 0;
+        cursor.offset += length;
+    }
+    for (size_t i = 0; i < locationCount && !cursor.overflow; i++)
+    {
+        size_t length = convertLocationToBinary(&locations[i], buffer + cursor.offset, size - cursor.offset);
+        cursor.overflow |= length == 0;
+        cursor.offset += length;
+    }
+
+    return cursor.overflow ? 0 : cursor.offset;
+}
+
+bool parseBmsStatusBinary(const uint8_t *payload, size_t length, BmsStatus *status)
+{
+    BinaryCursor cursor = {.data = (uint8_t *)payload, .size = length};
+    memset(status, 0, sizeof(*status));
+
+    uint8_t version = get_u8(&cursor);
+    if (version < 1 || version > TELEMETRY_BINARY_VERSION)
+    {
+        return false;
+    }
+    status->state = get_u16(&cursor);
+    uint8_t flags = get_u8(&cursor);
+    status->chg_enable = flags & BMS_STATUS_FLAG_CHG_ENABLE;
+    status->dis_enable = flags & BMS_STATUS_FLAG_DIS_ENABLE;
+    status->full = flags & BMS_STATUS_FLAG_FULL;
+    status->empty = flags & BMS_STATUS_FLAG_EMPTY;
+    status->connected_cells = get_u8(&cursor);
+    uint8_t thermistors = get_u8(&cursor);
+    if (status->connected_cells > BOARD_NUM_CELLS_MAX || thermistors > BOARD_NUM_THERMISTORS_MAX)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < status->connected_cells; i++)
+    {
+        status->cell_voltages[i] = get_f32(&cursor);
+    }
+    status->cell_voltage_max = get_f32(&cursor);
+    status->cell_voltage_min = get_f32(&cursor);
+    status->cell_voltage_avg = get_f32(&cursor);
+    status->pack_voltage = get_f32(&cursor);
+    status->stack_voltage = get_f32(&cursor);
+    status->pack_current = get_f32(&cursor);
+
+    for (int i = 0; i < thermistors; i++)
+    {
+        status->bat_temps[i] = get_f32(&cursor);
+    }
+    status->bat_temp_max = get_f32(&cursor);
+    status->bat_temp_min = get_f32(&cursor);
+    status->bat_temp_avg = get_f32(&cursor);
+    status->mosfet_temp = get_f32(&cursor);
+    status->ic_temp = get_f32(&cursor);
+    status->mcu_temp = get_f32(&cursor);
+    status->soc = get_f32(&cursor);
+
+    status->balancing_status = get_u32(&cursor);
+    status->error_flags = get_u32(&cursor);
+    status->no_idle_timestamp = get_i64(&cursor);
+    status->timestamp = get_i64(&cursor);
+    if (version >= 2)
+    {
+        status->boot_id = get_u32(&cursor);
+        status->sequence = get_u32(&cursor);
+        status->uptime_ms = get_i64(&cursor);
+    }
+
+    return !cursor.overflow;
+}
+
+bool parseLocationBinary(const uint8_t *payload, size_t length, Location *location)
+{
+    BinaryCursor cursor = {.data = (uint8_t *)payload, .size = length};
+    memset(location, 0, sizeof(*location));
+
+    uint8_t version = get_u8(&cursor);
+    if (version < 1 || version > TELEMETRY_BINARY_VERSION)
+    {
+        return false;
+    }
+    location->latitude = get_f32(&cursor);
+    location->longitude = get_f32(&cursor);
+    location->timestamp = get_i64(&cursor);
+    if (version >= 2)
+    {
+        location->boot_id = get_u32(&cursor);
+        location->sequence = get_u32(&cursor);
+        location->uptime_ms = get_i64(&cursor);
+    }
+
+    return !cursor.overflow;
+}
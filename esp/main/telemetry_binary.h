@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "telemetry.h"
+
+/**
+ * Compact little-endian wire format for BmsStatus and Location.
+ *
+ * Every message starts with a schema version byte so the aggregator can
+ * accept old and new layouts side by side. Only the `connected_cells` cell
+ * voltages are sent, all measurements stay IEEE-754 float32 and timestamps
+ * are int64 seconds since the epoch.
+ *
+ * BmsStatus (version 2):
+ *   u8   version
+ *   u16  state
+ *   u8   flags (bit 0 chg_enable, 1 dis_enable, 2 full, 3 empty)
+ *   u8   connected_cells (n)
+ *   u8   thermistors (m)
+ *   f32  cell_voltages[n]
+ *   f32  cell_voltage_max, cell_voltage_min, cell_voltage_avg
+ *   f32  pack_voltage, stack_voltage, pack_current
+ *   f32  bat_temps[m]
+ *   f32  bat_temp_max, bat_temp_min, bat_temp_avg
+ *   f32  mosfet_temp, ic_temp, mcu_temp, soc
+ *   u32  balancing_status, error_flags
+ *   i64  no_idle_timestamp, timestamp
+ *   u32  boot_id, sequence
+ *   i64  uptime_ms
+ *
+ * Location (version 2):
+ *   u8   version
+ *   f32  latitude, longitude
+ *   i64  timestamp
+ *   u32  boot_id, sequence
+ *   i64  uptime_ms
+ *
+ * Version 1 messages end before boot_id. They are still parsed, with
+ * boot_id, sequence and uptime_ms left 0.
+ *
+ * Batch (version 2):
+ *   u8   version
+ *   u8   battery count (b), location count (l)
+ *   b    BmsStatus messages
+ *   l    Location messages
+ */
+#define TELEMETRY_BINARY_VERSION 2
+
+#define BMS_STATUS_FLAG_CHG_ENABLE (1 << 0)
+#define BMS_STATUS_FLAG_DIS_ENABLE (1 << 1)
+#define BMS_STATUS_FLAG_FULL (1 << 2)
+#define BMS_STATUS_FLAG_EMPTY (1 << 3)
+
+#define BMS_STATUS_BINARY_MAX_LEN \
+    (6 + 4 * BOARD_NUM_CELLS_MAX + 4 * 6 + 4 * BOARD_NUM_THERMISTORS_MAX + 4 * 7 + 4 * 2 + 8 * 2 + 4 * 2 + 8)
+#define LOCATION_BINARY_LEN (1 + 4 * 2 + 8 + 4 * 2 + 8)
+#define BATCH_BINARY_MAX_LEN(count) (3 + (count) * (BMS_STATUS_BINARY_MAX_LEN + LOCATION_BINARY_LEN))
+
+/**
+ * Serialize a BmsStatus into `buffer`.
+ *
+ * @return Number of bytes written, or 0 if the message did not fit
+ */
+size_t convertBmsStatusToBinary(const BmsStatus *status, uint8_t *buffer, size_t size);
+
+/**
+ * Serialize a Location into `buffer`.
+ *
+ * @return Number of bytes written, or 0 if the message did not fit
+ */
+size_t convertLocationToBinary(const Location *location, uint8_t *buffer, size_t size);
+
+/**
+ * Serialize a batch of samples into one message.
+ *
+ * @return Number of bytes written, or 0 if the batch did not fit
+ */
+size_t convertBatchToBinary(const BmsStatus *statuses, size_t statusCount, const Location *locations,
+                            size_t locationCount, uint8_t *buffer, size_t size);
+
+/**
+ * Parse a binary BmsStatus. Cell voltages past `connected_cells` are zeroed.
+ *
+ * @return false if the payload is truncated or has an unknown version
+ */
+bool parseBmsStatusBinary(const uint8_t *payload, size_t length, BmsStatus *status);
+
+/**
+ * Parse a binary Location.
+ *
+ * @return false if the payload is truncated or has an unknown version
+ */
+bool parseLocationBinary(const uint8_t *payload, size_t length, Location *location);
@@ -0,0 +1,169 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry_boot.h"
+
+bool bootParseRegistration(const char *response)
+{
+    const char *at = strchr(response, ':');
+    if (at == NULL)
+    {
+        return false;
+    }
+
+    // "<n>,<stat>[,...]" to a query, a bare "<stat>" when unsolicited
+    char *end;
+    long first = strtol(at + 1, &end, 10);
+    if (end == at + 1)
+    {
+        return false;
+    }
+    long stat = first;
+    if (*end == ',')
+    {
+        const char *next = end + 1;
+        stat = strtol(next, &end, 10);
+        if (end == next)
+        {
+            return false;
+        }
+    }
+    return stat == 1 || stat == 5;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date, no timegm() on the target
+static int64_t days_from_civil(int year, int month, int day)
+{
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int yearOfEra = year - era * 400;
+    int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return (int64_t)era * 146097 + dayOfEra - 719468;
+}
+
+static bool read_number(const char **at, int digits, int *value)
+{
+    *value = 0;
+    for (int i = 0; i < digits; i++, (*at)++)
+    {
+        if (!isdigit((unsigned char)**at))
+        {
+            return false;
+        }
+        *value = *value * 10 + (**at - '0');
+    }
+    return true;
+}
+
+static bool expect_char(const char **at, char c)
+{
+    return *(*at)++ == c;
+}
+
+bool bootParseNetworkTime(const char *response, int64_t *utc_s)
+{
+    const char *at = response;
+    while (*at != '\0' && !isdigit((unsigned char)*at))
+    {
+        at++;
+    }
+
+    // yy/MM/dd,hh:mm:ss±zz
+    int year, month, day, hour, minute, second, zone;
+    if (!read_number(&at, 2, &year) || !expect_char(&at, '/') || !read_number(&at, 2, &month) ||
+        !expect_char(&at, '/') || !read_number(&at, 2, &day) || !expect_char(&at, ',') ||
+        !read_number(&at, 2, &hour) || !expect_char(&at, ':') || !read_number(&at, 2, &minute) ||
+        !expect_char(&at, ':') || !read_number(&at, 2, &second))
+    {
+        return false;
+    }
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+    {
+        return false;
+    }
+
+    char sign = *at++;
+    if ((sign != '+' && sign != '-') || !read_number(&at, 1, &zone))
+    {
+        return false;
+    }
+    int more;
+    const char *digit = at;
+    if (read_number(&digit, 1, &more))
+    {
+        zone = zone * 10 + more;
+    }
+
+    // Modems without network time report their 1980 (GPS epoch) default
+    year += year < 70 ? 2000 : 1900;
+    int64_t local = days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    int64_t utc = local - (sign == '-' ? -zone : zone) * 15 * 60;
+    if (utc < CLOCK_VALID_AFTER)
+    {
+        return false;
+    }
+    *utc_s = utc;
+    return true;
+}
+
+void clockSyncInit(ClockSync *clock)
+{
+    atomic_init(&clock->offset_s, 0);
+    atomic_init(&clock->source, CLOCK_SOURCE_NONE);
+}
+
+int64_t clockSyncStep(ClockSync *clock, int64_t system_s, int64_t utc_s, ClockSource source)
+{
+    // Steps add up, SNTP refining the network time moves boot-relative stamps along
+    int64_t step = utc_s - system_s;
+    atomic_fetch_add(&clock->offset_s, step);
+    atomic_store(&clock->source, source);
+    return step;
+}
+
+bool clockSyncIsSet(const ClockSync *clock)
+{
+    return atomic_load(&clock->source) != CLOCK_SOURCE_NONE;
+}
+
+int64_t clockSyncRestamp(const ClockSync *clock, int64_t timestamp)
+{
+    if (timestamp >= CLOCK_VALID_AFTER || !clockSyncIsSet(clock))
+    {
+        return timestamp;
+    }
+    return timestamp + atomic_load(&clock->offset_s);
+}
+
+void bootTimelineInit(BootTimeline *timeline)
+{
+    for (int i = 0; i < BOOT_MILESTONE_COUNT; i++)
+    {
+        atomic_init(&timeline->at_us[i], 0);
+    }
+}
+
+bool bootTimelineMark(BootTimeline *timeline, BootMilestone milestone, int64_t now_us)
+{
+    int_fast64_t expected = 0;
+    return atomic_compare_exchange_strong(&timeline->at_us[milestone], &expected, now_us > 0 ? now_us : 1);
+}
+
+int32_t bootTimelineMs(const BootTimeline *timeline, BootMilestone from, BootMilestone to)
+{
+    int64_t start = atomic_load(&timeline->at_us[from]);
+    int64_t end = atomic_load(&timeline->at_us[to]);
+    return start == 0 || end == 0 ? -1 : (int32_t)((end - start) / 1000);
+}
+
+const char *bootMilestoneName(BootMilestone milestone)
+{
+    static const char *const names[] = {
+        [BOOT_MODEM_READY] = "modem ready", [BOOT_REGISTERED] = "registered",
+        [BOOT_CLOCK_SET] = "clock set",     [BOOT_PPP_UP] = "PPP up",
+        [BOOT_MQTT_UP] = "MQTT up",         [BOOT_FIRST_PUBLISH] = "first publish",
+    };
+    return milestone < BOOT_MILESTONE_COUNT ? names[milestone] : "?";
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Boot-to-first-publish path: modem responses polled while it powers up,
+ * the network clock, re-stamping of samples taken before the clock was set
+ * and the boot timeline.
+ *
+ * The system clock counts seconds since boot until it is set, so a
+ * timestamp before CLOCK_VALID_AFTER is boot-relative. ClockSync keeps the
+ * total step applied to the clock, which turns such a timestamp into UTC
+ * once the network or SNTP provided the time.
+ */
+
+#define CLOCK_VALID_AFTER 1577836800 ///< 2020-01-01, earlier timestamps are seconds since boot
+
+typedef enum
+{
+    CLOCK_SOURCE_NONE,
+    CLOCK_SOURCE_NETWORK, ///< AT+CCLK, the time the cell network sent on registration
+    CLOCK_SOURCE_SNTP,
+} ClockSource;
+
+typedef struct
+{
+    atomic_int_fast64_t offset_s; ///< UTC minus the boot-relative clock
+    atomic_int source;            ///< ClockSource of the last step
+} ClockSync;
+
+typedef enum
+{
+    BOOT_MODEM_READY,   ///< Modem answered AT
+    BOOT_REGISTERED,    ///< Registered on the cell network
+    BOOT_CLOCK_SET,     ///< First valid UTC time
+    BOOT_PPP_UP,        ///< PPP got an address
+    BOOT_MQTT_UP,       ///< MQTT connected
+    BOOT_FIRST_PUBLISH, ///< First sample handed to MQTT
+    BOOT_MILESTONE_COUNT,
+} BootMilestone;
+
+typedef struct
+{
+    atomic_int_fast64_t at_us[BOOT_MILESTONE_COUNT]; ///< Time since boot, 0 until reached
+} BootTimeline;
+
+/**
+ * Parse an AT+CREG? / AT+CEREG? / AT+CGREG? answer ("+CREG: 0,1"), true
+ * when registered at home or roaming.
+ */
+bool bootParseRegistration(const char *response);
+
+/**
+ * Parse an AT+CCLK? answer ("+CCLK: \"24/03/10,23:50:00+08\"", local time
+ * and the zone in quarter hours) into UTC seconds. Fails for times before
+ * CLOCK_VALID_AFTER, which modems report until the network sent the time.
+ */
+bool bootParseNetworkTime(const char *response, int64_t *utc_s);
+
+void clockSyncInit(ClockSync *clock);
+
+/**
+ * Record that the clock is stepped from system_s to utc_s, returns the step.
+ */
+int64_t clockSyncStep(ClockSync *clock, int64_t system_s, int64_t utc_s, ClockSource source);
+
+bool clockSyncIsSet(const ClockSync *clock);
+
+/**
+ * UTC of a timestamp taken before the clock was set, other timestamps are
+ * returned unchanged.
+ */
+int64_t clockSyncRestamp(const ClockSync *clock, int64_t timestamp);
+
+void bootTimelineInit(BootTimeline *timeline);
+
+/**
+ * Record a milestone, only the first time it is reached counts. Returns
+ * true on that first time.
+ */
+bool bootTimelineMark(BootTimeline *timeline, BootMilestone milestone, int64_t now_us);
+
+/**
+ * Time between two reached milestones (ms), -1 when either is missing.
+ */
+int32_t bootTimelineMs(const BootTimeline *timeline, BootMilestone from, BootMilestone to);
+
+const char *bootMilestoneName(BootMilestone milestone);
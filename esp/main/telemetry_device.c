@@ -0,0 +1,34 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "telemetry_device.h"
+
+size_t deviceIdFromMac(const uint8_t mac[6], char *out, size_t size)
+{
+    int length = snprintf(out, size, "%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return length < 0 || (size_t)length >= size ? 0 : (size_t)length;
+}
+
+bool deviceIdIsValid(const char *deviceId)
+{
+    size_t length = strlen(deviceId);
+    if (length == 0 || length >= DEVICE_ID_MAX_LEN)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++)
+    {
+        char c = deviceId[i];
+        if (c <= ' ' || c > '~' || c == '/' || c == '+' || c == '#')
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t deviceTopic(char *out, size_t size, const char *deviceId, const char *suffix)
+{
+    int length = snprintf(out, size, DEVICE_TOPIC_PREFIX "%s/%s", deviceId, suffix);
+    return length < 0 || (size_t)length >= size ? 0 : (size_t)length;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Device identity and the per-device topic namespace.
+ *
+ * Every tracker publishes under /bicycle/<device-id>/, so the aggregator
+ * knows which bike a reading belongs to without it being repeated in each
+ * payload. The ID is the lowercase hex of the factory MAC unless one is
+ * provisioned in NVS.
+ */
+
+#define DEVICE_TOPIC_PREFIX "/bicycle/"
+#define DEVICE_ID_MAX_LEN 32    ///< Including the terminator
+#define DEVICE_TOPIC_MAX_LEN 80 ///< Including the terminator
+
+/**
+ * Write the 12 hex digit ID of a MAC address, returns its length.
+ */
+size_t deviceIdFromMac(const uint8_t mac[6], char *out, size_t size);
+
+/**
+ * An ID has to be a single non-empty topic level: no '/', no wildcards,
+ * only printable ASCII and shorter than DEVICE_ID_MAX_LEN.
+ */
+bool deviceIdIsValid(const char *deviceId);
+
+/**
+ * Write DEVICE_TOPIC_PREFIX "<device-id>/<suffix>", returns its length or 0
+ * when it does not fit.
+ */
+size_t deviceTopic(char *out, size_t size, const char *deviceId, const char *suffix);
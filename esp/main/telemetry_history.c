@@ -0,0 +1,463 @@
+#include <math.h>
+#include <string.h>
+
+#include "telemetry_binary.h"
+#include "telemetry_history.h"
+
+#define HISTORY_CELLS_SHIFT 4
+
+// Round to the nearest step and clamp, NaN ends up at min
+static int32_t quantize(float value, float scale, int32_t min, int32_t max)
+{
+    float scaled = roundf(value * scale);
+    if (!(scaled >= (float)min))
+    {
+        return min;
+    }
+    return scaled > (float)max ? max : (int32_t)scaled;
+}
+
+static uint16_t to_mv(float volts)
+{
+    return quantize(volts, 1000.0f, 0, UINT16_MAX);
+}
+
+static int16_t to_dd(float degrees)
+{
+    return quantize(degrees, 10.0f, INT16_MIN, INT16_MAX);
+}
+
+static int32_t clamp_s(int64_t seconds)
+{
+    return seconds < INT32_MIN ? INT32_MIN : seconds > INT32_MAX ? INT32_MAX : (int32_t)seconds;
+}
+
+bool historyPack(const BmsStatus *status, int64_t base, HistoryRecord *record)
+{
+    int64_t offset = (int64_t)status->timestamp - base;
+    if (offset < 0 || offset > UINT32_MAX)
+    {
+        return false;
+    }
+
+    uint8_t cells = status->connected_cells > BOARD_NUM_CELLS_MAX ? BOARD_NUM_CELLS_MAX : status->connected_cells;
+    uint8_t flags = cells << HISTORY_CELLS_SHIFT;
+    flags |= status->chg_enable ? BMS_STATUS_FLAG_CHG_ENABLE : 0;
+    flags |= status->dis_enable ? BMS_STATUS_FLAG_DIS_ENABLE : 0;
+    flags |= status->full ? BMS_STATUS_FLAG_FULL : 0;
+    flags |= status->empty ? BMS_STATUS_FLAG_EMPTY : 0;
+
+    record->offset_s = (uint32_t)offset;
+    record->idle_s = clamp_s((int64_t)status->timestamp - status->no_idle_timestamp);
+    record->error_flags = status->error_flags;
+    record->state = status->state;
+    record->flags = flags;
+    record->balancing = status->balancing_status & ((1u << BOARD_NUM_CELLS_MAX) - 1);
+
+    for (int i = 0; i < BOARD_NUM_CELLS_MAX; i++)
+    {
+        // Unconnected cells read 0 V, they are not sent anyway
+        record->cell_mv[i] = i < cells ? to_mv(status->cell_voltages[i]) : 0;
+    }
+    record->cell_max_mv = to_mv(status->cell_voltage_max);
+    record->cell_min_mv = to_mv(status->cell_voltage_min);
+    record->cell_avg_mv = to_mv(status->cell_voltage_avg);
+    record->pack_mv = to_mv(status->pack_voltage);
+    record->stack_mv = to_mv(status->stack_voltage);
+    record->current_10ma = quantize(status->pack_current, 100.0f, INT16_MIN, INT16_MAX);
+    record->soc_centi = quantize(status->soc, 100.0f, 0, UINT16_MAX);
+
+    for (int i = 0; i < BOARD_NUM_THERMISTORS_MAX; i++)
+    {
+        record->bat_temp_dd[i] = to_dd(status->bat_temps[i]);
+    }
+    record->bat_temp_max_dd = to_dd(status->bat_temp_max);
+    record->bat_temp_min_dd = to_dd(status->bat_temp_min);
+    record->bat_temp_avg_dd = to_dd(status->bat_temp_avg);
+    record->mosfet_temp_dd = to_dd(status->mosfet_temp);
+    record->ic_temp_dd = to_dd(status->ic_temp);
+    record->mcu_temp_dd = to_dd(status->mcu_temp);
+    record->sequence = status->sequence;
+    record->uptime_ms = (uint32_t)status->uptime_ms;
+    return true;
+}
+
+void historyUnpack(const HistoryRecord *record, int64_t base, BmsStatus *status)
+{
+    memset(status, 0, sizeof(*status));
+    status->timestamp = base + record->offset_s;
+    status->no_idle_timestamp = status->timestamp - record->idle_s;
+    status->error_flags = record->error_flags;
+    status->state = record->state;
+    status->connected_cells = record->flags >> HISTORY_CELLS_SHIFT;
+    status->chg_enable = record->flags & BMS_STATUS_FLAG_CHG_ENABLE;
+    status->dis_enable = record->flags & BMS_STATUS_FLAG_DIS_ENABLE;
+    status->full = record->flags & BMS_STATUS_FLAG_FULL;
+    status->empty = record->flags & BMS_STATUS_FLAG_EMPTY;
+    status->balancing_status = record->balancing;
+
+    for (int i = 0; i < BOARD_NUM_CELLS_MAX; i++)
+    {
+        status->cell_voltages[i] = record->cell_mv[i] / 1000.0f;
+    }
+    status->cell_voltage_max = record->cell_max_mv / 1000.0f;
+    status->cell_voltage_min = record->cell_min_mv / 1000.0f;
+    status->cell_voltage_avg = record->cell_avg_mv / 1000.0f;
+    status->pack_voltage = record->pack_mv / 1000.0f;
+    status->stack_voltage = record->stack_mv / 1000.0f;
+    status->pack_current = record->current_10ma / 100.0f;
+    status->soc = record->soc_centi / 100.0f;
+
+    for (int i = 0; i < BOARD_NUM_THERMISTORS_MAX; i++)
+    {
+        status->bat_temps[i] = record->bat_temp_dd[i] / 10.0f;
+    }
+    status->bat_temp_max = record->bat_temp_max_dd / 10.0f;
+    status->bat_temp_min = record->bat_temp_min_dd / 10.0f;
+    status->bat_temp_avg = record->bat_temp_avg_dd / 10.0f;
+    status->mosfet_temp = record->mosfet_temp_dd / 10.0f;
+    status->ic_temp = record->ic_temp_dd / 10.0f;
+    status->mcu_temp = record->mcu_temp_dd / 10.0f;
+    status->sequence = record->sequence;
+    status->uptime_ms = record->uptime_ms;
+}
+
+// Temperatures in the order of HistorySlot.temp_dd
+static void get_temps(const HistoryRecord *record, int16_t *dd)
+{
+    for (int i = 0; i < BOARD_NUM_THERMISTORS_MAX; i++)
+    {
+        dd[i] = record->bat_temp_dd[i];
+    }
+    dd[BOARD_NUM_THERMISTORS_MAX] = record->bat_temp_max_dd;
+    dd[BOARD_NUM_THERMISTORS_MAX + 1] = record->bat_temp_min_dd;
+    dd[BOARD_NUM_THERMISTORS_MAX + 2] = record->bat_temp_avg_dd;
+    dd[BOARD_NUM_THERMISTORS_MAX + 3] = record->mosfet_temp_dd;
+    dd[BOARD_NUM_THERMISTORS_MAX + 4] = record->ic_temp_dd;
+    dd[BOARD_NUM_THERMISTORS_MAX + 5] = record->mcu_temp_dd;
+}
+
+static void set_temps(HistoryRecord *record, const int16_t *dd)
+{
+    for (int i = 0; i < BOARD_NUM_THERMISTORS_MAX; i++)
+    {
+        record->bat_temp_dd[i] = dd[i];
+    }
+    record->bat_temp_max_dd = dd[BOARD_NUM_THERMISTORS_MAX];
+    record->bat_temp_min_dd = dd[BOARD_NUM_THERMISTORS_MAX + 1];
+    record->bat_temp_avg_dd = dd[BOARD_NUM_THERMISTORS_MAX + 2];
+    record->mosfet_temp_dd = dd[BOARD_NUM_THERMISTORS_MAX + 3];
+    record->ic_temp_dd = dd[BOARD_NUM_THERMISTORS_MAX + 4];
+    record->mcu_temp_dd = dd[BOARD_NUM_THERMISTORS_MAX + 5];
+}
+
+// Sum, maximum and minimum of the connected cells, all 0 without any
+static void cell_stats(const HistoryRecord *record, int32_t *sum, uint16_t *max, uint16_t *min)
+{
+    int cells = record->flags >> HISTORY_CELLS_SHIFT;
+    *sum = 0;
+    *max = 0;
+    *min = cells > 0 ? UINT16_MAX : 0;
+    for (int i = 0; i < cells; i++)
+    {
+        *sum += record->cell_mv[i];
+        *max = record->cell_mv[i] > *max ? record->cell_mv[i] : *max;
+        *min = record->cell_mv[i] < *min ? record->cell_mv[i] : *min;
+    }
+}
+
+static bool fits(int64_t value, int64_t min, int64_t max)
+{
+    return value >= min && value <= max;
+}
+
+bool historyDeltaPack(const HistoryRecord *previous, const HistoryRecord *record, HistorySlot *slot)
+{
+    // Rarely change, a change is kept in full
+    if (record->state != previous->state || record->error_flags != previous->error_flags ||
+        (record->flags >> HISTORY_CELLS_SHIFT) != (previous->flags >> HISTORY_CELLS_SHIFT))
+    {
+        return false;
+    }
+
+    int32_t sum;
+    uint16_t max;
+    uint16_t min;
+    cell_stats(record, &sum, &max, &min);
+    if (record->cell_max_mv != max || record->cell_min_mv != min)
+    {
+        return false;
+    }
+
+    int64_t offset = (int64_t)record->offset_s - previous->offset_s;
+    int64_t noIdle = (offset - record->idle_s) + previous->idle_s;
+    int64_t uptime = (int64_t)(uint32_t)(record->uptime_ms - previous->uptime_ms) - 1000 * offset;
+    uint32_t sequence = record->sequence - previous->sequence;
+    int32_t stack = record->stack_mv - sum;
+    int32_t pack = record->pack_mv - record->stack_mv;
+    int32_t soc = record->soc_centi - previous->soc_centi;
+    if (!fits(offset, 0, UINT16_MAX) || !fits(noIdle, INT16_MIN, INT16_MAX) || !fits(uptime, INT16_MIN, INT16_MAX) ||
+        sequence > UINT8_MAX || !fits(stack, INT8_MIN, INT8_MAX) || !fits(pack, INT8_MIN, INT8_MAX) ||
+        !fits(soc, INT8_MIN, INT8_MAX))
+    {
+        return false;
+    }
+
+    int cells = record->flags >> HISTORY_CELLS_SHIFT;
+    for (int i = 0; i < BOARD_NUM_CELLS_MAX; i++)
+    {
+        int32_t cell = i < cells ? record->cell_mv[i] - record->cell_avg_mv : 0;
+        if (!fits(cell, INT8_MIN, INT8_MAX))
+        {
+            return false;
+        }
+        slot->cell_mv[i] = cell;
+    }
+
+    int16_t temps[HISTORY_TEMPS];
+    int16_t previousTemps[HISTORY_TEMPS];
+    get_temps(record, temps);
+    get_temps(previous, previousTemps);
+    for (int i = 0; i < HISTORY_TEMPS; i++)
+    {
+        int32_t temp = temps[i] - previousTemps[i];
+        if (!fits(temp, INT8_MIN, INT8_MAX))
+        {
+            return false;
+        }
+        slot->temp_dd[i] = temp;
+    }
+
+    slot->flags = (record->flags & ((1 << HISTORY_CELLS_SHIFT) - 1)) | HISTORY_SLOT_DELTA << HISTORY_CELLS_SHIFT;
+    slot->balancing = record->balancing;
+    slot->offset_s = offset;
+    slot->no_idle_s = noIdle;
+    slot->uptime_ms = uptime;
+    slot->cell_avg_mv = record->cell_avg_mv;
+    slot->current_10ma = record->current_10ma;
+    slot->sequence = sequence;
+    slot->soc_centi = soc;
+    slot->stack_mv = stack;
+    slot->pack_mv = pack;
+    return true;
+}
+
+void historyDeltaUnpack(const HistoryRecord *previous, const HistorySlot *slot, HistoryRecord *record)
+{
+    *record = *previous;
+    record->flags = (previous->flags & ~((1 << HISTORY_CELLS_SHIFT) - 1)) |
+                    (slot->flags & ((1 << HISTORY_CELLS_SHIFT) - 1));
+    record->balancing = slot->balancing;
+    record->offset_s = previous->offset_s + slot->offset_s;
+    record->idle_s = (int64_t)previous->idle_s + slot->offset_s - slot->no_idle_s;
+    record->uptime_ms = previous->uptime_ms + (uint32_t)(1000 * slot->offset_s + slot->uptime_ms);
+    record->sequence = previous->sequence + slot->sequence;
+    record->cell_avg_mv = slot->cell_avg_mv;
+    record->current_10ma = slot->current_10ma;
+    record->soc_centi = previous->soc_centi + slot->soc_centi;
+
+    int cells = record->flags >> HISTORY_CELLS_SHIFT;
+    for (int i = 0; i < BOARD_NUM_CELLS_MAX; i++)
+    {
+        record->cell_mv[i] = i < cells ? record->cell_avg_mv + slot->cell_mv[i] : 0;
+    }
+    int32_t sum;
+    cell_stats(record, &sum, &record->cell_max_mv, &record->cell_min_mv);
+    record->stack_mv = sum + slot->stack_mv;
+    record->pack_mv = record->stack_mv + slot->pack_mv;
+
+    int16_t temps[HISTORY_TEMPS];
+    get_temps(previous, temps);
+    for (int i = 0; i < HISTORY_TEMPS; i++)
+    {
+        temps[i] += slot->temp_dd[i];
+    }
+    set_temps(record, temps);
+}
+
+void historyRingInit(HistoryRing *ring, HistorySlot *slots, uint32_t depth)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->slots = slots;
+    ring->depth = depth;
+}
+
+// A record kept in full starts with its cell count, a difference with HISTORY_SLOT_DELTA
+static uint32_t slots_at(const HistoryRing *ring, uint32_t slot)
+{
+    return ring->slots[slot].flags >> HISTORY_CELLS_SHIFT == HISTORY_SLOT_DELTA ? 1 : HISTORY_RECORD_SLOTS;
+}
+
+static void read_record(const HistoryRing *ring, uint32_t slot, HistoryRecord *record)
+{
+    uint8_t *bytes = (uint8_t *)record;
+    for (size_t done = 0; done < sizeof(*record); done += sizeof(HistorySlot), slot = (slot + 1) % ring->depth)
+    {
+        size_t length = sizeof(*record) - done < sizeof(HistorySlot) ? sizeof(*record) - done : sizeof(HistorySlot);
+        memcpy(bytes + done, &ring->slots[slot], length);
+    }
+}
+
+static void write_record(HistoryRing *ring, uint32_t slot, const HistoryRecord *record)
+{
+    const uint8_t *bytes = (const uint8_t *)record;
+    for (size_t done = 0; done < sizeof(*record); done += sizeof(HistorySlot), slot = (slot + 1) % ring->depth)
+    {
+        size_t length = sizeof(*record) - done < sizeof(HistorySlot) ? sizeof(*record) - done : sizeof(HistorySlot);
+        memcpy(&ring->slots[slot], bytes + done, length);
+    }
+}
+
+// The record at slot, previous is the one before it
+static void decode_at(const HistoryRing *ring, uint32_t slot, const HistoryRecord *previous, HistoryRecord *record)
+{
+    if (slots_at(ring, slot) == 1)
+    {
+        historyDeltaUnpack(previous, &ring->slots[slot], record);
+    }
+    else
+    {
+        read_record(ring, slot, record);
+    }
+}
+
+// Drop the oldest record, the next one becomes the oldest
+static void drop_oldest(HistoryRing *ring)
+{
+    uint32_t length = slots_at(ring, ring->head);
+    ring->head = (ring->head + length) % ring->depth;
+    ring->used -= length;
+    ring->count--;
+    if (ring->count > 0)
+    {
+        HistoryRecord next;
+        decode_at(ring, ring->head, &ring->oldest, &next);
+        ring->oldest = next;
+    }
+}
+
+// Count the offsets from an earlier base, false when one of them would not fit
+static bool move_base_back(HistoryRing *ring, int64_t base)
+{
+    uint64_t shift = ring->base - base;
+    HistoryRecord record = ring->oldest;
+    for (uint32_t slot = ring->head, i = 0; i < ring->count; i++)
+    {
+        if (i > 0)
+        {
+            HistoryRecord next;
+            decode_at(ring, slot, &record, &next);
+            record = next;
+        }
+        if (record.offset_s + shift > UINT32_MAX)
+        {
+            return false;
+        }
+        slot = (slot + slots_at(ring, slot)) % ring->depth;
+    }
+
+    // Only the records kept in full hold offsets, the others count from them
+    for (uint32_t slot = ring->head, i = 0; i < ring->count; i++)
+    {
+        uint32_t length = slots_at(ring, slot);
+        if (length > 1)
+        {
+            read_record(ring, slot, &record);
+            record.offset_s += shift;
+            write_record(ring, slot, &record);
+        }
+        slot = (slot + length) % ring->depth;
+    }
+    ring->oldest.offset_s += shift;
+    ring->newest.offset_s += shift;
+    ring->base = base;
+    return true;
+}
+
+bool historyRingPush(HistoryRing *ring, const BmsStatus *status)
+{
+    if (ring->depth < HISTORY_RECORD_SLOTS)
+    {
+        return false;
+    }
+    if (ring->count == 0)
+    {
+        ring->base = status->timestamp;
+        ring->boot_id = status->boot_id;
+        ring->uptime_ms = status->uptime_ms;
+    }
+    else if (status->boot_id != ring->boot_id)
+    {
+        return false;
+    }
+    else if (status->timestamp < ring->base && !move_base_back(ring, status->timestamp))
+    {
+        return false;
+    }
+
+    HistoryRecord record;
+    if (!historyPack(status, ring->base, &record))
+    {
+        return false;
+    }
+    HistorySlot delta;
+    uint32_t length = ring->count > 0 && historyDeltaPack(&ring->newest, &record, &delta) ? 1 : HISTORY_RECORD_SLOTS;
+    while (ring->depth - ring->used < length)
+    {
+        drop_oldest(ring);
+        ring->overwritten++;
+    }
+
+    uint32_t slot = (ring->head + ring->used) % ring->depth;
+    if (length == 1)
+    {
+        ring->slots[slot] = delta;
+    }
+    else
+    {
+        write_record(ring, slot, &record);
+    }
+    if (ring->count == 0)
+    {
+        ring->oldest = record;
+    }
+    ring->newest = record;
+    ring->used += length;
+    ring->count++;
+    if (status->uptime_ms > ring->uptime_ms)
+    {
+        ring->uptime_ms = status->uptime_ms;
+    }
+    return true;
+}
+
+bool historyRingGet(const HistoryRing *ring, uint32_t index, BmsStatus *status)
+{
+    if (index >= ring->count)
+    {
+        return false;
+    }
+    HistoryRecord record = ring->oldest;
+    for (uint32_t slot = ring->head, i = 0; i < index; i++)
+    {
+        slot = (slot + slots_at(ring, slot)) % ring->depth;
+        HistoryRecord next;
+        decode_at(ring, slot, &record, &next);
+        record = next;
+    }
+    historyUnpack(&record, ring->base, status);
+    status->boot_id = ring->boot_id;
+    // The newest uptime minus how far the low bits are behind it
+    status->uptime_ms = ring->uptime_ms - (uint32_t)((uint32_t)ring->uptime_ms - record.uptime_ms);
+    return true;
+}
+
+bool historyRingPop(HistoryRing *ring, BmsStatus *status)
+{
+    if (!historyRingGet(ring, 0, status))
+    {
+        return false;
+    }
+    drop_oldest(ring);
+    return true;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "telemetry.h"
+
+/**
+ * Compact in-RAM history of BmsStatus samples.
+ *
+ * A HistoryRecord holds a sample in fixed point instead of floats:
+ *
+ *   - voltages in millivolts, within 0.5 mV (0 to 65.535 V)
+ *   - pack_current in 10 mA steps, within 5 mA (±327.67 A)
+ *   - temperatures in tenths of a degree, within 0.05 °C (±3276.7 °C)
+ *   - soc in hundredths of a percent, within 0.005 % (0 to 655.35 %)
+ *   - timestamp as seconds after the ring's base, no_idle_timestamp as
+ *     seconds before timestamp
+ *   - flags, connected_cells and balancing_status (one switch per cell)
+ *     packed into two bytes, cell voltages past connected_cells as 0
+ *   - sequence as is, uptime_ms as its low 32 bits. The ring keeps the
+ *     boot_id of its samples and the newest uptime_ms and restores the
+ *     others from it, which holds for samples up to 49 days apart
+ *
+ * Values outside a range are clamped to it. Unpacking and packing a record
+ * again gives the same record, so a sample can be kept here and encoded
+ * later without drifting.
+ *
+ * The ring keeps most records as a HistorySlot, the difference to the
+ * record before:
+ *
+ *   - cell voltages relative to cell_voltage_avg, cell_voltage_max and
+ *     cell_voltage_min not at all as they are those of the cells
+ *   - stack_voltage relative to the sum of the cells, pack_voltage relative
+ *     to stack_voltage
+ *   - temperatures, soc, timestamp, no_idle_timestamp, sequence and
+ *     uptime_ms relative to the record before
+ *
+ * Decoding gives back the same record. A record whose differences do not
+ * fit, whose state, error_flags or connected_cells changed, or that comes
+ * first, is kept in full over HISTORY_RECORD_SLOTS slots instead.
+ *
+ * The ring is preallocated and keeps the newest samples, the oldest ones
+ * are overwritten when full. Not thread safe, a ring belongs to the uplink
+ * task.
+ */
+
+_Static_assert(BOARD_NUM_CELLS_MAX <= 8, "balancing_status is kept in one byte");
+_Static_assert(BOARD_NUM_CELLS_MAX < 15, "connected_cells is kept in four bits, 15 marks a HistorySlot");
+
+/// Temperatures of a record: bat_temps, then max, min, avg, mosfet, ic and mcu
+#define HISTORY_TEMPS (BOARD_NUM_THERMISTORS_MAX + 6)
+
+typedef struct
+{
+    uint8_t flags;     ///< BMS_STATUS_FLAG_* in bits 0-3, connected_cells in bits 4-7
+    uint8_t balancing; ///< balancing_status of the cells
+    uint16_t state;
+    uint32_t offset_s; ///< timestamp - base of the ring
+    int32_t idle_s;    ///< timestamp - no_idle_timestamp
+    uint32_t error_flags;
+    uint16_t cell_mv[BOARD_NUM_CELLS_MAX];
+    uint16_t cell_max_mv;
+    uint16_t cell_min_mv;
+    uint16_t cell_avg_mv;
+    uint16_t pack_mv;
+    uint16_t stack_mv;
+    int16_t current_10ma;
+    uint16_t soc_centi;
+    int16_t bat_temp_dd[BOARD_NUM_THERMISTORS_MAX];
+    int16_t bat_temp_max_dd;
+    int16_t bat_temp_min_dd;
+    int16_t bat_temp_avg_dd;
+    int16_t mosfet_temp_dd;
+    int16_t ic_temp_dd;
+    int16_t mcu_temp_dd;
+    uint32_t sequence;
+    uint32_t uptime_ms; ///< Low 32 bits of uptime_ms
+} HistoryRecord;
+
+/**
+ * A record as the difference to the one before, or part of a full record.
+ * flags comes first in both, bits 4-7 are HISTORY_SLOT_DELTA here.
+ */
+typedef struct
+{
+    uint8_t flags; ///< BMS_STATUS_FLAG_* in bits 0-3
+    uint8_t balancing;
+    uint16_t offset_s;                   ///< Seconds after the record before
+    int16_t no_idle_s;                   ///< no_idle_timestamp - the one of the record before
+    int16_t uptime_ms;                   ///< uptime_ms - the one before - 1000 * offset_s
+    uint16_t cell_avg_mv;                ///< As in the record
+    int16_t current_10ma;                ///< As in the record
+    uint8_t sequence;                    ///< sequence - the one before
+    int8_t soc_centi;                    ///< soc_centi - the one before
+    int8_t cell_mv[BOARD_NUM_CELLS_MAX]; ///< cell_mv - cell_avg_mv, 0 past connected_cells
+    int8_t stack_mv;                     ///< stack_mv - sum of cell_mv
+    int8_t pack_mv;                      ///< pack_mv - stack_mv
+    int8_t temp_dd[HISTORY_TEMPS];       ///< Temperatures - the ones before
+} HistorySlot;
+
+#define HISTORY_SLOT_DELTA 15
+
+/// Slots taken by a record kept in full
+#define HISTORY_RECORD_SLOTS ((sizeof(HistoryRecord) + sizeof(HistorySlot) - 1) / sizeof(HistorySlot))
+
+typedef struct
+{
+    HistorySlot *slots;
+    uint32_t depth;       ///< Slots
+    uint32_t head;        ///< Slot of the oldest record
+    uint32_t used;        ///< Slots taken
+    uint32_t count;       ///< Records kept
+    int64_t base;         ///< Epoch seconds the record offsets count from
+    uint32_t overwritten; ///< Oldest records replaced by newer ones
+    uint32_t boot_id;     ///< Of every record
+    int64_t uptime_ms;    ///< Newest uptime_ms of the records
+    HistoryRecord oldest; ///< Decoded, the next slots count from it
+    HistoryRecord newest; ///< Decoded, the next push counts from it
+} HistoryRing;
+
+/**
+ * Pack a sample taken at or after base (epoch seconds). Returns false when
+ * the timestamp does not fit in the offset.
+ */
+bool historyPack(const BmsStatus *status, int64_t base, HistoryRecord *record);
+
+/**
+ * Unpack a record. boot_id is left 0 and uptime_ms holds only the low 32
+ * bits, historyRingGet() restores both.
+ */
+void historyUnpack(const HistoryRecord *record, int64_t base, BmsStatus *status);
+
+/**
+ * Keep record as the difference to previous, with the same base. Returns
+ * false when it does not fit a slot.
+ */
+bool historyDeltaPack(const HistoryRecord *previous, const HistoryRecord *record, HistorySlot *slot);
+
+/**
+ * The record a slot of historyDeltaPack() was made from.
+ */
+void historyDeltaUnpack(const HistoryRecord *previous, const HistorySlot *slot, HistoryRecord *record);
+
+void historyRingInit(HistoryRing *ring, HistorySlot *slots, uint32_t depth);
+
+/**
+ * Keep a sample, overwriting the oldest ones when the ring is full. A sample
+ * older than the base moves the base back. Returns false when the sample is
+ * too far from the others for the offsets (136 years), comes from another
+ * boot than the samples kept, or needs more slots than the ring has.
+ */
+bool historyRingPush(HistoryRing *ring, const BmsStatus *status);
+
+/**
+ * Sample index records after the oldest, false when there are fewer.
+ * Decodes the slots up to it.
+ */
+bool historyRingGet(const HistoryRing *ring, uint32_t index, BmsStatus *status);
+
+/**
+ * Take out the oldest sample, false when the ring is empty.
+ */
+bool historyRingPop(HistoryRing *ring, BmsStatus *status);
@@ -0,0 +1,194 @@
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry_json.h"
+
+/**
+ * Append-only view of a caller-provided buffer. Once a write does not fit,
+ * `overflow` is latched and every following write is ignored.
+ */
+typedef struct
+{
+    char *buffer;
+    size_t size;
+    size_t length;
+    bool overflow;
+} JsonWriter;
+
+static void json_put_raw(JsonWriter *writer, const char *data, size_t length)
+{
+    if (writer->overflow || writer->length + length >= writer->size)
+    {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(writer->buffer + writer->length, data, length);
+    writer->length += length;
+}
+
+static void json_put_key(JsonWriter *writer, const char *key)
+{
+    // Every key but the first one is preceded by a separator
+    if (writer->length > 1)
+    {
+        json_put_raw(writer, ",", 1);
+    }
+    json_put_raw(writer, "\"", 1);
+    json_put_raw(writer, key, strlen(key));
+    json_put_raw(writer, "\":", 2);
+}
+
+/**
+ * Print a number exactly like cJSON's print_number(): integral values go
+ * through "%d" of the clamped valueint, everything else is printed with 15
+ * significant digits and falls back to 17 when that does not round-trip.
+ */
+static void json_put_number(JsonWriter *writer, double number)
+{
+    char number_buffer[26];
+    int length;
+
+    if (isnan(number) || isinf(number))
+    {
+        json_put_raw(writer, "null", 4);
+        return;
+    }
+
+    int valueint;
+    if (number >= INT_MAX)
+    {
+        valueint = INT_MAX;
+    }
+    else if (number <= (double)INT_MIN)
+    {
+        valueint = INT_MIN;
+    }
+    else
+    {
+        valueint = (int)number;
+    }
+
+    if (number == (double)valueint)
+    {
+        length = snprintf(number_buffer, sizeof(number_buffer), "%d", valueint);
+    }
+    else
+    {
+        length = snprintf(number_buffer, sizeof(number_buffer), "%1.15g", number);
+
+        double test = strtod(number_buffer, NULL);
+        double max_value = fabs(test) > fabs(number) ? fabs(test) : fabs(number);
+        if (fabs(test - number) > max_value * DBL_EPSILON)
+        {
+            length = snprintf(number_buffer, sizeof(number_buffer), "%1.17g", number);
+        }
+    }
+
+    if (length < 0 || (size_t)length >= sizeof(number_buffer))
+    {
+        writer->overflow = true;
+        return;
+    }
+    json_put_raw(writer, number_buffer, length);
+}
+
+static void json_put_bool(JsonWriter *writer, bool value)
+{
+    if (value)
+    {
+        json_put_raw(writer, "true", 4);
+    }
+    else
+    {
+        json_put_raw(writer, "false", 5);
+    }
+}
+
+// Format timestamp as RFC3339 string
+static void json_put_timestamp(JsonWriter *writer, time_t timestamp)
+{
+    char timestampString[21];
+    struct tm timeinfo;
+
+    gmtime_r(&timestamp, &timeinfo);
+    size_t length = strftime(timestampString, sizeof(timestampString), "%Y-%m-%dT%H:%M:%SZ", &timeinfo);
+
+    json_put_raw(writer, "\"", 1);
+    json_put_raw(writer, timestampString, length);
+    json_put_raw(writer, "\"", 1);
+}
+
+static void json_put_float_array(JsonWriter *writer, const float *values, int count)
+{
+    json_put_raw(writer, "[", 1);
+    for (int i = 0; i < count; i++)
+    {
+        if (i > 0)
+        {
+            json_put_raw(writer, ",", 1);
+        }
+        json_put_number(writer, values[i]);
+    }
+    json_put_raw(writer, "]", 1);
+}
+
+static size_t json_finish(JsonWriter *writer)
+{
+    json_put_raw(writer, "}", 1);
+    if (writer->overflow)
+    {
+        if (writer->size > 0)
+        {
+            writer->buffer[0] = '\0';
+        }
+        return 0;
+    }
+    writer->buffer[writer->length] = '\0';
+    return writer->length;
+}
+
+// convertBmsStatusToJSON() and convertLocationToJSON(), from schema/telemetry.schema
+#include "telemetry_json_gen.inc"
+
+size_t convertBatchToJSON(const BmsStatus *statuses, size_t statusCount, const Location *locations,
+                          size_t locationCount, char *buffer, size_t size)
+{
+    JsonWriter writer = {.buffer = buffer, .size = size};
+
+    json_put_raw(&writer, "{", 1);
+
+    json_put_key(&writer, "batteries");
+    json_put_raw(&writer, "[", 1);
+    for (size_t i = 0; i < statusCount && !writer.overflow; i++)
+    {
+        if (i > 0)
+        {
+            json_put_raw(&writer, ",", 1);
+        }
+        size_t length = convertBmsStatusToJSON(&statuses[i], buffer + writer.length, size - writer.length);
+        writer.overflow |= length == 0;
+        writer.length += length;
+    }
+    json_put_raw(&writer, "]", 1);
+
+    json_put_key(&writer, "locations");
+    json_put_raw(&writer, "[", 1);
+    for (size_t i = 0; i < locationCount && !writer.overflow; i++)
+    {
+        if (i > 0)
+        {
+            json_put_raw(&writer, ",", 1);
+        }
+        size_t length = convertLocationToJSON(&locations[i], buffer + writer.length, size - writer.length);
+        writer.overflow |= length == 0;
+        writer.length += length;
+    }
+    json_put_raw(&writer, "]", 1);
+
+    return json_finish(&writer);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "telemetry.h"
+
+/**
+ * Upper bounds for the unformatted JSON documents, including the terminating
+ * NUL. Every number is at most 24 characters wide ("%1.17g" of a negative
+ * float with an exponent), so these leave room for all keys and separators.
+ */
+#define BMS_STATUS_JSON_MAX_LEN 1152
+#define LOCATION_JSON_MAX_LEN 256
+#define BATCH_JSON_MAX_LEN(count) (32 + (count) * (BMS_STATUS_JSON_MAX_LEN + LOCATION_JSON_MAX_LEN))
+
+/**
+ * Serialize a BmsStatus into `buffer` without touching the heap.
+ *
+ * The output is byte-identical to cJSON_PrintUnformatted() of the object tree
+ * the firmware used to build, so the aggregator does not need to change.
+ *
+ * @return Length of the document (excluding the NUL), or 0 if it did not fit
+ */
+size_t convertBmsStatusToJSON(const BmsStatus *status, char *buffer, size_t size);
+
+/**
+ * Serialize a Location into `buffer` without touching the heap.
+ *
+ * @return Length of the document (excluding the NUL), or 0 if it did not fit
+ */
+size_t convertLocationToJSON(const Location *location, char *buffer, size_t size);
+
+/**
+ * Serialize a batch of samples as {"batteries":[...],"locations":[...]}, where
+ * every element is the document convertBmsStatusToJSON() or
+ * convertLocationToJSON() would produce on its own.
+ *
+ * @return Length of the document (excluding the NUL), or 0 if it did not fit
+ */
+size_t convertBatchToJSON(const BmsStatus *statuses, size_t statusCount, const Location *locations,
+                          size_t locationCount, char *buffer, size_t size);
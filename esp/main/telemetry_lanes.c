@@ -0,0 +1,164 @@
+#include <string.h>
+
+#include "telemetry_lanes.h"
+
+bool sendLaneInit(SendLane *lane, LanePolicy policy, uint8_t *buffer, uint32_t size, LaneMessage *messages,
+                  uint32_t capacity)
+{
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+    {
+        return false;
+    }
+    memset(lane, 0, sizeof(*lane));
+    lane->policy = policy;
+    lane->buffer = buffer;
+    lane->size = size;
+    lane->messages = messages;
+    lane->capacity = capacity;
+    return true;
+}
+
+static LaneMessage *message_at(const SendLane *lane, uint32_t index)
+{
+    return &lane->messages[(lane->head + index) & (lane->capacity - 1)];
+}
+
+static void remove_head(SendLane *lane)
+{
+    LaneMessage *message = message_at(lane, 0);
+    if (message->live)
+    {
+        lane->bytes -= message->length;
+    }
+    lane->head = (lane->head + 1) & (lane->capacity - 1);
+    if (--lane->count == 0)
+    {
+        lane->tail = 0;
+    }
+}
+
+// Contiguous room for length bytes after the newest payload, or from offset 0
+static bool allocate(const SendLane *lane, uint32_t length, uint32_t *offset)
+{
+    if (lane->count == 0)
+    {
+        *offset = 0;
+        return length <= lane->size;
+    }
+
+    // Once wrapped, tail stays strictly below the oldest payload so the two cases never look alike
+    uint32_t start = message_at(lane, 0)->offset;
+    if (lane->tail > start)
+    {
+        if (lane->size - lane->tail >= length)
+        {
+            *offset = lane->tail;
+            return true;
+        }
+        if (length < start)
+        {
+            *offset = 0;
+            return true;
+        }
+        return false;
+    }
+    if (start - lane->tail > length)
+    {
+        *offset = lane->tail;
+        return true;
+    }
+    return false;
+}
+
+bool sendLanePush(SendLane *lane, uint8_t topic, uint8_t key, const void *payload, uint32_t length, int64_t now_us)
+{
+    if (length == 0 || length > lane->size)
+    {
+        lane->counters.dropped++;
+        return false;
+    }
+
+    if (lane->policy == LANE_COALESCE_LATEST)
+    {
+        for (uint32_t i = 0; i < lane->count; i++)
+        {
+            LaneMessage *message = message_at(lane, i);
+            if (message->live && message->key == key)
+            {
+                message->live = false;
+                lane->bytes -= message->length;
+                lane->counters.coalesced++;
+            }
+        }
+    }
+
+    uint32_t offset;
+    while (lane->count == lane->capacity || !allocate(lane, length, &offset))
+    {
+        if (message_at(lane, 0)->live)
+        {
+            lane->counters.dropped++;
+        }
+        remove_head(lane);
+    }
+
+    LaneMessage *message = message_at(lane, lane->count);
+    *message = (LaneMessage){
+        .offset = offset,
+        .length = length,
+        .enqueued_us = now_us,
+        .topic = topic,
+        .key = key,
+        .live = true,
+    };
+    memcpy(lane->buffer + offset, payload, length);
+    lane->tail = offset + length;
+    lane->count++;
+    lane->bytes += length;
+    lane->counters.enqueued++;
+    return true;
+}
+
+const LaneMessage *sendLanePeek(SendLane *lane)
+{
+    while (lane->count > 0 && !message_at(lane, 0)->live)
+    {
+        remove_head(lane);
+    }
+    return lane->count > 0 ? message_at(lane, 0) : NULL;
+}
+
+const uint8_t *sendLanePayload(const SendLane *lane, const LaneMessage *message)
+{
+    return lane->buffer + message->offset;
+}
+
+void sendLanePop(SendLane *lane)
+{
+    if (sendLanePeek(lane) == NULL)
+    {
+        return;
+    }
+    lane->counters.sent++;
+    remove_head(lane);
+}
+
+void alarmDetectorInit(AlarmDetector *detector, float max_temperature)
+{
+    memset(detector, 0, sizeof(*detector));
+    detector->max_temperature = max_temperature;
+}
+
+bool alarmCheck(AlarmDetector *detector, const BmsStatus *status)
+{
+    BmsFault fault = {
+        .error_flags = status->error_flags,
+        .empty = status->empty,
+        .over_temperature = status->bat_temp_max >= detector->max_temperature,
+    };
+    const BmsFault *last = &detector->last;
+    bool changed = fault.error_flags != last->error_flags || fault.empty != last->empty ||
+                   fault.over_temperature != last->over_temperature;
+    detector->last = fault;
+    return changed;
+}
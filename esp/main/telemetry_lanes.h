@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "telemetry.h"
+
+/**
+ * Priority lanes in front of the MQTT client.
+ *
+ * Encoded messages wait in a lane until the uplink hands them to MQTT. The
+ * alarm lane is always emptied first, so a BMS fault does not queue behind
+ * routine samples after a reconnect. Each lane holds at most its byte
+ * budget, which bounds what piles up while the link is slow or down:
+ *
+ *   - LANE_DROP_OLDEST: a message that does not fit evicts the oldest ones
+ *   - LANE_COALESCE_LATEST: a message replaces the queued one with the same
+ *     key (e.g. the last position), and evicts the oldest when still full
+ *
+ * Payloads live in a byte ring, each contiguous: one that does not fit
+ * before the end of the buffer starts over at offset 0. Replaced messages
+ * keep their bytes until they reach the head.
+ *
+ * Not thread safe, a lane belongs to the uplink task.
+ */
+
+typedef enum
+{
+    LANE_ALARM,   ///< BMS faults, sent before anything else
+    LANE_ROUTINE, ///< Periodic samples and batches
+    LANE_COUNT,
+} Lane;
+
+typedef enum
+{
+    LANE_DROP_OLDEST,
+    LANE_COALESCE_LATEST,
+} LanePolicy;
+
+typedef struct
+{
+    uint32_t offset; ///< In the lane buffer
+    uint32_t length;
+    int64_t enqueued_us;
+    uint8_t topic; ///< Caller's topic index
+    uint8_t key;   ///< Coalescing key
+    bool live;     ///< False once replaced by a newer message with the same key
+} LaneMessage;
+
+typedef struct
+{
+    uint32_t enqueued;
+    uint32_t sent;
+    uint32_t dropped;   ///< Evicted to make room, or larger than the budget
+    uint32_t coalesced; ///< Replaced by a newer message with the same key
+} LaneCounters;
+
+typedef struct
+{
+    LanePolicy policy;
+    uint8_t *buffer;
+    uint32_t size; ///< Byte budget
+    LaneMessage *messages;
+    uint32_t capacity; ///< Messages, a power of two
+    uint32_t head;
+    uint32_t count; ///< Including replaced messages
+    uint32_t tail;  ///< End of the newest payload
+    uint32_t bytes; ///< Live payload bytes
+    LaneCounters counters;
+} SendLane;
+
+/**
+ * Fails when capacity is not a power of two.
+ */
+bool sendLaneInit(SendLane *lane, LanePolicy policy, uint8_t *buffer, uint32_t size, LaneMessage *messages,
+                  uint32_t capacity);
+
+/**
+ * Queue a copy of the payload, evicting as the policy says. Returns false
+ * only when the payload is larger than the whole budget.
+ */
+bool sendLanePush(SendLane *lane, uint8_t topic, uint8_t key, const void *payload, uint32_t length, int64_t now_us);
+
+/**
+ * Oldest live message, NULL when the lane is empty. Stays queued until
+ * sendLanePop.
+ */
+const LaneMessage *sendLanePeek(SendLane *lane);
+
+const uint8_t *sendLanePayload(const SendLane *lane, const LaneMessage *message);
+
+/**
+ * Remove the message returned by sendLanePeek after it was sent.
+ */
+void sendLanePop(SendLane *lane);
+
+typedef struct
+{
+    uint32_t error_flags;
+    bool empty;
+    bool over_temperature;
+} BmsFault;
+
+typedef struct
+{
+    float max_temperature; ///< bat_temp_max at or above it is a fault (°C)
+    BmsFault last;
+} AlarmDetector;
+
+void alarmDetectorInit(AlarmDetector *detector, float max_temperature);
+
+/**
+ * True when the status raises, changes or clears a fault: error_flags,
+ * empty or bat_temp_max over the limit. A fault that persists is only an
+ * alarm on the sample it appears in.
+ */
+bool alarmCheck(AlarmDetector *detector, const BmsStatus *status);
@@ -0,0 +1,181 @@
+#include <string.h>
+
+#include "telemetry_link.h"
+
+#define US_PER_S 1000000LL
+
+void linkInit(LinkManager *link, const LinkConfig *config, int64_t now_us)
+{
+    memset(link, 0, sizeof(*link));
+    link->config = *config;
+    link->state = LINK_ASLEEP;
+    link->state_since_us = now_us;
+    link->started_us = now_us;
+    link->interval_s = config->min_interval_s;
+    link->window_at_us = now_us; // Upload once right after boot
+    atomic_init(&link->upload_requested, false);
+}
+
+void linkRequestUpload(LinkManager *link)
+{
+    atomic_store(&link->upload_requested, true);
+}
+
+void linkSetBuffered(LinkManager *link, uint32_t samples)
+{
+    link->buffered = samples;
+}
+
+int64_t linkRadioOnUs(const LinkManager *link, int64_t now_us)
+{
+    return link->radio_on_us + (link->radio_on ? now_us - link->radio_on_since_us : 0);
+}
+
+float linkRadioOnPerHour(const LinkManager *link, int64_t now_us)
+{
+    int64_t elapsed = now_us - link->started_us;
+    return elapsed > 0 ? (float)linkRadioOnUs(link, now_us) / elapsed * 3600 : 0;
+}
+
+const char *linkStateName(LinkState state)
+{
+    static const char *const names[] = {
+        [LINK_ASLEEP] = "asleep",         [LINK_WAKING] = "waking",     [LINK_ATTACHING] = "attaching",
+        [LINK_CONNECTING] = "connecting", [LINK_FLUSHING] = "flushing", [LINK_RELEASING] = "releasing",
+    };
+    return state <= LINK_RELEASING ? names[state] : "?";
+}
+
+static LinkAction enter(LinkManager *link, LinkState state, LinkAction action, int64_t now_us)
+{
+    link->state = state;
+    link->state_since_us = now_us;
+    return action;
+}
+
+// Interval at which waking up costs overhead_percent of the time
+static void adapt_interval(LinkManager *link)
+{
+    const LinkConfig *config = &link->config;
+    uint64_t interval = config->overhead_percent > 0
+                            ? (uint64_t)link->wake_cost_us * 100 / config->overhead_percent / US_PER_S
+                            : config->max_interval_s;
+    if (interval < config->min_interval_s)
+    {
+        interval = config->min_interval_s;
+    }
+    if (interval > config->max_interval_s)
+    {
+        interval = config->max_interval_s;
+    }
+    link->interval_s = interval;
+}
+
+static bool window_due(LinkManager *link, int64_t now_us)
+{
+    if (atomic_exchange(&link->upload_requested, false))
+    {
+        return true;
+    }
+    if (link->config.buffer_high_water > 0 && link->buffered >= link->config.buffer_high_water)
+    {
+        return true;
+    }
+    return now_us >= link->window_at_us;
+}
+
+static bool timed_out(const LinkManager *link, uint32_t timeout_s, int64_t now_us)
+{
+    return now_us - link->state_since_us >= timeout_s * US_PER_S;
+}
+
+// Give up on the current window and retry after the shortest interval
+static LinkAction fail(LinkManager *link, int64_t now_us)
+{
+    link->failures++;
+    link->window_at_us = now_us + (int64_t)link->config.min_interval_s * US_PER_S;
+    return enter(link, LINK_RELEASING, LINK_ACTION_RELEASE, now_us);
+}
+
+static LinkAction power_off(LinkManager *link, int64_t now_us)
+{
+    if (link->radio_on)
+    {
+        link->radio_on_us += now_us - link->radio_on_since_us;
+        link->radio_on = false;
+    }
+    return enter(link, LINK_ASLEEP, LINK_ACTION_POWER_OFF, now_us);
+}
+
+LinkAction linkHandle(LinkManager *link, LinkEvent event, int64_t now_us)
+{
+    const LinkConfig *config = &link->config;
+
+    switch (link->state)
+    {
+    case LINK_ASLEEP:
+        if (!window_due(link, now_us))
+        {
+            return LINK_ACTION_NONE;
+        }
+        link->windows++;
+        link->wake_started_us = now_us;
+        if (!link->radio_on)
+        {
+            link->radio_on = true;
+            link->radio_on_since_us = now_us;
+        }
+        return enter(link, LINK_WAKING, LINK_ACTION_POWER_ON, now_us);
+
+    case LINK_WAKING:
+        if (event == LINK_EVENT_MODEM_READY)
+        {
+            return enter(link, LINK_ATTACHING, LINK_ACTION_START_PPP, now_us);
+        }
+        return timed_out(link, config->wake_timeout_s, now_us) ? fail(link, now_us) : LINK_ACTION_NONE;
+
+    case LINK_ATTACHING:
+        if (event == LINK_EVENT_PPP_UP)
+        {
+            return enter(link, LINK_CONNECTING, LINK_ACTION_START_MQTT, now_us);
+        }
+        return timed_out(link, config->wake_timeout_s, now_us) ? fail(link, now_us) : LINK_ACTION_NONE;
+
+    case LINK_CONNECTING:
+        if (event == LINK_EVENT_MQTT_UP)
+        {
+            int64_t cost = now_us - link->wake_started_us;
+            link->wake_cost_us = link->wake_cost_us == 0 ? cost : (3 * link->wake_cost_us + cost) / 4;
+            adapt_interval(link);
+            return enter(link, LINK_FLUSHING, LINK_ACTION_FLUSH, now_us);
+        }
+        if (event == LINK_EVENT_LOST || timed_out(link, config->wake_timeout_s, now_us))
+        {
+            return fail(link, now_us);
+        }
+        return LINK_ACTION_NONE;
+
+    case LINK_FLUSHING:
+        if (event == LINK_EVENT_FLUSHED)
+        {
+            // Counted from the start of this window, so the wake-up is part of the interval.
+            // Whatever asked for an upload meanwhile has just been sent.
+            link->window_at_us = link->wake_started_us + (int64_t)link->interval_s * US_PER_S;
+            atomic_store(&link->upload_requested, false);
+            return enter(link, LINK_RELEASING, LINK_ACTION_RELEASE, now_us);
+        }
+        if (event == LINK_EVENT_LOST || timed_out(link, config->flush_timeout_s, now_us))
+        {
+            return fail(link, now_us);
+        }
+        return LINK_ACTION_NONE;
+
+    case LINK_RELEASING:
+        if (event == LINK_EVENT_RELEASED || timed_out(link, config->flush_timeout_s, now_us))
+        {
+            return power_off(link, now_us);
+        }
+        return LINK_ACTION_NONE;
+    }
+    return LINK_ACTION_NONE;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Duty-cycled uplink: the modem is powered down between upload windows and
+ * samples wait in the telemetry log meanwhile.
+ *
+ *   ASLEEP --window due--> WAKING --modem answers AT--> ATTACHING
+ *     --PPP got an address--> CONNECTING --MQTT connected--> FLUSHING
+ *     --log drained and outbox empty--> RELEASING --command mode--> ASLEEP
+ *
+ * Any step that does not finish within its timeout, or a link lost while
+ * flushing, releases the radio and retries after min_interval_s, so a dead
+ * network costs at most one timeout per min_interval_s.
+ *
+ * The state machine only decides. linkHandle() takes what happened and
+ * returns the action the caller has to carry out on the modem, so the same
+ * code runs against esp_modem on the tracker and a simulated DCE on the
+ * host.
+ *
+ * The upload interval adapts to the wake-up cost, the time from powering
+ * the modem to MQTT being connected: it is chosen so that waking up takes
+ * at most overhead_percent of the interval, within [min_interval_s,
+ * max_interval_s]. An alarm or a nearly full buffer opens a window right
+ * away.
+ */
+
+typedef enum
+{
+    LINK_ASLEEP,     ///< Modem powered down or in PSM
+    LINK_WAKING,     ///< Powered on, waiting for it to answer AT
+    LINK_ATTACHING,  ///< Data mode requested, waiting for a PPP address
+    LINK_CONNECTING, ///< Waiting for the MQTT session
+    LINK_FLUSHING,   ///< Sending the buffered samples
+    LINK_RELEASING,  ///< Back to command mode before powering down
+} LinkState;
+
+typedef enum
+{
+    LINK_EVENT_TICK,        ///< Nothing happened, lets timeouts and windows fire
+    LINK_EVENT_MODEM_READY, ///< The modem answered AT
+    LINK_EVENT_PPP_UP,
+    LINK_EVENT_MQTT_UP,
+    LINK_EVENT_FLUSHED,  ///< Buffer empty and every publish acknowledged
+    LINK_EVENT_LOST,     ///< PPP or MQTT went down while connected
+    LINK_EVENT_RELEASED, ///< Modem is back in command mode
+} LinkEvent;
+
+typedef enum
+{
+    LINK_ACTION_NONE,
+    LINK_ACTION_POWER_ON,   ///< Power/PWKEY the modem and start polling AT
+    LINK_ACTION_START_PPP,  ///< Switch to data mode
+    LINK_ACTION_START_MQTT, ///< Start or reconnect the MQTT client
+    LINK_ACTION_FLUSH,      ///< Drain the buffer
+    LINK_ACTION_RELEASE,    ///< Stop MQTT and go back to command mode
+    LINK_ACTION_POWER_OFF,  ///< Power the modem down or enter PSM
+} LinkAction;
+
+typedef struct
+{
+    uint32_t min_interval_s;    ///< Shortest time between two upload windows
+    uint32_t max_interval_s;    ///< Longest time a sample may wait
+    uint32_t overhead_percent;  ///< Share of the interval the wake-up may cost
+    uint32_t wake_timeout_s;    ///< Per step, WAKING to CONNECTING
+    uint32_t flush_timeout_s;   ///< FLUSHING and RELEASING
+    uint32_t buffer_high_water; ///< Buffered samples that open a window early, 0 for none
+} LinkConfig;
+
+typedef struct
+{
+    LinkConfig config;
+    LinkState state;
+    int64_t state_since_us;
+    int64_t window_at_us;    ///< Next upload window
+    int64_t wake_started_us; ///< POWER_ON of the current window
+    int64_t wake_cost_us;    ///< Moving average of POWER_ON to MQTT_UP, 0 before the first window
+    uint32_t interval_s;     ///< Current upload interval
+
+    atomic_bool upload_requested; ///< Set from other tasks by linkRequestUpload
+    uint32_t buffered;            ///< Samples waiting, reported by linkSetBuffered
+
+    int64_t started_us;
+    int64_t radio_on_us; ///< Completed on-periods
+    bool radio_on;
+    int64_t radio_on_since_us;
+
+    uint32_t windows;  ///< Upload windows opened
+    uint32_t failures; ///< Windows that timed out or lost the link
+} LinkManager;
+
+void linkInit(LinkManager *link, const LinkConfig *config, int64_t now_us);
+
+/**
+ * Feed an event, returns the action to carry out. Call it with
+ * LINK_EVENT_TICK regularly, at least once a second while awake.
+ */
+LinkAction linkHandle(LinkManager *link, LinkEvent event, int64_t now_us);
+
+/**
+ * Open a window as soon as possible, safe to call from any task.
+ */
+void linkRequestUpload(LinkManager *link);
+
+void linkSetBuffered(LinkManager *link, uint32_t samples);
+
+/**
+ * Time the radio was on, including the current on-period.
+ */
+int64_t linkRadioOnUs(const LinkManager *link, int64_t now_us);
+
+/**
+ * Radio-on time per hour of uptime (s), the headline figure of the duty cycle.
+ */
+float linkRadioOnPerHour(const LinkManager *link, int64_t now_us);
+
+const char *linkStateName(LinkState state);
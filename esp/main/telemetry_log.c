@@ -0,0 +1,488 @@
+#include <string.h>
+
+#include "telemetry_log.h"
+
+#define SECTOR_MAGIC 0x474f4c54 // "TLOG"
+#define RECORD_PENDING 0xff
+#define RECORD_CONSUMED 0x00
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t erase_count;
+    uint32_t crc;
+} SectorHeader;
+
+typedef struct
+{
+    uint16_t length;
+    uint8_t type;
+    uint8_t state; ///< Not covered by the CRC, cleared in place once consumed
+    uint32_t crc;
+} RecordHeader;
+
+typedef enum
+{
+    RECORD_VALID,
+    RECORD_END,     ///< Erased space or no room for another header
+    RECORD_CORRUPT, ///< Torn write, the rest of the sector is unusable
+} RecordStatus;
+
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t length)
+{
+    const uint8_t *bytes = data;
+    crc = ~crc;
+    while (length--)
+    {
+        crc ^= *bytes++;
+        for (int i = 0; i < 8; i++)
+        {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t record_size(uint16_t length)
+{
+    return (sizeof(RecordHeader) + length + 3) & ~3u;
+}
+
+static uint32_t sector_base(uint32_t sector)
+{
+    return sector * TELEMETRY_LOG_SECTOR_SIZE;
+}
+
+static bool read_sector_header(const TelemetryLog *log, uint32_t sector, SectorHeader *header)
+{
+    if (log->flash.read(log->flash.ctx, sector_base(sector), header, sizeof(*header)) != 0)
+    {
+        return false;
+    }
+    return header->magic == SECTOR_MAGIC &&
+           header->crc == crc32_update(0, header, offsetof(SectorHeader, crc));
+}
+
+static bool is_erased(const void *data, size_t length)
+{
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (bytes[i] != 0xff)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static RecordStatus read_record(const TelemetryLog *log, uint32_t sector, uint32_t offset, RecordHeader *header)
+{
+    if (offset + sizeof(RecordHeader) > TELEMETRY_LOG_SECTOR_SIZE)
+    {
+        return RECORD_END;
+    }
+    uint32_t address = sector_base(sector) + offset;
+    if (log->flash.read(log->flash.ctx, address, header, sizeof(*header)) != 0)
+    {
+        return RECORD_CORRUPT;
+    }
+    if (is_erased(header, sizeof(*header)))
+    {
+        return RECORD_END;
+    }
+    if (header->length > TELEMETRY_LOG_MAX_RECORD_LEN || offset + record_size(header->length) > TELEMETRY_LOG_SECTOR_SIZE)
+    {
+        return RECORD_CORRUPT;
+    }
+
+    // Stream the payload through the CRC in small chunks to keep the stack flat
+    uint32_t crc = crc32_update(0, header, offsetof(RecordHeader, state));
+    uint8_t chunk[32];
+    for (uint32_t done = 0; done < header->length; done += sizeof(chunk))
+    {
+        uint32_t length = header->length - done < sizeof(chunk) ? header->length - done : sizeof(chunk);
+        if (log->flash.read(log->flash.ctx, address + sizeof(RecordHeader) + done, chunk, length) != 0)
+        {
+            return RECORD_CORRUPT;
+        }
+        crc = crc32_update(crc, chunk, length);
+    }
+    return crc == header->crc ? RECORD_VALID : RECORD_CORRUPT;
+}
+
+bool telemetryLogMount(TelemetryLog *log, const TelemetryLogFlash *flash)
+{
+    memset(log, 0, sizeof(*log));
+    log->flash = *flash;
+    log->sector_count = flash->size / TELEMETRY_LOG_SECTOR_SIZE;
+    if (log->sector_count < 2 || flash->size % TELEMETRY_LOG_SECTOR_SIZE != 0)
+    {
+        return false;
+    }
+
+    // The most recently opened sector is the one with the highest sequence
+    SectorHeader header;
+    bool found = false;
+    for (uint32_t sector = 0; sector < log->sector_count; sector++)
+    {
+        if (read_sector_header(log, sector, &header) && (!found || header.sequence >= log->next_sequence))
+        {
+            found = true;
+            log->head_sector = sector;
+            log->next_sequence = header.sequence + 1;
+        }
+    }
+    if (!found)
+    {
+        // Start at sector 0 on the first append
+        log->head_sector = log->sector_count - 1;
+        log->next_sequence = 1;
+        return true;
+    }
+
+    // Sectors are opened in ring order, so walking the ring from the one after
+    // the head visits them from oldest to newest
+    bool tail_found = false;
+    for (uint32_t i = 1; i <= log->sector_count; i++)
+    {
+        uint32_t sector = (log->head_sector + i) % log->sector_count;
+        if (!read_sector_header(log, sector, &header))
+        {
+            continue;
+        }
+
+        RecordHeader record;
+        RecordStatus status;
+        uint32_t offset = sizeof(SectorHeader);
+        while ((status = read_record(log, sector, offset, &record)) == RECORD_VALID)
+        {
+            if (record.state == RECORD_PENDING)
+            {
+                log->pending++;
+                if (!tail_found)
+                {
+                    tail_found = true;
+                    log->tail_sector = sector;
+                    log->tail_offset = offset;
+                }
+            }
+            offset += record_size(record.length);
+        }
+
+        if (sector == log->head_sector)
+        {
+            log->head_open = true;
+            // Never append behind a torn record
+            log->head_offset = status == RECORD_END ? offset : TELEMETRY_LOG_SECTOR_SIZE;
+        }
+    }
+
+    if (!tail_found)
+    {
+        log->tail_sector = log->head_sector;
+        log->tail_offset = log->head_offset;
+    }
+    telemetryLogRewind(log);
+    return true;
+}
+
+// Count the pending records from the tail to the end of its sector
+static uint32_t count_pending_in_tail_sector(const TelemetryLog *log)
+{
+    RecordHeader record;
+    uint32_t count = 0;
+    uint32_t offset = log->tail_offset;
+    while (read_record(log, log->tail_sector, offset, &record) == RECORD_VALID)
+    {
+        if (record.state == RECORD_PENDING)
+        {
+            count++;
+        }
+        offset += record_size(record.length);
+    }
+    return count;
+}
+
+static bool open_next_sector(TelemetryLog *log)
+{
+    uint32_t sector = (log->head_sector + 1) % log->sector_count;
+
+    // The ring is full, make room by dropping the oldest sector
+    if (log->pending > 0 && log->tail_sector == sector)
+    {
+        uint32_t dropped = count_pending_in_tail_sector(log);
+        log->dropped += dropped;
+        log->pending -= dropped;
+        log->tail_sector = (sector + 1) % log->sector_count;
+        log->tail_offset = sizeof(SectorHeader);
+        // Records read from the dropped sector may still be waiting for their acknowledgement
+        telemetryLogRewind(log);
+    }
+
+    SectorHeader header;
+    uint32_t erase_count = read_sector_header(log, sector, &header) ? header.erase_count : 0;
+
+    // Whatever happens next, never append to the previous sector again
+    log->head_sector = sector;
+    log->head_offset = TELEMETRY_LOG_SECTOR_SIZE;
+    log->head_open = true;
+
+    if (log->flash.erase_sector(log->flash.ctx, sector_base(sector)) != 0)
+    {
+        return false;
+    }
+
+    header.magic = SECTOR_MAGIC;
+    header.sequence = log->next_sequence++;
+    header.erase_count = erase_count + 1;
+    header.crc = crc32_update(0, &header, offsetof(SectorHeader, crc));
+    if (log->flash.write(log->flash.ctx, sector_base(sector), &header, sizeof(header)) != 0)
+    {
+        return false;
+    }
+
+    log->head_offset = sizeof(SectorHeader);
+    if (log->pending == 0)
+    {
+        log->tail_sector = sector;
+        log->tail_offset = log->head_offset;
+    }
+    return true;
+}
+
+bool telemetryLogAppend(TelemetryLog *log, uint8_t type, const void *payload, size_t length)
+{
+    if (length == 0 || length > TELEMETRY_LOG_MAX_RECORD_LEN)
+    {
+        return false;
+    }
+
+    uint32_t size = record_size(length);
+    if (!log->head_open || log->head_offset + size > TELEMETRY_LOG_SECTOR_SIZE)
+    {
+        if (!open_next_sector(log))
+        {
+            return false;
+        }
+    }
+
+    RecordHeader record = {
+        .length = length,
+        .type = type,
+        .state = RECORD_PENDING,
+    };
+    record.crc = crc32_update(crc32_update(0, &record, offsetof(RecordHeader, state)), payload, length);
+
+    // The header goes first, so a torn write can never look like erased space
+    uint32_t address = sector_base(log->head_sector) + log->head_offset;
+    if (log->flash.write(log->flash.ctx, address, &record, sizeof(record)) != 0 ||
+        log->flash.write(log->flash.ctx, address + sizeof(record), payload, length) != 0)
+    {
+        log->head_offset = TELEMETRY_LOG_SECTOR_SIZE;
+        return false;
+    }
+
+    if (log->pending == 0)
+    {
+        log->tail_sector = log->head_sector;
+        log->tail_offset = log->head_offset;
+    }
+    if (log->unread == 0)
+    {
+        log->read_sector = log->head_sector;
+        log->read_offset = log->head_offset;
+    }
+    log->head_offset += size;
+    log->pending++;
+    log->unread++;
+    return true;
+}
+
+// Move a cursor to the next pending record at or after it, false when there is none
+static bool seek_pending(const TelemetryLog *log, uint32_t *sector, uint32_t *offset, RecordHeader *record)
+{
+    // Bounded so a log that disagrees with the flash cannot spin forever
+    for (uint32_t moves = 0; moves <= log->sector_count;)
+    {
+        RecordStatus status = read_record(log, *sector, *offset, record);
+        if (status == RECORD_VALID && record->state != RECORD_PENDING)
+        {
+            *offset += record_size(record->length);
+            continue;
+        }
+        if (status == RECORD_VALID)
+        {
+            return true;
+        }
+        if (*sector == log->head_sector)
+        {
+            return false;
+        }
+
+        SectorHeader header;
+        do
+        {
+            *sector = (*sector + 1) % log->sector_count;
+            moves++;
+        } while (*sector != log->head_sector && !read_sector_header(log, *sector, &header));
+        *offset = sizeof(SectorHeader);
+    }
+    return false;
+}
+
+static size_t copy_payload(const TelemetryLog *log, uint32_t sector, uint32_t offset, const RecordHeader *record,
+                           uint8_t *type, void *buffer, size_t size)
+{
+    if (record->length > size ||
+        log->flash.read(log->flash.ctx, sector_base(sector) + offset + sizeof(*record), buffer, record->length) != 0)
+    {
+        return 0;
+    }
+    *type = record->type;
+    return record->length;
+}
+
+size_t telemetryLogPeek(TelemetryLog *log, uint8_t *type, void *buffer, size_t size)
+{
+    RecordHeader record;
+    if (log->pending > 0 && seek_pending(log, &log->tail_sector, &log->tail_offset, &record))
+    {
+        return copy_payload(log, log->tail_sector, log->tail_offset, &record, type, buffer, size);
+    }
+    log->pending = 0;
+    log->unread = 0;
+    return 0;
+}
+
+size_t telemetryLogRead(TelemetryLog *log, uint8_t *type, void *buffer, size_t size)
+{
+    RecordHeader record;
+    if (log->unread == 0)
+    {
+        return 0;
+    }
+    if (!seek_pending(log, &log->read_sector, &log->read_offset, &record))
+    {
+        log->unread = 0;
+        return 0;
+    }
+
+    size_t length = copy_payload(log, log->read_sector, log->read_offset, &record, type, buffer, size);
+    if (length > 0)
+    {
+        log->read_offset += record_size(record.length);
+        log->unread--;
+    }
+    return length;
+}
+
+void telemetryLogRewind(TelemetryLog *log)
+{
+    log->read_sector = log->tail_sector;
+    log->read_offset = log->tail_offset;
+    log->unread = log->pending;
+}
+
+bool telemetryLogPop(TelemetryLog *log)
+{
+    RecordHeader record;
+    if (log->pending == 0 || !seek_pending(log, &log->tail_sector, &log->tail_offset, &record))
+    {
+        return false;
+    }
+
+    uint8_t consumed = RECORD_CONSUMED;
+    uint32_t address = sector_base(log->tail_sector) + log->tail_offset + offsetof(RecordHeader, state);
+    if (log->flash.write(log->flash.ctx, address, &consumed, sizeof(consumed)) != 0)
+    {
+        return false;
+    }
+    // Nothing was read ahead of the tail, so the record was not read yet either
+    bool unread = log->unread == log->pending;
+    log->tail_offset += record_size(record.length);
+    log->pending--;
+    if (unread)
+    {
+        log->unread--;
+        log->read_sector = log->tail_sector;
+        log->read_offset = log->tail_offset;
+    }
+    return true;
+}
+
+uint32_t telemetryLogMaxEraseCount(const TelemetryLog *log)
+{
+    uint32_t max = 0;
+    SectorHeader header;
+    for (uint32_t sector = 0; sector < log->sector_count; sector++)
+    {
+        if (read_sector_header(log, sector, &header) && header.erase_count > max)
+        {
+            max = header.erase_count;
+        }
+    }
+    return max;
+}
+
+void logInFlightInit(LogInFlight *flight)
+{
+    memset(flight, 0, sizeof(*flight));
+}
+
+bool logInFlightSent(LogInFlight *flight, int msg_id, int64_t now_us)
+{
+    if (flight->count == LOG_IN_FLIGHT_SLOTS)
+    {
+        return false;
+    }
+    uint32_t slot = (flight->first + flight->count++) % LOG_IN_FLIGHT_SLOTS;
+    flight->sent_us[slot] = now_us;
+    atomic_store_explicit(&flight->msg_ids[slot], msg_id > 0 ? msg_id : 0, memory_order_release);
+    return true;
+}
+
+void logInFlightAcked(LogInFlight *flight, int msg_id)
+{
+    if (msg_id <= 0)
+    {
+        return;
+    }
+    for (int slot = 0; slot < LOG_IN_FLIGHT_SLOTS; slot++)
+    {
+        int expected = msg_id;
+        if (atomic_compare_exchange_strong_explicit(&flight->msg_ids[slot], &expected, 0, memory_order_acq_rel,
+                                                    memory_order_relaxed))
+        {
+            return;
+        }
+    }
+}
+
+uint32_t logInFlightCompleted(LogInFlight *flight)
+{
+    uint32_t completed = 0;
+    while (flight->count > 0 && atomic_load_explicit(&flight->msg_ids[flight->first], memory_order_acquire) == 0)
+    {
+        flight->first = (flight->first + 1) % LOG_IN_FLIGHT_SLOTS;
+        flight->count--;
+        completed++;
+    }
+    return completed;
+}
+
+bool logInFlightExpired(const LogInFlight *flight, int64_t now_us, int64_t timeout_us)
+{
+    return flight->count > 0 && now_us - flight->sent_us[flight->first] > timeout_us;
+}
+
+void logInFlightClear(LogInFlight *flight)
+{
+    for (int slot = 0; slot < LOG_IN_FLIGHT_SLOTS; slot++)
+    {
+        atomic_store_explicit(&flight->msg_ids[slot], 0, memory_order_relaxed);
+    }
+    flight->first = 0;
+    flight->count = 0;
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Append-only ring log of telemetry records on raw NOR flash, used to keep
+ * samples while the cellular link is down.
+ *
+ * The log area is split into sectors that are filled in ring order, so erases
+ * are spread evenly over the partition. Each sector starts with a header
+ * holding a monotonic sequence number and its erase count, each record with
+ * a CRC-protected header. A write torn by power loss fails its CRC and seals
+ * the sector, so only complete records are ever returned. Consumed records
+ * are marked by clearing their state byte in place, without an erase.
+ *
+ * When the ring is full, the oldest sector is erased and its pending records
+ * are counted as dropped.
+ *
+ * Records are read ahead of the ones consumed: telemetryLogRead() hands out
+ * the next record while the ones before it stay pending until their upload
+ * is acknowledged and they are popped. telemetryLogRewind() reads the
+ * unacknowledged ones again. Only consumption is written to flash, so after
+ * a reboot every record that was not popped is read again.
+ */
+
+#define TELEMETRY_LOG_SECTOR_SIZE 4096
+#define TELEMETRY_LOG_MAX_RECORD_LEN 256
+
+/**
+ * Raw flash access. Every callback returns 0 on success, which matches
+ * ESP_OK so the esp_partition_* functions can be wrapped directly.
+ */
+typedef struct
+{
+    int (*read)(void *ctx, uint32_t offset, void *dst, size_t length);
+    int (*write)(void *ctx, uint32_t offset, const void *src, size_t length);
+    int (*erase_sector)(void *ctx, uint32_t offset);
+    void *ctx;
+    uint32_t size; ///< Size of the log area, a multiple of TELEMETRY_LOG_SECTOR_SIZE
+} TelemetryLogFlash;
+
+typedef struct
+{
+    TelemetryLogFlash flash;
+    uint32_t sector_count;
+
+    uint32_t head_sector;  ///< Sector currently being appended to
+    uint32_t head_offset;  ///< Offset of the next record in head_sector
+    bool head_open;        ///< false until a sector has been opened for writing
+
+    uint32_t tail_sector;  ///< Sector holding the oldest pending record
+    uint32_t tail_offset;  ///< Offset of the oldest pending record
+
+    uint32_t read_sector;  ///< Sector holding the next record to read
+    uint32_t read_offset;  ///< Offset of the next record to read
+
+    uint32_t next_sequence; ///< Sequence number for the next opened sector
+    uint32_t pending;       ///< Records appended but not yet consumed
+    uint32_t unread;        ///< Pending records not read yet
+    uint32_t dropped;       ///< Records lost because the ring wrapped around
+} TelemetryLog;
+
+/**
+ * Recover the log state from flash. An erased or foreign partition mounts
+ * as an empty log.
+ *
+ * @return false if the flash could not be read or has a bad size
+ */
+bool telemetryLogMount(TelemetryLog *log, const TelemetryLogFlash *flash);
+
+/**
+ * Append a record. If the ring is full the oldest sector is dropped.
+ *
+ * @return false if the record is too large or the flash write failed
+ */
+bool telemetryLogAppend(TelemetryLog *log, uint8_t type, const void *payload, size_t length);
+
+/**
+ * Copy the oldest pending record into `buffer` without consuming it.
+ *
+ * @return Length of the record, or 0 if the log is empty
+ */
+size_t telemetryLogPeek(TelemetryLog *log, uint8_t *type, void *buffer, size_t size);
+
+/**
+ * Copy the next record that was not read yet into `buffer`, it stays
+ * pending until popped.
+ *
+ * @return Length of the record, or 0 if every pending record was read
+ */
+size_t telemetryLogRead(TelemetryLog *log, uint8_t *type, void *buffer, size_t size);
+
+/**
+ * Read every pending record again, starting with the oldest. Dropping a
+ * sector when the ring is full rewinds as well.
+ */
+void telemetryLogRewind(TelemetryLog *log);
+
+/**
+ * Mark the oldest pending record, the one telemetryLogPeek() returns, as
+ * consumed.
+ */
+bool telemetryLogPop(TelemetryLog *log);
+
+/**
+ * Erase count of the most worn sector, for diagnostics.
+ */
+uint32_t telemetryLogMaxEraseCount(const TelemetryLog *log);
+
+/**
+ * Records read from the log and handed to MQTT, oldest first, until their
+ * PUBACK. Only the acknowledged ones at the front are popped from the log,
+ * so the log keeps every record the broker does not have yet.
+ *
+ * logInFlightAcked() runs in the MQTT task, everything else in the task
+ * draining the log. A PUBACK that arrives before its msg_id was recorded
+ * is missed, the record then expires and is sent again.
+ */
+#define LOG_IN_FLIGHT_SLOTS 16
+
+typedef struct
+{
+    atomic_int msg_ids[LOG_IN_FLIGHT_SLOTS]; ///< 0 once acknowledged
+    int64_t sent_us[LOG_IN_FLIGHT_SLOTS];
+    uint32_t first;
+    uint32_t count;
+} LogInFlight;
+
+void logInFlightInit(LogInFlight *flight);
+
+/**
+ * Track the next record read from the log. A msg_id of 0 marks a record
+ * that needs no PUBACK, such as one that could not be decoded.
+ *
+ * @return false when every slot is taken, nothing is tracked then
+ */
+bool logInFlightSent(LogInFlight *flight, int msg_id, int64_t now_us);
+
+/**
+ * Called on MQTT_EVENT_PUBLISHED.
+ */
+void logInFlightAcked(LogInFlight *flight, int msg_id);
+
+/**
+ * Forget the acknowledged records at the front.
+ *
+ * @return Number of records to pop from the log
+ */
+uint32_t logInFlightCompleted(LogInFlight *flight);
+
+/**
+ * True when the oldest record waited longer than timeout_us for its PUBACK.
+ * esp-mqtt has dropped it from its outbox by then, it has to be read again.
+ */
+bool logInFlightExpired(const LogInFlight *flight, int64_t now_us, int64_t timeout_us);
+
+/**
+ * Forget every record, after telemetryLogRewind().
+ */
+void logInFlightClear(LogInFlight *flight);
@@ -0,0 +1,157 @@
+#include <string.h>
+
+#include "telemetry_metrics.h"
+
+void metricsInit(MetricsRegistry *metrics)
+{
+    memset(metrics, 0, sizeof(*metrics));
+    metricsSet(metrics, METRIC_RSSI, 99);
+    metricsSet(metrics, METRIC_BER, 99);
+}
+
+void metricsCount(MetricsRegistry *metrics, MetricCounter counter, uint32_t amount)
+{
+    atomic_fetch_add_explicit(&metrics->counters[counter], amount, memory_order_relaxed);
+}
+
+void metricsSet(MetricsRegistry *metrics, MetricGauge gauge, int32_t value)
+{
+    atomic_store_explicit(&metrics->gauges[gauge], value, memory_order_relaxed);
+}
+
+int metricsBucket(uint32_t value)
+{
+    int bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+    return bucket < METRIC_HISTOGRAM_BUCKETS ? bucket : METRIC_HISTOGRAM_BUCKETS - 1;
+}
+
+void metricsRecord(MetricsRegistry *metrics, MetricHistogram histogram, uint32_t value)
+{
+    MetricHistogramValues *values = &metrics->histograms[histogram];
+    atomic_fetch_add_explicit(&values->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&values->sum, value, memory_order_relaxed);
+    atomic_fetch_add_explicit(&values->buckets[metricsBucket(value)], 1, memory_order_relaxed);
+
+    uint_fast32_t max = atomic_load_explicit(&values->max, memory_order_relaxed);
+    while (value > max &&
+           !atomic_compare_exchange_weak_explicit(&values->max, &max, value, memory_order_relaxed,
+                                                  memory_order_relaxed))
+    {
+    }
+}
+
+static uint8_t *put_u16(uint8_t *at, uint16_t value)
+{
+    at[0] = value;
+    at[1] = value >> 8;
+    return at + 2;
+}
+
+static uint8_t *put_u32(uint8_t *at, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        at[i] = value >> (8 * i);
+    }
+    return at + 4;
+}
+
+static uint8_t *put_i64(uint8_t *at, int64_t value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        at[i] = (uint64_t)value >> (8 * i);
+    }
+    return at + 8;
+}
+
+static uint32_t take(atomic_uint_fast32_t *value)
+{
+    return atomic_exchange_explicit(value, 0, memory_order_relaxed);
+}
+
+size_t metricsSnapshot(MetricsRegistry *metrics, uint32_t uptime, int64_t timestamp, uint8_t *buffer, size_t size)
+{
+    if (size < METRICS_SNAPSHOT_LEN)
+    {
+        return 0;
+    }
+
+    uint8_t *at = buffer;
+    *at++ = METRICS_SNAPSHOT_VERSION;
+    *at++ = METRIC_COUNTER_COUNT;
+    *at++ = METRIC_GAUGE_COUNT;
+    *at++ = METRIC_HISTOGRAM_COUNT;
+    *at++ = METRIC_HISTOGRAM_BUCKETS;
+    at = put_u32(at, uptime);
+    at = put_u32(at, uptime - metrics->snapshot_uptime);
+    at = put_i64(at, timestamp);
+    metrics->snapshot_uptime = uptime;
+
+    for (int i = 0; i < METRIC_COUNTER_COUNT; i++)
+    {
+        at = put_u32(at, take(&metrics->counters[i]));
+    }
+    for (int i = 0; i < METRIC_GAUGE_COUNT; i++)
+    {
+        at = put_u32(at, (uint32_t)atomic_load_explicit(&metrics->gauges[i], memory_order_relaxed));
+    }
+    for (int i = 0; i < METRIC_HISTOGRAM_COUNT; i++)
+    {
+        MetricHistogramValues *values = &metrics->histograms[i];
+        at = put_u32(at, take(&values->count));
+        at = put_u32(at, take(&values->sum));
+        at = put_u32(at, take(&values->max));
+        for (int bucket = 0; bucket < METRIC_HISTOGRAM_BUCKETS; bucket++)
+        {
+            uint32_t count = take(&values->buckets[bucket]);
+            at = put_u16(at, count > UINT16_MAX ? UINT16_MAX : count);
+        }
+    }
+    return at - buffer;
+}
+
+void pubackTrackerInit(PubackTracker *tracker)
+{
+    memset(tracker, 0, sizeof(*tracker));
+}
+
+void pubackTrackerSent(PubackTracker *tracker, int msg_id, int64_t now_us)
+{
+    if (msg_id <= 0)
+    {
+        return;
+    }
+    uint32_t slot = atomic_fetch_add_explicit(&tracker->next, 1, memory_order_relaxed) % PUBACK_TRACKER_SLOTS;
+    // Invalidate the slot before the time changes, then publish the id
+    atomic_store_explicit(&tracker->msg_ids[slot], 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    tracker->sent_us[slot] = now_us;
+    atomic_store_explicit(&tracker->msg_ids[slot], msg_id, memory_order_release);
+}
+
+bool pubackTrackerAcked(PubackTracker *tracker, int msg_id, int64_t now_us, int64_t *rtt_us)
+{
+    if (msg_id <= 0)
+    {
+        return false;
+    }
+    for (int slot = 0; slot < PUBACK_TRACKER_SLOTS; slot++)
+    {
+        if (atomic_load_explicit(&tracker->msg_ids[slot], memory_order_acquire) != msg_id)
+        {
+            continue;
+        }
+        int64_t sent = tracker->sent_us[slot];
+        int expected = msg_id;
+        // Lost to a newer publish reusing the slot in between
+        if (!atomic_compare_exchange_strong_explicit(&tracker->msg_ids[slot], &expected, 0, memory_order_acq_rel,
+                                                     memory_order_relaxed))
+        {
+            return false;
+        }
+        *rtt_us = now_us - sent;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Runtime metrics of the tracker, published as a periodic diagnostics
+ * snapshot.
+ *
+ * The registry is a fixed set of counters, gauges and histograms, so
+ * recording never allocates or takes a lock and works from any task.
+ * Histograms have power-of-two buckets: bucket 0 counts zeros, bucket i
+ * counts values in [2^(i-1), 2^i) and the last bucket everything above.
+ *
+ * Counters and histograms cover the interval since the previous snapshot,
+ * taking a snapshot resets them. Gauges hold their last value.
+ *
+ * Snapshot (version 1), little-endian like telemetry_binary.h:
+ *   u8   version
+ *   u8   counters (c), gauges (g), histograms (h), buckets per histogram (k)
+ *   u32  uptime (s)
+ *   u32  interval (s) since the previous snapshot
+ *   i64  timestamp
+ *   u32  counters[c]
+ *   i32  gauges[g]
+ *   h    times: u32 count, sum, max; u16 buckets[k] (saturated)
+ *
+ * The counts let the aggregator read snapshots of firmware that knows more
+ * or fewer metrics than it does. New metrics are only ever appended.
+ */
+#define METRICS_SNAPSHOT_VERSION 1
+#define METRIC_HISTOGRAM_BUCKETS 16
+
+typedef enum
+{
+    METRIC_PUBLISHED,         ///< Publish calls that got a message id
+    METRIC_PUBLISH_FAILED,    ///< Publish calls that returned an error
+    METRIC_PUBACKS,           ///< PUBACKs matched to a tracked publish
+    METRIC_MQTT_DISCONNECTS,  ///< MQTT_EVENT_DISCONNECTED
+    METRIC_PPP_RECONNECTS,    ///< PPP got an address again after losing it
+    METRIC_PPP_DOWNTIME_MS,   ///< Time spent without a PPP address
+    METRIC_ALARM_DROPPED,     ///< Alarms evicted from the alarm lane
+    METRIC_ROUTINE_DROPPED,   ///< Messages evicted from the routine lane
+    METRIC_ROUTINE_COALESCED, ///< Routine messages replaced by a newer one on their topic
+    METRIC_MQTT_CONNECTS,     ///< MQTT_EVENT_CONNECTED
+    METRIC_SESSIONS_PRESENT,  ///< Connects where the broker still had the MQTT session
+    METRIC_TLS_RESUMED,       ///< Connects that resumed the previous TLS session
+    METRIC_COUNTER_COUNT,
+} MetricCounter;
+
+typedef enum
+{
+    METRIC_OUTBOX_BYTES,             ///< MQTT outbox size
+    METRIC_FREE_HEAP,                ///< Bytes
+    METRIC_MIN_FREE_HEAP,            ///< Lowest free heap since boot
+    METRIC_UPLINK_STACK_FREE,        ///< uplink_task stack high-water mark (bytes left)
+    METRIC_SAMPLER_STACK_FREE,       ///< sampler_task stack high-water mark (bytes left)
+    METRIC_RSSI,                     ///< AT+CSQ 0-31, 99 unknown
+    METRIC_BER,                      ///< AT+CSQ 0-7, 99 unknown
+    METRIC_BOOT_TO_PUBLISH_MS,       ///< Boot to the first publish, 0 until then
+    METRIC_REGISTERED_TO_PUBLISH_MS, ///< Network registration to the first publish, -1 if not registered
+    METRIC_ROUTINE_QUEUED_BYTES,     ///< Bytes waiting in the routine lane
+    METRIC_GAUGE_COUNT,
+} MetricGauge;
+
+typedef enum
+{
+    METRIC_ENCODE_US,        ///< Time to encode a message
+    METRIC_PUBLISH_US,       ///< Time spent in esp_mqtt_client_publish
+    METRIC_PUBACK_MS,        ///< Publish to PUBACK round-trip
+    METRIC_ALARM_QUEUE_MS,   ///< Time an alarm waited in its lane
+    METRIC_ROUTINE_QUEUE_MS, ///< Time a routine message waited in its lane
+    METRIC_CONNECT_MS,       ///< Start of the TCP connect to CONNACK
+    METRIC_CONNECT_BYTES,    ///< Sent and received from the TCP connect to CONNACK
+    METRIC_HISTOGRAM_COUNT,
+} MetricHistogram;
+
+typedef struct
+{
+    atomic_uint_fast32_t count;
+    atomic_uint_fast32_t sum;
+    atomic_uint_fast32_t max;
+    atomic_uint_fast32_t buckets[METRIC_HISTOGRAM_BUCKETS];
+} MetricHistogramValues;
+
+typedef struct
+{
+    atomic_uint_fast32_t counters[METRIC_COUNTER_COUNT];
+    atomic_int_fast32_t gauges[METRIC_GAUGE_COUNT];
+    MetricHistogramValues histograms[METRIC_HISTOGRAM_COUNT];
+    uint32_t snapshot_uptime; ///< Uptime of the previous snapshot (s)
+} MetricsRegistry;
+
+#define METRICS_SNAPSHOT_LEN                                                                                 \
+    (5 + 4 + 4 + 8 + 4 * METRIC_COUNTER_COUNT + 4 * METRIC_GAUGE_COUNT +                                     \
+     METRIC_HISTOGRAM_COUNT * (4 * 3 + 2 * METRIC_HISTOGRAM_BUCKETS))
+
+void metricsInit(MetricsRegistry *metrics);
+
+void metricsCount(MetricsRegistry *metrics, MetricCounter counter, uint32_t amount);
+
+void metricsSet(MetricsRegistry *metrics, MetricGauge gauge, int32_t value);
+
+void metricsRecord(MetricsRegistry *metrics, MetricHistogram histogram, uint32_t value);
+
+/**
+ * Bucket a value falls into.
+ */
+int metricsBucket(uint32_t value);
+
+/**
+ * Serialize the registry and reset its counters and histograms.
+ *
+ * @return Number of bytes written, or 0 if the snapshot did not fit (nothing is reset then)
+ */
+size_t metricsSnapshot(MetricsRegistry *metrics, uint32_t uptime, int64_t timestamp, uint8_t *buffer, size_t size);
+
+/**
+ * Matches PUBACKs to the time their publish was sent. Publishes are tracked
+ * in a small ring, the oldest is forgotten when more are in flight.
+ */
+#define PUBACK_TRACKER_SLOTS 16
+
+typedef struct
+{
+    atomic_int msg_ids[PUBACK_TRACKER_SLOTS]; ///< 0 marks a free slot
+    int64_t sent_us[PUBACK_TRACKER_SLOTS];
+    atomic_uint_fast32_t next;
+} PubackTracker;
+
+void pubackTrackerInit(PubackTracker *tracker);
+
+/**
+ * Called by the publishing task once esp_mqtt_client_publish returned msg_id.
+ */
+void pubackTrackerSent(PubackTracker *tracker, int msg_id, int64_t now_us);
+
+/**
+ * Called on MQTT_EVENT_PUBLISHED.
+ *
+ * @return false if the publish was not tracked (QoS 0 or already forgotten)
+ */
+bool pubackTrackerAcked(PubackTracker *tracker, int msg_id, int64_t now_us, int64_t *rtt_us);
@@ -0,0 +1,81 @@
+#include "telemetry_pipeline.h"
+
+bool sampleRingInit(SampleRing *ring, SampleRecord *records, uint32_t capacity, SampleRingDropPolicy policy)
+{
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+    {
+        return false;
+    }
+    ring->records = records;
+    ring->capacity = capacity;
+    ring->policy = policy;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->overflows, 0);
+    atomic_init(&ring->dropped, 0);
+    return true;
+}
+
+bool sampleRingPush(SampleRing *ring, const SampleRecord *record)
+{
+    uint_fast32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint_fast32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if ((uint32_t)(head - tail) >= ring->capacity)
+    {
+        atomic_fetch_add_explicit(&ring->overflows, 1, memory_order_relaxed);
+        if (ring->policy == SAMPLE_RING_DROP_NEWEST)
+        {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return false;
+        }
+        // Evict the oldest record, unless the consumer claimed it in the meantime
+        if (atomic_compare_exchange_strong_explicit(&ring->tail, &tail, tail + 1, memory_order_acq_rel,
+                                                    memory_order_acquire))
+        {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        }
+    }
+
+    ring->records[head & (ring->capacity - 1)] = *record;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool sampleRingPop(SampleRing *ring, SampleRecord *record)
+{
+    uint_fast32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    while (1)
+    {
+        uint_fast32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail == head)
+        {
+            return false;
+        }
+        *record = ring->records[tail & (ring->capacity - 1)];
+        // Fails if the producer evicted this record while it was copied, tail is reloaded then
+        if (atomic_compare_exchange_weak_explicit(&ring->tail, &tail, tail + 1, memory_order_acq_rel,
+                                                  memory_order_acquire))
+        {
+            return true;
+        }
+    }
+}
+
+uint32_t sampleRingCount(const SampleRing *ring)
+{
+    uint_fast32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint_fast32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    return (uint32_t)(head - tail);
+}
+
+void sampleJitterAdd(SampleJitter *jitter, int64_t scheduled_us, int64_t actual_us)
+{
+    int64_t deviation = actual_us > scheduled_us ? actual_us - scheduled_us : scheduled_us - actual_us;
+    jitter->samples++;
+    jitter->total_us += deviation;
+    if (deviation > jitter->max_us)
+    {
+        jitter->max_us = deviation;
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "telemetry.h"
+
+/**
+ * Hand-over between the sampler task and the uplink task.
+ *
+ * Samples travel as fixed-size records through a lock-free single-producer
+ * single-consumer ring, so a publish blocked on a slow modem never delays
+ * the next sample. The producer only ever writes head and the record slots,
+ * the consumer claims records by advancing tail with a compare-and-swap.
+ * That CAS is what makes the drop-oldest policy possible: a producer facing
+ * a full ring may advance tail itself, and a consumer that loses the race
+ * for a slot discards its copy and retries.
+ */
+
+typedef enum
+{
+    SAMPLE_BMS_STATUS = 1,
+    SAMPLE_LOCATION,
+} SampleType;
+
+typedef struct
+{
+    uint8_t type;      ///< SampleType
+    uint32_t sequence; ///< Incremented per record by the sampler, gaps show drops
+    union
+    {
+        BmsStatus status;
+        Location location;
+    };
+} SampleRecord;
+
+typedef enum
+{
+    SAMPLE_RING_DROP_NEWEST, ///< A full ring rejects the new record
+    SAMPLE_RING_DROP_OLDEST, ///< A full ring evicts its oldest record
+} SampleRingDropPolicy;
+
+typedef struct
+{
+    SampleRecord *records;
+    uint32_t capacity; ///< Power of two
+    SampleRingDropPolicy policy;
+
+    atomic_uint_fast32_t head; ///< Next slot to write, only advanced by the producer
+    atomic_uint_fast32_t tail; ///< Oldest unread slot
+
+    atomic_uint_fast32_t overflows; ///< Pushes that found the ring full
+    atomic_uint_fast32_t dropped;   ///< Records lost to the drop policy
+} SampleRing;
+
+/**
+ * @param records Storage for capacity records
+ * @return false if capacity is not a power of two
+ */
+bool sampleRingInit(SampleRing *ring, SampleRecord *records, uint32_t capacity, SampleRingDropPolicy policy);
+
+/**
+ * Producer side, never blocks.
+ *
+ * @return false if the record was dropped
+ */
+bool sampleRingPush(SampleRing *ring, const SampleRecord *record);
+
+/**
+ * Consumer side, never blocks.
+ *
+ * @return false if the ring is empty
+ */
+bool sampleRingPop(SampleRing *ring, SampleRecord *record);
+
+/**
+ * Records waiting, may be stale by the time it returns.
+ */
+uint32_t sampleRingCount(const SampleRing *ring);
+
+/**
+ * Deviation of the sample times from the ideal schedule.
+ */
+typedef struct
+{
+    uint32_t samples;
+    int64_t max_us;   ///< Largest deviation
+    int64_t total_us; ///< Sum of the deviations, for the mean
+} SampleJitter;
+
+void sampleJitterAdd(SampleJitter *jitter, int64_t scheduled_us, int64_t actual_us);
@@ -0,0 +1,99 @@
+#include <math.h>
+#include <string.h>
+
+#include "telemetry_scheduler.h"
+#include "telemetry_track.h"
+
+void schedulerInit(PublishScheduler *scheduler, const PublishThresholds *thresholds)
+{
+    memset(scheduler, 0, sizeof(*scheduler));
+    scheduler->thresholds = *thresholds;
+}
+
+static bool exceeds(float current, float reference, float deadband)
+{
+    // NaN readings count as a change, so a failing sensor is reported
+    return !(fabsf(current - reference) < deadband);
+}
+
+static bool heartbeat_due(const PublishScheduler *scheduler, time_t last, time_t now)
+{
+    return scheduler->thresholds.heartbeat > 0 && now - last >= (time_t)scheduler->thresholds.heartbeat;
+}
+
+static PublishReason count(PublishCounters *counters, PublishReason reason)
+{
+    if (reason == PUBLISH_SUPPRESS)
+    {
+        counters->suppressed++;
+    }
+    else
+    {
+        counters->published++;
+    }
+    return reason;
+}
+
+static PublishReason check_bms_status(const PublishScheduler *scheduler, const BmsStatus *last, const BmsStatus *status)
+{
+    const PublishThresholds *thresholds = &scheduler->thresholds;
+
+    if (status->error_flags != last->error_flags || status->full != last->full || status->empty != last->empty ||
+        status->state != last->state)
+    {
+        return PUBLISH_ALARM;
+    }
+    if (exceeds(status->soc, last->soc, thresholds->soc) ||
+        exceeds(status->pack_current, last->pack_current, thresholds->current) ||
+        exceeds(status->cell_voltage_max, last->cell_voltage_max, thresholds->cell_voltage) ||
+        exceeds(status->cell_voltage_min, last->cell_voltage_min, thresholds->cell_voltage) ||
+        exceeds(status->bat_temp_max, last->bat_temp_max, thresholds->temperature) ||
+        status->chg_enable != last->chg_enable || status->dis_enable != last->dis_enable)
+    {
+        return PUBLISH_CHANGE;
+    }
+    if (heartbeat_due(scheduler, last->timestamp, status->timestamp))
+    {
+        return PUBLISH_HEARTBEAT;
+    }
+    return PUBLISH_SUPPRESS;
+}
+
+PublishReason schedulerCheckBmsStatus(PublishScheduler *scheduler, const BmsStatus *status)
+{
+    PublishReason reason =
+        scheduler->has_status ? check_bms_status(scheduler, &scheduler->status, status) : PUBLISH_FIRST;
+    if (reason != PUBLISH_SUPPRESS)
+    {
+        scheduler->status = *status;
+        scheduler->has_status = true;
+    }
+    return count(&scheduler->battery, reason);
+}
+
+PublishReason schedulerCheckLocation(PublishScheduler *scheduler, const Location *location)
+{
+    PublishReason reason = PUBLISH_FIRST;
+    if (scheduler->has_location)
+    {
+        const Location *last = &scheduler->location;
+        if (exceeds(trackSegmentError(last, last, location), 0, scheduler->thresholds.distance))
+        {
+            reason = PUBLISH_CHANGE;
+        }
+        else if (heartbeat_due(scheduler, last->timestamp, location->timestamp))
+        {
+            reason = PUBLISH_HEARTBEAT;
+        }
+        else
+        {
+            reason = PUBLISH_SUPPRESS;
+        }
+    }
+    if (reason != PUBLISH_SUPPRESS)
+    {
+        scheduler->location = *location;
+        scheduler->has_location = true;
+    }
+    return count(&scheduler->gps, reason);
+}
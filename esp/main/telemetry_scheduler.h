@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "telemetry.h"
+
+/**
+ * Change-driven publishing: a sample is only sent when it differs enough
+ * from the last one that was sent, so an idle bike stays mostly silent
+ * while a charging or riding one keeps reporting.
+ *
+ * Every analog field has a deadband against the last published value, so
+ * slow drift still gets through once it adds up. Alarm conditions (any
+ * error_flags bit flipping, full/empty or the BMS state changing) are
+ * published on the sample they appear in. A heartbeat bounds the time
+ * between two published samples.
+ */
+
+typedef struct
+{
+    float soc;          ///< State of charge deadband (%)
+    float current;      ///< pack_current deadband (A)
+    float cell_voltage; ///< cell_voltage_max/min deadband (V)
+    float temperature;  ///< bat_temp_max deadband (°C)
+    float distance;     ///< Location deadband (m)
+    uint32_t heartbeat; ///< Maximum time between published samples (s)
+} PublishThresholds;
+
+typedef enum
+{
+    PUBLISH_SUPPRESS = 0,
+    PUBLISH_FIRST,     ///< Nothing published yet
+    PUBLISH_CHANGE,    ///< A deadband was exceeded
+    PUBLISH_ALARM,     ///< error_flags, full/empty or state changed
+    PUBLISH_HEARTBEAT, ///< Nothing published for the heartbeat interval
+} PublishReason;
+
+typedef struct
+{
+    uint32_t published;  ///< Samples let through
+    uint32_t suppressed; ///< Samples held back
+} PublishCounters;
+
+typedef struct
+{
+    PublishThresholds thresholds;
+
+    BmsStatus status; ///< Last published BmsStatus
+    bool has_status;
+    Location location; ///< Last published Location
+    bool has_location;
+
+    PublishCounters battery;
+    PublishCounters gps;
+} PublishScheduler;
+
+void schedulerInit(PublishScheduler *scheduler, const PublishThresholds *thresholds);
+
+/**
+ * Decide whether a BmsStatus is published. The status becomes the new
+ * reference when it is.
+ */
+PublishReason schedulerCheckBmsStatus(PublishScheduler *scheduler, const BmsStatus *status);
+
+/**
+ * Decide whether a Location is published, based on the distance from the
+ * last published one and the heartbeat.
+ */
+PublishReason schedulerCheckLocation(PublishScheduler *scheduler, const Location *location);
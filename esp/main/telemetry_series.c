@@ -0,0 +1,569 @@
+#include <string.h>
+
+#include "telemetry_series.h"
+
+typedef struct
+{
+    uint8_t *data;
+    size_t size;
+    size_t bit; ///< Next bit to write or read
+    bool overflow;
+} BitStream;
+
+/// Per-column state of the float XOR encoding
+typedef struct
+{
+    uint32_t previous;
+    uint8_t leading;
+    uint8_t trailing;
+    bool first;
+    bool window; ///< leading/trailing describe a usable window
+} FloatColumn;
+
+/// Per-column state of the timestamp delta-of-delta encoding
+typedef struct
+{
+    int64_t previous;
+    int64_t delta;
+    bool first;
+} TimeColumn;
+
+/// Per-column state of the repeat encoding for integers
+typedef struct
+{
+    uint32_t previous;
+    bool first;
+} IntColumn;
+
+static const size_t statusFloatFields[] = {
+    offsetof(BmsStatus, cell_voltage_max),
+    offsetof(BmsStatus, cell_voltage_min),
+    offsetof(BmsStatus, cell_voltage_avg),
+    offsetof(BmsStatus, pack_voltage),
+    offsetof(BmsStatus, stack_voltage),
+    offsetof(BmsStatus, pack_current),
+    offsetof(BmsStatus, bat_temp_max),
+    offsetof(BmsStatus, bat_temp_min),
+    offsetof(BmsStatus, bat_temp_avg),
+    offsetof(BmsStatus, mosfet_temp),
+    offsetof(BmsStatus, ic_temp),
+    offsetof(BmsStatus, mcu_temp),
+    offsetof(BmsStatus, soc),
+};
+
+#define FIELD(type, sample, offset) ((type *)((uint8_t *)(sample) + (offset)))
+
+static void put_bits(BitStream *stream, uint64_t value, int count)
+{
+    if (stream->overflow || stream->bit + count > stream->size * 8)
+    {
+        stream->overflow = true;
+        return;
+    }
+    // Fill the current byte from the top, a whole byte at a time when aligned
+    while (count > 0)
+    {
+        int used = stream->bit % 8;
+        int take = 8 - used < count ? 8 - used : count;
+        uint8_t chunk = (value >> (count - take)) & ((1u << take) - 1);
+        uint8_t *byte = &stream->data[stream->bit / 8];
+        if (used == 0)
+        {
+            *byte = 0;
+        }
+        *byte |= chunk << (8 - used - take);
+        stream->bit += take;
+        count -= take;
+    }
+}
+
+static uint64_t get_bits(BitStream *stream, int count)
+{
+    if (stream->overflow || stream->bit + count > stream->size * 8)
+    {
+        stream->overflow = true;
+        return 0;
+    }
+    uint64_t value = 0;
+    while (count > 0)
+    {
+        int used = stream->bit % 8;
+        int take = 8 - used < count ? 8 - used : count;
+        uint8_t chunk = (stream->data[stream->bit / 8] >> (8 - used - take)) & ((1u << take) - 1);
+        value = value << take | chunk;
+        stream->bit += take;
+        count -= take;
+    }
+    return value;
+}
+
+static int leading_zeros(uint32_t value)
+{
+    return value ? __builtin_clz(value) : 32;
+}
+
+static int trailing_zeros(uint32_t value)
+{
+    return value ? __builtin_ctz(value) : 32;
+}
+
+static uint64_t zigzag(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static void put_float(BitStream *stream, FloatColumn *column, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    if (column->first)
+    {
+        put_bits(stream, bits, 32);
+        column->first = false;
+        column->previous = bits;
+        return;
+    }
+
+    uint32_t xor = bits ^ column->previous;
+    column->previous = bits;
+    if (xor == 0)
+    {
+        put_bits(stream, 0, 1);
+        return;
+    }
+
+    int leading = leading_zeros(xor);
+    int trailing = trailing_zeros(xor);
+    if (column->window && leading >= column->leading && trailing >= column->trailing)
+    {
+        // Fits in the previous window: '10' and the meaningful bits
+        put_bits(stream, 2, 2);
+        put_bits(stream, xor >> column->trailing, 32 - column->leading - column->trailing);
+        return;
+    }
+
+    // New window: '11', 5 bits of leading zeros, 5 bits of length - 1
+    int meaningful = 32 - leading - trailing;
+    put_bits(stream, 3, 2);
+    put_bits(stream, leading, 5);
+    put_bits(stream, meaningful - 1, 5);
+    put_bits(stream, xor >> trailing, meaningful);
+    column->leading = leading;
+    column->trailing = trailing;
+    column->window = true;
+}
+
+static float get_float(BitStream *stream, FloatColumn *column)
+{
+    uint32_t bits;
+    if (column->first)
+    {
+        bits = get_bits(stream, 32);
+        column->first = false;
+    }
+    else if (get_bits(stream, 1) == 0)
+    {
+        bits = column->previous;
+    }
+    else if (get_bits(stream, 1) == 0)
+    {
+        if (!column->window)
+        {
+            stream->overflow = true;
+            return 0;
+        }
+        int meaningful = 32 - column->leading - column->trailing;
+        bits = column->previous ^ (uint32_t)(get_bits(stream, meaningful) << column->trailing);
+    }
+    else
+    {
+        int leading = get_bits(stream, 5);
+        int meaningful = get_bits(stream, 5) + 1;
+        if (leading + meaningful > 32)
+        {
+            stream->overflow = true;
+            return 0;
+        }
+        column->leading = leading;
+        column->trailing = 32 - leading - meaningful;
+        column->window = true;
+        bits = column->previous ^ (uint32_t)(get_bits(stream, meaningful) << column->trailing);
+    }
+
+    column->previous = bits;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void put_time(BitStream *stream, TimeColumn *column, int64_t value)
+{
+    if (column->first)
+    {
+        put_bits(stream, (uint64_t)value, 64);
+        column->first = false;
+        column->previous = value;
+        return;
+    }
+
+    int64_t delta = value - column->previous;
+    uint64_t dod = zigzag(delta - column->delta);
+    column->previous = value;
+    column->delta = delta;
+
+    if (dod == 0)
+    {
+        put_bits(stream, 0, 1);
+    }
+    else if (dod < (1 << 7))
+    {
+        put_bits(stream, 2, 2);
+        put_bits(stream, dod, 7);
+    }
+    else if (dod < (1 << 9))
+    {
+        put_bits(stream, 6, 3);
+        put_bits(stream, dod, 9);
+    }
+    else if (dod < (1 << 12))
+    {
+        put_bits(stream, 14, 4);
+        put_bits(stream, dod, 12);
+    }
+    else
+    {
+        put_bits(stream, 15, 4);
+        put_bits(stream, dod, 64);
+    }
+}
+
+static int64_t get_time(BitStream *stream, TimeColumn *column)
+{
+    if (column->first)
+    {
+        column->first = false;
+        column->previous = (int64_t)get_bits(stream, 64);
+        return column->previous;
+    }
+
+    // Count the leading ones of the bucket prefix, at most four
+    int prefix = 0;
+    while (prefix < 4 && get_bits(stream, 1) == 1)
+    {
+        prefix++;
+    }
+    static const int widths[] = {0, 7, 9, 12, 64};
+    uint64_t dod = prefix == 0 ? 0 : get_bits(stream, widths[prefix]);
+
+    column->delta += unzigzag(dod);
+    column->previous += column->delta;
+    return column->previous;
+}
+
+static void put_int(BitStream *stream, IntColumn *column, uint32_t value, int width)
+{
+    if (!column->first && value == column->previous)
+    {
+        put_bits(stream, 0, 1);
+        return;
+    }
+    if (!column->first)
+    {
+        put_bits(stream, 1, 1);
+    }
+    put_bits(stream, value, width);
+    column->first = false;
+    column->previous = value;
+}
+
+static uint32_t get_int(BitStream *stream, IntColumn *column, int width)
+{
+    if (column->first || get_bits(stream, 1) == 1)
+    {
+        column->previous = get_bits(stream, width);
+        column->first = false;
+    }
+    return column->previous;
+}
+
+static uint32_t status_flags(const BmsStatus *status)
+{
+    return status->chg_enable | status->dis_enable << 1 | status->full << 2 | status->empty << 3;
+}
+
+size_t convertBatchToSeries(const BmsStatus *statuses, size_t statusCount, const Location *locations,
+                            size_t locationCount, uint8_t *buffer, size_t size)
+{
+    if (size < 4 || statusCount > UINT8_MAX || locationCount > UINT8_MAX)
+    {
+        return 0;
+    }
+    buffer[0] = TELEMETRY_SERIES_VERSION;
+    buffer[1] = statusCount;
+    buffer[2] = locationCount;
+    buffer[3] = BOARD_NUM_THERMISTORS_MAX;
+
+    BitStream stream = {.data = buffer + 4, .size = size - 4};
+
+    TimeColumn times[2] = {{.first = true}, {.first = true}};
+    IntColumn ints[5] = {{.first = true}, {.first = true}, {.first = true}, {.first = true}, {.first = true}};
+    for (size_t i = 0; i < statusCount; i++)
+    {
+        put_time(&stream, &times[0], statuses[i].timestamp);
+    }
+    for (size_t i = 0; i < statusCount; i++)
+    {
+        put_time(&stream, &times[1], statuses[i].no_idle_timestamp);
+    }
+    for (size_t i = 0; i < statusCount; i++)
+    {
+        put_int(&stream, &ints[0], statuses[i].state, 16);
+    }
+    for (size_t i = 0; i < statusCount; i++)
+    {
+        put_int(&stream, &ints[1], status_flags(&statuses[i]), 4);
+    }
+    for (size_t i = 0; i < statusCount; i++)
+    {
+        uint16_t cells = statuses[i].connected_cells;
+        put_int(&stream, &ints[2], cells > BOARD_NUM_CELLS_MAX ? BOARD_NUM_CELLS_MAX : cells, 8);
+    }
+    for (size_t i = 0; i < statusCount; i++)
+    {
+        put_int(&stream, &ints[3], statuses[i].balancing_status, 32);
+    }
+    for (size_t i = 0; i < statusCount; i++)
+    {
+        put_int(&stream, &ints[4], statuses[i].error_flags, 32);
+    }
+
+    for (int cell = 0; cell < BOARD_NUM_CELLS_MAX; cell++)
+    {
+        FloatColumn column = {.first = true};
+        for (size_t i = 0; i < statusCount; i++)
+        {
+            if (statuses[i].connected_cells > cell)
+            {
+                put_float(&stream, &column, statuses[i].cell_voltages[cell]);
+            }
+        }
+    }
+    for (int thermistor = 0; thermistor < BOARD_NUM_THERMISTORS_MAX; thermistor++)
+    {
+        FloatColumn column = {.first = true};
+        for (size_t i = 0; i < statusCount; i++)
+        {
+            put_float(&stream, &column, statuses[i].bat_temps[thermistor]);
+        }
+    }
+    for (size_t field = 0; field < sizeof(statusFloatFields) / sizeof(statusFloatFields[0]); field++)
+    {
+        FloatColumn column = {.first = true};
+        for (size_t i = 0; i < statusCount; i++)
+        {
+            put_float(&stream, &column, *FIELD(const float, &statuses[i], statusFloatFields[field]));
+        }
+    }
+
+    IntColumn bootIds = {.first = true};
+    TimeColumn sequences = {.first = true};
+    TimeColumn uptimes = {.first = true};
+    for (size_t i = 0; i < statusCount; i++)
+    {
+        put_int(&stream, &bootIds, statuses[i].boot_id, 32);
+    }
+    for (size_t i = 0; i < statusCount; i++)
+    {
+        put_time(&stream, &sequences, statuses[i].sequence);
+    }
+    for (size_t i = 0; i < statusCount; i++)
+    {
+        put_time(&stream, &uptimes, statuses[i].uptime_ms);
+    }
+
+    TimeColumn locationTimes = {.first = true};
+    FloatColumn latitudes = {.first = true};
+    FloatColumn longitudes = {.first = true};
+    for (size_t i = 0; i < locationCount; i++)
+    {
+        put_time(&stream, &locationTimes, locations[i].timestamp);
+    }
+    for (size_t i = 0; i < locationCount; i++)
+    {
+        put_float(&stream, &latitudes, locations[i].latitude);
+    }
+    for (size_t i = 0; i < locationCount; i++)
+    {
+        put_float(&stream, &longitudes, locations[i].longitude);
+    }
+
+    IntColumn locationBootIds = {.first = true};
+    TimeColumn locationSequences = {.first = true};
+    TimeColumn locationUptimes = {.first = true};
+    for (size_t i = 0; i < locationCount; i++)
+    {
+        put_int(&stream, &locationBootIds, locations[i].boot_id, 32);
+    }
+    for (size_t i = 0; i < locationCount; i++)
+    {
+        put_time(&stream, &locationSequences, locations[i].sequence);
+    }
+    for (size_t i = 0; i < locationCount; i++)
+    {
+        put_time(&stream, &locationUptimes, locations[i].uptime_ms);
+    }
+
+    // Pad the last byte with zeros
+    if (stream.bit % 8)
+    {
+        put_bits(&stream, 0, 8 - stream.bit % 8);
+    }
+    return stream.overflow ? 0 : 4 + stream.bit / 8;
+}
+
+bool parseSeriesBatch(const uint8_t *payload, size_t length, BmsStatus *statuses, size_t *statusCount,
+                      Location *locations, size_t *locationCount)
+{
+    if (length < 4 || payload[0] < 1 || payload[0] > TELEMETRY_SERIES_VERSION || payload[1] > *statusCount ||
+        payload[2] > *locationCount || payload[3] > BOARD_NUM_THERMISTORS_MAX)
+    {
+        return false;
+    }
+    int version = payload[0];
+    size_t statuses_n = payload[1];
+    size_t locations_n = payload[2];
+    int thermistors = payload[3];
+    memset(statuses, 0, statuses_n * sizeof(*statuses));
+    memset(locations, 0, locations_n * sizeof(*locations));
+
+    BitStream stream = {.data = (uint8_t *)payload + 4, .size = length - 4};
+
+    TimeColumn times[2] = {{.first = true}, {.first = true}};
+    IntColumn ints[5] = {{.first = true}, {.first = true}, {.first = true}, {.first = true}, {.first = true}};
+    for (size_t i = 0; i < statuses_n; i++)
+    {
+        statuses[i].timestamp = get_time(&stream, &times[0]);
+    }
+    for (size_t i = 0; i < statuses_n; i++)
+    {
+        statuses[i].no_idle_timestamp = get_time(&stream, &times[1]);
+    }
+    for (size_t i = 0; i < statuses_n; i++)
+    {
+        statuses[i].state = get_int(&stream, &ints[0], 16);
+    }
+    for (size_t i = 0; i < statuses_n; i++)
+    {
+        uint32_t flags = get_int(&stream, &ints[1], 4);
+        statuses[i].chg_enable = flags & 1;
+        statuses[i].dis_enable = flags & 2;
+        statuses[i].full = flags & 4;
+        statuses[i].empty = flags & 8;
+    }
+    for (size_t i = 0; i < statuses_n; i++)
+    {
+        statuses[i].connected_cells = get_int(&stream, &ints[2], 8);
+        if (statuses[i].connected_cells > BOARD_NUM_CELLS_MAX)
+        {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < statuses_n; i++)
+    {
+        statuses[i].balancing_status = get_int(&stream, &ints[3], 32);
+    }
+    for (size_t i = 0; i < statuses_n; i++)
+    {
+        statuses[i].error_flags = get_int(&stream, &ints[4], 32);
+    }
+
+    for (int cell = 0; cell < BOARD_NUM_CELLS_MAX; cell++)
+    {
+        FloatColumn column = {.first = true};
+        for (size_t i = 0; i < statuses_n; i++)
+        {
+            if (statuses[i].connected_cells > cell)
+            {
+                statuses[i].cell_voltages[cell] = get_float(&stream, &column);
+            }
+        }
+    }
+    for (int thermistor = 0; thermistor < thermistors; thermistor++)
+    {
+        FloatColumn column = {.first = true};
+        for (size_t i = 0; i < statuses_n; i++)
+        {
+            statuses[i].bat_temps[thermistor] = get_float(&stream, &column);
+        }
+    }
+    for (size_t field = 0; field < sizeof(statusFloatFields) / sizeof(statusFloatFields[0]); field++)
+    {
+        FloatColumn column = {.first = true};
+        for (size_t i = 0; i < statuses_n; i++)
+        {
+            *FIELD(float, &statuses[i], statusFloatFields[field]) = get_float(&stream, &column);
+        }
+    }
+
+    IntColumn bootIds = {.first = true};
+    TimeColumn sequences = {.first = true};
+    TimeColumn uptimes = {.first = true};
+    for (size_t i = 0; version >= 2 && i < statuses_n; i++)
+    {
+        statuses[i].boot_id = get_int(&stream, &bootIds, 32);
+    }
+    for (size_t i = 0; version >= 2 && i < statuses_n; i++)
+    {
+        statuses[i].sequence = get_time(&stream, &sequences);
+    }
+    for (size_t i = 0; version >= 2 && i < statuses_n; i++)
+    {
+        statuses[i].uptime_ms = get_time(&stream, &uptimes);
+    }
+
+    TimeColumn locationTimes = {.first = true};
+    FloatColumn latitudes = {.first = true};
+    FloatColumn longitudes = {.first = true};
+    for (size_t i = 0; i < locations_n; i++)
+    {
+        locations[i].timestamp = get_time(&stream, &locationTimes);
+    }
+    for (size_t i = 0; i < locations_n; i++)
+    {
+        locations[i].latitude = get_float(&stream, &latitudes);
+    }
+    for (size_t i = 0; i < locations_n; i++)
+    {
+        locations[i].longitude = get_float(&stream, &longitudes);
+    }
+
+    IntColumn locationBootIds = {.first = true};
+    TimeColumn locationSequences = {.first = true};
+    TimeColumn locationUptimes = {.first = true};
+    for (size_t i = 0; version >= 2 && i < locations_n; i++)
+    {
+        locations[i].boot_id = get_int(&stream, &locationBootIds, 32);
+    }
+    for (size_t i = 0; version >= 2 && i < locations_n; i++)
+    {
+        locations[i].sequence = get_time(&stream, &locationSequences);
+    }
+    for (size_t i = 0; version >= 2 && i < locations_n; i++)
+    {
+        locations[i].uptime_ms = get_time(&stream, &locationUptimes);
+    }
+
+    if (stream.overflow)
+    {
+        return false;
+    }
+    *statusCount = statuses_n;
+    *locationCount = locations_n;
+    return true;
+}
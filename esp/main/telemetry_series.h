@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "telemetry.h"
+
+/**
+ * Lossless columnar compression for batches of samples, after Facebook's
+ * Gorilla time-series encoding.
+ *
+ * Every field is written as one column over the whole batch into an
+ * MSB-first bit stream:
+ *   - timestamps as delta-of-delta in variable-width buckets
+ *   - floats as the XOR with the previous value, reusing the previous
+ *     leading/trailing zero window when the new value fits in it
+ *   - integers and flags as a single bit when unchanged, raw otherwise
+ *
+ * The cell_voltages[i] column only holds samples with more than i
+ * connected cells. Version 2 adds boot_id, sequence and uptime_ms columns
+ * after the other BmsStatus and Location columns, sequence and uptime_ms
+ * delta-of-delta coded like the timestamps. Version 1 batches are still
+ * parsed, with those fields left 0.
+ *
+ * Message (version 2):
+ *   u8   version
+ *   u8   battery count, location count, thermistors
+ *   ...  bit stream, padded to a whole byte
+ */
+#define TELEMETRY_SERIES_VERSION 2
+
+/**
+ * Worst case is 167 bytes per BmsStatus (every float changes its whole
+ * XOR window) and 42 bytes per Location, plus the header.
+ */
+#define SERIES_BATCH_MAX_LEN(count) (5 + (count) * (168 + 42))
+
+/**
+ * Compress a batch of samples.
+ *
+ * @return Number of bytes written, or 0 if the batch did not fit
+ */
+size_t convertBatchToSeries(const BmsStatus *statuses, size_t statusCount, const Location *locations,
+                            size_t locationCount, uint8_t *buffer, size_t size);
+
+/**
+ * Decompress a batch. The counts are in/out: capacity of the arrays on the
+ * way in, number of decoded samples on the way out.
+ *
+ * @return false if the payload is malformed or does not fit the arrays
+ */
+bool parseSeriesBatch(const uint8_t *payload, size_t length, BmsStatus *statuses, size_t *statusCount,
+                      Location *locations, size_t *locationCount);
@@ -0,0 +1,129 @@
+#include <string.h>
+
+#include "telemetry_boot.h"
+#include "telemetry_session.h"
+
+// Same CRC-32 as the flash log records
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t length)
+{
+    const uint8_t *bytes = data;
+    crc = ~crc;
+    while (length--)
+    {
+        crc ^= *bytes++;
+        for (int i = 0; i < 8; i++)
+        {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static void put_le(uint8_t *buffer, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        buffer[i] = value >> (8 * i);
+    }
+}
+
+static uint64_t get_le(const uint8_t *buffer, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        value |= (uint64_t)buffer[i] << (8 * i);
+    }
+    return value;
+}
+
+void sessionCacheInit(SessionCache *cache)
+{
+    cache->host[0] = '\0';
+    cache->saved_at = 0;
+    cache->length = 0;
+}
+
+bool sessionCacheStore(SessionCache *cache, const char *host, const uint8_t *data, size_t length, int64_t now)
+{
+    size_t hostLength = strlen(host);
+    if (hostLength == 0 || hostLength > SESSION_HOST_MAX_LEN || length == 0 || length > SESSION_DATA_MAX_LEN)
+    {
+        sessionCacheClear(cache);
+        return false;
+    }
+    if (cache->length == length && strcmp(cache->host, host) == 0 && memcmp(cache->data, data, length) == 0)
+    {
+        return false;
+    }
+
+    memcpy(cache->host, host, hostLength + 1);
+    memcpy(cache->data, data, length);
+    cache->length = length;
+    cache->saved_at = now;
+    return true;
+}
+
+const uint8_t *sessionCacheLookup(const SessionCache *cache, const char *host, int64_t now, uint32_t max_age_s,
+                                  size_t *length)
+{
+    if (cache->length == 0 || strcmp(cache->host, host) != 0)
+    {
+        return NULL;
+    }
+    if (now >= CLOCK_VALID_AFTER && cache->saved_at >= CLOCK_VALID_AFTER &&
+        (now < cache->saved_at || now - cache->saved_at >= max_age_s))
+    {
+        return NULL;
+    }
+    *length = cache->length;
+    return cache->data;
+}
+
+void sessionCacheClear(SessionCache *cache)
+{
+    sessionCacheInit(cache);
+}
+
+size_t sessionCacheEncode(const SessionCache *cache, uint8_t *buffer, size_t size)
+{
+    size_t hostLength = strlen(cache->host);
+    size_t length = SESSION_BLOB_HEADER_LEN + hostLength + cache->length + 4;
+    if (cache->length == 0 || size < length)
+    {
+        return 0;
+    }
+
+    buffer[0] = SESSION_CACHE_VERSION;
+    buffer[1] = hostLength;
+    put_le(buffer + 2, cache->length, 2);
+    put_le(buffer + 4, (uint64_t)cache->saved_at, 8);
+    memcpy(buffer + SESSION_BLOB_HEADER_LEN, cache->host, hostLength);
+    memcpy(buffer + SESSION_BLOB_HEADER_LEN + hostLength, cache->data, cache->length);
+    put_le(buffer + length - 4, crc32_update(0, buffer, length - 4), 4);
+    return length;
+}
+
+bool sessionCacheDecode(SessionCache *cache, const uint8_t *blob, size_t length)
+{
+    sessionCacheInit(cache);
+    if (length < SESSION_BLOB_HEADER_LEN + 4 || blob[0] != SESSION_CACHE_VERSION)
+    {
+        return false;
+    }
+    size_t hostLength = blob[1];
+    size_t dataLength = get_le(blob + 2, 2);
+    if (hostLength == 0 || hostLength > SESSION_HOST_MAX_LEN || dataLength == 0 ||
+        dataLength > SESSION_DATA_MAX_LEN || length != SESSION_BLOB_HEADER_LEN + hostLength + dataLength + 4 ||
+        get_le(blob + length - 4, 4) != crc32_update(0, blob, length - 4))
+    {
+        return false;
+    }
+
+    memcpy(cache->host, blob + SESSION_BLOB_HEADER_LEN, hostLength);
+    cache->host[hostLength] = '\0';
+    memcpy(cache->data, blob + SESSION_BLOB_HEADER_LEN + hostLength, dataLength);
+    cache->length = dataLength;
+    cache->saved_at = (int64_t)get_le(blob + 4, 8);
+    return true;
+}
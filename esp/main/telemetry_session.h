@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * TLS session of the broker connection, kept for the next connect.
+ *
+ * A full TLS 1.2 handshake sends the broker's certificate chain and a key
+ * exchange over the cell link and takes two round trips. Offering the
+ * session ticket of the previous connection instead resumes it in one round
+ * trip without either, which is most of the cost of a reconnect after a PPP
+ * drop or an upload window. The cache holds the session as an opaque blob
+ * (mbedtls_ssl_session_save) with the broker it belongs to, in RAM and
+ * mirrored to NVS so a reboot resumes as well.
+ *
+ * A session is only offered to its broker and while younger than the
+ * ticket lifetime. A broker that no longer accepts it falls back to a full
+ * handshake, which costs the ticket's bytes and nothing else.
+ *
+ * NVS blob (version 1), little-endian like telemetry_binary.h:
+ *   u8   version
+ *   u8   host length (n)
+ *   u16  session length (m)
+ *   i64  saved at (s, boot-relative before the clock is set)
+ *   u8   host[n]
+ *   u8   session[m]
+ *   u32  CRC-32 of everything before it
+ */
+#define SESSION_CACHE_VERSION 1
+#define SESSION_HOST_MAX_LEN 64
+#define SESSION_DATA_MAX_LEN 2048 ///< Saved sessions keep the peer certificate (MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+#define SESSION_BLOB_HEADER_LEN 12
+#define SESSION_BLOB_MAX_LEN (SESSION_BLOB_HEADER_LEN + SESSION_HOST_MAX_LEN + SESSION_DATA_MAX_LEN + 4)
+
+typedef struct
+{
+    char host[SESSION_HOST_MAX_LEN + 1]; ///< Empty when nothing is cached
+    int64_t saved_at;
+    uint16_t length;
+    uint8_t data[SESSION_DATA_MAX_LEN];
+} SessionCache;
+
+void sessionCacheInit(SessionCache *cache);
+
+/**
+ * Keep the session a handshake with host ended with.
+ *
+ * @return true when the cache changed and should be written to NVS, false
+ *         for the session already cached (a resumed connection) or one that
+ *         does not fit (nothing is kept then)
+ */
+bool sessionCacheStore(SessionCache *cache, const char *host, const uint8_t *data, size_t length, int64_t now);
+
+/**
+ * Session to offer when connecting to host, or NULL. Its age is only
+ * checked when both now and the time it was saved are UTC, a boot-relative
+ * time says nothing about a session saved before a reboot.
+ */
+const uint8_t *sessionCacheLookup(const SessionCache *cache, const char *host, int64_t now, uint32_t max_age_s,
+                                  size_t *length);
+
+/**
+ * Forget the session, after a handshake that offered it failed.
+ */
+void sessionCacheClear(SessionCache *cache);
+
+/**
+ * @return Number of bytes written, 0 when nothing is cached or the buffer is too short
+ */
+size_t sessionCacheEncode(const SessionCache *cache, uint8_t *buffer, size_t size);
+
+/**
+ * Restore the cache from an NVS blob. A blob of another version, a torn or
+ * corrupted one leaves the cache empty.
+ */
+bool sessionCacheDecode(SessionCache *cache, const uint8_t *blob, size_t length);
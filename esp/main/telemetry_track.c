@@ -0,0 +1,102 @@
+#include <math.h>
+#include <string.h>
+
+#include "telemetry_track.h"
+
+#define EARTH_RADIUS_M 6371000.0f
+#define DEG_TO_RAD ((float)M_PI / 180.0f)
+
+void trackInit(Track *track, const TrackConfig *config)
+{
+    memset(track, 0, sizeof(*track));
+    track->config = *config;
+    if (track->config.window < 1)
+    {
+        track->config.window = 1;
+    }
+    if (track->config.window > TRACK_WINDOW_MAX)
+    {
+        track->config.window = TRACK_WINDOW_MAX;
+    }
+}
+
+float trackSegmentError(const Location *start, const Location *end, const Location *location)
+{
+    // Equirectangular projection around the start, good to well below a
+    // meter over the few kilometers a window can span
+    float latitude = start->latitude;
+    float longitude = start->longitude;
+    float fraction = 0.0f;
+    if (end->timestamp != start->timestamp)
+    {
+        fraction = (float)(location->timestamp - start->timestamp) / (float)(end->timestamp - start->timestamp);
+        latitude += (end->latitude - start->latitude) * fraction;
+        longitude += (end->longitude - start->longitude) * fraction;
+    }
+
+    float north = (location->latitude - latitude) * DEG_TO_RAD * EARTH_RADIUS_M;
+    float east = (location->longitude - longitude) * DEG_TO_RAD * EARTH_RADIUS_M *
+                 cosf(start->latitude * DEG_TO_RAD);
+    return sqrtf(north * north + east * east);
+}
+
+static bool window_fits(const Track *track, const Location *end)
+{
+    for (size_t i = 0; i < track->count; i++)
+    {
+        if (trackSegmentError(&track->anchor, end, &track->window[i]) > track->config.tolerance_m)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void publish(Track *track, const Location *location, Location *out, size_t *emitted)
+{
+    track->anchor = *location;
+    track->has_anchor = true;
+    track->published++;
+    out[(*emitted)++] = *location;
+}
+
+size_t trackAddLocation(Track *track, const Location *location, Location *out)
+{
+    size_t emitted = 0;
+    track->sampled++;
+
+    if (!track->has_anchor)
+    {
+        publish(track, location, out, &emitted);
+        return emitted;
+    }
+
+    if (track->count > 0 && (track->count == track->config.window || !window_fits(track, location)))
+    {
+        // The newest windowed position is the last one the segment still covered
+        publish(track, &track->window[track->count - 1], out, &emitted);
+        track->count = 0;
+    }
+
+    if (track->config.max_interval > 0 && location->timestamp - track->anchor.timestamp >= track->config.max_interval)
+    {
+        publish(track, location, out, &emitted);
+        track->count = 0;
+    }
+    else
+    {
+        track->window[track->count++] = *location;
+    }
+    return emitted;
+}
+
+size_t trackFlush(Track *track, Location *out)
+{
+    size_t emitted = 0;
+    if (track->count > 0)
+    {
+        publish(track, &track->window[track->count - 1], out, &emitted);
+        track->count = 0;
+    }
+    return emitted;
+}
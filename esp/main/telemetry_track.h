@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "telemetry.h"
+
+/**
+ * Streaming simplification of the GPS track, so only the positions needed to
+ * rebuild the path are published.
+ *
+ * Positions are sampled faster than they are published and collected in a
+ * small window behind the last published point (the anchor). As long as
+ * every windowed position lies within the tolerance of the straight segment
+ * from the anchor to the newest sample, nothing is published. Once a sample
+ * breaks the corridor, or the window is full, the last position that still
+ * fit is published and becomes the new anchor (opening-window variant of
+ * Douglas-Peucker).
+ *
+ * Distances are synchronized: a position is compared with the point reached
+ * at the same timestamp when moving along the segment at constant speed, so
+ * linear interpolation over time rebuilds every sample within the tolerance,
+ * including the stops.
+ *
+ * A parked bike never leaves the corridor, so a position is also published
+ * when the anchor gets older than max_interval.
+ */
+
+#define TRACK_WINDOW_MAX 64
+
+/// Positions published by a single trackAddLocation() call at most
+#define TRACK_MAX_EMIT 2
+
+typedef struct
+{
+    float tolerance_m;     ///< Maximum reconstruction error (m)
+    uint16_t window;       ///< Positions kept behind the anchor, at most TRACK_WINDOW_MAX
+    uint32_t max_interval; ///< Maximum time between published positions (s), 0 to disable
+} TrackConfig;
+
+typedef struct
+{
+    TrackConfig config;
+
+    Location anchor; ///< Last published position
+    bool has_anchor;
+
+    Location window[TRACK_WINDOW_MAX]; ///< Positions since the anchor, oldest first
+    size_t count;
+
+    uint32_t sampled;   ///< Positions fed to the track
+    uint32_t published; ///< Positions returned for publishing
+} Track;
+
+void trackInit(Track *track, const TrackConfig *config);
+
+/**
+ * Feed the next sampled position, timestamps must not go backwards.
+ *
+ * @param out Receives the positions to publish, oldest first, room for TRACK_MAX_EMIT
+ * @return Number of positions written to out
+ */
+size_t trackAddLocation(Track *track, const Location *location, Location *out);
+
+/**
+ * Publish the newest windowed position, e.g. before going to sleep, so the
+ * track is complete up to now.
+ *
+ * @return 1 if a position was written to out, 0 if there was nothing pending
+ */
+size_t trackFlush(Track *track, Location *out);
+
+/**
+ * Synchronized distance (m) between location and the position interpolated
+ * at its timestamp on the segment from start to end.
+ */
+float trackSegmentError(const Location *start, const Location *end, const Location *location);
@@ -0,0 +1,431 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_crt_bundle.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
+
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/platform_util.h"
+#include "mbedtls/ssl.h"
+
+#include "sdkconfig.h"
+
+#include "telemetry_session.h"
+#include "telemetry_transport.h"
+
+static const char *TAG = "transport";
+
+typedef struct
+{
+    bool tls;
+    bool handshaken;
+    mbedtls_net_context net;
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_config conf;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    TransportStats stats;
+    SessionCache sessions;
+    uint8_t offered_master[48]; ///< Master secret of the offered session, a full handshake derives a new one
+    uint8_t scratch[SESSION_BLOB_MAX_LEN]; ///< Saved session and NVS blob
+} TelemetryTransport;
+
+static int open_socket(const char *host, int port, int timeout_ms)
+{
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *addresses;
+    char service[8];
+    snprintf(service, sizeof(service), "%d", port);
+    if (getaddrinfo(host, service, &hints, &addresses) != 0 || addresses == NULL)
+    {
+        ESP_LOGE(TAG, "Could not resolve %s", host);
+        return -1;
+    }
+
+    int fd = socket(addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol);
+    if (fd >= 0)
+    {
+        // Non-blocking only for the connect, so it gives up after timeout_ms
+        int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        int result = connect(fd, addresses->ai_addr, addresses->ai_addrlen);
+        if (result < 0 && errno == EINPROGRESS)
+        {
+            fd_set writable;
+            FD_ZERO(&writable);
+            FD_SET(fd, &writable);
+            struct timeval timeout = {.tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000};
+            int error = 0;
+            socklen_t length = sizeof(error);
+            result = select(fd + 1, NULL, &writable, NULL, &timeout) == 1 &&
+                             getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0
+                         ? 0
+                         : -1;
+        }
+        fcntl(fd, F_SETFL, flags);
+        if (result < 0)
+        {
+            ESP_LOGE(TAG, "Could not connect to %s:%d (errno %d)", host, port, errno);
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    return fd;
+}
+
+static int wait_socket(int fd, bool write, int timeout_ms)
+{
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(fd, &set);
+    struct timeval timeout = {.tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000};
+    int ready = select(fd + 1, write ? NULL : &set, write ? &set : NULL, NULL, timeout_ms < 0 ? NULL : &timeout);
+    return ready < 0 ? -1 : ready > 0;
+}
+
+static int count_send(void *context, const unsigned char *buffer, size_t length)
+{
+    TelemetryTransport *transport = context;
+    int sent = mbedtls_net_send(&transport->net, buffer, length);
+    if (sent > 0)
+    {
+        transport->stats.bytes += sent;
+    }
+    return sent;
+}
+
+static int count_recv(void *context, unsigned char *buffer, size_t length, uint32_t timeout_ms)
+{
+    TelemetryTransport *transport = context;
+    int received = mbedtls_net_recv_timeout(&transport->net, buffer, length, timeout_ms);
+    if (received > 0)
+    {
+        transport->stats.bytes += received;
+    }
+    return received;
+}
+
+static void load_sessions(TelemetryTransport *transport)
+{
+    nvs_handle_t nvs;
+    size_t length = sizeof(transport->scratch);
+    if (nvs_open("tracker", NVS_READONLY, &nvs) != ESP_OK)
+    {
+        return;
+    }
+    if (nvs_get_blob(nvs, "tls_session", transport->scratch, &length) == ESP_OK &&
+        !sessionCacheDecode(&transport->sessions, transport->scratch, length))
+    {
+        ESP_LOGW(TAG, "Dropping the stored TLS session, it is corrupt or of another version");
+    }
+    nvs_close(nvs);
+}
+
+static void keep_session(TelemetryTransport *transport, const char *host)
+{
+    mbedtls_ssl_session session;
+    size_t length;
+    mbedtls_ssl_session_init(&session);
+    bool saved = mbedtls_ssl_get_session(&transport->ssl, &session) == 0 &&
+                 mbedtls_ssl_session_save(&session, transport->scratch, SESSION_DATA_MAX_LEN, &length) == 0;
+    mbedtls_ssl_session_free(&session);
+    if (!saved || !sessionCacheStore(&transport->sessions, host, transport->scratch, length, time(NULL)))
+    {
+        return;
+    }
+
+    // A new ticket, written so a reboot resumes as well
+    nvs_handle_t nvs;
+    length = sessionCacheEncode(&transport->sessions, transport->scratch, sizeof(transport->scratch));
+    if (length > 0 && nvs_open("tracker", NVS_READWRITE, &nvs) == ESP_OK)
+    {
+        if (nvs_set_blob(nvs, "tls_session", transport->scratch, length) != ESP_OK || nvs_commit(nvs) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Could not store the TLS session");
+        }
+        nvs_close(nvs);
+    }
+}
+
+static void offer_session(TelemetryTransport *transport, const char *host)
+{
+    size_t length;
+    const uint8_t *data =
+        sessionCacheLookup(&transport->sessions, host, time(NULL), CONFIG_MQTT_TLS_SESSION_LIFETIME, &length);
+    if (data == NULL)
+    {
+        return;
+    }
+
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    if (mbedtls_ssl_session_load(&session, data, length) == 0 &&
+        mbedtls_ssl_set_session(&transport->ssl, &session) == 0)
+    {
+        transport->stats.offered = true;
+        memcpy(transport->offered_master, session.MBEDTLS_PRIVATE(master), sizeof(transport->offered_master));
+    }
+    else
+    {
+        sessionCacheClear(&transport->sessions);
+    }
+    mbedtls_ssl_session_free(&session);
+}
+
+// The broker accepted the offered session if the handshake kept its master secret
+static bool session_resumed(TelemetryTransport *transport)
+{
+    if (!transport->stats.offered)
+    {
+        return false;
+    }
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    bool resumed = mbedtls_ssl_get_session(&transport->ssl, &session) == 0 &&
+                   memcmp(session.MBEDTLS_PRIVATE(master), transport->offered_master,
+                          sizeof(transport->offered_master)) == 0;
+    mbedtls_ssl_session_free(&session);
+    mbedtls_platform_zeroize(transport->offered_master, sizeof(transport->offered_master));
+    return resumed;
+}
+
+static int handshake(TelemetryTransport *transport, const char *host, int timeout_ms)
+{
+    int result = mbedtls_ssl_setup(&transport->ssl, &transport->conf);
+    if (result == 0)
+    {
+        result = mbedtls_ssl_set_hostname(&transport->ssl, host);
+    }
+    if (result != 0)
+    {
+        return result;
+    }
+    mbedtls_ssl_set_bio(&transport->ssl, transport, count_send, NULL, count_recv);
+#if CONFIG_MQTT_TLS_SESSION_RESUMPTION
+    offer_session(transport, host);
+#endif
+
+    int64_t deadline = transport->stats.connect_started_us + (int64_t)timeout_ms * 1000;
+    do
+    {
+        int64_t left_ms = (deadline - esp_timer_get_time()) / 1000;
+        if (left_ms <= 0)
+        {
+            return MBEDTLS_ERR_SSL_TIMEOUT;
+        }
+        mbedtls_ssl_conf_read_timeout(&transport->conf, left_ms);
+        result = mbedtls_ssl_handshake(&transport->ssl);
+    } while (result == MBEDTLS_ERR_SSL_WANT_READ || result == MBEDTLS_ERR_SSL_WANT_WRITE);
+
+    if (result == MBEDTLS_ERR_SSL_FATAL_ALERT_MESSAGE && transport->stats.offered)
+    {
+        // Refused, not cut off by the link: do not offer the session again
+        sessionCacheClear(&transport->sessions);
+    }
+    if (result != 0)
+    {
+        mbedtls_platform_zeroize(transport->offered_master, sizeof(transport->offered_master));
+        return result;
+    }
+
+    transport->handshaken = true;
+    transport->stats.resumed = session_resumed(transport);
+    ESP_LOGI(TAG, "TLS %s with %s, %" PRIu32 " bytes", transport->stats.resumed ? "resumed" : "handshake", host,
+             transport->stats.bytes);
+#if CONFIG_MQTT_TLS_SESSION_RESUMPTION
+    keep_session(transport, host);
+#endif
+    return 0;
+}
+
+static int transport_close(esp_transport_handle_t t)
+{
+    TelemetryTransport *transport = esp_transport_get_context_data(t);
+    if (transport->handshaken)
+    {
+        mbedtls_ssl_close_notify(&transport->ssl);
+        transport->handshaken = false;
+    }
+    if (transport->tls)
+    {
+        mbedtls_ssl_free(&transport->ssl);
+        mbedtls_ssl_init(&transport->ssl);
+    }
+    mbedtls_net_free(&transport->net);
+    return 0;
+}
+
+static int transport_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    TelemetryTransport *transport = esp_transport_get_context_data(t);
+    transport_close(t);
+    transport->stats = (TransportStats){.connect_started_us = esp_timer_get_time()};
+
+    transport->net.fd = open_socket(host, port, timeout_ms);
+    if (transport->net.fd < 0)
+    {
+        return -1;
+    }
+    if (transport->tls)
+    {
+        int result = handshake(transport, host, timeout_ms);
+        if (result != 0)
+        {
+            ESP_LOGE(TAG, "TLS handshake with %s failed: -0x%04x", host, -result);
+            transport_close(t);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int transport_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    TelemetryTransport *transport = esp_transport_get_context_data(t);
+    if (transport->handshaken && mbedtls_ssl_get_bytes_avail(&transport->ssl) > 0)
+    {
+        return 1;
+    }
+    return wait_socket(transport->net.fd, false, timeout_ms);
+}
+
+static int transport_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    TelemetryTransport *transport = esp_transport_get_context_data(t);
+    return wait_socket(transport->net.fd, true, timeout_ms);
+}
+
+// A timeout is not an error, esp-mqtt polls again
+static int transport_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    TelemetryTransport *transport = esp_transport_get_context_data(t);
+    int ready = transport_poll_read(t, timeout_ms);
+    if (ready <= 0)
+    {
+        return ready < 0 ? ERR_TCP_TRANSPORT_CONNECTION_FAILED : ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+
+    int received;
+    if (transport->tls)
+    {
+        mbedtls_ssl_conf_read_timeout(&transport->conf, timeout_ms);
+        received = mbedtls_ssl_read(&transport->ssl, (unsigned char *)buffer, len);
+        if (received == MBEDTLS_ERR_SSL_WANT_READ || received == MBEDTLS_ERR_SSL_WANT_WRITE ||
+            received == MBEDTLS_ERR_SSL_TIMEOUT)
+        {
+            return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+        }
+        if (received == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY)
+        {
+            received = 0;
+        }
+    }
+    else
+    {
+        received = count_recv(transport, (unsigned char *)buffer, len, 0);
+    }
+    if (received == 0)
+    {
+        return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+    }
+    return received < 0 ? ERR_TCP_TRANSPORT_CONNECTION_FAILED : received;
+}
+
+static int transport_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    TelemetryTransport *transport = esp_transport_get_context_data(t);
+    int ready = transport_poll_write(t, timeout_ms);
+    if (ready <= 0)
+    {
+        return ready < 0 ? ERR_TCP_TRANSPORT_CONNECTION_FAILED : ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+
+    int sent = transport->tls ? mbedtls_ssl_write(&transport->ssl, (const unsigned char *)buffer, len)
+                              : count_send(transport, (const unsigned char *)buffer, len);
+    if (sent == MBEDTLS_ERR_SSL_WANT_READ || sent == MBEDTLS_ERR_SSL_WANT_WRITE)
+    {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    return sent < 0 ? ERR_TCP_TRANSPORT_CONNECTION_FAILED : sent;
+}
+
+static int transport_destroy(esp_transport_handle_t t)
+{
+    TelemetryTransport *transport = esp_transport_get_context_data(t);
+    transport_close(t);
+    if (transport->tls)
+    {
+        mbedtls_ssl_config_free(&transport->conf);
+        mbedtls_ctr_drbg_free(&transport->drbg);
+        mbedtls_entropy_free(&transport->entropy);
+    }
+    free(transport);
+    return 0;
+}
+
+static bool configure_tls(TelemetryTransport *transport)
+{
+    mbedtls_ssl_init(&transport->ssl);
+    mbedtls_ssl_config_init(&transport->conf);
+    mbedtls_entropy_init(&transport->entropy);
+    mbedtls_ctr_drbg_init(&transport->drbg);
+    if (mbedtls_ctr_drbg_seed(&transport->drbg, mbedtls_entropy_func, &transport->entropy, NULL, 0) != 0 ||
+        mbedtls_ssl_config_defaults(&transport->conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                    MBEDTLS_SSL_PRESET_DEFAULT) != 0 ||
+        esp_crt_bundle_attach(&transport->conf) != ESP_OK)
+    {
+        return false;
+    }
+    mbedtls_ssl_conf_authmode(&transport->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_rng(&transport->conf, mbedtls_ctr_drbg_random, &transport->drbg);
+    // TLS 1.3 tickets arrive after the handshake, a 1.2 session is complete once it is done
+    mbedtls_ssl_conf_max_tls_version(&transport->conf, MBEDTLS_SSL_VERSION_TLS1_2);
+    mbedtls_ssl_conf_session_tickets(&transport->conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+    load_sessions(transport);
+    return true;
+}
+
+esp_transport_handle_t telemetryTransportInit(bool tls)
+{
+    TelemetryTransport *transport = calloc(1, sizeof(TelemetryTransport));
+    esp_transport_handle_t t = transport ? esp_transport_init() : NULL;
+    if (t == NULL)
+    {
+        free(transport);
+        return NULL;
+    }
+
+    transport->tls = tls;
+    mbedtls_net_init(&transport->net);
+    sessionCacheInit(&transport->sessions);
+    esp_transport_set_context_data(t, transport);
+    esp_transport_set_func(t, transport_connect, transport_read, transport_write, transport_close,
+                           transport_poll_read, transport_poll_write, transport_destroy);
+    esp_transport_set_default_port(t, tls ? 8883 : 1883);
+    if (tls && !configure_tls(transport))
+    {
+        ESP_LOGE(TAG, "Could not set up TLS");
+        esp_transport_destroy(t);
+        return NULL;
+    }
+    return t;
+}
+
+const TransportStats *telemetryTransportStats(esp_transport_handle_t t)
+{
+    TelemetryTransport *transport = esp_transport_get_context_data(t);
+    return &transport->stats;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_transport.h"
+
+/**
+ * Broker connection for esp-mqtt (network.transport): TCP, or TLS 1.2 for
+ * an mqtts:// broker.
+ *
+ * The TLS side resumes the session of the previous connection when it can,
+ * see telemetry_session.h. The session is kept in RAM and in NVS (namespace
+ * "tracker", key "tls_session"), the broker is verified against the ESP-IDF
+ * certificate bundle. Bytes are counted on the socket so the cost of a
+ * connect can be reported, handshake included.
+ */
+
+typedef struct
+{
+    int64_t connect_started_us; ///< esp_timer time the last connect started
+    uint32_t bytes;             ///< Sent and received since then, TCP payload
+    bool offered;               ///< The last TLS handshake offered a cached session
+    bool resumed;               ///< and the broker accepted it
+} TransportStats;
+
+/**
+ * @param tls TLS for mqtts://, plain TCP otherwise
+ * @return The transport, owned by the MQTT client from then on, or NULL
+ */
+esp_transport_handle_t telemetryTransportInit(bool tls);
+
+const TransportStats *telemetryTransportStats(esp_transport_handle_t transport);
@@ -0,0 +1,19 @@
+package main
+
+import "log"
+
+// Alarms are BmsStatus messages the tracker sent ahead of its routine
+// samples because a fault appeared, changed or cleared (error flags, empty
+// pack, over-temperature). They are stored like any other battery reading,
+// the separate topic only lets them overtake the backlog and be subscribed
+// to with QoS 1.
+
+func handleAlarmMessage(deviceID string, payload []byte) {
+	log.Printf("Alarm from %s\n", deviceID)
+	handleBatteryMessage(deviceID, payload)
+}
+
+func handleAlarmBinaryMessage(deviceID string, payload []byte) {
+	log.Printf("Alarm from %s\n", deviceID)
+	handleBatteryBinaryMessage(deviceID, payload)
+}
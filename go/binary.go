@@ -0,0 +1,194 @@
+package main
+
+import (
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"math"
+	"time"
+)
+
+// Decoders for the packed little-endian layout produced by
+// esp/main/telemetry_binary.c. Every message starts with a schema version
+// byte; only the connected cells' voltages are present on the wire.
+
+const (
+	binaryVersion = 2 // Version 1 has no boot_id, sequence and uptime_ms
+
+	binaryFlagChgEnable = 1 << 0
+	binaryFlagDisEnable = 1 << 1
+	binaryFlagFull      = 1 << 2
+	binaryFlagEmpty     = 1 << 3
+)
+
+var errBinaryTruncated = errors.New("truncated binary payload")
+
+// binaryReader walks a payload and latches the first out-of-bounds read.
+type binaryReader struct {
+	payload []byte
+	offset  int
+	err     error
+}
+
+func (r *binaryReader) take(n int) []byte {
+	if r.err != nil || r.offset+n > len(r.payload) {
+		r.err = errBinaryTruncated
+		return nil
+	}
+	b := r.payload[r.offset : r.offset+n]
+	r.offset += n
+	return b
+}
+
+func (r *binaryReader) u8() uint8 {
+	if b := r.take(1); b != nil {
+		return b[0]
+	}
+	return 0
+}
+
+func (r *binaryReader) u16() uint16 {
+	if b := r.take(2); b != nil {
+		return binary.LittleEndian.Uint16(b)
+	}
+	return 0
+}
+
+func (r *binaryReader) u32() uint32 {
+	if b := r.take(4); b != nil {
+		return binary.LittleEndian.Uint32(b)
+	}
+	return 0
+}
+
+func (r *binaryReader) f32() float32 {
+	return math.Float32frombits(r.u32())
+}
+
+func (r *binaryReader) i64() int64 {
+	if b := r.take(8); b != nil {
+		return int64(binary.LittleEndian.Uint64(b))
+	}
+	return 0
+}
+
+func (r *binaryReader) timestamp() time.Time {
+	if b := r.take(8); b != nil {
+		return time.Unix(int64(binary.LittleEndian.Uint64(b)), 0).UTC()
+	}
+	return time.Time{}
+}
+
+func (r *binaryReader) f32s(n int) []float32 {
+	values := make([]float32, n)
+	for i := range values {
+		values[i] = r.f32()
+	}
+	return values
+}
+
+// version reads the schema version, every version up to binaryVersion is understood.
+func (r *binaryReader) version() uint8 {
+	version := r.u8()
+	if r.err == nil && (version < 1 || version > binaryVersion) {
+		r.err = fmt.Errorf("unsupported binary payload version %d", version)
+	}
+	return version
+}
+
+func (r *binaryReader) battery() BatteryData {
+	var data BatteryData
+	version := r.version()
+	if r.err != nil {
+		return data
+	}
+
+	data.State = r.u16()
+	flags := r.u8()
+	data.ChgEnable = flags&binaryFlagChgEnable != 0
+	data.DisEnable = flags&binaryFlagDisEnable != 0
+	data.IsFull = flags&binaryFlagFull != 0
+	data.IsEmpty = flags&binaryFlagEmpty != 0
+	data.ConnectedCells = uint16(r.u8())
+	thermistors := int(r.u8())
+
+	data.CellVoltages = r.f32s(int(data.ConnectedCells))
+	data.CellVoltageMax = r.f32()
+	data.CellVoltageMin = r.f32()
+	data.CellVoltageAvg = r.f32()
+	data.PackVoltage = r.f32()
+	data.StackVoltage = r.f32()
+	data.PackCurrent = r.f32()
+
+	data.BatTemps = r.f32s(thermistors)
+	data.BatTempMax = r.f32()
+	data.BatTempMin = r.f32()
+	data.BatTempAvg = r.f32()
+	data.MosfetTemp = r.f32()
+	data.IcTemp = r.f32()
+	data.McuTemp = r.f32()
+	data.Soc = r.f32()
+
+	data.BalancingStatus = r.u32()
+	data.ErrorFlags = r.u32()
+	data.NoIdleTimestamp = r.timestamp()
+	data.Timestamp = r.timestamp()
+	if version >= 2 {
+		data.BootID = r.u32()
+		data.Sequence = r.u32()
+		data.UptimeMs = r.i64()
+	}
+
+	return data
+}
+
+func (r *binaryReader) location() LocationData {
+	var data LocationData
+	version := r.version()
+	if r.err != nil {
+		return data
+	}
+
+	data.Latitude = float64(r.f32())
+	data.Longitude = float64(r.f32())
+	data.Timestamp = r.timestamp()
+	if version >= 2 {
+		data.BootID = r.u32()
+		data.Sequence = r.u32()
+		data.UptimeMs = r.i64()
+	}
+
+	return data
+}
+
+func decodeBatteryBinary(payload []byte) (BatteryData, error) {
+	r := binaryReader{payload: payload}
+	data := r.battery()
+	return data, r.err
+}
+
+func decodeLocationBinary(payload []byte) (LocationData, error) {
+	r := binaryReader{payload: payload}
+	data := r.location()
+	return data, r.err
+}
+
+// decodeBatchBinary unpacks an envelope of back-to-back battery and location messages.
+func decodeBatchBinary(payload []byte) (BatchData, error) {
+	var batch BatchData
+	r := binaryReader{payload: payload}
+	if r.version(); r.err != nil {
+		return batch, r.err
+	}
+
+	batteries := int(r.u8())
+	locations := int(r.u8())
+	for i := 0; i < batteries && r.err == nil; i++ {
+		batch.Batteries = append(batch.Batteries, r.battery())
+	}
+	for i := 0; i < locations && r.err == nil; i++ {
+		batch.Locations = append(batch.Locations, r.location())
+	}
+
+	return batch, r.err
+}
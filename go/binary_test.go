@@ -0,0 +1,152 @@
+package main
+
+import (
+	"encoding/hex"
+	"reflect"
+	"testing"
+	"time"
+)
+
+// Produced by convertBmsStatusToBinary / convertLocationToBinary for the
+// golden samples in esp/host_test/bench_json.c. The version 1 messages are
+// from firmware before boot_id, sequence and uptime_ms.
+const (
+	goldenBatteryBinary  = "020300090402cdcc6c4000007040333373400000804000008040cdcc6c400000744000007441cdcc7441000020c00000ac410000b0410000b0410000ac410000ae410000f0410000f841000000420000a142005ed0b20500000000f15365000000000af1536500000000efbeadde2a0000007b5c260500000000"
+	goldenLocationBinary = "028f423742ddb57f4100f1536500000000efbeadde07000000f034260500000000"
+	goldenBatchBinary    = "020201" + goldenBatteryBinary + goldenBatteryBinary + goldenLocationBinary
+
+	goldenBatteryBinaryV1  = "010300090402cdcc6c4000007040333373400000804000008040cdcc6c400000744000007441cdcc7441000020c00000ac410000b0410000b0410000ac410000ae410000f0410000f841000000420000a142005ed0b20500000000f15365000000000af1536500000000"
+	goldenLocationBinaryV1 = "018f423742ddb57f4100f1536500000000"
+	goldenBatchBinaryV1    = "010201" + goldenBatteryBinaryV1 + goldenBatteryBinaryV1 + goldenLocationBinaryV1
+)
+
+func mustDecodeHex(t *testing.T, s string) []byte {
+	t.Helper()
+	b, err := hex.DecodeString(s)
+	if err != nil {
+		t.Fatal(err)
+	}
+	return b
+}
+
+func goldenBatteryData() BatteryData {
+	return BatteryData{
+		State:           3,
+		ChgEnable:       true,
+		ConnectedCells:  4,
+		CellVoltages:    []float32{3.7, 3.75, 3.8, 4},
+		CellVoltageMax:  4,
+		CellVoltageMin:  3.7,
+		CellVoltageAvg:  3.8125,
+		PackVoltage:     15.25,
+		StackVoltage:    15.3,
+		PackCurrent:     -2.5,
+		BatTemps:        []float32{21.5, 22},
+		BatTempMax:      22,
+		BatTempMin:      21.5,
+		BatTempAvg:      21.75,
+		MosfetTemp:      30,
+		IcTemp:          31,
+		McuTemp:         32,
+		IsEmpty:         true,
+		Soc:             80.5,
+		BalancingStatus: 3000000000,
+		NoIdleTimestamp: time.Unix(1700000000, 0).UTC(),
+		ErrorFlags:      5,
+		Timestamp:       time.Unix(1700000010, 0).UTC(),
+		BootID:          0xdeadbeef,
+		Sequence:        42,
+		UptimeMs:        86400123,
+	}
+}
+
+// untracedBatteryData is goldenBatteryData as version 1 firmware sent it.
+func untracedBatteryData() BatteryData {
+	data := goldenBatteryData()
+	data.BootID, data.Sequence, data.UptimeMs = 0, 0, 0
+	return data
+}
+
+func TestDecodeBatteryBinary(t *testing.T) {
+	payload := mustDecodeHex(t, goldenBatteryBinary)
+
+	got, err := decodeBatteryBinary(payload)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if want := goldenBatteryData(); !reflect.DeepEqual(got, want) {
+		t.Fatalf("decoded %+v, want %+v", got, want)
+	}
+
+	for n := 0; n < len(payload); n++ {
+		if _, err := decodeBatteryBinary(payload[:n]); err == nil {
+			t.Fatalf("truncated payload of %d bytes was accepted", n)
+		}
+	}
+}
+
+func TestDecodeLocationBinary(t *testing.T) {
+	payload := mustDecodeHex(t, goldenLocationBinary)
+
+	got, err := decodeLocationBinary(payload)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if got.Latitude != float64(float32(45.815)) || got.Longitude != float64(float32(15.9819)) ||
+		!got.Timestamp.Equal(time.Unix(1700000000, 0)) || got.BootID != 0xdeadbeef || got.Sequence != 7 ||
+		got.UptimeMs != 86390000 {
+		t.Fatalf("decoded %+v", got)
+	}
+
+	payload[0] = binaryVersion + 1
+	if _, err := decodeLocationBinary(payload); err == nil {
+		t.Fatal("unknown version was accepted")
+	}
+}
+
+func TestDecodeBatchBinary(t *testing.T) {
+	payload := mustDecodeHex(t, goldenBatchBinary)
+
+	got, err := decodeBatchBinary(payload)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(got.Batteries) != 2 || len(got.Locations) != 1 {
+		t.Fatalf("decoded %d batteries and %d locations", len(got.Batteries), len(got.Locations))
+	}
+	for _, battery := range got.Batteries {
+		if want := goldenBatteryData(); !reflect.DeepEqual(battery, want) {
+			t.Fatalf("decoded %+v, want %+v", battery, want)
+		}
+	}
+
+	if _, err := decodeBatchBinary(payload[:len(payload)-1]); err == nil {
+		t.Fatal("truncated batch was accepted")
+	}
+}
+
+func TestDecodeBinaryVersion1(t *testing.T) {
+	battery, err := decodeBatteryBinary(mustDecodeHex(t, goldenBatteryBinaryV1))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if want := untracedBatteryData(); !reflect.DeepEqual(battery, want) {
+		t.Fatalf("decoded %+v, want %+v", battery, want)
+	}
+
+	location, err := decodeLocationBinary(mustDecodeHex(t, goldenLocationBinaryV1))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !location.Timestamp.Equal(time.Unix(1700000000, 0)) || location.BootID != 0 || location.UptimeMs != 0 {
+		t.Fatalf("decoded %+v", location)
+	}
+
+	batch, err := decodeBatchBinary(mustDecodeHex(t, goldenBatchBinaryV1))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(batch.Batteries) != 2 || len(batch.Locations) != 1 || !reflect.DeepEqual(batch.Batteries[1], untracedBatteryData()) {
+		t.Fatalf("decoded %+v", batch)
+	}
+}
@@ -0,0 +1,189 @@
+package main
+
+import (
+	"context"
+	"fmt"
+	"log"
+	"time"
+)
+
+// Decoder and storage for the diagnostics snapshots produced by
+// esp/main/telemetry_metrics.c. A snapshot announces how many counters,
+// gauges, histograms and buckets it carries. Metrics are only ever appended,
+// so unknown trailing ones are skipped and missing ones stay zero.
+
+const (
+	diagnosticsVersion = 1
+	diagnosticsTable   = "diagnostics"
+)
+
+type HistogramData struct {
+	Count   uint32
+	Sum     uint32
+	Max     uint32
+	Buckets []int32 // Bucket 0 counts zeros, bucket i values in [2^(i-1), 2^i)
+}
+
+type DiagnosticsData struct {
+	Uptime    uint32 // s
+	Interval  uint32 // s covered by the counters and histograms
+	Timestamp time.Time
+	DeviceID  string
+
+	// Counters, over the interval
+	Published       uint32
+	PublishFailed   uint32
+	Pubacks         uint32
+	MQTTDisconnects uint32
+	PPPReconnects   uint32
+	PPPDowntimeMs   uint32
+	// Priority lanes, 0 from firmware without them
+	AlarmDropped     uint32
+	RoutineDropped   uint32
+	RoutineCoalesced uint32
+	// Broker connection, 0 from firmware that does not report it
+	MQTTConnects    uint32
+	SessionsPresent uint32
+	TLSResumed      uint32
+
+	// Gauges, at the time of the snapshot
+	OutboxBytes      int32
+	FreeHeap         int32
+	MinFreeHeap      int32
+	UplinkStackFree  int32
+	SamplerStackFree int32
+	RSSI             int32
+	BER              int32
+	// Boot timeline, 0 from firmware that does not report it
+	BootToPublishMs       int32
+	RegisteredToPublishMs int32
+	RoutineQueuedBytes    int32
+
+	// Histograms, over the interval
+	EncodeUs  HistogramData
+	PublishUs HistogramData
+	PubackMs  HistogramData
+	// Time spent waiting in the priority lanes
+	AlarmQueueMs   HistogramData
+	RoutineQueueMs HistogramData
+	// Cost of a connect, from the TCP connect to CONNACK
+	ConnectMs    HistogramData
+	ConnectBytes HistogramData
+}
+
+func decodeDiagnostics(payload []byte) (DiagnosticsData, error) {
+	r := binaryReader{payload: payload}
+	var data DiagnosticsData
+	if version := r.u8(); r.err == nil && version != diagnosticsVersion {
+		return data, fmt.Errorf("unsupported diagnostics version %d", version)
+	}
+	counterCount, gaugeCount := int(r.u8()), int(r.u8())
+	histogramCount, bucketCount := int(r.u8()), int(r.u8())
+	data.Uptime = r.u32()
+	data.Interval = r.u32()
+	data.Timestamp = r.timestamp()
+
+	counters := []*uint32{
+		&data.Published, &data.PublishFailed, &data.Pubacks,
+		&data.MQTTDisconnects, &data.PPPReconnects, &data.PPPDowntimeMs,
+		&data.AlarmDropped, &data.RoutineDropped, &data.RoutineCoalesced,
+		&data.MQTTConnects, &data.SessionsPresent, &data.TLSResumed,
+	}
+	for i := 0; i < counterCount; i++ {
+		value := r.u32()
+		if i < len(counters) {
+			*counters[i] = value
+		}
+	}
+
+	gauges := []*int32{
+		&data.OutboxBytes, &data.FreeHeap, &data.MinFreeHeap,
+		&data.UplinkStackFree, &data.SamplerStackFree, &data.RSSI, &data.BER,
+		&data.BootToPublishMs, &data.RegisteredToPublishMs, &data.RoutineQueuedBytes,
+	}
+	for i := 0; i < gaugeCount; i++ {
+		value := int32(r.u32())
+		if i < len(gauges) {
+			*gauges[i] = value
+		}
+	}
+
+	histograms := []*HistogramData{
+		&data.EncodeUs, &data.PublishUs, &data.PubackMs, &data.AlarmQueueMs, &data.RoutineQueueMs,
+		&data.ConnectMs, &data.ConnectBytes,
+	}
+	for i := 0; i < histogramCount; i++ {
+		histogram := HistogramData{Count: r.u32(), Sum: r.u32(), Max: r.u32(), Buckets: make([]int32, bucketCount)}
+		for bucket := range histogram.Buckets {
+			histogram.Buckets[bucket] = int32(r.u16())
+		}
+		if i < len(histograms) {
+			*histograms[i] = histogram
+		}
+	}
+	// Not NULL in the table, a histogram the firmware does not know is empty
+	for _, histogram := range histograms {
+		if histogram.Buckets == nil {
+			histogram.Buckets = []int32{}
+		}
+	}
+
+	return data, r.err
+}
+
+func handleDiagnosticsMessage(deviceID string, payload []byte) {
+	diagnosticsData, err := decodeDiagnostics(payload)
+	if err != nil {
+		log.Println("Error parsing diagnostics payload:", err)
+		return
+	}
+	log.Printf("Parsed diagnostics payload (%s): %+v\n", deviceID, diagnosticsData)
+
+	diagnosticsData.DeviceID = deviceID
+	insertDiagnosticsData(diagnosticsData)
+}
+
+// insertDiagnosticsData writes right away, a snapshot every few minutes per
+// bike does not need the batching ingest stage.
+func insertDiagnosticsData(data DiagnosticsData) {
+	_, err := dbpool.Exec(context.Background(), `
+		INSERT INTO `+diagnosticsTable+` (
+			device_id, timestamp, uptime_s, interval_s,
+			published, publish_failed, pubacks, mqtt_disconnects, ppp_reconnects, ppp_downtime_ms,
+			outbox_bytes, free_heap, min_free_heap, uplink_stack_free, sampler_stack_free, rssi, ber,
+			boot_to_publish_ms, registered_to_publish_ms,
+			alarm_dropped, routine_dropped, routine_coalesced, routine_queued_bytes,
+			encode_us_count, encode_us_sum, encode_us_max, encode_us_buckets,
+			publish_us_count, publish_us_sum, publish_us_max, publish_us_buckets,
+			puback_ms_count, puback_ms_sum, puback_ms_max, puback_ms_buckets,
+			alarm_queue_ms_count, alarm_queue_ms_sum, alarm_queue_ms_max, alarm_queue_ms_buckets,
+			routine_queue_ms_count, routine_queue_ms_sum, routine_queue_ms_max, routine_queue_ms_buckets,
+			mqtt_connects, sessions_present, tls_resumed,
+			connect_ms_count, connect_ms_sum, connect_ms_max, connect_ms_buckets,
+			connect_bytes_count, connect_bytes_sum, connect_bytes_max, connect_bytes_buckets
+		) VALUES (
+			$1, $2, $3, $4, $5, $6, $7, $8, $9, $10,
+			$11, $12, $13, $14, $15, $16, $17, $18, $19, $20,
+			$21, $22, $23, $24, $25, $26, $27, $28, $29, $30,
+			$31, $32, $33, $34, $35, $36, $37, $38, $39, $40,
+			$41, $42, $43, $44, $45, $46, $47, $48, $49, $50,
+			$51, $52, $53, $54
+		)
+	`, data.DeviceID, data.Timestamp, data.Uptime, data.Interval,
+		data.Published, data.PublishFailed, data.Pubacks, data.MQTTDisconnects, data.PPPReconnects, data.PPPDowntimeMs,
+		data.OutboxBytes, data.FreeHeap, data.MinFreeHeap, data.UplinkStackFree, data.SamplerStackFree, data.RSSI, data.BER,
+		data.BootToPublishMs, data.RegisteredToPublishMs,
+		data.AlarmDropped, data.RoutineDropped, data.RoutineCoalesced, data.RoutineQueuedBytes,
+		data.EncodeUs.Count, data.EncodeUs.Sum, data.EncodeUs.Max, data.EncodeUs.Buckets,
+		data.PublishUs.Count, data.PublishUs.Sum, data.PublishUs.Max, data.PublishUs.Buckets,
+		data.PubackMs.Count, data.PubackMs.Sum, data.PubackMs.Max, data.PubackMs.Buckets,
+		data.AlarmQueueMs.Count, data.AlarmQueueMs.Sum, data.AlarmQueueMs.Max, data.AlarmQueueMs.Buckets,
+		data.RoutineQueueMs.Count, data.RoutineQueueMs.Sum, data.RoutineQueueMs.Max, data.RoutineQueueMs.Buckets,
+		data.MQTTConnects, data.SessionsPresent, data.TLSResumed,
+		data.ConnectMs.Count, data.ConnectMs.Sum, data.ConnectMs.Max, data.ConnectMs.Buckets,
+		data.ConnectBytes.Count, data.ConnectBytes.Sum, data.ConnectBytes.Max, data.ConnectBytes.Buckets,
+	)
+	if err != nil {
+		log.Println("Error inserting data into PostgreSQL (diagnostics):", err)
+	}
+}
@@ -0,0 +1,109 @@
+package main
+
+import (
+	"testing"
+	"time"
+)
+
+// Printed by esp/host_test/test_metrics for its fixed registry.
+const goldenDiagnostics = "010c0a0710580200005802000000f153650000000076000000020000007500000001000000010000009a100000000000000c000000000000000200000001000000010000003601000048c802000c9c0200ec040000d40300001100000063000000aa370000de0d0000d80400000300000049020000d20000000000000000000000000000000000000003000000000000000000000000000000020000001c3e0000983a0000000000000000000000000000000000000000000001000000000000000100000003000000740e0000540b000000000000000000000000000000000000000002000000000001000000000000000100000003000000030000000000000001000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000002000000020d00002e090000000000000000000000000000000000000000000001000000010000000000000002000000b50c0000980900000000000000000000000000000000000000000000010000000100000000000000"
+
+// The same registry from firmware before the connect metrics.
+const goldenDiagnosticsFiveHistograms = "01090a0510580200005802000000f153650000000076000000020000007500000001000000010000009a100000000000000c000000000000003601000048c802000c9c0200ec040000d40300001100000063000000aa370000de0d0000d80400000300000049020000d20000000000000000000000000000000000000003000000000000000000000000000000020000001c3e0000983a0000000000000000000000000000000000000000000001000000000000000100000003000000740e0000540b0000000000000000000000000000000000000000020000000000010000000000000001000000030000000300000000000000010000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000"
+
+// The same registry from firmware before the priority lanes.
+const goldenDiagnosticsNineGauges = "0106090310580200005802000000f153650000000076000000020000007500000001000000010000009a1000003601000048c802000c9c0200ec040000d40300001100000063000000aa370000de0d00000300000049020000d20000000000000000000000000000000000000003000000000000000000000000000000020000001c3e0000983a0000000000000000000000000000000000000000000001000000000000000100000003000000740e0000540b00000000000000000000000000000000000000000200000000000100000000000000"
+
+// The same registry from firmware before the boot timeline gauges.
+const goldenDiagnosticsSevenGauges = "0106070310580200005802000000f153650000000076000000020000007500000001000000010000009a1000003601000048c802000c9c0200ec040000d403000011000000630000000300000049020000d20000000000000000000000000000000000000003000000000000000000000000000000020000001c3e0000983a0000000000000000000000000000000000000000000001000000000000000100000003000000740e0000540b00000000000000000000000000000000000000000200000000000100000000000000"
+
+func TestDecodeDiagnostics(t *testing.T) {
+	got, err := decodeDiagnostics(mustDecodeHex(t, goldenDiagnostics))
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	if got.Uptime != 600 || got.Interval != 600 || !got.Timestamp.Equal(time.Unix(1700000000, 0)) {
+		t.Fatalf("header %d s uptime, %d s interval, %s", got.Uptime, got.Interval, got.Timestamp)
+	}
+	if got.Published != 118 || got.PublishFailed != 2 || got.Pubacks != 117 ||
+		got.MQTTDisconnects != 1 || got.PPPReconnects != 1 || got.PPPDowntimeMs != 4250 ||
+		got.AlarmDropped != 0 || got.RoutineDropped != 12 || got.RoutineCoalesced != 0 ||
+		got.MQTTConnects != 2 || got.SessionsPresent != 1 || got.TLSResumed != 1 {
+		t.Fatalf("counters %+v", got)
+	}
+	if got.OutboxBytes != 310 || got.FreeHeap != 182344 || got.MinFreeHeap != 171020 ||
+		got.UplinkStackFree != 1260 || got.SamplerStackFree != 980 || got.RSSI != 17 || got.BER != 99 ||
+		got.BootToPublishMs != 14250 || got.RegisteredToPublishMs != 3550 || got.RoutineQueuedBytes != 1240 {
+		t.Fatalf("gauges %+v", got)
+	}
+	if got.EncodeUs.Count != 3 || got.EncodeUs.Sum != 585 || got.EncodeUs.Max != 210 || got.EncodeUs.Buckets[8] != 3 {
+		t.Fatalf("encode histogram %+v", got.EncodeUs)
+	}
+	if got.PublishUs.Max != 15000 || got.PublishUs.Buckets[10] != 1 || got.PublishUs.Buckets[14] != 1 {
+		t.Fatalf("publish histogram %+v", got.PublishUs)
+	}
+	if got.PubackMs.Count != 3 || got.PubackMs.Max != 2900 || len(got.PubackMs.Buckets) != 16 {
+		t.Fatalf("PUBACK histogram %+v", got.PubackMs)
+	}
+	if got.AlarmQueueMs.Count != 1 || got.AlarmQueueMs.Max != 3 || got.AlarmQueueMs.Buckets[2] != 1 ||
+		got.RoutineQueueMs.Count != 0 {
+		t.Fatalf("lane histograms %+v %+v", got.AlarmQueueMs, got.RoutineQueueMs)
+	}
+	if got.ConnectMs.Count != 2 || got.ConnectMs.Sum != 3330 || got.ConnectMs.Max != 2350 ||
+		got.ConnectBytes.Max != 2456 || got.ConnectBytes.Buckets[10] != 1 || got.ConnectBytes.Buckets[12] != 1 {
+		t.Fatalf("connect histograms %+v %+v", got.ConnectMs, got.ConnectBytes)
+	}
+}
+
+func TestDecodeDiagnosticsNewerFirmware(t *testing.T) {
+	// One more counter than this decoder knows about
+	payload := mustDecodeHex(t, goldenDiagnostics)
+	payload[1]++
+	counters := 21 + 4*12
+	extended := append(append(append([]byte{}, payload[:counters]...), 0xff, 0xff, 0xff, 0xff), payload[counters:]...)
+
+	got, err := decodeDiagnostics(extended)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if got.TLSResumed != 1 || got.PPPDowntimeMs != 4250 || got.OutboxBytes != 310 || got.PubackMs.Max != 2900 {
+		t.Fatalf("decoded %+v", got)
+	}
+
+	if _, err := decodeDiagnostics(payload[:len(payload)-1]); err == nil {
+		t.Fatal("truncated snapshot decoded")
+	}
+}
+
+func TestDecodeDiagnosticsOlderFirmware(t *testing.T) {
+	got, err := decodeDiagnostics(mustDecodeHex(t, goldenDiagnosticsSevenGauges))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if got.BER != 99 || got.BootToPublishMs != 0 || got.RegisteredToPublishMs != 0 || got.PubackMs.Max != 2900 {
+		t.Fatalf("decoded %+v", got)
+	}
+}
+
+func TestDecodeDiagnosticsBeforeLanes(t *testing.T) {
+	got, err := decodeDiagnostics(mustDecodeHex(t, goldenDiagnosticsNineGauges))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if got.RegisteredToPublishMs != 3550 || got.RoutineDropped != 0 || got.RoutineQueuedBytes != 0 ||
+		got.PubackMs.Max != 2900 || got.AlarmQueueMs.Count != 0 {
+		t.Fatalf("decoded %+v", got)
+	}
+}
+
+func TestDecodeDiagnosticsBeforeConnectMetrics(t *testing.T) {
+	got, err := decodeDiagnostics(mustDecodeHex(t, goldenDiagnosticsFiveHistograms))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if got.RoutineDropped != 12 || got.MQTTConnects != 0 || got.TLSResumed != 0 || got.RoutineQueuedBytes != 1240 ||
+		got.AlarmQueueMs.Count != 1 || got.ConnectMs.Count != 0 || got.ConnectBytes.Buckets == nil {
+		t.Fatalf("decoded %+v", got)
+	}
+}
@@ -0,0 +1,350 @@
+package main
+
+import (
+	"context"
+	"errors"
+	"hash/fnv"
+	"log"
+	"strconv"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
+
+	"github.com/jackc/pgx/v5"
+	"github.com/jackc/pgx/v5/pgconn"
+	"github.com/jackc/pgx/v5/pgxpool"
+)
+
+// Batching ingest stage between the MQTT handlers and Postgres.
+//
+// Handlers only decode and enqueue into bounded channels, one per worker.
+// Records of a device always go to the same worker, so they are written in
+// the order they arrived. Each worker drains its channel and writes each
+// batch in one transaction with COPY into the battery and location tables,
+// cell voltages and thermistor temperatures go inline as array columns.
+// The battery rollups, trips and newest positions are brought up to date
+// in the same transaction.
+//
+// A full queue blocks the MQTT callback, which in turn slows down reading
+// from the broker. A message that cannot be queued within enqueueTimeout
+// is dropped and counted.
+//
+// A batch that fails to write is retried flushRetries times, waiting
+// retryBackoff and twice as long for each further retry, so a database
+// restart or failover costs no data. If it still fails, each of its records
+// is written on its own: a record the database rejects is dropped and
+// counted, the rest of the batch is kept.
+
+type ingestConfig struct {
+	workers        int
+	batchSize      int
+	flushInterval  time.Duration
+	queueSize      int
+	enqueueTimeout time.Duration
+	tripGap        time.Duration // Silence that ends a trip
+	flushRetries   int           // Retries of a failed batch before its records are written one by one
+	retryBackoff   time.Duration // Wait before the first retry, doubled for each further one
+}
+
+// ingestTx is the part of pgx.Tx the ingest stage uses.
+type ingestTx interface {
+	CopyFrom(ctx context.Context, tableName pgx.Identifier, columnNames []string, rowSrc pgx.CopyFromSource) (int64, error)
+	Exec(ctx context.Context, sql string, arguments ...any) (pgconn.CommandTag, error)
+	Commit(ctx context.Context) error
+	Rollback(ctx context.Context) error
+}
+
+type ingestDB interface {
+	beginIngest(ctx context.Context) (ingestTx, error)
+}
+
+type poolIngestDB struct {
+	pool *pgxpool.Pool
+}
+
+func (db poolIngestDB) beginIngest(ctx context.Context) (ingestTx, error) {
+	return db.pool.Begin(ctx)
+}
+
+type ingestMetrics struct {
+	enqueued       atomic.Int64
+	dropped        atomic.Int64 // Not queued within enqueueTimeout
+	blocked        atomic.Int64 // Enqueues that found the queue full
+	blockedNanos   atomic.Int64 // Time handlers spent waiting for room
+	queueHighWater atomic.Int64 // Deepest worker queue
+	flushes        atomic.Int64
+	flushNanos     atomic.Int64
+	rows           atomic.Int64
+	retries        atomic.Int64 // Batches written again after a failure
+	splitBatches   atomic.Int64 // Batches that failed every retry and were written per record
+	failedRecords  atomic.Int64 // Records lost to failed flushes
+}
+
+type ingestRecord struct {
+	battery  *BatteryData
+	location *LocationData
+}
+
+type ingester struct {
+	config  ingestConfig
+	db      ingestDB
+	queues  []chan ingestRecord
+	metrics ingestMetrics
+	wg      sync.WaitGroup
+}
+
+var errIngestQueueFull = errors.New("ingest queue full")
+
+func newIngester(db ingestDB, config ingestConfig) *ingester {
+	in := &ingester{
+		config: config,
+		db:     db,
+		queues: make([]chan ingestRecord, config.workers),
+	}
+	queueSize := max(config.queueSize/config.workers, 1)
+	for i := range in.queues {
+		in.queues[i] = make(chan ingestRecord, queueSize)
+		in.wg.Add(1)
+		go in.worker(in.queues[i])
+	}
+	return in
+}
+
+func (in *ingester) submitBattery(batteryData BatteryData) error {
+	return in.submit(batteryData.DeviceID, ingestRecord{battery: &batteryData})
+}
+
+func (in *ingester) submitLocation(locationData LocationData) error {
+	return in.submit(locationData.DeviceID, ingestRecord{location: &locationData})
+}
+
+func (in *ingester) submit(deviceID string, record ingestRecord) error {
+	hash := fnv.New32a()
+	hash.Write([]byte(deviceID))
+	queue := in.queues[hash.Sum32()%uint32(len(in.queues))]
+
+	select {
+	case queue <- record:
+	default:
+		in.metrics.blocked.Add(1)
+		start := time.Now()
+		timer := time.NewTimer(in.config.enqueueTimeout)
+		defer timer.Stop()
+		select {
+		case queue <- record:
+			in.metrics.blockedNanos.Add(int64(time.Since(start)))
+		case <-timer.C:
+			in.metrics.blockedNanos.Add(int64(time.Since(start)))
+			in.metrics.dropped.Add(1)
+			return errIngestQueueFull
+		}
+	}
+
+	in.metrics.enqueued.Add(1)
+	depth := int64(len(queue))
+	for {
+		highWater := in.metrics.queueHighWater.Load()
+		if depth <= highWater || in.metrics.queueHighWater.CompareAndSwap(highWater, depth) {
+			break
+		}
+	}
+	return nil
+}
+
+// close stops accepting records and waits for the queued ones to be written.
+func (in *ingester) close() {
+	for _, queue := range in.queues {
+		close(queue)
+	}
+	in.wg.Wait()
+}
+
+func (in *ingester) worker(queue chan ingestRecord) {
+	defer in.wg.Done()
+
+	var batteries []BatteryData
+	var locations []LocationData
+	ticker := time.NewTicker(in.config.flushInterval)
+	defer ticker.Stop()
+
+	flush := func() {
+		if len(batteries)+len(locations) > 0 {
+			in.flush(batteries, locations)
+			batteries, locations = batteries[:0], locations[:0]
+		}
+	}
+
+	for {
+		select {
+		case record, ok := <-queue:
+			if !ok {
+				flush()
+				return
+			}
+			if record.battery != nil {
+				batteries = append(batteries, *record.battery)
+			}
+			if record.location != nil {
+				locations = append(locations, *record.location)
+			}
+			if len(batteries)+len(locations) >= in.config.batchSize {
+				flush()
+			}
+		case <-ticker.C:
+			flush()
+		}
+	}
+}
+
+func (in *ingester) flush(batteries []BatteryData, locations []LocationData) {
+	start := time.Now()
+	rows, err := in.copyWithRetries(batteries, locations)
+	in.metrics.flushes.Add(1)
+	in.metrics.flushNanos.Add(int64(time.Since(start)))
+	if err == nil {
+		in.metrics.rows.Add(rows)
+		traces.stored(batteries, locations, time.Now())
+		return
+	}
+
+	log.Printf("Error writing batch of %d batteries, %d locations to PostgreSQL, writing them one by one: %s\n", len(batteries), len(locations), err)
+	in.metrics.splitBatches.Add(1)
+	for i := range batteries {
+		in.copyRecord(batteries[i:i+1], nil)
+	}
+	for i := range locations {
+		in.copyRecord(nil, locations[i:i+1])
+	}
+}
+
+// copyWithRetries writes a batch, retrying with backoff while it fails.
+func (in *ingester) copyWithRetries(batteries []BatteryData, locations []LocationData) (int64, error) {
+	backoff := in.config.retryBackoff
+	for retry := 0; ; retry++ {
+		rows, err := copyBatch(context.Background(), in.db, batteries, locations, in.config.tripGap)
+		if err == nil || retry >= in.config.flushRetries {
+			return rows, err
+		}
+		in.metrics.retries.Add(1)
+		time.Sleep(backoff)
+		backoff *= 2
+	}
+}
+
+// copyRecord writes a single record of a failed batch.
+func (in *ingester) copyRecord(batteries []BatteryData, locations []LocationData) {
+	rows, err := copyBatch(context.Background(), in.db, batteries, locations, in.config.tripGap)
+	if err != nil {
+		log.Printf("Dropping a record the database rejects: %s\n", err)
+		in.metrics.failedRecords.Add(1)
+		traces.forget(batteries, locations)
+		return
+	}
+	in.metrics.rows.Add(rows)
+	traces.stored(batteries, locations, time.Now())
+}
+
+func (in *ingester) logMetrics() {
+	m := &in.metrics
+	flushes := m.flushes.Load()
+	var flushMillis float64
+	if flushes > 0 {
+		flushMillis = float64(m.flushNanos.Load()) / float64(flushes) / 1e6
+	}
+	var queued int
+	for _, queue := range in.queues {
+		queued += len(queue)
+	}
+	log.Printf("Ingest: %d queued (%d now, high water %d of %d per worker), %d blocked for %s, %d dropped, %d flushes (%.1f ms avg, %d retries, %d split), %d rows, %d failed\n",
+		m.enqueued.Load(), queued, m.queueHighWater.Load(), cap(in.queues[0]),
+		m.blocked.Load(), time.Duration(m.blockedNanos.Load()), m.dropped.Load(),
+		flushes, flushMillis, m.retries.Load(), m.splitBatches.Load(), m.rows.Load(), m.failedRecords.Load())
+}
+
+// The per-message inserts write the same columns as COPY, see schema_gen.go
+var (
+	batteryInsert  = insertStatement(batteryTable, batteryColumns)
+	locationInsert = insertStatement(locationTable, locationColumns)
+)
+
+func insertStatement(table string, columns []string) string {
+	placeholders := make([]string, len(columns))
+	for i := range columns {
+		placeholders[i] = "$" + strconv.Itoa(i+1)
+	}
+	return "INSERT INTO " + table + " (" + strings.Join(columns, ", ") + ") VALUES (" + strings.Join(placeholders, ", ") + ")"
+}
+
+// insertRecords writes readings with one INSERT each, for INGEST_WORKERS=0,
+// and brings the rollups, trips and newest positions up to date in the
+// same transaction like copyBatch.
+func insertRecords(ctx context.Context, db ingestDB, batteries []BatteryData, locations []LocationData, tripGap time.Duration) error {
+	tx, err := db.beginIngest(ctx)
+	if err != nil {
+		return err
+	}
+	defer tx.Rollback(ctx)
+
+	for i := range batteries {
+		if _, err := tx.Exec(ctx, batteryInsert, batteryRow(&batteries[i])...); err != nil {
+			return err
+		}
+	}
+	if len(batteries) > 0 {
+		if err := upsertRollups(ctx, tx, batteries); err != nil {
+			return err
+		}
+	}
+	for i := range locations {
+		if _, err := tx.Exec(ctx, locationInsert, locationRow(&locations[i])...); err != nil {
+			return err
+		}
+	}
+	if len(locations) > 0 {
+		if err := upsertTrips(ctx, tx, locations, tripGap); err != nil {
+			return err
+		}
+	}
+	return tx.Commit(ctx)
+}
+
+// copyBatch writes a batch in one transaction and returns the number of rows written.
+func copyBatch(ctx context.Context, db ingestDB, batteries []BatteryData, locations []LocationData, tripGap time.Duration) (int64, error) {
+	tx, err := db.beginIngest(ctx)
+	if err != nil {
+		return 0, err
+	}
+	defer tx.Rollback(ctx)
+
+	var rows int64
+	if len(batteries) > 0 {
+		n, err := tx.CopyFrom(ctx, pgx.Identifier{batteryTable}, batteryColumns,
+			pgx.CopyFromSlice(len(batteries), func(i int) ([]any, error) {
+				return batteryRow(&batteries[i]), nil
+			}))
+		if err != nil {
+			return 0, err
+		}
+		rows += n
+		if err := upsertRollups(ctx, tx, batteries); err != nil {
+			return 0, err
+		}
+	}
+
+	if len(locations) > 0 {
+		n, err := tx.CopyFrom(ctx, pgx.Identifier{locationTable}, locationColumns,
+			pgx.CopyFromSlice(len(locations), func(i int) ([]any, error) {
+				return locationRow(&locations[i]), nil
+			}))
+		if err != nil {
+			return 0, err
+		}
+		rows += n
+		if err := upsertTrips(ctx, tx, locations, tripGap); err != nil {
+			return 0, err
+		}
+	}
+
+	return rows, tx.Commit(ctx)
+}
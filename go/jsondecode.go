@@ -0,0 +1,548 @@
+package main
+
+import (
+	"bytes"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"strconv"
+	"time"
+)
+
+//go:generate go run ./schemagen -schema ../schema/telemetry.schema -c ../esp/main/telemetry_json_gen.inc -go schema_gen.go -sql ../schema/telemetry.sql
+
+// jsonDecoder reads the JSON messages of the tracker into the structs of
+// schema_gen.go without reflection: the generated decoders switch on each
+// key and call the method of the field's type, which parses the value in
+// place. It accepts exactly what json.Unmarshal accepts into those structs
+// and gives the same values (TestDecodeJSONMatchesUnmarshal):
+//
+//   - keys match exactly, or else case-insensitively, unknown keys and
+//     their values are skipped
+//   - null leaves a field as it is, and sets an array to nil
+//   - integers must fit their field, floats are rounded to their size
+//
+// Unlike json.Unmarshal it stops at the first value that does not fit its
+// field. The first error is kept and ends the decoding.
+type jsonDecoder struct {
+	data  []byte
+	pos   int
+	key   []byte // Of the value at pos, set by next
+	depth int
+	err   error
+}
+
+// Nesting limit of encoding/json
+const jsonMaxDepth = 10000
+
+var errJSONEnd = errors.New("unexpected end of JSON input")
+
+func (d *jsonDecoder) fail(format string, args ...any) {
+	if d.err == nil {
+		d.err = fmt.Errorf("%s at offset %d", fmt.Sprintf(format, args...), d.pos)
+	}
+	// Every loop stops at the end of the data
+	d.pos = len(d.data)
+}
+
+func (d *jsonDecoder) space() {
+	for d.pos < len(d.data) {
+		switch d.data[d.pos] {
+		case ' ', '\t', '\n', '\r':
+			d.pos++
+		default:
+			return
+		}
+	}
+}
+
+// peek returns the next byte after white space, 0 at the end.
+func (d *jsonDecoder) peek() byte {
+	d.space()
+	if d.pos >= len(d.data) {
+		return 0
+	}
+	return d.data[d.pos]
+}
+
+// end checks that only white space follows the value and returns the first error.
+func (d *jsonDecoder) end() error {
+	if d.space(); d.err == nil && d.pos < len(d.data) {
+		d.fail("invalid character %q after top-level value", d.data[d.pos])
+	}
+	return d.err
+}
+
+func (d *jsonDecoder) literal(word string) bool {
+	if !bytes.HasPrefix(d.data[d.pos:], []byte(word)) {
+		if d.pos+len(word) > len(d.data) && bytes.HasPrefix([]byte(word), d.data[d.pos:]) {
+			d.err = errJSONEnd
+			d.pos = len(d.data)
+		} else {
+			d.fail("invalid literal")
+		}
+		return false
+	}
+	d.pos += len(word)
+	return true
+}
+
+// null consumes a null value.
+func (d *jsonDecoder) null() bool {
+	if d.peek() != 'n' {
+		return false
+	}
+	d.literal("null")
+	return true
+}
+
+// object starts an object, false for null or an error.
+func (d *jsonDecoder) object() bool {
+	return d.open('{', "an object")
+}
+
+// array starts an array, false for null or an error.
+func (d *jsonDecoder) array() bool {
+	return d.open('[', "an array")
+}
+
+func (d *jsonDecoder) open(bracket byte, want string) bool {
+	switch c := d.peek(); c {
+	case bracket:
+		d.pos++
+		d.depth++
+		if d.depth > jsonMaxDepth {
+			d.fail("exceeded max depth")
+			return false
+		}
+		return true
+	case 'n':
+		d.literal("null")
+		return false
+	default:
+		d.wrongType(c, want)
+		return false
+	}
+}
+
+// next moves to the value of the next key of the object and sets key,
+// false after the closing brace or an error.
+func (d *jsonDecoder) next(first bool) bool {
+	if !d.more(first, '}', "object key:value pair") {
+		return false
+	}
+	if c := d.peek(); c != '"' {
+		d.unexpected(c, "looking for beginning of object key string")
+		return false
+	}
+	key, escaped := d.string()
+	if d.err != nil {
+		return false
+	}
+	if escaped {
+		// Keys of the tracker never are, so this may be slow
+		var unquoted string
+		if err := json.Unmarshal(key, &unquoted); err != nil {
+			d.fail("invalid object key")
+			return false
+		}
+		d.key = []byte(unquoted)
+	} else {
+		d.key = key[1 : len(key)-1]
+	}
+
+	if c := d.peek(); c != ':' {
+		d.unexpected(c, "after object key")
+		return false
+	}
+	d.pos++
+	return true
+}
+
+// element moves to the next element of the array, false after the closing
+// bracket or an error.
+func (d *jsonDecoder) element(first bool) bool {
+	return d.more(first, ']', "array element")
+}
+
+// more consumes the comma before another entry, or the closing bracket.
+func (d *jsonDecoder) more(first bool, bracket byte, what string) bool {
+	c := d.peek()
+	if c == bracket && first {
+		d.pos++
+		d.depth--
+		return false
+	}
+	if first {
+		return d.err == nil
+	}
+	switch c {
+	case bracket:
+		d.pos++
+		d.depth--
+		return false
+	case ',':
+		d.pos++
+		return true
+	default:
+		d.unexpected(c, "after "+what)
+		return false
+	}
+}
+
+func (d *jsonDecoder) unexpected(c byte, where string) {
+	if c == 0 {
+		d.err = errJSONEnd
+		d.pos = len(d.data)
+		return
+	}
+	d.fail("invalid character %q %s", c, where)
+}
+
+// wrongType reports a value that does not fit the field.
+func (d *jsonDecoder) wrongType(c byte, want string) {
+	if c == 0 {
+		d.unexpected(c, "")
+		return
+	}
+	d.fail("cannot decode a value starting with %q into %s", c, want)
+}
+
+// string consumes a string and returns it with its quotes, and whether it
+// has escapes.
+func (d *jsonDecoder) string() (raw []byte, escaped bool) {
+	start := d.pos
+	d.pos++
+	for d.pos < len(d.data) {
+		c := d.data[d.pos]
+		switch {
+		case c == '"':
+			d.pos++
+			return d.data[start:d.pos], escaped
+		case c == '\\':
+			escaped = true
+			d.pos++
+			if d.pos < len(d.data) && d.data[d.pos] == 'u' {
+				for i := 0; i < 4; i++ {
+					d.pos++
+					if d.pos >= len(d.data) {
+						break
+					}
+					if !isHex(d.data[d.pos]) {
+						d.fail("invalid character %q in \\u hexadecimal character escape", d.data[d.pos])
+						return nil, false
+					}
+				}
+				d.pos++
+			} else if d.pos < len(d.data) {
+				switch d.data[d.pos] {
+				case '"', '\\', '/', 'b', 'f', 'n', 'r', 't':
+					d.pos++
+				default:
+					d.fail("invalid character %q in string escape code", d.data[d.pos])
+					return nil, false
+				}
+			}
+		case c < ' ':
+			d.fail("invalid character %q in string literal", c)
+			return nil, false
+		default:
+			d.pos++
+		}
+	}
+	d.unexpected(0, "")
+	return nil, false
+}
+
+func isHex(c byte) bool {
+	return '0' <= c && c <= '9' || 'a' <= c && c <= 'f' || 'A' <= c && c <= 'F'
+}
+
+func isDigit(c byte) bool {
+	return '0' <= c && c <= '9'
+}
+
+// digits consumes one or more digits.
+func (d *jsonDecoder) digits() bool {
+	if d.pos >= len(d.data) {
+		d.unexpected(0, "")
+		return false
+	}
+	if !isDigit(d.data[d.pos]) {
+		d.fail("invalid character %q in numeric literal", d.data[d.pos])
+		return false
+	}
+	for d.pos < len(d.data) && isDigit(d.data[d.pos]) {
+		d.pos++
+	}
+	return true
+}
+
+// number consumes a number and returns its text, nil after an error.
+func (d *jsonDecoder) number(want string) []byte {
+	c := d.peek()
+	if c != '-' && !isDigit(c) {
+		d.wrongType(c, want)
+		return nil
+	}
+	start := d.pos
+	if c == '-' {
+		d.pos++
+	}
+	if d.pos < len(d.data) && d.data[d.pos] == '0' {
+		d.pos++
+	} else if !d.digits() {
+		return nil
+	}
+	if d.pos < len(d.data) && d.data[d.pos] == '.' {
+		d.pos++
+		if !d.digits() {
+			return nil
+		}
+	}
+	if d.pos < len(d.data) && (d.data[d.pos] == 'e' || d.data[d.pos] == 'E') {
+		d.pos++
+		if d.pos < len(d.data) && (d.data[d.pos] == '+' || d.data[d.pos] == '-') {
+			d.pos++
+		}
+		if !d.digits() {
+			return nil
+		}
+	}
+	return d.data[start:d.pos]
+}
+
+// skip consumes a value of any type.
+func (d *jsonDecoder) skip() {
+	switch c := d.peek(); c {
+	case '{':
+		if d.object() {
+			for first := true; d.next(first); first = false {
+				d.skip()
+			}
+		}
+	case '[':
+		if d.array() {
+			for first := true; d.element(first); first = false {
+				d.skip()
+			}
+		}
+	case '"':
+		d.string()
+	case 't':
+		d.literal("true")
+	case 'f':
+		d.literal("false")
+	case 'n':
+		d.literal("null")
+	default:
+		if c != '-' && !isDigit(c) {
+			d.unexpected(c, "looking for beginning of value")
+			return
+		}
+		d.number("a value")
+	}
+}
+
+func (d *jsonDecoder) bool(value *bool) {
+	switch c := d.peek(); c {
+	case 't':
+		if d.literal("true") {
+			*value = true
+		}
+	case 'f':
+		if d.literal("false") {
+			*value = false
+		}
+	case 'n':
+		d.literal("null")
+	default:
+		d.wrongType(c, "a bool")
+	}
+}
+
+func (d *jsonDecoder) uint(bits int) (uint64, bool) {
+	if d.null() {
+		return 0, false
+	}
+	text := d.number("an unsigned integer")
+	if text == nil {
+		return 0, false
+	}
+	n, err := strconv.ParseUint(string(text), 10, bits)
+	if err != nil {
+		d.fail("cannot decode number %s into uint%d", text, bits)
+		return 0, false
+	}
+	return n, true
+}
+
+func (d *jsonDecoder) uint16(value *uint16) {
+	if n, ok := d.uint(16); ok {
+		*value = uint16(n)
+	}
+}
+
+func (d *jsonDecoder) uint32(value *uint32) {
+	if n, ok := d.uint(32); ok {
+		*value = uint32(n)
+	}
+}
+
+func (d *jsonDecoder) int64(value *int64) {
+	if d.null() {
+		return
+	}
+	text := d.number("an integer")
+	if text == nil {
+		return
+	}
+	n, err := strconv.ParseInt(string(text), 10, 64)
+	if err != nil {
+		d.fail("cannot decode number %s into int64", text)
+		return
+	}
+	*value = n
+}
+
+func (d *jsonDecoder) float(bits int) (float64, bool) {
+	if d.null() {
+		return 0, false
+	}
+	text := d.number("a float")
+	if text == nil {
+		return 0, false
+	}
+	f, err := strconv.ParseFloat(string(text), bits)
+	if err != nil {
+		d.fail("cannot decode number %s into float%d", text, bits)
+		return 0, false
+	}
+	return f, true
+}
+
+func (d *jsonDecoder) float32(value *float32) {
+	if f, ok := d.float(32); ok {
+		*value = float32(f)
+	}
+}
+
+func (d *jsonDecoder) float64(value *float64) {
+	if f, ok := d.float(64); ok {
+		*value = f
+	}
+}
+
+func (d *jsonDecoder) float32s(values *[]float32) {
+	if d.null() {
+		*values = nil
+		return
+	}
+	if !d.array() {
+		return
+	}
+	*values = (*values)[:0]
+	for first := true; d.element(first); first = false {
+		*values = grow(*values)
+		d.float32(&(*values)[len(*values)-1])
+	}
+	if len(*values) == 0 {
+		*values = []float32{}
+	}
+}
+
+// grow adds an element for the next value of an array. Like json.Unmarshal
+// it reuses the capacity left by an earlier value of the same key.
+func grow[T any](values []T) []T {
+	if len(values) < cap(values) {
+		return values[:len(values)+1]
+	}
+	var zero T
+	return append(values, zero)
+}
+
+// time reads an RFC 3339 string the way time.Time unmarshals itself.
+func (d *jsonDecoder) time(value *time.Time) {
+	c := d.peek()
+	if c == 'n' {
+		d.literal("null")
+		return
+	}
+	if c != '"' {
+		d.wrongType(c, "a time")
+		return
+	}
+	raw, _ := d.string()
+	if d.err != nil {
+		return
+	}
+	if err := value.UnmarshalJSON(raw); err != nil {
+		d.fail("%v", err)
+	}
+}
+
+// foldKey returns the key of keys that equals key case-insensitively, nil
+// when there is none.
+func foldKey(key []byte, keys []string) []byte {
+	for _, k := range keys {
+		if bytes.EqualFold(key, []byte(k)) {
+			return []byte(k)
+		}
+	}
+	return nil
+}
+
+// decodeBatchJSON decodes the payload of convertBatchToJSON.
+func decodeBatchJSON(data []byte) (BatchData, error) {
+	d := jsonDecoder{data: data}
+	var batch BatchData
+	if d.object() {
+		for first := true; d.next(first); first = false {
+			switch {
+			case bytes.EqualFold(d.key, []byte("batteries")):
+				d.batteries(&batch.Batteries)
+			case bytes.EqualFold(d.key, []byte("locations")):
+				d.locations(&batch.Locations)
+			default:
+				d.skip()
+			}
+		}
+	}
+	return batch, d.end()
+}
+
+func (d *jsonDecoder) batteries(batteries *[]BatteryData) {
+	if d.null() {
+		*batteries = nil
+		return
+	}
+	if !d.array() {
+		return
+	}
+	*batteries = (*batteries)[:0]
+	for first := true; d.element(first); first = false {
+		*batteries = grow(*batteries)
+		d.battery(&(*batteries)[len(*batteries)-1])
+	}
+	if len(*batteries) == 0 {
+		*batteries = []BatteryData{}
+	}
+}
+
+func (d *jsonDecoder) locations(locations *[]LocationData) {
+	if d.null() {
+		*locations = nil
+		return
+	}
+	if !d.array() {
+		return
+	}
+	*locations = (*locations)[:0]
+	for first := true; d.element(first); first = false {
+		*locations = grow(*locations)
+		d.location(&(*locations)[len(*locations)-1])
+	}
+	if len(*locations) == 0 {
+		*locations = []LocationData{}
+	}
+}
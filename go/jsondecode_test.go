@@ -0,0 +1,210 @@
+package main
+
+import (
+	"encoding/json"
+	"reflect"
+	"strings"
+	"testing"
+	"time"
+)
+
+// Published by convertBmsStatusToJSON / convertLocationToJSON for the golden
+// samples in esp/host_test/bench_json.c
+const (
+	goldenBatteryJSON = `{"state":3,"chg_enable":true,"dis_enable":false,"connected_cells":4,` +
+		`"cell_voltages":[3.7000000476837158,3.75,3.7999999523162842,4,0,0],` +
+		`"cell_voltage_max":4,"cell_voltage_min":3.7000000476837158,"cell_voltage_avg":3.8125,` +
+		`"pack_voltage":15.25,"stack_voltage":15.300000190734863,"pack_current":-2.5,` +
+		`"bat_temps":[21.5,22],"bat_temp_max":22,"bat_temp_min":21.5,"bat_temp_avg":21.75,` +
+		`"mosfet_temp":30,"ic_temp":31,"mcu_temp":32,"full":false,"empty":true,` +
+		`"soc":80.5,"balancing_status":3000000000,"no_idle_timestamp":"2023-11-14T22:13:20Z",` +
+		`"error_flags":5,"timestamp":"2023-11-14T22:13:30Z",` +
+		`"boot_id":3735928559,"sequence":42,"uptime_ms":86400123}`
+	goldenLocationJSON = `{"latitude":45.814998626708984,"longitude":15.981900215148926,"timestamp":"2023-11-14T22:13:20Z",` +
+		`"boot_id":3735928559,"sequence":7,"uptime_ms":86390000}`
+	goldenBatchJSON = `{"batteries":[` + goldenBatteryJSON + `,` + goldenBatteryJSON + `],"locations":[` + goldenLocationJSON + `]}`
+)
+
+// The JSON messages carry every cell and thermistor, connected or not
+func goldenBatteryDataJSON() BatteryData {
+	data := goldenBatteryData()
+	data.CellVoltages = append(data.CellVoltages, 0, 0)
+	return data
+}
+
+func goldenLocationDataJSON() LocationData {
+	return LocationData{
+		Latitude:  float64(float32(45.815)),
+		Longitude: float64(float32(15.9819)),
+		Timestamp: time.Unix(1700000000, 0).UTC(),
+		BootID:    0xdeadbeef,
+		Sequence:  7,
+		UptimeMs:  86390000,
+	}
+}
+
+func TestDecodeBatteryJSON(t *testing.T) {
+	got, err := decodeBatteryJSON([]byte(goldenBatteryJSON))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if want := goldenBatteryDataJSON(); !reflect.DeepEqual(got, want) {
+		t.Fatalf("decoded %+v\nwant %+v", got, want)
+	}
+}
+
+func TestDecodeLocationJSON(t *testing.T) {
+	got, err := decodeLocationJSON([]byte(goldenLocationJSON))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if want := goldenLocationDataJSON(); !reflect.DeepEqual(got, want) {
+		t.Fatalf("decoded %+v\nwant %+v", got, want)
+	}
+}
+
+func TestDecodeBatchJSON(t *testing.T) {
+	got, err := decodeBatchJSON([]byte(goldenBatchJSON))
+	if err != nil {
+		t.Fatal(err)
+	}
+	want := BatchData{
+		Batteries: []BatteryData{goldenBatteryDataJSON(), goldenBatteryDataJSON()},
+		Locations: []LocationData{goldenLocationDataJSON()},
+	}
+	if !reflect.DeepEqual(got, want) {
+		t.Fatalf("decoded %+v\nwant %+v", got, want)
+	}
+}
+
+// Payloads the generated decoders must treat exactly like json.Unmarshal,
+// valid or not
+var jsonDecodeCases = []string{
+	goldenBatteryJSON,
+	goldenLocationJSON,
+	goldenBatchJSON,
+	` { "state" : 1 , "unknown" : {"a":[1,{"b":null}],"c":"\"}"} , "soc" : 5e1 } `,
+	`{"STATE":7,"Chg_Enable":true,"ſtate":8}`,
+	`{"state":9,"timestamp":"2023-11-14T23:13:30+01:00"}`,
+	`{"cell_voltages":[1,2,3],"cell_voltages":[null]}`,
+	`{"cell_voltages":null,"bat_temps":[],"timestamp":null,"state":null}`,
+	`{"batteries":[{"state":1},null,{"state":2}],"locations":[],"other":true}`,
+	`{"batteries":[{"state":1,"soc":2}],"batteries":[{"state":3}]}`,
+	`null`,
+	`{}`,
+	`{"state":65536}`,
+	`{"state":-1}`,
+	`{"state":1.5}`,
+	`{"state":"1"}`,
+	`{"soc":1e39}`,
+	`{"uptime_ms":-9223372036854775808,"latitude":-0.0,"longitude":1E-400}`,
+	`{"chg_enable":1}`,
+	`{"timestamp":"yesterday"}`,
+	`{"timestamp":1700000000}`,
+	`{"cell_voltages":{}}`,
+	`{"batteries":{}}`,
+	`{"state":01}`,
+	`{"state":1,}`,
+	`{"state" 1}`,
+	`{"state":1`,
+	`{"cell_voltages":[1,]}`,
+	`{"cell_voltages":[1 2]}`,
+	`{"a":"\x"}`,
+	`{"a":"\u12"}`,
+	"{\"a\":\"\x01\"}",
+	"{}\x00",
+	`{"a":tru}`,
+	`{"a":-}`,
+	`{"a":1.}`,
+	`{"a":1e}`,
+	`{} {}`,
+	`[]`,
+	`"state"`,
+	``,
+	` `,
+}
+
+func checkDecodeJSON[T any](t *testing.T, payload string, decode func([]byte) (T, error)) {
+	t.Helper()
+	got, err := decode([]byte(payload))
+	var want T
+	wantErr := json.Unmarshal([]byte(payload), &want)
+	if (err != nil) != (wantErr != nil) {
+		t.Fatalf("%s: error %v, json.Unmarshal %v", payload, err, wantErr)
+	}
+	if err == nil && !reflect.DeepEqual(got, want) {
+		t.Fatalf("%s: decoded %+v\njson.Unmarshal %+v", payload, got, want)
+	}
+}
+
+func checkDecodeJSONAll(t *testing.T, payload string) {
+	t.Helper()
+	checkDecodeJSON(t, payload, decodeBatteryJSON)
+	checkDecodeJSON(t, payload, decodeLocationJSON)
+	checkDecodeJSON(t, payload, decodeBatchJSON)
+}
+
+func TestDecodeJSONMatchesUnmarshal(t *testing.T) {
+	for _, payload := range jsonDecodeCases {
+		checkDecodeJSONAll(t, payload)
+	}
+	// Cut anywhere, a payload is rejected by both
+	for i := range goldenBatchJSON {
+		checkDecodeJSONAll(t, goldenBatchJSON[:i])
+	}
+	// Nesting limit
+	deep := `{"a":` + strings.Repeat("[", 10001) + strings.Repeat("]", 10001) + `}`
+	checkDecodeJSONAll(t, deep)
+}
+
+func FuzzDecodeJSON(f *testing.F) {
+	for _, payload := range jsonDecodeCases {
+		f.Add(payload)
+	}
+	f.Fuzz(checkDecodeJSONAll)
+}
+
+// The hot path of the aggregator's JSON handlers, without the logging:
+//
+//	go test -run - -bench JSON -benchmem
+func BenchmarkDecodeBatteryJSON(b *testing.B) {
+	payload := []byte(goldenBatteryJSON)
+	b.SetBytes(int64(len(payload)))
+	for i := 0; i < b.N; i++ {
+		if _, err := decodeBatteryJSON(payload); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkUnmarshalBatteryJSON(b *testing.B) {
+	payload := []byte(goldenBatteryJSON)
+	b.SetBytes(int64(len(payload)))
+	for i := 0; i < b.N; i++ {
+		var data BatteryData
+		if err := json.Unmarshal(payload, &data); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkDecodeBatchJSON(b *testing.B) {
+	payload := []byte(goldenBatchJSON)
+	b.SetBytes(int64(len(payload)))
+	for i := 0; i < b.N; i++ {
+		if _, err := decodeBatchJSON(payload); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkUnmarshalBatchJSON(b *testing.B) {
+	payload := []byte(goldenBatchJSON)
+	b.SetBytes(int64(len(payload)))
+	for i := 0; i < b.N; i++ {
+		var batch BatchData
+		if err := json.Unmarshal(payload, &batch); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
@@ -2,10 +2,10 @@ package main
 
 import (
 	"context"
-	"encoding/json"
 	"log"
 	"os"
 	"os/signal"
+	"strconv"
 	"syscall"
 	"time"
 
@@ -13,38 +13,10 @@ import (
 	"github.com/jackc/pgx/v5/pgxpool"
 )
 
-type BatteryData struct {
-	State           uint16    `json:"state"`
-	ChgEnable       bool      `json:"chg_enable"`
-	DisEnable       bool      `json:"dis_enable"`
-	ConnectedCells  uint16    `json:"connected_cells"`
-	CellVoltages    []float32 `json:"cell_voltages"`
-	CellVoltageMax  float32   `json:"cell_voltage_max"`
-	CellVoltageMin  float32   `json:"cell_voltage_min"`
-	CellVoltageAvg  float32   `json:"cell_voltage_avg"`
-	PackVoltage     float32   `json:"pack_voltage"`
-	StackVoltage    float32   `json:"stack_voltage"`
-	PackCurrent     float32   `json:"pack_current"`
-	BatTemps        []float32 `json:"bat_temps"`
-	BatTempMax      float32   `json:"bat_temp_max"`
-	BatTempMin      float32   `json:"bat_temp_min"`
-	BatTempAvg      float32   `json:"bat_temp_avg"`
-	MosfetTemp      float32   `json:"mosfet_temp"`
-	IcTemp          float32   `json:"ic_temp"`
-	McuTemp         float32   `json:"mcu_temp"`
-	IsFull          bool      `json:"full"`
-	IsEmpty         bool      `json:"empty"`
-	Soc             float32   `json:"soc"`
-	BalancingStatus uint32    `json:"balancing_status"`
-	NoIdleTimestamp time.Time `json:"no_idle_timestamp"`
-	ErrorFlags      uint32    `json:"error_flags"`
-	Timestamp       time.Time `json:"timestamp"`
-}
-
-type LocationData struct {
-	Latitude  float64   `json:"latitude"`
-	Longitude float64   `json:"longitude"`
-	Timestamp time.Time `json:"timestamp"`
+// BatchData is the envelope published when the tracker batches samples.
+type BatchData struct {
+	Batteries []BatteryData  `json:"batteries"`
+	Locations []LocationData `json:"locations"`
 }
 
 func getEnvVar(key string, defaultValue string) string {
@@ -58,21 +30,44 @@ func getEnvVar(key string, defaultValue string) string {
 const (
 	logFilePath = "app.log"
 
-	batteryTopic  = "/bicycle/battery-status"
-	locationTopic = "/bicycle/gps-coordinates"
-
-	batteryTable                    = "batteries"
-	batteryReadingBatTempsTable     = "battery_reading_bat_temps"
-	batteryReadingCellVoltagesTable = "battery_reading_cell_voltages"
-	locationTable                   = "locations"
+	// Every bike publishes under its own /bicycle/<device-id>/ namespace
+	batteryTopic        = "/bicycle/+/battery-status"
+	locationTopic       = "/bicycle/+/gps-coordinates"
+	batteryBinaryTopic  = batteryTopic + "/bin"
+	locationBinaryTopic = locationTopic + "/bin"
+	batchTopic          = "/bicycle/+/batch"
+	batchBinaryTopic    = batchTopic + "/bin"
+	batchSeriesTopic    = batchTopic + "/series"
+	diagnosticsTopic    = "/bicycle/+/diagnostics"
+	alarmTopic          = "/bicycle/+/alarm"
+	alarmBinaryTopic    = alarmTopic + "/bin"
 )
 
 var (
 	dbpool     *pgxpool.Pool
+	ingest     *ingester
+	traces     = newTracer()
+	tripGap    = 10 * time.Minute // Silence that ends a trip, TRIP_GAP
 	logger     *log.Logger
 	logFile, _ = os.OpenFile(logFilePath, os.O_APPEND|os.O_CREATE|os.O_WRONLY, 0666)
 )
 
+func getEnvInt(key string, defaultValue int) int {
+	value, err := strconv.Atoi(getEnvVar(key, strconv.Itoa(defaultValue)))
+	if err != nil {
+		log.Fatalf("%s must be an integer: %s", key, err)
+	}
+	return value
+}
+
+func getEnvDuration(key string, defaultValue time.Duration) time.Duration {
+	value, err := time.ParseDuration(getEnvVar(key, defaultValue.String()))
+	if err != nil {
+		log.Fatalf("%s must be a duration: %s", key, err)
+	}
+	return value
+}
+
 func initLogger() {
 	logger = log.New(logFile, "", log.LstdFlags|log.Lshortfile)
 }
@@ -86,133 +81,257 @@ func setupPostgres(connString string) *pgxpool.Pool {
 	return pool
 }
 
-func setupMQTTClient(brokerURL string, brokerUsername string, brokerPassword string) mqtt.Client {
+func setupMQTTClient(brokerURL string, brokerUsername string, brokerPassword string, clientID string, shareGroup string) mqtt.Client {
 	opts := mqtt.NewClientOptions().AddBroker(brokerURL)
     opts.SetUsername(brokerUsername)
     opts.SetPassword(brokerPassword)
-	opts.SetClientID("go_mqtt_aggregator")
+	opts.SetClientID(clientID)
 	client := mqtt.NewClient(opts)
 	if token := client.Connect(); token.Wait() && token.Error() != nil {
 		log.Fatal(token.Error())
 	}
 
-	tokenBattery := client.Subscribe(batteryTopic, 0, func(client mqtt.Client, msg mqtt.Message) {
-		handleBatteryMessage(msg.Payload())
+	tokenBattery := client.Subscribe(sharedTopic(shareGroup, batteryTopic), 0, func(client mqtt.Client, msg mqtt.Message) {
+		handleBatteryMessage(deviceIDFromTopic(msg.Topic()), msg.Payload())
 	})
 
 	if tokenBattery.Wait() && tokenBattery.Error() != nil {
 		log.Fatal(tokenBattery.Error())
 	}
 
-	tokenLocation := client.Subscribe(locationTopic, 0, func(client mqtt.Client, msg mqtt.Message) {
-		handleLocationMessage(msg.Payload())
+	tokenLocation := client.Subscribe(sharedTopic(shareGroup, locationTopic), 0, func(client mqtt.Client, msg mqtt.Message) {
+		handleLocationMessage(deviceIDFromTopic(msg.Topic()), msg.Payload())
 	})
 
 	if tokenLocation.Wait() && tokenLocation.Error() != nil {
 		log.Fatal(tokenLocation.Error())
 	}
 
+	tokenBatteryBinary := client.Subscribe(sharedTopic(shareGroup, batteryBinaryTopic), 0, func(client mqtt.Client, msg mqtt.Message) {
+		handleBatteryBinaryMessage(deviceIDFromTopic(msg.Topic()), msg.Payload())
+	})
+
+	if tokenBatteryBinary.Wait() && tokenBatteryBinary.Error() != nil {
+		log.Fatal(tokenBatteryBinary.Error())
+	}
+
+	tokenLocationBinary := client.Subscribe(sharedTopic(shareGroup, locationBinaryTopic), 0, func(client mqtt.Client, msg mqtt.Message) {
+		handleLocationBinaryMessage(deviceIDFromTopic(msg.Topic()), msg.Payload())
+	})
+
+	if tokenLocationBinary.Wait() && tokenLocationBinary.Error() != nil {
+		log.Fatal(tokenLocationBinary.Error())
+	}
+
+	tokenBatch := client.Subscribe(sharedTopic(shareGroup, batchTopic), 0, func(client mqtt.Client, msg mqtt.Message) {
+		handleBatchMessage(deviceIDFromTopic(msg.Topic()), msg.Payload())
+	})
+
+	if tokenBatch.Wait() && tokenBatch.Error() != nil {
+		log.Fatal(tokenBatch.Error())
+	}
+
+	tokenBatchBinary := client.Subscribe(sharedTopic(shareGroup, batchBinaryTopic), 0, func(client mqtt.Client, msg mqtt.Message) {
+		handleBatchBinaryMessage(deviceIDFromTopic(msg.Topic()), msg.Payload())
+	})
+
+	if tokenBatchBinary.Wait() && tokenBatchBinary.Error() != nil {
+		log.Fatal(tokenBatchBinary.Error())
+	}
+
+	tokenBatchSeries := client.Subscribe(sharedTopic(shareGroup, batchSeriesTopic), 0, func(client mqtt.Client, msg mqtt.Message) {
+		handleBatchSeriesMessage(deviceIDFromTopic(msg.Topic()), msg.Payload())
+	})
+
+	if tokenBatchSeries.Wait() && tokenBatchSeries.Error() != nil {
+		log.Fatal(tokenBatchSeries.Error())
+	}
+
+	tokenDiagnostics := client.Subscribe(sharedTopic(shareGroup, diagnosticsTopic), 0, func(client mqtt.Client, msg mqtt.Message) {
+		handleDiagnosticsMessage(deviceIDFromTopic(msg.Topic()), msg.Payload())
+	})
+
+	if tokenDiagnostics.Wait() && tokenDiagnostics.Error() != nil {
+		log.Fatal(tokenDiagnostics.Error())
+	}
+
+	// QoS 1, an alarm must not be lost between the broker and the aggregator
+	tokenAlarm := client.Subscribe(sharedTopic(shareGroup, alarmTopic), 1, func(client mqtt.Client, msg mqtt.Message) {
+		handleAlarmMessage(deviceIDFromTopic(msg.Topic()), msg.Payload())
+	})
+
+	if tokenAlarm.Wait() && tokenAlarm.Error() != nil {
+		log.Fatal(tokenAlarm.Error())
+	}
+
+	tokenAlarmBinary := client.Subscribe(sharedTopic(shareGroup, alarmBinaryTopic), 1, func(client mqtt.Client, msg mqtt.Message) {
+		handleAlarmBinaryMessage(deviceIDFromTopic(msg.Topic()), msg.Payload())
+	})
+
+	if tokenAlarmBinary.Wait() && tokenAlarmBinary.Error() != nil {
+		log.Fatal(tokenAlarmBinary.Error())
+	}
+
 	return client
 }
 
-func handleBatteryMessage(payload []byte) {
+func handleBatteryMessage(deviceID string, payload []byte) {
 	log.Printf("JSON payload: %+v\n", string(payload))
 
-	var batteryData BatteryData
-	err := json.Unmarshal(payload, &batteryData)
+	batteryData, err := decodeBatteryJSON(payload)
 	if err != nil {
 		log.Println("Error parsing JSON payload (battery):", err)
 		return
 	}
 	log.Printf("Parsed JSON payload (battery): %+v\n", batteryData)
 
-	tx, err := dbpool.Begin(context.Background())
+	batteryData.DeviceID = deviceID
+	storeBatteryData(batteryData)
+}
+
+func handleBatteryBinaryMessage(deviceID string, payload []byte) {
+	batteryData, err := decodeBatteryBinary(payload)
 	if err != nil {
-		log.Println("Error beginning PostgreSQL transaction (battery):", err)
+		log.Println("Error parsing binary payload (battery):", err)
 		return
 	}
-	defer tx.Rollback(context.Background())
-
-	var batteryID int64
-	err = tx.QueryRow(context.Background(), `
-		INSERT INTO `+batteryTable+` (
-			bat_temp_avg, bat_temp_max, bat_temp_min,
-			cell_voltage_avg, cell_voltage_max, cell_voltage_min,
-			chg_enable, connected_cells, dis_enable,
-			ic_temp, is_empty, is_full,
-			mcu_temp, mosfet_temp, pack_current,
-			pack_voltage, soc, stack_voltage,
-			state, balancing_status, error_flags,
-			no_idle_timestamp, timestamp
-		) VALUES (
-			$1, $2, $3, $4, $5, $6, $7, $8, $9, $10,
-			$11, $12, $13, $14, $15, $16, $17, $18, $19,
-			$20, $21, $22, $23
-		) RETURNING battery_id
-	`, batteryData.BatTempAvg, batteryData.BatTempMax, batteryData.BatTempMin,
-		batteryData.CellVoltageAvg, batteryData.CellVoltageMax, batteryData.CellVoltageMin,
-		batteryData.ChgEnable, batteryData.ConnectedCells, batteryData.DisEnable,
-		batteryData.IcTemp, batteryData.IsEmpty, batteryData.IsFull,
-		batteryData.McuTemp, batteryData.MosfetTemp, batteryData.PackCurrent,
-		batteryData.PackVoltage, batteryData.Soc, batteryData.StackVoltage,
-		batteryData.State, batteryData.BalancingStatus, batteryData.ErrorFlags,
-		batteryData.NoIdleTimestamp, batteryData.Timestamp,
-	).Scan(&batteryID)
+	log.Printf("Parsed binary payload (battery): %+v\n", batteryData)
+
+	batteryData.DeviceID = deviceID
+	storeBatteryData(batteryData)
+}
+
+func insertBatteryData(batteryData BatteryData) {
+	err := insertRecords(context.Background(), poolIngestDB{dbpool}, []BatteryData{batteryData}, nil, tripGap)
 	if err != nil {
 		log.Println("Error inserting data into PostgreSQL (battery):", err)
+		traces.forget([]BatteryData{batteryData}, nil)
 		return
 	}
+	traces.stored([]BatteryData{batteryData}, nil, time.Now())
+}
 
-	for i, temp := range batteryData.BatTemps {
-		query := `
-        INSERT INTO ` + batteryReadingBatTempsTable + ` (bat_temps, bat_temps_order, battery_reading_battery_id)
-        VALUES ($1, $2, $3)
-    `
-		_, err := tx.Exec(context.Background(), query, temp, i+1, batteryID)
-		if err != nil {
-			log.Printf("Error executing query (battery temps): %s\nQuery: %s\n", err, query)
-			return
-		}
+func handleLocationMessage(deviceID string, payload []byte) {
+	log.Printf("JSON payload: %+v\n", string(payload))
+	locationData, err := decodeLocationJSON(payload)
+	if err != nil {
+		log.Println("Error parsing JSON payload (location):", err)
+		return
+	}
+	log.Printf("Parsed JSON payload (battery): %+v\n", locationData)
+
+	locationData.DeviceID = deviceID
+	storeLocationData(locationData)
+}
+
+func handleLocationBinaryMessage(deviceID string, payload []byte) {
+	locationData, err := decodeLocationBinary(payload)
+	if err != nil {
+		log.Println("Error parsing binary payload (location):", err)
+		return
 	}
+	log.Printf("Parsed binary payload (location): %+v\n", locationData)
+
+	locationData.DeviceID = deviceID
+	storeLocationData(locationData)
+}
 
-	for i, voltage := range batteryData.CellVoltages {
-		query := `
-        INSERT INTO ` + batteryReadingCellVoltagesTable + ` (cell_voltage, cell_voltages_order, battery_reading_battery_id)
-        VALUES ($1, $2, $3)
-    `
-		_, err := tx.Exec(context.Background(), query, voltage, i+1, batteryID)
-		if err != nil {
-			log.Printf("Error executing query (battery voltages): %s\nQuery: %s\n", err, query)
-			return
-		}
+func handleBatchMessage(deviceID string, payload []byte) {
+	batchData, err := decodeBatchJSON(payload)
+	if err != nil {
+		log.Println("Error parsing JSON payload (batch):", err)
+		return
 	}
+	log.Printf("Parsed JSON payload (batch): %d batteries, %d locations\n", len(batchData.Batteries), len(batchData.Locations))
 
-	err = tx.Commit(context.Background())
+	insertBatchData(deviceID, batchData)
+}
+
+func handleBatchBinaryMessage(deviceID string, payload []byte) {
+	batchData, err := decodeBatchBinary(payload)
 	if err != nil {
-		log.Println("Error committing PostgreSQL transaction (battery):", err)
+		log.Println("Error parsing binary payload (batch):", err)
 		return
 	}
+	log.Printf("Parsed binary payload (batch): %d batteries, %d locations\n", len(batchData.Batteries), len(batchData.Locations))
+
+	insertBatchData(deviceID, batchData)
 }
 
-func handleLocationMessage(payload []byte) {
-	log.Printf("JSON payload: %+v\n", string(payload))
-	var locationData LocationData
-	err := json.Unmarshal(payload, &locationData)
+func handleBatchSeriesMessage(deviceID string, payload []byte) {
+	batchData, err := decodeBatchSeries(payload)
 	if err != nil {
-		log.Println("Error parsing JSON payload (location):", err)
+		log.Println("Error parsing series payload (batch):", err)
 		return
 	}
-	log.Printf("Parsed JSON payload (battery): %+v\n", locationData)
+	log.Printf("Parsed series payload (batch): %d batteries, %d locations\n", len(batchData.Batteries), len(batchData.Locations))
+
+	insertBatchData(deviceID, batchData)
+}
+
+func insertBatchData(deviceID string, batchData BatchData) {
+	for _, batteryData := range batchData.Batteries {
+		batteryData.DeviceID = deviceID
+		storeBatteryData(batteryData)
+	}
+	for _, locationData := range batchData.Locations {
+		locationData.DeviceID = deviceID
+		storeLocationData(locationData)
+	}
+}
+
+// storeBatteryData hands a reading to the ingest stage, or inserts it right
+// away when the stage is disabled with INGEST_WORKERS=0. Readings whose
+// sequence number was already seen are dropped, see tracing.go; a reading
+// that is not stored after all is forgotten again.
+func storeBatteryData(batteryData BatteryData) {
+	batteryData.ReceivedAt = time.Now()
+	if stampedTooFarAhead(batteryData.Timestamp, batteryData.ReceivedAt) {
+		log.Printf("Dropping battery reading %d of boot %08x from %s stamped in the future: %s\n", batteryData.Sequence, batteryData.BootID, batteryData.DeviceID, batteryData.Timestamp)
+		return
+	}
+	if !traces.observe(batteryData.DeviceID, traceBattery, batteryData.BootID, batteryData.Sequence, batteryData.UptimeMs, batteryData.ReceivedAt) {
+		log.Printf("Dropping duplicate battery reading %d of boot %08x from %s\n", batteryData.Sequence, batteryData.BootID, batteryData.DeviceID)
+		return
+	}
+	if ingest == nil {
+		insertBatteryData(batteryData)
+		return
+	}
+	if err := ingest.submitBattery(batteryData); err != nil {
+		log.Println("Dropping battery reading:", err)
+		traces.forget([]BatteryData{batteryData}, nil)
+	}
+}
 
-	_, err = dbpool.Exec(context.Background(), `
-		INSERT INTO `+locationTable+` (latitude, longitude, timestamp)
-		VALUES ($1, $2, $3)
-	`, locationData.Latitude, locationData.Longitude, locationData.Timestamp)
+func storeLocationData(locationData LocationData) {
+	locationData.ReceivedAt = time.Now()
+	if stampedTooFarAhead(locationData.Timestamp, locationData.ReceivedAt) {
+		log.Printf("Dropping location reading %d of boot %08x from %s stamped in the future: %s\n", locationData.Sequence, locationData.BootID, locationData.DeviceID, locationData.Timestamp)
+		return
+	}
+	if !traces.observe(locationData.DeviceID, traceLocation, locationData.BootID, locationData.Sequence, locationData.UptimeMs, locationData.ReceivedAt) {
+		log.Printf("Dropping duplicate location reading %d of boot %08x from %s\n", locationData.Sequence, locationData.BootID, locationData.DeviceID)
+		return
+	}
+	if ingest == nil {
+		insertLocationData(locationData)
+		return
+	}
+	if err := ingest.submitLocation(locationData); err != nil {
+		log.Println("Dropping location reading:", err)
+		traces.forget(nil, []LocationData{locationData})
+	}
+}
 
+func insertLocationData(locationData LocationData) {
+	err := insertRecords(context.Background(), poolIngestDB{dbpool}, nil, []LocationData{locationData}, tripGap)
 	if err != nil {
 		log.Println("Error inserting data into PostgreSQL (location):", err)
+		traces.forget(nil, []LocationData{locationData})
 		return
 	}
+	traces.stored(nil, []LocationData{locationData}, time.Now())
 }
 
 func main() {
@@ -222,12 +341,48 @@ func main() {
 	mqttBroker := getEnvVar("MQTT_BROKER", "tcp://localhost:1883")
 	mqttUsername := getEnvVar("MQTT_USERNAME", "username")
 	mqttPassword := getEnvVar("MQTT_PASSWORD", "password")
+	// Instances of the aggregator share the subscriptions, so each needs its own client ID
+	hostname, _ := os.Hostname()
+	mqttClientID := getEnvVar("MQTT_CLIENT_ID", "go_mqtt_aggregator-"+hostname+"-"+strconv.Itoa(os.Getpid()))
+	mqttShareGroup := getEnvVar("MQTT_SHARE_GROUP", "aggregator")
 	postgresConn := getEnvVar("DATABASE_URL", "host=localhost user=postgres password=postgres dbname=database sslmode=disable")
 
 	dbpool = setupPostgres(postgresConn)
 	defer dbpool.Close()
 
-	client := setupMQTTClient(mqttBroker, mqttUsername, mqttPassword)
+	// Duplicate, gap and lag metrics, see tracing.go. An empty address turns the endpoint off
+	if metricsAddr := getEnvVar("METRICS_ADDR", "localhost:2112"); metricsAddr != "" {
+		go serveMetrics(metricsAddr, traces)
+	}
+
+	maxTimestampAhead = getEnvDuration("MAX_TIMESTAMP_AHEAD", maxTimestampAhead)
+	runPartitionMaintenance(getEnvInt("RETENTION_MONTHS", 0), getEnvDuration("PARTITION_MAINTENANCE_INTERVAL", 24*time.Hour))
+
+	tripGap = getEnvDuration("TRIP_GAP", tripGap)
+	ingestWorkers := getEnvInt("INGEST_WORKERS", 4)
+	if ingestWorkers > 0 {
+		ingest = newIngester(poolIngestDB{dbpool}, ingestConfig{
+			workers:        ingestWorkers,
+			batchSize:      getEnvInt("INGEST_BATCH_SIZE", 500),
+			flushInterval:  getEnvDuration("INGEST_FLUSH_INTERVAL", 200*time.Millisecond),
+			queueSize:      getEnvInt("INGEST_QUEUE_SIZE", 10000),
+			enqueueTimeout: getEnvDuration("INGEST_ENQUEUE_TIMEOUT", 5*time.Second),
+			tripGap:        tripGap,
+			flushRetries:   getEnvInt("INGEST_FLUSH_RETRIES", 3),
+			retryBackoff:   getEnvDuration("INGEST_RETRY_BACKOFF", 100*time.Millisecond),
+		})
+		// Runs after the MQTT client is disconnected, so nothing is queued anymore
+		defer ingest.close()
+
+		metricsInterval := getEnvDuration("INGEST_METRICS_INTERVAL", time.Minute)
+		go func() {
+			for range time.Tick(metricsInterval) {
+				ingest.logMetrics()
+			}
+		}()
+	}
+
+	client := setupMQTTClient(mqttBroker, mqttUsername, mqttPassword, mqttClientID, mqttShareGroup)
 	defer client.Disconnect(250)
 
 	log.Println("Press Ctrl+C to exit")
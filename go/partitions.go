@@ -0,0 +1,56 @@
+package main
+
+import (
+	"context"
+	"log"
+	"time"
+)
+
+// Monthly partitions of the reading tables (see the V5 migration) are
+// created a few months ahead, and months older than the retention are
+// dropped as a whole instead of deleting rows.
+
+const partitionsAhead = 3
+
+// maxTimestampAhead bounds how far past its arrival a reading may be
+// stamped (MAX_TIMESTAMP_AHEAD). Later ones come from a wrong device clock
+// and are rejected, in the default partition they would stay out of reach
+// of the retention and slow every month created after them.
+var maxTimestampAhead = time.Hour
+
+func stampedTooFarAhead(timestamp, receivedAt time.Time) bool {
+	return timestamp.Sub(receivedAt) > maxTimestampAhead
+}
+
+func maintainPartitions(ctx context.Context, retentionMonths int) {
+	_, err := dbpool.Exec(ctx, `SELECT create_reading_partitions(now()::date, $1)`, partitionsAhead)
+	if err != nil {
+		log.Println("Error creating reading partitions:", err)
+		return
+	}
+	if retentionMonths <= 0 {
+		return
+	}
+
+	var dropped int
+	err = dbpool.QueryRow(ctx, `
+		SELECT drop_reading_partitions((date_trunc('month', now()) - make_interval(months => $1))::date)
+	`, retentionMonths).Scan(&dropped)
+	if err != nil {
+		log.Println("Error dropping reading partitions:", err)
+		return
+	}
+	if dropped > 0 {
+		log.Printf("Dropped %d reading partitions older than %d months\n", dropped, retentionMonths)
+	}
+}
+
+// runPartitionMaintenance maintains the partitions now and then once per interval.
+func runPartitionMaintenance(retentionMonths int, interval time.Duration) {
+	maintainPartitions(context.Background(), retentionMonths)
+	go func() {
+		for range time.Tick(interval) {
+			maintainPartitions(context.Background(), retentionMonths)
+		}
+	}()
+}
@@ -0,0 +1,25 @@
+package main
+
+import (
+	"testing"
+	"time"
+)
+
+func TestStampedTooFarAhead(t *testing.T) {
+	received := time.Date(2024, 3, 10, 12, 0, 0, 0, time.UTC)
+	cases := []struct {
+		timestamp time.Time
+		want      bool
+	}{
+		{received.Add(-48 * time.Hour), false}, // Stored while offline
+		{received, false},
+		{received.Add(maxTimestampAhead), false},
+		{received.Add(maxTimestampAhead + time.Second), true},
+		{time.Date(2099, 1, 1, 0, 0, 0, 0, time.UTC), true},
+	}
+	for _, c := range cases {
+		if got := stampedTooFarAhead(c.timestamp, received); got != c.want {
+			t.Errorf("%s: %v, want %v", c.timestamp, got, c.want)
+		}
+	}
+}
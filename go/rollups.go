@@ -0,0 +1,180 @@
+package main
+
+import (
+	"context"
+	"fmt"
+	"sort"
+	"strings"
+	"time"
+)
+
+// Incremental maintenance of the battery rollups (see the V10 migration).
+//
+// Each ingest batch is reduced to one partial rollup per device and bucket,
+// which is merged into the 1 minute, 1 hour and 1 day tables with an upsert
+// in the batch's transaction. Within an instance the records of a device
+// always go to the same worker, but other instances may merge into the same
+// rows: ON CONFLICT serializes those merges, and rows are upserted in
+// (device_id, bucket) order so two batches wait on each other instead of
+// deadlocking.
+
+type rollupField struct {
+	column string
+	value  func(b *BatteryData) float32
+}
+
+var rollupFields = []rollupField{
+	{"soc", func(b *BatteryData) float32 { return b.Soc }},
+	{"pack_voltage", func(b *BatteryData) float32 { return b.PackVoltage }},
+	{"pack_current", func(b *BatteryData) float32 { return b.PackCurrent }},
+	{"cell_voltage_min", func(b *BatteryData) float32 { return b.CellVoltageMin }},
+	{"cell_voltage_max", func(b *BatteryData) float32 { return b.CellVoltageMax }},
+	{"bat_temp_max", func(b *BatteryData) float32 { return b.BatTempMax }},
+}
+
+type rollupTable struct {
+	name   string
+	width  time.Duration
+	upsert string
+}
+
+var rollupTables = []rollupTable{
+	{name: "battery_rollups_1m", width: time.Minute},
+	{name: "battery_rollups_1h", width: time.Hour},
+	{name: "battery_rollups_1d", width: 24 * time.Hour},
+}
+
+func init() {
+	for i := range rollupTables {
+		rollupTables[i].upsert = rollupUpsertSQL(rollupTables[i].name)
+	}
+}
+
+type rollupStats struct {
+	min, max, last float32
+	sum            float64
+}
+
+type batteryRollup struct {
+	deviceID string
+	bucket   time.Time
+	samples  int64
+	lastAt   time.Time
+	stats    []rollupStats // Indexed like rollupFields
+}
+
+// rollupBatteries reduces readings to one rollup per device and bucket of
+// the given width, buckets start at multiples of width since the epoch (UTC).
+// Rollups are sorted by device ID and bucket.
+func rollupBatteries(batteries []BatteryData, width time.Duration) []batteryRollup {
+	type key struct {
+		deviceID string
+		bucket   int64
+	}
+	index := map[key]int{}
+	var rollups []batteryRollup
+
+	for i := range batteries {
+		b := &batteries[i]
+		at := b.Timestamp.UTC()
+		bucket := at.Truncate(width)
+		k := key{b.DeviceID, bucket.Unix()}
+		n, ok := index[k]
+		if !ok {
+			n = len(rollups)
+			index[k] = n
+			rollups = append(rollups, batteryRollup{deviceID: b.DeviceID, bucket: bucket, stats: make([]rollupStats, len(rollupFields))})
+		}
+
+		r := &rollups[n]
+		newest := r.samples == 0 || !at.Before(r.lastAt)
+		for f, field := range rollupFields {
+			value := field.value(b)
+			s := &r.stats[f]
+			if r.samples == 0 || value < s.min {
+				s.min = value
+			}
+			if r.samples == 0 || value > s.max {
+				s.max = value
+			}
+			s.sum += float64(value)
+			if newest {
+				s.last = value
+			}
+		}
+		if newest {
+			r.lastAt = at
+		}
+		r.samples++
+	}
+
+	sort.Slice(rollups, func(i, j int) bool {
+		if rollups[i].deviceID != rollups[j].deviceID {
+			return rollups[i].deviceID < rollups[j].deviceID
+		}
+		return rollups[i].bucket.Before(rollups[j].bucket)
+	})
+	return rollups
+}
+
+// rollupUpsertSQL merges rows passed as one array per column into table:
+// samples and sums add up, min and max widen, last follows the newest reading.
+func rollupUpsertSQL(table string) string {
+	columns := []string{"device_id", "bucket", "samples", "last_at"}
+	types := []string{"text", "timestamp", "bigint", "timestamp"}
+	merges := []string{"samples = r.samples + EXCLUDED.samples", "last_at = greatest(r.last_at, EXCLUDED.last_at)"}
+	for _, field := range rollupFields {
+		c := field.column
+		columns = append(columns, c+"_min", c+"_max", c+"_sum", c+"_last")
+		types = append(types, "real", "real", "double precision", "real")
+		merges = append(merges,
+			fmt.Sprintf("%s_min = least(r.%s_min, EXCLUDED.%s_min)", c, c, c),
+			fmt.Sprintf("%s_max = greatest(r.%s_max, EXCLUDED.%s_max)", c, c, c),
+			fmt.Sprintf("%s_sum = r.%s_sum + EXCLUDED.%s_sum", c, c, c),
+			fmt.Sprintf("%s_last = CASE WHEN EXCLUDED.last_at >= r.last_at THEN EXCLUDED.%s_last ELSE r.%s_last END", c, c, c))
+	}
+
+	params := make([]string, len(columns))
+	for i := range columns {
+		params[i] = fmt.Sprintf("$%d::%s[]", i+1, types[i])
+	}
+	return fmt.Sprintf("INSERT INTO %s AS r (%s) SELECT * FROM unnest(%s) ON CONFLICT (device_id, bucket) DO UPDATE SET %s",
+		table, strings.Join(columns, ", "), strings.Join(params, ", "), strings.Join(merges, ", "))
+}
+
+// rollupArgs lays the rollups out as one array per column of rollupUpsertSQL.
+func rollupArgs(rollups []batteryRollup) []any {
+	deviceIDs := make([]string, len(rollups))
+	buckets := make([]time.Time, len(rollups))
+	samples := make([]int64, len(rollups))
+	lastAts := make([]time.Time, len(rollups))
+	args := []any{deviceIDs, buckets, samples, lastAts}
+	stats := make([][]float32, 3*len(rollupFields))
+	sums := make([][]float64, len(rollupFields))
+	for f := range rollupFields {
+		for j := 0; j < 3; j++ {
+			stats[3*f+j] = make([]float32, len(rollups))
+		}
+		sums[f] = make([]float64, len(rollups))
+		args = append(args, stats[3*f], stats[3*f+1], sums[f], stats[3*f+2])
+	}
+
+	for i := range rollups {
+		r := &rollups[i]
+		deviceIDs[i], buckets[i], samples[i], lastAts[i] = r.deviceID, r.bucket, r.samples, r.lastAt
+		for f, s := range r.stats {
+			stats[3*f][i], stats[3*f+1][i], sums[f][i], stats[3*f+2][i] = s.min, s.max, s.sum, s.last
+		}
+	}
+	return args
+}
+
+// upsertRollups merges a batch of readings into every rollup table.
+func upsertRollups(ctx context.Context, tx ingestTx, batteries []BatteryData) error {
+	for _, table := range rollupTables {
+		if _, err := tx.Exec(ctx, table.upsert, rollupArgs(rollupBatteries(batteries, table.width))...); err != nil {
+			return fmt.Errorf("%s: %w", table.name, err)
+		}
+	}
+	return nil
+}
@@ -0,0 +1,85 @@
+package main
+
+import (
+	"context"
+	"strings"
+	"testing"
+	"time"
+)
+
+func TestRollupBatteries(t *testing.T) {
+	start := time.Date(2024, 3, 10, 21, 59, 0, 0, time.UTC)
+	reading := func(device string, offset time.Duration, soc float32) BatteryData {
+		b := goldenBatteryData()
+		b.DeviceID = device
+		b.Timestamp = start.Add(offset)
+		b.Soc = soc
+		return b
+	}
+	// Out of order within the first minute, then across the hour
+	batteries := []BatteryData{
+		reading("bike-2", 20*time.Second, 50),
+		reading("bike-1", 30*time.Second, 80),
+		reading("bike-1", 70*time.Second, 77),
+		reading("bike-1", 50*time.Second, 78),
+		reading("bike-1", 10*time.Second, 90),
+	}
+
+	minutes := rollupBatteries(batteries, time.Minute)
+	if len(minutes) != 3 {
+		t.Fatalf("%d minute rollups", len(minutes))
+	}
+	first := minutes[0]
+	soc := first.stats[0]
+	if first.deviceID != "bike-1" || !first.bucket.Equal(start) || first.samples != 3 ||
+		!first.lastAt.Equal(start.Add(50*time.Second)) {
+		t.Fatalf("first minute %+v", first)
+	}
+	if soc.min != 78 || soc.max != 90 || soc.sum != 248 || soc.last != 78 {
+		t.Fatalf("first minute soc %+v", soc)
+	}
+	// Sorted by device and bucket, whatever the order of the readings
+	if minutes[1].samples != 1 || !minutes[1].bucket.Equal(start.Add(time.Minute)) || minutes[2].deviceID != "bike-2" {
+		t.Fatalf("minute rollups %+v", minutes)
+	}
+
+	hours := rollupBatteries(batteries, time.Hour)
+	if len(hours) != 3 || hours[0].samples != 3 || hours[1].samples != 1 || hours[1].bucket.Hour() != 22 {
+		t.Fatalf("hour rollups %+v", hours)
+	}
+	days := rollupBatteries(batteries, 24*time.Hour)
+	if len(days) != 2 || days[0].samples != 4 || days[0].stats[0].last != 77 ||
+		!days[0].bucket.Equal(time.Date(2024, 3, 10, 0, 0, 0, 0, time.UTC)) {
+		t.Fatalf("day rollups %+v", days)
+	}
+}
+
+func TestUpsertRollups(t *testing.T) {
+	tx := &fakeIngestTx{execs: map[string][][]any{}}
+	batteries := []BatteryData{goldenBatteryData(), goldenBatteryData()}
+	batteries[1].DeviceID = "bike-2"
+	if err := upsertRollups(context.Background(), tx, batteries); err != nil {
+		t.Fatal(err)
+	}
+	if len(tx.execs) != len(rollupTables) {
+		t.Fatalf("%d statements", len(tx.execs))
+	}
+
+	for _, table := range rollupTables {
+		calls := tx.execs[table.upsert]
+		if len(calls) != 1 || !strings.HasPrefix(table.upsert, "INSERT INTO "+table.name+" ") {
+			t.Fatalf("%s: %d calls", table.name, len(calls))
+		}
+		// One array per column, each with a row per device
+		args := calls[0]
+		if strings.Count(table.upsert, "::") != len(args) || len(args) != 4+4*len(rollupFields) {
+			t.Fatalf("%s: %d arguments for %s", table.name, len(args), table.upsert)
+		}
+		if ids := args[0].([]string); len(ids) != 2 || ids[1] != "bike-2" {
+			t.Fatalf("%s: device ids %v", table.name, ids)
+		}
+		if socMin := args[4].([]float32); socMin[0] != 80.5 {
+			t.Fatalf("%s: soc_min %v", table.name, socMin)
+		}
+	}
+}
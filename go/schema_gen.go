@@ -0,0 +1,296 @@
+// Code generated by go/schemagen from schema/telemetry.schema. DO NOT EDIT.
+
+package main
+
+import "time"
+
+const (
+	batteryTable  = "batteries"
+	locationTable = "locations"
+)
+
+// BatteryData is a BmsStatus published by the tracker.
+type BatteryData struct {
+	State           uint16    `json:"state"`
+	ChgEnable       bool      `json:"chg_enable"`
+	DisEnable       bool      `json:"dis_enable"`
+	ConnectedCells  uint16    `json:"connected_cells"`
+	CellVoltages    []float32 `json:"cell_voltages"`
+	CellVoltageMax  float32   `json:"cell_voltage_max"`
+	CellVoltageMin  float32   `json:"cell_voltage_min"`
+	CellVoltageAvg  float32   `json:"cell_voltage_avg"`
+	PackVoltage     float32   `json:"pack_voltage"`
+	StackVoltage    float32   `json:"stack_voltage"`
+	PackCurrent     float32   `json:"pack_current"`
+	BatTemps        []float32 `json:"bat_temps"`
+	BatTempMax      float32   `json:"bat_temp_max"`
+	BatTempMin      float32   `json:"bat_temp_min"`
+	BatTempAvg      float32   `json:"bat_temp_avg"`
+	MosfetTemp      float32   `json:"mosfet_temp"`
+	IcTemp          float32   `json:"ic_temp"`
+	McuTemp         float32   `json:"mcu_temp"`
+	IsFull          bool      `json:"full"`
+	IsEmpty         bool      `json:"empty"`
+	Soc             float32   `json:"soc"`
+	BalancingStatus uint32    `json:"balancing_status"`
+	NoIdleTimestamp time.Time `json:"no_idle_timestamp"`
+	ErrorFlags      uint32    `json:"error_flags"`
+	Timestamp       time.Time `json:"timestamp"`
+	BootID          uint32    `json:"boot_id"` // 0 from firmware without tracing
+	Sequence        uint32    `json:"sequence"`
+	UptimeMs        int64     `json:"uptime_ms"`
+	DeviceID        string    `json:"-"` // From the topic
+	ReceivedAt      time.Time `json:"-"`
+}
+
+// batteryColumns are the columns of batteries that batteryRow fills, in its order.
+var batteryColumns = []string{
+	"state",
+	"chg_enable",
+	"dis_enable",
+	"connected_cells",
+	"cell_voltages",
+	"cell_voltage_max",
+	"cell_voltage_min",
+	"cell_voltage_avg",
+	"pack_voltage",
+	"stack_voltage",
+	"pack_current",
+	"bat_temps",
+	"bat_temp_max",
+	"bat_temp_min",
+	"bat_temp_avg",
+	"mosfet_temp",
+	"ic_temp",
+	"mcu_temp",
+	"is_full",
+	"is_empty",
+	"soc",
+	"balancing_status",
+	"no_idle_timestamp",
+	"error_flags",
+	"timestamp",
+	"device_id",
+}
+
+func batteryRow(b *BatteryData) []any {
+	return []any{
+		b.State,
+		b.ChgEnable,
+		b.DisEnable,
+		b.ConnectedCells,
+		b.CellVoltages,
+		b.CellVoltageMax,
+		b.CellVoltageMin,
+		b.CellVoltageAvg,
+		b.PackVoltage,
+		b.StackVoltage,
+		b.PackCurrent,
+		b.BatTemps,
+		b.BatTempMax,
+		b.BatTempMin,
+		b.BatTempAvg,
+		b.MosfetTemp,
+		b.IcTemp,
+		b.McuTemp,
+		b.IsFull,
+		b.IsEmpty,
+		b.Soc,
+		b.BalancingStatus,
+		b.NoIdleTimestamp,
+		b.ErrorFlags,
+		b.Timestamp,
+		b.DeviceID,
+	}
+}
+
+// decodeBatteryJSON decodes the payload of convertBmsStatusToJSON.
+func decodeBatteryJSON(data []byte) (BatteryData, error) {
+	d := jsonDecoder{data: data}
+	var b BatteryData
+	d.battery(&b)
+	return b, d.end()
+}
+
+func (d *jsonDecoder) battery(b *BatteryData) {
+	if !d.object() {
+		return
+	}
+	for first := true; d.next(first); first = false {
+		if !d.batteryField(b, d.key) && !d.batteryField(b, foldKey(d.key, batteryKeys)) {
+			d.skip()
+		}
+	}
+}
+
+var batteryKeys = []string{
+	"state",
+	"chg_enable",
+	"dis_enable",
+	"connected_cells",
+	"cell_voltages",
+	"cell_voltage_max",
+	"cell_voltage_min",
+	"cell_voltage_avg",
+	"pack_voltage",
+	"stack_voltage",
+	"pack_current",
+	"bat_temps",
+	"bat_temp_max",
+	"bat_temp_min",
+	"bat_temp_avg",
+	"mosfet_temp",
+	"ic_temp",
+	"mcu_temp",
+	"full",
+	"empty",
+	"soc",
+	"balancing_status",
+	"no_idle_timestamp",
+	"error_flags",
+	"timestamp",
+	"boot_id",
+	"sequence",
+	"uptime_ms",
+}
+
+func (d *jsonDecoder) batteryField(b *BatteryData, key []byte) bool {
+	switch string(key) {
+	case "state":
+		d.uint16(&b.State)
+	case "chg_enable":
+		d.bool(&b.ChgEnable)
+	case "dis_enable":
+		d.bool(&b.DisEnable)
+	case "connected_cells":
+		d.uint16(&b.ConnectedCells)
+	case "cell_voltages":
+		d.float32s(&b.CellVoltages)
+	case "cell_voltage_max":
+		d.float32(&b.CellVoltageMax)
+	case "cell_voltage_min":
+		d.float32(&b.CellVoltageMin)
+	case "cell_voltage_avg":
+		d.float32(&b.CellVoltageAvg)
+	case "pack_voltage":
+		d.float32(&b.PackVoltage)
+	case "stack_voltage":
+		d.float32(&b.StackVoltage)
+	case "pack_current":
+		d.float32(&b.PackCurrent)
+	case "bat_temps":
+		d.float32s(&b.BatTemps)
+	case "bat_temp_max":
+		d.float32(&b.BatTempMax)
+	case "bat_temp_min":
+		d.float32(&b.BatTempMin)
+	case "bat_temp_avg":
+		d.float32(&b.BatTempAvg)
+	case "mosfet_temp":
+		d.float32(&b.MosfetTemp)
+	case "ic_temp":
+		d.float32(&b.IcTemp)
+	case "mcu_temp":
+		d.float32(&b.McuTemp)
+	case "full":
+		d.bool(&b.IsFull)
+	case "empty":
+		d.bool(&b.IsEmpty)
+	case "soc":
+		d.float32(&b.Soc)
+	case "balancing_status":
+		d.uint32(&b.BalancingStatus)
+	case "no_idle_timestamp":
+		d.time(&b.NoIdleTimestamp)
+	case "error_flags":
+		d.uint32(&b.ErrorFlags)
+	case "timestamp":
+		d.time(&b.Timestamp)
+	case "boot_id":
+		d.uint32(&b.BootID)
+	case "sequence":
+		d.uint32(&b.Sequence)
+	case "uptime_ms":
+		d.int64(&b.UptimeMs)
+	default:
+		return false
+	}
+	return true
+}
+
+// LocationData is a Location published by the tracker.
+type LocationData struct {
+	Latitude   float64   `json:"latitude"`
+	Longitude  float64   `json:"longitude"`
+	Timestamp  time.Time `json:"timestamp"`
+	BootID     uint32    `json:"boot_id"` // 0 from firmware without tracing
+	Sequence   uint32    `json:"sequence"`
+	UptimeMs   int64     `json:"uptime_ms"`
+	DeviceID   string    `json:"-"` // From the topic
+	ReceivedAt time.Time `json:"-"`
+}
+
+// locationColumns are the columns of locations that locationRow fills, in its order.
+var locationColumns = []string{
+	"latitude",
+	"longitude",
+	"timestamp",
+	"device_id",
+}
+
+func locationRow(l *LocationData) []any {
+	return []any{
+		l.Latitude,
+		l.Longitude,
+		l.Timestamp,
+		l.DeviceID,
+	}
+}
+
+// decodeLocationJSON decodes the payload of convertLocationToJSON.
+func decodeLocationJSON(data []byte) (LocationData, error) {
+	d := jsonDecoder{data: data}
+	var l LocationData
+	d.location(&l)
+	return l, d.end()
+}
+
+func (d *jsonDecoder) location(l *LocationData) {
+	if !d.object() {
+		return
+	}
+	for first := true; d.next(first); first = false {
+		if !d.locationField(l, d.key) && !d.locationField(l, foldKey(d.key, locationKeys)) {
+			d.skip()
+		}
+	}
+}
+
+var locationKeys = []string{
+	"latitude",
+	"longitude",
+	"timestamp",
+	"boot_id",
+	"sequence",
+	"uptime_ms",
+}
+
+func (d *jsonDecoder) locationField(l *LocationData, key []byte) bool {
+	switch string(key) {
+	case "latitude":
+		d.float64(&l.Latitude)
+	case "longitude":
+		d.float64(&l.Longitude)
+	case "timestamp":
+		d.time(&l.Timestamp)
+	case "boot_id":
+		d.uint32(&l.BootID)
+	case "sequence":
+		d.uint32(&l.Sequence)
+	case "uptime_ms":
+		d.int64(&l.UptimeMs)
+	default:
+		return false
+	}
+	return true
+}
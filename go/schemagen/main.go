@@ -0,0 +1,327 @@
+// Command schemagen generates the telemetry message code of the tracker, the
+// aggregator and the database from schema/telemetry.schema:
+//
+//	go run ./schemagen -schema ../schema/telemetry.schema \
+//		-c ../esp/main/telemetry_json_gen.inc -go schema_gen.go -sql ../schema/telemetry.sql
+//
+// The C encoders write every key with its separators as one literal and
+// call the writer of the field's type directly, the Go decoders switch on
+// the key and parse the value into the field, neither looks anything up at
+// runtime.
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"flag"
+	"fmt"
+	"go/format"
+	"io"
+	"log"
+	"os"
+	"strings"
+)
+
+type field struct {
+	name    string // C struct field and JSON key
+	kind    string // bool, u16, u32, i64, f32, f64, f32s or time
+	length  string // C array length of f32s
+	goName  string
+	column  string // Empty when not stored
+	comment string
+}
+
+type message struct {
+	cName  string
+	goName string
+	table  string
+	key    string
+	fields []field
+}
+
+func parseSchema(r io.Reader) ([]*message, error) {
+	var messages []*message
+	scanner := bufio.NewScanner(r)
+	for line := 1; scanner.Scan(); line++ {
+		text, comment, _ := strings.Cut(scanner.Text(), "//")
+		text, _, _ = strings.Cut(text, "#")
+		words := strings.Fields(text)
+		if len(words) == 0 {
+			continue
+		}
+		fail := func(format string, args ...any) error {
+			return fmt.Errorf("line %d: %s", line, fmt.Sprintf(format, args...))
+		}
+
+		if words[0] == "message" {
+			if len(words) != 5 {
+				return nil, fail("want message <C struct> <Go struct> <table> <key column>")
+			}
+			messages = append(messages, &message{cName: words[1], goName: words[2], table: words[3], key: words[4]})
+			continue
+		}
+		if len(messages) == 0 {
+			return nil, fail("field %s outside a message", words[0])
+		}
+		if len(words) < 2 {
+			return nil, fail("field %s has no type", words[0])
+		}
+
+		f := field{name: words[0], goName: camelCase(words[0]), column: words[0], comment: strings.TrimSpace(comment)}
+		switch kind := words[1]; {
+		case kind == "bool" || kind == "u16" || kind == "u32" || kind == "i64" || kind == "f32" || kind == "time":
+			f.kind = kind
+		case kind == "f32:f64":
+			f.kind = "f64"
+		case strings.HasPrefix(kind, "f32[") && strings.HasSuffix(kind, "]") && len(kind) > 5:
+			f.kind, f.length = "f32s", kind[4:len(kind)-1]
+		default:
+			return nil, fail("field %s has unknown type %s", f.name, kind)
+		}
+		for _, option := range words[2:] {
+			name, value, _ := strings.Cut(option, "=")
+			switch {
+			case name == "go" && value != "":
+				f.goName = value
+			case name == "column" && value == "-":
+				f.column = ""
+			case name == "column" && value != "":
+				f.column = value
+			default:
+				return nil, fail("field %s has unknown option %s", f.name, option)
+			}
+		}
+
+		m := messages[len(messages)-1]
+		for _, other := range m.fields {
+			if other.name == f.name || other.goName == f.goName || (f.column != "" && other.column == f.column) {
+				return nil, fail("field %s repeats a name of %s", f.name, other.name)
+			}
+		}
+		m.fields = append(m.fields, f)
+	}
+	if err := scanner.Err(); err != nil {
+		return nil, err
+	}
+	for _, m := range messages {
+		if len(m.fields) == 0 {
+			return nil, fmt.Errorf("message %s has no fields", m.cName)
+		}
+	}
+	return messages, nil
+}
+
+func camelCase(name string) string {
+	var b strings.Builder
+	for _, word := range strings.Split(name, "_") {
+		if word != "" {
+			b.WriteString(strings.ToUpper(word[:1]) + word[1:])
+		}
+	}
+	return b.String()
+}
+
+// battery for BatteryData, the prefix of the generated Go names
+func (m *message) prefix() string {
+	name := strings.TrimSuffix(m.goName, "Data")
+	return strings.ToLower(name[:1]) + name[1:]
+}
+
+// status for BmsStatus, the parameter of the C encoder
+func (m *message) param() string {
+	name := m.cName
+	for i := len(name) - 1; i > 0; i-- {
+		if name[i] >= 'A' && name[i] <= 'Z' {
+			name = name[i:]
+			break
+		}
+	}
+	return strings.ToLower(name[:1]) + name[1:]
+}
+
+const header = "Code generated by go/schemagen from schema/telemetry.schema. DO NOT EDIT."
+
+var cTypes = map[string]string{
+	"bool": "bool", "u16": "uint16_t", "u32": "uint32_t", "i64": "int64_t",
+	"f32": "float", "f64": "float", "time": "time_t",
+}
+
+var cWriters = map[string]string{
+	"bool": "json_put_bool", "u16": "json_put_number", "u32": "json_put_number", "i64": "json_put_number",
+	"f32": "json_put_number", "f64": "json_put_number", "time": "json_put_timestamp",
+}
+
+func generateC(w io.Writer, messages []*message) {
+	fmt.Fprintf(w, "// %s\n", header)
+	fmt.Fprintf(w, "//\n// Included by telemetry_json.c, which defines JsonWriter and the json_put_*\n")
+	fmt.Fprintf(w, "// writers. A field that does not match the schema fails the build.\n")
+	for _, m := range messages {
+		fmt.Fprintln(w)
+		for _, f := range m.fields {
+			cType := cTypes[f.kind]
+			if f.kind == "f32s" {
+				cType = "float[" + f.length + "]"
+			}
+			fmt.Fprintf(w, "_Static_assert(sizeof(((%s *)0)->%s) == sizeof(%s), \"%s.%s is %s\");\n",
+				m.cName, f.name, cType, m.cName, f.name, cType)
+		}
+
+		param := m.param()
+		fmt.Fprintf(w, "\nsize_t convert%sToJSON(const %s *%s, char *buffer, size_t size)\n{\n", m.cName, m.cName, param)
+		fmt.Fprintf(w, "    JsonWriter writer = {.buffer = buffer, .size = size};\n\n")
+		for i, f := range m.fields {
+			key := `"` + f.name + `":`
+			if i == 0 {
+				key = "{" + key
+			} else {
+				key = "," + key
+			}
+			fmt.Fprintf(w, "    json_put_raw(&writer, %q, %d);\n", key, len(key))
+			if f.kind == "f32s" {
+				fmt.Fprintf(w, "    json_put_float_array(&writer, %s->%s, %s);\n", param, f.name, f.length)
+			} else {
+				fmt.Fprintf(w, "    %s(&writer, %s->%s);\n", cWriters[f.kind], param, f.name)
+			}
+		}
+		fmt.Fprintf(w, "\n    return json_finish(&writer);\n}\n")
+	}
+}
+
+var goTypes = map[string]string{
+	"bool": "bool", "u16": "uint16", "u32": "uint32", "i64": "int64",
+	"f32": "float32", "f64": "float64", "f32s": "[]float32", "time": "time.Time",
+}
+
+// Methods of jsonDecoder in jsondecode.go
+var goReaders = map[string]string{
+	"bool": "bool", "u16": "uint16", "u32": "uint32", "i64": "int64",
+	"f32": "float32", "f64": "float64", "f32s": "float32s", "time": "time",
+}
+
+func generateGo(w io.Writer, messages []*message) error {
+	var b bytes.Buffer
+	fmt.Fprintf(&b, "// %s\n\npackage main\n\nimport \"time\"\n\nconst (\n", header)
+	for _, m := range messages {
+		fmt.Fprintf(&b, "%sTable = %q\n", m.prefix(), m.table)
+	}
+	fmt.Fprintf(&b, ")\n")
+
+	for _, m := range messages {
+		prefix, receiver := m.prefix(), m.prefix()[:1]
+
+		fmt.Fprintf(&b, "\n// %s is a %s published by the tracker.\ntype %s struct {\n", m.goName, m.cName, m.goName)
+		for _, f := range m.fields {
+			fmt.Fprintf(&b, "%s %s `json:%q`", f.goName, goTypes[f.kind], f.name)
+			if f.comment != "" {
+				fmt.Fprintf(&b, " // %s", f.comment)
+			}
+			fmt.Fprintln(&b)
+		}
+		fmt.Fprintf(&b, "DeviceID string `json:\"-\"` // From the topic\nReceivedAt time.Time `json:\"-\"`\n}\n")
+
+		fmt.Fprintf(&b, "\n// %sColumns are the columns of %s that %sRow fills, in its order.\n", prefix, m.table, prefix)
+		fmt.Fprintf(&b, "var %sColumns = []string{\n", prefix)
+		for _, f := range m.fields {
+			if f.column != "" {
+				fmt.Fprintf(&b, "%q,\n", f.column)
+			}
+		}
+		fmt.Fprintf(&b, "\"device_id\",\n}\n\nfunc %sRow(%s *%s) []any {\nreturn []any{\n", prefix, receiver, m.goName)
+		for _, f := range m.fields {
+			if f.column != "" {
+				fmt.Fprintf(&b, "%s.%s,\n", receiver, f.goName)
+			}
+		}
+		fmt.Fprintf(&b, "%s.DeviceID,\n}\n}\n", receiver)
+
+		fmt.Fprintf(&b, "\n// decode%sJSON decodes the payload of convert%sToJSON.\n", strings.TrimSuffix(m.goName, "Data"), m.cName)
+		fmt.Fprintf(&b, "func decode%sJSON(data []byte) (%s, error) {\n", strings.TrimSuffix(m.goName, "Data"), m.goName)
+		fmt.Fprintf(&b, "d := jsonDecoder{data: data}\nvar %s %s\nd.%s(&%s)\nreturn %s, d.end()\n}\n", receiver, m.goName, prefix, receiver, receiver)
+
+		fmt.Fprintf(&b, "\nfunc (d *jsonDecoder) %s(%s *%s) {\n", prefix, receiver, m.goName)
+		fmt.Fprintf(&b, "if !d.object() {\nreturn\n}\nfor first := true; d.next(first); first = false {\n")
+		fmt.Fprintf(&b, "if !d.%sField(%s, d.key) && !d.%sField(%s, foldKey(d.key, %sKeys)) {\n", prefix, receiver, prefix, receiver, prefix)
+		fmt.Fprintf(&b, "d.skip()\n}\n}\n}\n")
+
+		fmt.Fprintf(&b, "\nvar %sKeys = []string{\n", prefix)
+		for _, f := range m.fields {
+			fmt.Fprintf(&b, "%q,\n", f.name)
+		}
+		fmt.Fprintf(&b, "}\n\nfunc (d *jsonDecoder) %sField(%s *%s, key []byte) bool {\nswitch string(key) {\n", prefix, receiver, m.goName)
+		for _, f := range m.fields {
+			fmt.Fprintf(&b, "case %q:\nd.%s(&%s.%s)\n", f.name, goReaders[f.kind], receiver, f.goName)
+		}
+		fmt.Fprintf(&b, "default:\nreturn false\n}\nreturn true\n}\n")
+	}
+
+	source, err := format.Source(b.Bytes())
+	if err != nil {
+		return err
+	}
+	_, err = w.Write(source)
+	return err
+}
+
+var sqlTypes = map[string]string{
+	"bool": "BOOLEAN", "u16": "INTEGER", "u32": "BIGINT", "i64": "BIGINT",
+	"f32": "FLOAT", "f64": "DOUBLE PRECISION", "f32s": "REAL[]", "time": "TIMESTAMP",
+}
+
+func generateSQL(w io.Writer, messages []*message) {
+	fmt.Fprintf(w, "-- %s\n--\n", header)
+	fmt.Fprintf(w, "-- Columns of the reading tables as the aggregator copies them. Flyway\n")
+	fmt.Fprintf(w, "-- migrations are never edited, a migration that changes these tables\n")
+	fmt.Fprintf(w, "-- brings them to this definition. Partitions, indexes and the columns\n")
+	fmt.Fprintf(w, "-- computed by the database are left to the migrations.\n")
+	for _, m := range messages {
+		fmt.Fprintf(w, "\nCREATE TABLE %s (\n   %s BIGINT NOT NULL,\n", m.table, m.key)
+		for _, f := range m.fields {
+			if f.column == "" {
+				continue
+			}
+			fmt.Fprintf(w, "   %s %s NOT NULL", f.column, sqlTypes[f.kind])
+			if f.kind == "f32s" {
+				fmt.Fprintf(w, " DEFAULT '{}'")
+			}
+			fmt.Fprintf(w, ",\n")
+		}
+		fmt.Fprintf(w, "   device_id TEXT,\n   PRIMARY KEY (%s, timestamp)\n) PARTITION BY RANGE (timestamp);\n", m.key)
+	}
+}
+
+func generate(schema io.Reader) (c, goSource, sql []byte, err error) {
+	messages, err := parseSchema(schema)
+	if err != nil {
+		return nil, nil, nil, err
+	}
+	var cOut, goOut, sqlOut bytes.Buffer
+	generateC(&cOut, messages)
+	if err := generateGo(&goOut, messages); err != nil {
+		return nil, nil, nil, err
+	}
+	generateSQL(&sqlOut, messages)
+	return cOut.Bytes(), goOut.Bytes(), sqlOut.Bytes(), nil
+}
+
+func main() {
+	schemaPath := flag.String("schema", "../schema/telemetry.schema", "field schema")
+	cPath := flag.String("c", "../esp/main/telemetry_json_gen.inc", "C encoders")
+	goPath := flag.String("go", "schema_gen.go", "Go structs and decoders")
+	sqlPath := flag.String("sql", "../schema/telemetry.sql", "SQL table definitions")
+	flag.Parse()
+
+	schema, err := os.Open(*schemaPath)
+	if err != nil {
+		log.Fatal(err)
+	}
+	defer schema.Close()
+	c, goSource, sql, err := generate(schema)
+	if err != nil {
+		log.Fatalf("%s: %v", *schemaPath, err)
+	}
+	for path, content := range map[string][]byte{*cPath: c, *goPath: goSource, *sqlPath: sql} {
+		if err := os.WriteFile(path, content, 0o644); err != nil {
+			log.Fatal(err)
+		}
+	}
+}
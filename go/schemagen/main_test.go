@@ -0,0 +1,51 @@
+package main
+
+import (
+	"bytes"
+	"os"
+	"strings"
+	"testing"
+)
+
+// The generated files are checked in, so the tracker builds without Go
+func TestGeneratedFilesUpToDate(t *testing.T) {
+	schema, err := os.Open("../../schema/telemetry.schema")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer schema.Close()
+	c, goSource, sql, err := generate(schema)
+	if err != nil {
+		t.Fatal(err)
+	}
+	for path, want := range map[string][]byte{
+		"../../esp/main/telemetry_json_gen.inc": c,
+		"../schema_gen.go":                      goSource,
+		"../../schema/telemetry.sql":            sql,
+	} {
+		got, err := os.ReadFile(path)
+		if err != nil {
+			t.Fatal(err)
+		}
+		if !bytes.Equal(got, want) {
+			t.Errorf("%s is out of date, run go generate", path)
+		}
+	}
+}
+
+func TestParseSchemaErrors(t *testing.T) {
+	for _, schema := range []string{
+		"state u16",
+		"message BmsStatus BatteryData batteries",
+		"message BmsStatus BatteryData batteries battery_id\nstate",
+		"message BmsStatus BatteryData batteries battery_id\nstate u8",
+		"message BmsStatus BatteryData batteries battery_id\nstate u16 sql=x",
+		"message BmsStatus BatteryData batteries battery_id\nstate u16\nstate u32",
+		"message BmsStatus BatteryData batteries battery_id\nfull bool column=state\nstate u16",
+		"message BmsStatus BatteryData batteries battery_id",
+	} {
+		if _, err := parseSchema(strings.NewReader(schema)); err == nil {
+			t.Errorf("%q accepted", schema)
+		}
+	}
+}
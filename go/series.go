@@ -0,0 +1,246 @@
+package main
+
+import (
+	"errors"
+	"fmt"
+	"math"
+	"time"
+)
+
+// Decoder for the columnar time-series batches produced by
+// esp/main/telemetry_series.c: delta-of-delta timestamps, XOR-coded floats
+// and repeat-coded integers, one column per field, in an MSB-first bit stream.
+
+const seriesVersion = 2 // Version 1 has no boot_id, sequence and uptime_ms columns
+
+var errSeriesTruncated = errors.New("truncated series payload")
+
+type bitReader struct {
+	payload []byte
+	bit     int
+	err     error
+}
+
+func (r *bitReader) bits(count int) uint64 {
+	if r.err != nil || r.bit+count > len(r.payload)*8 {
+		r.err = errSeriesTruncated
+		return 0
+	}
+	var value uint64
+	for count > 0 {
+		used := r.bit % 8
+		take := min(8-used, count)
+		chunk := (r.payload[r.bit/8] >> (8 - used - take)) & (1<<take - 1)
+		value = value<<take | uint64(chunk)
+		r.bit += take
+		count -= take
+	}
+	return value
+}
+
+type floatColumn struct {
+	previous uint32
+	leading  int
+	trailing int
+	started  bool
+	window   bool
+}
+
+func (c *floatColumn) next(r *bitReader) float32 {
+	switch {
+	case !c.started:
+		c.previous = uint32(r.bits(32))
+		c.started = true
+	case r.bits(1) == 0:
+		// Unchanged
+	case r.bits(1) == 0:
+		if !c.window {
+			r.err = errors.New("series float reuses a window before defining one")
+			return 0
+		}
+		c.previous ^= uint32(r.bits(32-c.leading-c.trailing)) << c.trailing
+	default:
+		leading := int(r.bits(5))
+		meaningful := int(r.bits(5)) + 1
+		if leading+meaningful > 32 {
+			r.err = errors.New("series float window out of range")
+			return 0
+		}
+		c.leading, c.trailing, c.window = leading, 32-leading-meaningful, true
+		c.previous ^= uint32(r.bits(meaningful)) << c.trailing
+	}
+	return math.Float32frombits(c.previous)
+}
+
+type timeColumn struct {
+	previous int64
+	delta    int64
+	started  bool
+}
+
+var seriesTimeWidths = [...]int{0, 7, 9, 12, 64}
+
+func (c *timeColumn) next(r *bitReader) time.Time {
+	return time.Unix(c.nextInt(r), 0).UTC()
+}
+
+// nextInt decodes a delta-of-delta column of plain integers (sequence, uptime_ms).
+func (c *timeColumn) nextInt(r *bitReader) int64 {
+	if !c.started {
+		c.previous = int64(r.bits(64))
+		c.started = true
+	} else {
+		prefix := 0
+		for prefix < 4 && r.bits(1) == 1 {
+			prefix++
+		}
+		dod := r.bits(seriesTimeWidths[prefix])
+		c.delta += int64(dod>>1) ^ -int64(dod&1)
+		c.previous += c.delta
+	}
+	return c.previous
+}
+
+type intColumn struct {
+	previous uint32
+	started  bool
+}
+
+func (c *intColumn) next(r *bitReader, width int) uint32 {
+	if !c.started || r.bits(1) == 1 {
+		c.previous = uint32(r.bits(width))
+		c.started = true
+	}
+	return c.previous
+}
+
+func decodeBatchSeries(payload []byte) (BatchData, error) {
+	var batch BatchData
+	if len(payload) < 4 {
+		return batch, errSeriesTruncated
+	}
+	version := payload[0]
+	if version < 1 || version > seriesVersion {
+		return batch, fmt.Errorf("unsupported series payload version %d", version)
+	}
+	batteries := make([]BatteryData, payload[1])
+	locations := make([]LocationData, payload[2])
+	thermistors := int(payload[3])
+	r := bitReader{payload: payload[4:]}
+
+	var times [2]timeColumn
+	for i := range batteries {
+		batteries[i].Timestamp = times[0].next(&r)
+	}
+	for i := range batteries {
+		batteries[i].NoIdleTimestamp = times[1].next(&r)
+	}
+
+	var ints [5]intColumn
+	for i := range batteries {
+		batteries[i].State = uint16(ints[0].next(&r, 16))
+	}
+	for i := range batteries {
+		flags := ints[1].next(&r, 4)
+		batteries[i].ChgEnable = flags&binaryFlagChgEnable != 0
+		batteries[i].DisEnable = flags&binaryFlagDisEnable != 0
+		batteries[i].IsFull = flags&binaryFlagFull != 0
+		batteries[i].IsEmpty = flags&binaryFlagEmpty != 0
+	}
+	maxCells := 0
+	for i := range batteries {
+		batteries[i].ConnectedCells = uint16(ints[2].next(&r, 8))
+		batteries[i].CellVoltages = make([]float32, batteries[i].ConnectedCells)
+		batteries[i].BatTemps = make([]float32, thermistors)
+		maxCells = max(maxCells, int(batteries[i].ConnectedCells))
+	}
+	for i := range batteries {
+		batteries[i].BalancingStatus = ints[3].next(&r, 32)
+	}
+	for i := range batteries {
+		batteries[i].ErrorFlags = ints[4].next(&r, 32)
+	}
+
+	for cell := 0; cell < maxCells; cell++ {
+		var column floatColumn
+		for i := range batteries {
+			if int(batteries[i].ConnectedCells) > cell {
+				batteries[i].CellVoltages[cell] = column.next(&r)
+			}
+		}
+	}
+	for thermistor := 0; thermistor < thermistors; thermistor++ {
+		var column floatColumn
+		for i := range batteries {
+			batteries[i].BatTemps[thermistor] = column.next(&r)
+		}
+	}
+
+	// Same order as statusFloatFields in telemetry_series.c
+	fields := []func(*BatteryData) *float32{
+		func(b *BatteryData) *float32 { return &b.CellVoltageMax },
+		func(b *BatteryData) *float32 { return &b.CellVoltageMin },
+		func(b *BatteryData) *float32 { return &b.CellVoltageAvg },
+		func(b *BatteryData) *float32 { return &b.PackVoltage },
+		func(b *BatteryData) *float32 { return &b.StackVoltage },
+		func(b *BatteryData) *float32 { return &b.PackCurrent },
+		func(b *BatteryData) *float32 { return &b.BatTempMax },
+		func(b *BatteryData) *float32 { return &b.BatTempMin },
+		func(b *BatteryData) *float32 { return &b.BatTempAvg },
+		func(b *BatteryData) *float32 { return &b.MosfetTemp },
+		func(b *BatteryData) *float32 { return &b.IcTemp },
+		func(b *BatteryData) *float32 { return &b.McuTemp },
+		func(b *BatteryData) *float32 { return &b.Soc },
+	}
+	for _, field := range fields {
+		var column floatColumn
+		for i := range batteries {
+			*field(&batteries[i]) = column.next(&r)
+		}
+	}
+	if version >= 2 {
+		var bootIDs intColumn
+		var sequences, uptimes timeColumn
+		for i := range batteries {
+			batteries[i].BootID = bootIDs.next(&r, 32)
+		}
+		for i := range batteries {
+			batteries[i].Sequence = uint32(sequences.nextInt(&r))
+		}
+		for i := range batteries {
+			batteries[i].UptimeMs = uptimes.nextInt(&r)
+		}
+	}
+
+	var locationTimes timeColumn
+	var latitudes, longitudes floatColumn
+	for i := range locations {
+		locations[i].Timestamp = locationTimes.next(&r)
+	}
+	for i := range locations {
+		locations[i].Latitude = float64(latitudes.next(&r))
+	}
+	for i := range locations {
+		locations[i].Longitude = float64(longitudes.next(&r))
+	}
+	if version >= 2 {
+		var bootIDs intColumn
+		var sequences, uptimes timeColumn
+		for i := range locations {
+			locations[i].BootID = bootIDs.next(&r, 32)
+		}
+		for i := range locations {
+			locations[i].Sequence = uint32(sequences.nextInt(&r))
+		}
+		for i := range locations {
+			locations[i].UptimeMs = uptimes.nextInt(&r)
+		}
+	}
+
+	if r.err != nil {
+		return batch, r.err
+	}
+	batch.Batteries = batteries
+	batch.Locations = locations
+	return batch, nil
+}
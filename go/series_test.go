@@ -0,0 +1,77 @@
+package main
+
+import (
+	"reflect"
+	"testing"
+	"time"
+)
+
+// Produced by convertBatchToSeries for three variations of the golden
+// BmsStatus and two of the golden Location, see checkBatchSeries. The
+// version 1 batch is from firmware before boot_id, sequence and uptime_ms.
+const (
+	goldenBatchSeries   = "02030202000000006553f10a8a000000001954fc4000003240440acb4178000000000540000001d01b333379ae3c79370bd40700000101cccccc8100000041ac0000106c0000040800000101b3333440740000105d000004174cccd30080000041b00000106b0000041ae0000107c0000041f8000010800000042a10000de0ea2ffbd5b7dde0000000000000015408000000000a4cb8f7e0000000000009c40000000006553f1008b211ba147fa24d05fed775bd5b7dde0000000000000007810000000002931a7878000000000002af80"
+	goldenBatchSeriesV1 = "01030202000000006553f10a8a000000001954fc4000003240440acb4178000000000540000001d01b333379ae3c79370bd40700000101cccccc8100000041ac0000106c0000040800000101b3333440740000105d000004174cccd30080000041b00000106b0000041ae0000107c0000041f8000010800000042a10000de0ea2fe00000000caa7e201164237428ff449a0bfdaee8"
+)
+
+func TestDecodeBatchSeries(t *testing.T) {
+	checkBatchSeries(t, goldenBatchSeries, true)
+}
+
+func TestDecodeBatchSeriesVersion1(t *testing.T) {
+	checkBatchSeries(t, goldenBatchSeriesV1, false)
+}
+
+func checkBatchSeries(t *testing.T, golden string, traced bool) {
+	t.Helper()
+	payload := mustDecodeHex(t, golden)
+
+	got, err := decodeBatchSeries(payload)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	if len(got.Batteries) != 3 {
+		t.Fatalf("decoded %d batteries", len(got.Batteries))
+	}
+	for i, battery := range got.Batteries {
+		want := goldenBatteryData()
+		if !traced {
+			want = untracedBatteryData()
+		}
+		want.Timestamp = want.Timestamp.Add(time.Duration(10*i) * time.Second)
+		want.CellVoltages[0] += 0.001 * float32(i)
+		want.Soc -= 0.5 * float32(i)
+		if i == 2 {
+			want.ConnectedCells = 2
+			want.CellVoltages = want.CellVoltages[:2]
+			want.ErrorFlags = 7
+		}
+		if traced {
+			want.Sequence += uint32(i)
+			want.UptimeMs += int64(10000 * i)
+		}
+		if !reflect.DeepEqual(battery, want) {
+			t.Fatalf("battery %d decoded %+v, want %+v", i, battery, want)
+		}
+	}
+
+	if len(got.Locations) != 2 {
+		t.Fatalf("decoded %d locations", len(got.Locations))
+	}
+	for i, location := range got.Locations {
+		latitude := float32(45.815) + 0.0001*float32(i)
+		if location.Latitude != float64(latitude) || location.Longitude != float64(float32(15.9819)) ||
+			!location.Timestamp.Equal(time.Unix(int64(1700000000+11*i), 0)) {
+			t.Fatalf("location %d decoded %+v", i, location)
+		}
+		if traced && (location.BootID != 0xdeadbeef || location.Sequence != uint32(7+i) ||
+			location.UptimeMs != int64(86390000+11000*i)) {
+			t.Fatalf("location %d decoded %+v", i, location)
+		}
+	}
+
+	if _, err := decodeBatchSeries(payload[:len(payload)/2]); err == nil {
+		t.Fatal("truncated batch was accepted")
+	}
+}
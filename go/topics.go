@@ -0,0 +1,28 @@
+package main
+
+import "strings"
+
+// sharedTopic subscribes through the $share/<group>/ prefix, so the broker
+// spreads the messages over all aggregator instances in the group instead
+// of delivering every message to each of them. An empty group subscribes
+// directly.
+//
+// Brokers balance shared subscriptions per message, not per device. Each
+// instance keeps the order of what it receives from a device (see
+// ingester.submit), and readings are stored with the device timestamp, so
+// a device split across instances does not lose ordering in the database.
+func sharedTopic(group string, topic string) string {
+	if group == "" {
+		return topic
+	}
+	return "$share/" + group + "/" + topic
+}
+
+// deviceIDFromTopic returns the <device-id> level of /bicycle/<device-id>/...
+func deviceIDFromTopic(topic string) string {
+	levels := strings.SplitN(topic, "/", 4)
+	if len(levels) < 4 || levels[0] != "" || levels[1] != "bicycle" {
+		return ""
+	}
+	return levels[2]
+}
@@ -0,0 +1,26 @@
+package main
+
+import "testing"
+
+func TestDeviceIDFromTopic(t *testing.T) {
+	for topic, want := range map[string]string{
+		"/bicycle/a4cf12f3c0de/battery-status":      "a4cf12f3c0de",
+		"/bicycle/a4cf12f3c0de/gps-coordinates/bin": "a4cf12f3c0de",
+		"/bicycle/bike-17/batch/series":             "bike-17",
+		"/bicycle/battery-status":                   "",
+		"bicycle/a4cf12f3c0de/battery-status":       "",
+	} {
+		if got := deviceIDFromTopic(topic); got != want {
+			t.Errorf("deviceIDFromTopic(%q) = %q, want %q", topic, got, want)
+		}
+	}
+}
+
+func TestSharedTopic(t *testing.T) {
+	if got := sharedTopic("aggregator", batteryTopic); got != "$share/aggregator//bicycle/+/battery-status" {
+		t.Errorf("shared topic %q", got)
+	}
+	if got := sharedTopic("", batteryTopic); got != batteryTopic {
+		t.Errorf("unshared topic %q", got)
+	}
+}
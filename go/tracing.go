@@ -0,0 +1,372 @@
+package main
+
+import (
+	"fmt"
+	"io"
+	"log"
+	"net/http"
+	"sort"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+// Tracing of the samples stamped by the tracker (binary and series version
+// 2, boot_id/sequence/uptime_ms in JSON).
+//
+// Every boot of a tracker picks a random boot ID and numbers its battery and
+// location messages separately from 0, once they are sent; samples the
+// publish scheduler suppresses take no number. Per device, boot and stream
+// the aggregator keeps the highest number seen and which of the traceWindow
+// numbers below it arrived:
+//   - a number already seen is a duplicate (a QoS 1 redelivery, a log
+//     record sent again after a lost ack) and is not stored again. A
+//     sample that could not be queued or written is forgotten again, so
+//     its resend is stored (and counted a second time)
+//   - a number below the highest one seen for the first time came out of
+//     order
+//   - a number that leaves the window without being seen is counted lost
+//   - a number behind the window can not be told from a duplicate, it is
+//     stored and counted late
+//
+// The lag is split where the aggregator can measure it:
+//   - device to aggregator: receive time minus the uptime the sample was
+//     taken at, less the smallest such difference seen in the boot. The
+//     tracker clock never has to agree with ours, this is the time spent
+//     waiting on the tracker, in the link and in the broker on top of the
+//     fastest delivery of the boot. MQTT 3.1.1 has no broker timestamp, so
+//     the broker is part of this leg.
+//   - aggregator to database: commit time minus receive time.
+//
+// Both are histograms on the Prometheus text endpoint at METRICS_ADDR.
+//
+// The state is in memory and per instance. A shared subscription that
+// balances per message spreads a device over the instances of the group,
+// each of them then counts the share it did not get as lost; the counts are
+// exact with a single instance or a broker strategy that keeps a publisher
+// on one subscriber (sticky, hash of the client ID).
+
+type traceStream int
+
+const (
+	traceBattery traceStream = iota
+	traceLocation
+	traceStreams
+)
+
+var traceStreamNames = [traceStreams]string{"battery", "location"}
+
+const (
+	traceWindow         = 1024 // Sequence numbers tracked below the highest one
+	traceBootsPerDevice = 4    // Older boots a device still drains its log from
+)
+
+// Upper bounds in seconds, from a slow publish to a day spent offline
+var traceLagBuckets = [...]float64{0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 300, 900, 3600, 21600, 86400}
+
+type sequenceResult int
+
+const (
+	sequenceInOrder sequenceResult = iota
+	sequenceReordered
+	sequenceDuplicate
+	sequenceLate
+)
+
+// sequenceWindow marks the sequence numbers seen among the traceWindow
+// numbers up to the highest one.
+type sequenceWindow struct {
+	started bool
+	first   uint32 // Lowest number seen, the ones before it are not missed
+	highest uint32
+	seen    [traceWindow / 64]uint64
+}
+
+func (w *sequenceWindow) slot(sequence uint32) (*uint64, uint64) {
+	index := sequence % traceWindow
+	return &w.seen[index/64], 1 << (index % 64)
+}
+
+func (w *sequenceWindow) marked(sequence uint32) bool {
+	word, bit := w.slot(sequence)
+	return *word&bit != 0
+}
+
+func (w *sequenceWindow) mark(sequence uint32) {
+	word, bit := w.slot(sequence)
+	*word |= bit
+}
+
+// unmark forgets a number, unless it already left the window.
+func (w *sequenceWindow) unmark(sequence uint32) {
+	if w.started && sequence <= w.highest && w.highest-sequence < traceWindow {
+		word, bit := w.slot(sequence)
+		*word &^= bit
+	}
+}
+
+// observe marks a number, returns how it arrived and how many numbers left
+// the window without being seen.
+func (w *sequenceWindow) observe(sequence uint32) (sequenceResult, int) {
+	switch {
+	case !w.started:
+		w.started, w.first, w.highest = true, sequence, sequence
+	case sequence > w.highest:
+		lost := w.advance(sequence)
+		w.mark(sequence)
+		return sequenceInOrder, lost
+	case w.highest-sequence >= traceWindow:
+		return sequenceLate, 0
+	case w.marked(sequence):
+		return sequenceDuplicate, 0
+	default:
+		w.first = min(w.first, sequence)
+		w.mark(sequence)
+		return sequenceReordered, 0
+	}
+	w.mark(sequence)
+	return sequenceInOrder, 0
+}
+
+// advance moves the window up to sequence and counts the numbers it drops unseen.
+func (w *sequenceWindow) advance(sequence uint32) int {
+	lost := 0
+	if sequence-w.highest >= traceWindow {
+		// Everything in the window leaves, and the numbers between never entered it
+		lost = w.missing() + int(sequence-traceWindow-w.highest)
+		w.seen = [traceWindow / 64]uint64{}
+	} else {
+		for step := uint32(1); step <= sequence-w.highest; step++ {
+			next := w.highest + step
+			// next takes over the slot of next - traceWindow
+			if next >= traceWindow && next-traceWindow >= w.first && !w.marked(next) {
+				lost++
+			}
+			word, bit := w.slot(next)
+			*word &^= bit
+		}
+	}
+	w.highest = sequence
+	return lost
+}
+
+// missing counts the numbers in the window not seen yet.
+func (w *sequenceWindow) missing() int {
+	if !w.started {
+		return 0
+	}
+	bottom := w.first
+	if w.highest-bottom >= traceWindow {
+		bottom = w.highest - traceWindow + 1
+	}
+	count := 0
+	for sequence := bottom; sequence != w.highest+1; sequence++ {
+		if !w.marked(sequence) {
+			count++
+		}
+	}
+	return count
+}
+
+type bootTrace struct {
+	id        uint32
+	lastUsed  time.Time
+	offsetMs  int64 // Smallest receive time minus uptime, the fastest delivery
+	hasOffset bool
+	windows   [traceStreams]sequenceWindow
+}
+
+type lagHistogram struct {
+	counts [len(traceLagBuckets) + 1]atomic.Int64 // Per bucket, the last one past the largest bound
+	sumNs  atomic.Int64
+}
+
+func (h *lagHistogram) observe(lag time.Duration) {
+	lag = max(lag, 0)
+	h.counts[sort.SearchFloat64s(traceLagBuckets[:], lag.Seconds())].Add(1)
+	h.sumNs.Add(int64(lag))
+}
+
+type tracer struct {
+	mu      sync.Mutex
+	devices map[string][]*bootTrace // At most traceBootsPerDevice each
+
+	samples    [traceStreams]atomic.Int64
+	duplicates [traceStreams]atomic.Int64
+	reordered  [traceStreams]atomic.Int64
+	late       [traceStreams]atomic.Int64
+	lost       [traceStreams]atomic.Int64
+	untraced   [traceStreams]atomic.Int64 // From firmware without a boot ID
+	boots      atomic.Int64
+
+	deviceLag [traceStreams]lagHistogram
+	storeLag  [traceStreams]lagHistogram
+}
+
+func newTracer() *tracer {
+	return &tracer{devices: make(map[string][]*bootTrace)}
+}
+
+// boot finds the trace of a boot of a device, or starts one in place of the
+// least recently used when the device has traceBootsPerDevice already.
+func (t *tracer) boot(deviceID string, bootID uint32, now time.Time) *bootTrace {
+	boots := t.devices[deviceID]
+	for _, boot := range boots {
+		if boot.id == bootID {
+			boot.lastUsed = now
+			return boot
+		}
+	}
+
+	boot := &bootTrace{id: bootID, lastUsed: now}
+	if len(boots) < traceBootsPerDevice {
+		boots = append(boots, boot)
+	} else {
+		oldest := 0
+		for i := range boots {
+			if boots[i].lastUsed.Before(boots[oldest].lastUsed) {
+				oldest = i
+			}
+		}
+		// Whatever it still missed is not coming anymore
+		for stream := range boots[oldest].windows {
+			t.lost[stream].Add(int64(boots[oldest].windows[stream].missing()))
+		}
+		boots[oldest] = boot
+	}
+	t.devices[deviceID] = boots
+	t.boots.Add(1)
+	return boot
+}
+
+// observe traces a sample received at receivedAt. It returns false for a
+// duplicate, which must not be stored again.
+func (t *tracer) observe(deviceID string, stream traceStream, bootID uint32, sequence uint32, uptimeMs int64,
+	receivedAt time.Time) bool {
+	if bootID == 0 {
+		t.untraced[stream].Add(1)
+		return true
+	}
+
+	t.mu.Lock()
+	boot := t.boot(deviceID, bootID, receivedAt)
+	result, lost := boot.windows[stream].observe(sequence)
+	offsetMs := receivedAt.UnixMilli() - uptimeMs
+	if result != sequenceDuplicate && (!boot.hasOffset || offsetMs < boot.offsetMs) {
+		boot.offsetMs, boot.hasOffset = offsetMs, true
+	}
+	lagMs := offsetMs - boot.offsetMs
+	t.mu.Unlock()
+
+	t.lost[stream].Add(int64(lost))
+	switch result {
+	case sequenceDuplicate:
+		t.duplicates[stream].Add(1)
+		return false
+	case sequenceReordered:
+		t.reordered[stream].Add(1)
+	case sequenceLate:
+		t.late[stream].Add(1)
+	}
+	t.samples[stream].Add(1)
+	t.deviceLag[stream].observe(time.Duration(lagMs) * time.Millisecond)
+	return true
+}
+
+// forget unmarks samples that could not be stored, so their resend is not
+// dropped as a duplicate.
+func (t *tracer) forget(batteries []BatteryData, locations []LocationData) {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+	for i := range batteries {
+		t.unmark(batteries[i].DeviceID, traceBattery, batteries[i].BootID, batteries[i].Sequence)
+	}
+	for i := range locations {
+		t.unmark(locations[i].DeviceID, traceLocation, locations[i].BootID, locations[i].Sequence)
+	}
+}
+
+func (t *tracer) unmark(deviceID string, stream traceStream, bootID uint32, sequence uint32) {
+	for _, boot := range t.devices[deviceID] {
+		if boot.id == bootID {
+			boot.windows[stream].unmark(sequence)
+			return
+		}
+	}
+}
+
+// stored records the lag of samples committed to the database at committedAt.
+func (t *tracer) stored(batteries []BatteryData, locations []LocationData, committedAt time.Time) {
+	for i := range batteries {
+		if !batteries[i].ReceivedAt.IsZero() {
+			t.storeLag[traceBattery].observe(committedAt.Sub(batteries[i].ReceivedAt))
+		}
+	}
+	for i := range locations {
+		if !locations[i].ReceivedAt.IsZero() {
+			t.storeLag[traceLocation].observe(committedAt.Sub(locations[i].ReceivedAt))
+		}
+	}
+}
+
+func (t *tracer) ServeHTTP(w http.ResponseWriter, r *http.Request) {
+	w.Header().Set("Content-Type", "text/plain; version=0.0.4; charset=utf-8")
+	t.writeMetrics(w)
+}
+
+// writeMetrics writes the counters and histograms in the Prometheus text format.
+func (t *tracer) writeMetrics(w io.Writer) {
+	counter := func(name string, help string, values *[traceStreams]atomic.Int64) {
+		fmt.Fprintf(w, "# HELP %s %s\n# TYPE %s counter\n", name, help, name)
+		for stream := range values {
+			fmt.Fprintf(w, "%s{stream=%q} %d\n", name, traceStreamNames[stream], values[stream].Load())
+		}
+	}
+	histogram := func(name string, help string, histograms *[traceStreams]lagHistogram) {
+		fmt.Fprintf(w, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name)
+		for stream := range histograms {
+			h := &histograms[stream]
+			label := traceStreamNames[stream]
+			var count int64
+			for i := range h.counts {
+				count += h.counts[i].Load()
+				bound := "+Inf"
+				if i < len(traceLagBuckets) {
+					bound = fmt.Sprint(traceLagBuckets[i])
+				}
+				fmt.Fprintf(w, "%s_bucket{stream=%q,le=%q} %d\n", name, label, bound, count)
+			}
+			fmt.Fprintf(w, "%s_sum{stream=%q} %g\n", name, label, time.Duration(h.sumNs.Load()).Seconds())
+			fmt.Fprintf(w, "%s_count{stream=%q} %d\n", name, label, count)
+		}
+	}
+
+	counter("telemetry_samples_total", "Traced samples accepted for storage.", &t.samples)
+	counter("telemetry_duplicates_total", "Samples dropped because their sequence number was already seen.", &t.duplicates)
+	counter("telemetry_reordered_total", "Samples that arrived after a higher sequence number.", &t.reordered)
+	counter("telemetry_late_total", "Samples behind the dedupe window, stored unchecked.", &t.late)
+	counter("telemetry_lost_total", "Sequence numbers that left the dedupe window unseen.", &t.lost)
+	counter("telemetry_untraced_total", "Samples without a boot ID, from older firmware.", &t.untraced)
+
+	t.mu.Lock()
+	devices := len(t.devices)
+	t.mu.Unlock()
+	fmt.Fprintf(w, "# HELP telemetry_traced_devices Devices with traced samples.\n# TYPE telemetry_traced_devices gauge\n")
+	fmt.Fprintf(w, "telemetry_traced_devices %d\n", devices)
+	fmt.Fprintf(w, "# HELP telemetry_boots_total Tracker boots seen.\n# TYPE telemetry_boots_total counter\n")
+	fmt.Fprintf(w, "telemetry_boots_total %d\n", t.boots.Load())
+
+	histogram("telemetry_device_to_aggregator_seconds",
+		"Delay from sampling to the aggregator, above the fastest delivery of the boot.", &t.deviceLag)
+	histogram("telemetry_aggregator_to_db_seconds", "Delay from the aggregator to the database commit.", &t.storeLag)
+}
+
+// serveMetrics exposes the tracer at http://addr/metrics until the process exits.
+func serveMetrics(addr string, t *tracer) {
+	mux := http.NewServeMux()
+	mux.Handle("/metrics", t)
+	log.Println("Serving metrics on", addr)
+	if err := http.ListenAndServe(addr, mux); err != nil {
+		log.Println("Metrics endpoint stopped:", err)
+	}
+}
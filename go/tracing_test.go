@@ -0,0 +1,161 @@
+package main
+
+import (
+	"net/http/httptest"
+	"strings"
+	"testing"
+	"time"
+)
+
+func TestSequenceWindow(t *testing.T) {
+	var w sequenceWindow
+	expect := func(sequence uint32, wantResult sequenceResult, wantLost int) {
+		t.Helper()
+		if result, lost := w.observe(sequence); result != wantResult || lost != wantLost {
+			t.Fatalf("sequence %d: result %d, %d lost, want %d, %d lost", sequence, result, lost, wantResult, wantLost)
+		}
+	}
+
+	// Numbers before the first one seen are not missed
+	expect(100, sequenceInOrder, 0)
+	expect(101, sequenceInOrder, 0)
+	expect(101, sequenceDuplicate, 0)
+	expect(104, sequenceInOrder, 0)
+	expect(102, sequenceReordered, 0)
+	expect(102, sequenceDuplicate, 0)
+	if missing := w.missing(); missing != 1 {
+		t.Fatalf("%d missing, want 103", missing)
+	}
+
+	// 103 is counted once it leaves the window
+	expect(100+traceWindow+2, sequenceInOrder, 0)
+	expect(100+traceWindow+3, sequenceInOrder, 1)
+	expect(103, sequenceLate, 0)
+
+	// A jump past the window drops it whole, with the numbers in between
+	highest := uint32(100 + traceWindow + 3)
+	missing := w.missing()
+	expect(highest+3*traceWindow, sequenceInOrder, missing+2*traceWindow)
+	if missing := w.missing(); missing != traceWindow-1 {
+		t.Fatalf("%d missing after the jump", missing)
+	}
+}
+
+func TestTracerDeduplicates(t *testing.T) {
+	tr := newTracer()
+	start := time.Unix(1700000000, 0)
+
+	for sequence := uint32(0); sequence < 5; sequence++ {
+		if !tr.observe("bike-1", traceBattery, 7, sequence, int64(sequence)*10000, start.Add(time.Duration(sequence)*10*time.Second)) {
+			t.Fatalf("sample %d dropped", sequence)
+		}
+	}
+	// A redelivery is dropped, the same number of another stream, device or boot is not
+	if tr.observe("bike-1", traceBattery, 7, 3, 30000, start.Add(time.Minute)) {
+		t.Fatal("duplicate accepted")
+	}
+	if !tr.observe("bike-1", traceLocation, 7, 3, 30000, start.Add(time.Minute)) ||
+		!tr.observe("bike-2", traceBattery, 7, 3, 30000, start.Add(time.Minute)) ||
+		!tr.observe("bike-1", traceBattery, 8, 3, 30000, start.Add(time.Minute)) {
+		t.Fatal("sample of another stream, device or boot dropped")
+	}
+	// Firmware without a boot ID is never deduplicated
+	if !tr.observe("bike-1", traceBattery, 0, 0, 0, start) || !tr.observe("bike-1", traceBattery, 0, 0, 0, start) {
+		t.Fatal("untraced sample dropped")
+	}
+
+	if samples, duplicates, untraced := tr.samples[traceBattery].Load(), tr.duplicates[traceBattery].Load(), tr.untraced[traceBattery].Load(); samples != 7 || duplicates != 1 || untraced != 2 {
+		t.Fatalf("%d samples, %d duplicates, %d untraced", samples, duplicates, untraced)
+	}
+	if boots := tr.boots.Load(); boots != 3 {
+		t.Fatalf("%d boots", boots)
+	}
+}
+
+func TestTracerForgets(t *testing.T) {
+	tr := newTracer()
+	start := time.Unix(1700000000, 0)
+	battery := goldenBatteryData()
+	battery.DeviceID, battery.BootID, battery.Sequence = "bike-1", 7, 2
+
+	// The write failed, the tracker sends the sample again
+	tr.observe("bike-1", traceBattery, 7, 2, 20000, start)
+	tr.forget([]BatteryData{battery}, nil)
+	if !tr.observe("bike-1", traceBattery, 7, 2, 20000, start.Add(time.Minute)) {
+		t.Fatal("resend of a sample not stored dropped")
+	}
+	if tr.observe("bike-1", traceBattery, 7, 2, 20000, start.Add(2*time.Minute)) {
+		t.Fatal("duplicate of the stored resend accepted")
+	}
+
+	// A sample of an unknown boot, or one that left the window, is ignored
+	battery.BootID = 9
+	tr.forget([]BatteryData{battery}, nil)
+	battery.BootID = 7
+	tr.observe("bike-1", traceBattery, 7, 2+traceWindow, 0, start.Add(time.Hour))
+	tr.forget([]BatteryData{battery}, nil)
+	if tr.observe("bike-1", traceBattery, 7, 2+traceWindow, 0, start.Add(time.Hour)) {
+		t.Fatal("duplicate accepted after forgetting a sample behind the window")
+	}
+}
+
+func TestTracerLag(t *testing.T) {
+	tr := newTracer()
+	start := time.Unix(1700000000, 0)
+
+	// Sampled every 10 s, delivered 200 ms after sampling, then a minute
+	// offline and the backlog sent at once
+	tr.observe("bike-1", traceBattery, 7, 0, 5000, start.Add(200*time.Millisecond))
+	tr.observe("bike-1", traceBattery, 7, 1, 15000, start.Add(10*time.Second+200*time.Millisecond))
+	tr.observe("bike-1", traceBattery, 7, 2, 25000, start.Add(80*time.Second))
+	h := &tr.deviceLag[traceBattery]
+	if inTime, delayed := h.counts[0].Load(), h.counts[9].Load(); inTime != 2 || delayed != 1 {
+		t.Fatalf("%d samples in time, %d delayed by up to a minute", inTime, delayed)
+	}
+	if sum := time.Duration(h.sumNs.Load()); sum != time.Minute-200*time.Millisecond {
+		t.Fatalf("lag sum %s", sum)
+	}
+
+	// Lost samples of a boot pushed out by newer ones are counted
+	tr.observe("bike-1", traceBattery, 7, 5, 55000, start.Add(90*time.Second))
+	for boot := uint32(8); boot < 8+traceBootsPerDevice; boot++ {
+		tr.observe("bike-1", traceBattery, boot, 0, 0, start.Add(time.Duration(boot)*time.Hour))
+	}
+	if lost := tr.lost[traceBattery].Load(); lost != 2 {
+		t.Fatalf("%d lost, want 3 and 4", lost)
+	}
+
+	battery := goldenBatteryData()
+	battery.ReceivedAt = start
+	tr.stored([]BatteryData{battery, goldenBatteryData()}, nil, start.Add(300*time.Millisecond))
+	if count := tr.storeLag[traceBattery].counts[3].Load(); count != 1 {
+		t.Fatalf("%d samples stored within 500 ms", count)
+	}
+}
+
+func TestTracerMetrics(t *testing.T) {
+	tr := newTracer()
+	start := time.Unix(1700000000, 0)
+	tr.observe("bike-1", traceLocation, 7, 0, 0, start)
+	tr.observe("bike-1", traceLocation, 7, 0, 0, start)
+	tr.observe("bike-1", traceLocation, 7, 1, 1000, start.Add(3*time.Second))
+
+	recorder := httptest.NewRecorder()
+	tr.ServeHTTP(recorder, httptest.NewRequest("GET", "/metrics", nil))
+	body := recorder.Body.String()
+	for _, line := range []string{
+		`telemetry_samples_total{stream="location"} 2`,
+		`telemetry_duplicates_total{stream="location"} 1`,
+		`telemetry_traced_devices 1`,
+		`telemetry_device_to_aggregator_seconds_bucket{stream="location",le="1"} 1`,
+		`telemetry_device_to_aggregator_seconds_bucket{stream="location",le="2.5"} 2`,
+		`telemetry_device_to_aggregator_seconds_bucket{stream="location",le="+Inf"} 2`,
+		`telemetry_device_to_aggregator_seconds_sum{stream="location"} 2`,
+		`telemetry_device_to_aggregator_seconds_count{stream="location"} 2`,
+		`# TYPE telemetry_aggregator_to_db_seconds histogram`,
+	} {
+		if !strings.Contains(body, line+"\n") {
+			t.Fatalf("no %q in\n%s", line, body)
+		}
+	}
+}
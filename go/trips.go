@@ -0,0 +1,175 @@
+package main
+
+import (
+	"context"
+	"fmt"
+	"math"
+	"sort"
+	"time"
+)
+
+// Trips and newest positions (see the V11 migration), kept up to date with
+// every ingest batch.
+//
+// The locations of a batch are split per device wherever the device
+// reported nothing for longer than the trip gap. Each segment is merged
+// into the device's trip it continues or overlaps, which also covers
+// backlogs the tracker sends after an outage, or starts a new trip.
+//
+// Aggregator instances share the devices, so each device's trips are
+// merged under a transaction advisory lock on it. Device IDs can share a
+// lock key, so all locks of a batch are taken up front in key order, which
+// keeps two batches from deadlocking whatever the IDs hash to.
+
+type tripSegment struct {
+	deviceID  string
+	startedAt time.Time
+	endedAt   time.Time
+	points    int64
+	distanceM float64 // Along the segment, without the hop from a trip it continues
+	first     LocationData
+	last      LocationData
+	minLat    float64
+	maxLat    float64
+	minLon    float64
+	maxLon    float64
+}
+
+const earthRadiusM = 6371008.8
+
+// distanceM is the great-circle distance like geo_distance_m in the database.
+func distanceM(lat1, lon1, lat2, lon2 float64) float64 {
+	rad := math.Pi / 180
+	dLat := (lat2 - lat1) * rad / 2
+	dLon := (lon2 - lon1) * rad / 2
+	h := math.Sin(dLat)*math.Sin(dLat) + math.Cos(lat1*rad)*math.Cos(lat2*rad)*math.Sin(dLon)*math.Sin(dLon)
+	return 2 * earthRadiusM * math.Asin(math.Sqrt(h))
+}
+
+// segmentTrips splits the locations of each device, sorted by time, where
+// consecutive points are more than gap apart. Segments are returned sorted
+// by device ID, and by time within a device.
+func segmentTrips(locations []LocationData, gap time.Duration) []tripSegment {
+	var devices []string
+	byDevice := map[string][]LocationData{}
+	for _, l := range locations {
+		if _, ok := byDevice[l.DeviceID]; !ok {
+			devices = append(devices, l.DeviceID)
+		}
+		byDevice[l.DeviceID] = append(byDevice[l.DeviceID], l)
+	}
+	sort.Strings(devices)
+
+	var segments []tripSegment
+	for _, deviceID := range devices {
+		points := byDevice[deviceID]
+		sort.SliceStable(points, func(i, j int) bool { return points[i].Timestamp.Before(points[j].Timestamp) })
+
+		var s *tripSegment
+		for _, p := range points {
+			if s == nil || p.Timestamp.Sub(s.endedAt) > gap {
+				segments = append(segments, tripSegment{
+					deviceID: deviceID, startedAt: p.Timestamp, endedAt: p.Timestamp, first: p, last: p,
+					minLat: p.Latitude, maxLat: p.Latitude, minLon: p.Longitude, maxLon: p.Longitude,
+				})
+				s = &segments[len(segments)-1]
+			} else {
+				s.distanceM += distanceM(s.last.Latitude, s.last.Longitude, p.Latitude, p.Longitude)
+				s.endedAt, s.last = p.Timestamp, p
+				s.minLat, s.maxLat = math.Min(s.minLat, p.Latitude), math.Max(s.maxLat, p.Latitude)
+				s.minLon, s.maxLon = math.Min(s.minLon, p.Longitude), math.Max(s.maxLon, p.Longitude)
+			}
+			s.points++
+		}
+	}
+	return segments
+}
+
+// Merges a segment ($2-$3) into the newest trip of the device within the gap
+// ($4) of it. The hop from the trip's end counts when the segment follows it.
+const mergeTripSQL = `
+	WITH prev AS (
+		SELECT trip_id FROM trips
+		WHERE device_id = $1 AND ended_at >= $2::timestamp - $4::interval AND started_at <= $3::timestamp + $4::interval
+		ORDER BY ended_at DESC
+		LIMIT 1
+		FOR UPDATE
+	), merged AS (
+		UPDATE trips t SET
+			started_at = least(t.started_at, $2),
+			ended_at = greatest(t.ended_at, $3),
+			points = t.points + $5,
+			distance_m = t.distance_m + $6 +
+				CASE WHEN $2 >= t.ended_at THEN geo_distance_m(t.end_latitude, t.end_longitude, $7, $8) ELSE 0 END,
+			end_latitude = CASE WHEN $3 >= t.ended_at THEN $9 ELSE t.end_latitude END,
+			end_longitude = CASE WHEN $3 >= t.ended_at THEN $10 ELSE t.end_longitude END,
+			min_latitude = least(t.min_latitude, $11),
+			max_latitude = greatest(t.max_latitude, $12),
+			min_longitude = least(t.min_longitude, $13),
+			max_longitude = greatest(t.max_longitude, $14)
+		FROM prev
+		WHERE t.trip_id = prev.trip_id
+		RETURNING t.trip_id
+	)
+	INSERT INTO trips (
+		device_id, started_at, ended_at, points, distance_m, end_latitude, end_longitude,
+		min_latitude, max_latitude, min_longitude, max_longitude
+	)
+	SELECT $1, $2, $3, $5, $6, $9, $10, $11, $12, $13, $14
+	WHERE NOT EXISTS (SELECT 1 FROM merged)
+`
+
+// Locks the trips of the devices ($1) until the ingest transaction ends, in
+// key order. The first key keeps them apart from other advisory locks.
+const lockDeviceTripsSQL = `
+	SELECT pg_advisory_xact_lock(hashtext('trips'), key)
+	FROM (SELECT DISTINCT hashtext(device_id) AS key FROM unnest($1::text[]) AS device_id ORDER BY key) AS keys
+`
+
+// Newest position per device, older ones than stored are ignored.
+const upsertPositionsSQL = `
+	INSERT INTO device_positions AS p (device_id, latitude, longitude, timestamp)
+	SELECT * FROM unnest($1::text[], $2::double precision[], $3::double precision[], $4::timestamp[])
+	ON CONFLICT (device_id) DO UPDATE
+	SET latitude = EXCLUDED.latitude, longitude = EXCLUDED.longitude, timestamp = EXCLUDED.timestamp
+	WHERE EXCLUDED.timestamp > p.timestamp
+`
+
+// upsertTrips merges the locations of a batch into the trips and the newest positions.
+func upsertTrips(ctx context.Context, tx ingestTx, locations []LocationData, gap time.Duration) error {
+	segments := segmentTrips(locations, gap)
+	deviceIDs := make([]string, 0, len(segments))
+	latitudes := make([]float64, 0, len(segments))
+	longitudes := make([]float64, 0, len(segments))
+	timestamps := make([]time.Time, 0, len(segments))
+	var locked []string
+	for i, s := range segments {
+		if i == 0 || segments[i-1].deviceID != s.deviceID {
+			locked = append(locked, s.deviceID)
+		}
+	}
+	if _, err := tx.Exec(ctx, lockDeviceTripsSQL, locked); err != nil {
+		return fmt.Errorf("trips lock: %w", err)
+	}
+
+	for i, s := range segments {
+		_, err := tx.Exec(ctx, mergeTripSQL, s.deviceID, s.startedAt, s.endedAt, gap, s.points, s.distanceM,
+			s.first.Latitude, s.first.Longitude, s.last.Latitude, s.last.Longitude,
+			s.minLat, s.maxLat, s.minLon, s.maxLon)
+		if err != nil {
+			return fmt.Errorf("trips: %w", err)
+		}
+		// Segments of a device are in time order, its last one holds the newest position
+		if i+1 == len(segments) || segments[i+1].deviceID != s.deviceID {
+			deviceIDs = append(deviceIDs, s.deviceID)
+			latitudes = append(latitudes, s.last.Latitude)
+			longitudes = append(longitudes, s.last.Longitude)
+			timestamps = append(timestamps, s.endedAt)
+		}
+	}
+
+	if _, err := tx.Exec(ctx, upsertPositionsSQL, deviceIDs, latitudes, longitudes, timestamps); err != nil {
+		return fmt.Errorf("device positions: %w", err)
+	}
+	return nil
+}
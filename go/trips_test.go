@@ -0,0 +1,121 @@
+package main
+
+import (
+	"context"
+	"fmt"
+	"math"
+	"testing"
+	"time"
+)
+
+func TestDistance(t *testing.T) {
+	// Zagreb to Ljubljana, about 117 km
+	if d := distanceM(45.815, 15.9819, 46.0569, 14.5058); math.Abs(d-117000) > 2000 {
+		t.Fatalf("%.0f m", d)
+	}
+	// 0.001 degrees of latitude
+	if d := distanceM(45, 16, 45.001, 16); math.Abs(d-111.2) > 0.5 {
+		t.Fatalf("%.1f m", d)
+	}
+}
+
+func TestSegmentTrips(t *testing.T) {
+	start := time.Unix(1700000000, 0).UTC()
+	at := func(device string, offset time.Duration, lat float64) LocationData {
+		return LocationData{Latitude: lat, Longitude: 16, Timestamp: start.Add(offset), DeviceID: device}
+	}
+	// bike-1 rides, pauses 15 minutes and rides on, a backlog point arrives late
+	locations := []LocationData{
+		at("bike-2", 0, 46),
+		at("bike-1", 0, 45.000),
+		at("bike-1", time.Minute, 45.001),
+		at("bike-1", 17*time.Minute, 45.010),
+		at("bike-1", 2*time.Minute, 45.002),
+		at("bike-1", 18*time.Minute, 45.011),
+	}
+
+	segments := segmentTrips(locations, 10*time.Minute)
+	if len(segments) != 3 {
+		t.Fatalf("%d segments", len(segments))
+	}
+	first := segments[0]
+	if first.deviceID != "bike-1" || first.points != 3 || !first.endedAt.Equal(start.Add(2*time.Minute)) ||
+		first.last.Latitude != 45.002 || first.minLat != 45 || first.maxLat != 45.002 {
+		t.Fatalf("first segment %+v", first)
+	}
+	if math.Abs(first.distanceM-222.4) > 1 {
+		t.Fatalf("first segment %.1f m", first.distanceM)
+	}
+	if second := segments[1]; second.deviceID != "bike-1" || second.points != 2 || !second.startedAt.Equal(start.Add(17*time.Minute)) {
+		t.Fatalf("second segment %+v", second)
+	}
+	if third := segments[2]; third.deviceID != "bike-2" || third.points != 1 || third.distanceM != 0 {
+		t.Fatalf("third segment %+v", third)
+	}
+}
+
+func TestUpsertTrips(t *testing.T) {
+	tx := &fakeIngestTx{execs: map[string][][]any{}}
+	locations := []LocationData{goldenLocationData(), goldenLocationData(), goldenLocationData()}
+	locations[1].Timestamp = locations[1].Timestamp.Add(time.Hour)
+	locations[1].Latitude = 45.9
+	locations[2].DeviceID = "bike-2"
+	if err := upsertTrips(context.Background(), tx, locations, 10*time.Minute); err != nil {
+		t.Fatal(err)
+	}
+
+	if merges := tx.execs[mergeTripSQL]; len(merges) != 3 {
+		t.Fatalf("%d trip merges", len(merges))
+	}
+	// The devices are locked once, before any merge, the database orders the keys
+	locks := tx.execs[lockDeviceTripsSQL]
+	if len(locks) != 1 || len(locks[0][0].([]string)) != 2 {
+		t.Fatalf("trip locks %v", locks)
+	}
+	positions := tx.execs[upsertPositionsSQL]
+	if len(positions) != 1 {
+		t.Fatalf("%d position upserts", len(positions))
+	}
+	// The newest position of each device
+	ids, latitudes := positions[0][0].([]string), positions[0][1].([]float64)
+	if len(ids) != 2 || ids[0] != "" || latitudes[0] != 45.9 || ids[1] != "bike-2" {
+		t.Fatalf("positions %v %v", ids, latitudes)
+	}
+}
+
+// The fake transaction accepts any SQL, this runs the statements on Postgres
+func TestUpsertTripsOnDatabase(t *testing.T) {
+	pool := databasePool(t)
+	defer pool.Close()
+	ctx := context.Background()
+	tx, err := pool.Begin(ctx)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer tx.Rollback(ctx)
+
+	// Two batches two minutes apart make one trip
+	device := fmt.Sprintf("trips-test-%d", time.Now().UnixNano())
+	first := goldenLocationData()
+	first.DeviceID = device
+	second := first
+	second.Timestamp = second.Timestamp.Add(2 * time.Minute)
+	second.Latitude = 45.82
+	for _, batch := range [][]LocationData{{first}, {second}} {
+		if err := upsertTrips(ctx, tx, batch, 10*time.Minute); err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	var trips, points int64
+	var distance, latitude float64
+	err = tx.QueryRow(ctx, `SELECT count(*), sum(points)::bigint, sum(distance_m) FROM trips WHERE device_id = $1`,
+		device).Scan(&trips, &points, &distance)
+	if err != nil || trips != 1 || points != 2 || math.Abs(distance-556) > 5 {
+		t.Fatalf("%d trips, %d points, %.0f m: %v", trips, points, distance, err)
+	}
+	err = tx.QueryRow(ctx, `SELECT latitude FROM device_positions WHERE device_id = $1`, device).Scan(&latitude)
+	if err != nil || latitude != 45.82 {
+		t.Fatalf("position at %f: %v", latitude, err)
+	}
+}
@@ -0,0 +1,46 @@
+-- Code generated by go/schemagen from schema/telemetry.schema. DO NOT EDIT.
+--
+-- Columns of the reading tables as the aggregator copies them. Flyway
+-- migrations are never edited, a migration that changes these tables
+-- brings them to this definition. Partitions, indexes and the columns
+-- computed by the database are left to the migrations.
+
+CREATE TABLE batteries (
+   battery_id BIGINT NOT NULL,
+   state INTEGER NOT NULL,
+   chg_enable BOOLEAN NOT NULL,
+   dis_enable BOOLEAN NOT NULL,
+   connected_cells INTEGER NOT NULL,
+   cell_voltages REAL[] NOT NULL DEFAULT '{}',
+   cell_voltage_max FLOAT NOT NULL,
+   cell_voltage_min FLOAT NOT NULL,
+   cell_voltage_avg FLOAT NOT NULL,
+   pack_voltage FLOAT NOT NULL,
+   stack_voltage FLOAT NOT NULL,
+   pack_current FLOAT NOT NULL,
+   bat_temps REAL[] NOT NULL DEFAULT '{}',
+   bat_temp_max FLOAT NOT NULL,
+   bat_temp_min FLOAT NOT NULL,
+   bat_temp_avg FLOAT NOT NULL,
+   mosfet_temp FLOAT NOT NULL,
+   ic_temp FLOAT NOT NULL,
+   mcu_temp FLOAT NOT NULL,
+   is_full BOOLEAN NOT NULL,
+   is_empty BOOLEAN NOT NULL,
+   soc FLOAT NOT NULL,
+   balancing_status BIGINT NOT NULL,
+   no_idle_timestamp TIMESTAMP NOT NULL,
+   error_flags BIGINT NOT NULL,
+   timestamp TIMESTAMP NOT NULL,
+   device_id TEXT,
+   PRIMARY KEY (battery_id, timestamp)
+) PARTITION BY RANGE (timestamp);
+
+CREATE TABLE locations (
+   location_id BIGINT NOT NULL,
+   latitude DOUBLE PRECISION NOT NULL,
+   longitude DOUBLE PRECISION NOT NULL,
+   timestamp TIMESTAMP NOT NULL,
+   device_id TEXT,
+   PRIMARY KEY (location_id, timestamp)
+) PARTITION BY RANGE (timestamp);